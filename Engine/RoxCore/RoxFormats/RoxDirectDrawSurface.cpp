@@ -3,11 +3,24 @@
 #include "RoxDirectDrawSurface.h"
 #include "RoxMemory/RoxMemoryReader.h"
 #include "RoxMemory/RoxTmpBuffers.h"
+#include "RoxMemory/RoxThreadPool.h"
 #include "RoxResources/RoxResources.h"
 
 #include <cstdint>
 #include <cstring>
 #include <algorithm>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define ROX_DDS_X86
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define ROX_DDS_TARGET(x)
+    #else
+        #define ROX_DDS_TARGET(x) __attribute__((target(x)))
+    #endif
+#endif
 
 namespace RoxFormats
 {
@@ -23,15 +36,28 @@ namespace RoxFormats
         uint bit_mask[4]; // rgba
     };
 
+    static int blockBytes(DirectDrawSurface::PIXEL_FORMAT format)
+    {
+        return (format == DirectDrawSurface::DXT1 || format == DirectDrawSurface::BC4) ? 8 : 16;
+    }
+
     static void flipRaw(int width, int height, int channels, const void* from_data, void* to_data)
     {
         if (!height)
             return;
 
         const std::size_t line_size = width * channels;
+        unsigned char* to = static_cast<unsigned char*>(to_data);
+        if (from_data == to_data)
+        {
+            for (int i = 0, j = height - 1; i < j; ++i, --j)
+                std::swap_ranges(to + i * line_size, to + (i + 1) * line_size, to + j * line_size);
+            return;
+        }
+
         const std::size_t total_size = line_size * height;
         const unsigned char* from = static_cast<const unsigned char*>(from_data);
-        unsigned char* to = static_cast<unsigned char*>(to_data) + line_size * (height - 1);
+        to += line_size * (height - 1);
 
         for (std::size_t offset = 0; offset < total_size; offset += line_size)
             std::memcpy(to - offset, from + offset, line_size);
@@ -53,7 +79,8 @@ namespace RoxFormats
         flipDxt1BlockFull(data + 8);
     }
 
-    static void flipDxt5BlockFull(unsigned char* data)
+    // dxt5 alpha and bc4/bc5 channel block
+    static void flipChannelBlockFull(unsigned char* data)
     {
         unsigned int line_0_1 = data[2] + 256 * (data[3] + 256 * data[4]);
         unsigned int line_2_3 = data[5] + 256 * (data[6] + 256 * data[7]);
@@ -72,66 +99,81 @@ namespace RoxFormats
         data[5] = line_1_0 & 0xFF;
         data[6] = (line_1_0 & 0xFF00) >> 8;
         data[7] = (line_1_0 & 0xFF0000) >> 16;
+    }
 
+    static void flipDxt5BlockFull(unsigned char* data)
+    {
+        flipChannelBlockFull(data);
         flipDxt1BlockFull(data + 8);
     }
 
-    static void flipDxt(int width, int height, DirectDrawSurface::PIXEL_FORMAT format, const void* from_data, void* to_data)
+    static void flipDxtRow(unsigned char* row, unsigned int line_size, int height, DirectDrawSurface::PIXEL_FORMAT format)
     {
-        if (from_data == to_data) // ToDo: Handle in-place flipping if necessary
-            return;
+        switch (format)
+        {
+        case DirectDrawSurface::DXT1:
+            if (height == 2)
+            {
+                for (unsigned int k = 0; k < line_size; k += 8)
+                    std::swap(row[k + 4], row[k + 5]);
+            }
+            else
+            {
+                for (unsigned int k = 0; k < line_size; k += 8)
+                    flipDxt1BlockFull(row + k);
+            }
+            break;
+
+        case DirectDrawSurface::DXT2:
+        case DirectDrawSurface::DXT3:
+            for (unsigned int k = 0; k < line_size; k += 16)
+                flipDxt3BlockFull(row + k);
+            break;
+
+        case DirectDrawSurface::DXT4:
+        case DirectDrawSurface::DXT5:
+            for (unsigned int k = 0; k < line_size; k += 16)
+                flipDxt5BlockFull(row + k);
+            break;
+
+        case DirectDrawSurface::BC4:
+        case DirectDrawSurface::BC5: // two bc4 blocks
+            for (unsigned int k = 0; k < line_size; k += 8)
+                flipChannelBlockFull(row + k);
+            break;
+
+        default:
+            break;
+        }
+    }
 
+    // from_data may be equal to to_data
+    static void flipDxt(int width, int height, DirectDrawSurface::PIXEL_FORMAT format, const void* from_data, void* to_data)
+    {
         if (!height)
             return;
 
-        const unsigned int line_size = ((width + 3) / 4) * (format == DirectDrawSurface::DXT1 ? 8 : 16);
-        const unsigned char* src = static_cast<const unsigned char*>(from_data);
-        unsigned char* dest = static_cast<unsigned char*>(to_data) + ((height + 3) / 4 - 1) * line_size;
+        const unsigned int line_size = ((width + 3) / 4) * blockBytes(format);
+        const int rows = (height + 3) / 4;
+        unsigned char* dest = static_cast<unsigned char*>(to_data);
 
-        if (height == 1)
+        if (from_data == to_data)
         {
-            std::memcpy(dest, src, line_size);
-            return;
+            for (int i = 0, j = rows - 1; i < j; ++i, --j)
+                std::swap_ranges(dest + i * line_size, dest + (i + 1) * line_size, dest + j * line_size);
         }
-
-        for (int i = 0; i < (height + 3) / 4; ++i)
+        else
         {
-            std::memcpy(dest, src, line_size);
-
-            switch (format)
-            {
-            case DirectDrawSurface::DXT1:
-                if (height == 2)
-                {
-                    for (unsigned int k = 0; k < line_size; k += 8)
-                        std::swap(dest[k + 4], dest[k + 5]);
-                }
-                else
-                {
-                    for (unsigned int k = 0; k < line_size; k += 8)
-                        flipDxt1BlockFull(dest + k);
-                }
-                break;
-
-            case DirectDrawSurface::DXT2:
-            case DirectDrawSurface::DXT3:
-                for (unsigned int k = 0; k < line_size; k += 16)
-                    flipDxt3BlockFull(dest + k);
-                break;
-
-            case DirectDrawSurface::DXT4:
-            case DirectDrawSurface::DXT5:
-                for (unsigned int k = 0; k < line_size; k += 16)
-                    flipDxt5BlockFull(dest + k);
-                break;
+            const unsigned char* src = static_cast<const unsigned char*>(from_data);
+            for (int i = 0; i < rows; ++i)
+                std::memcpy(dest + (rows - 1 - i) * line_size, src + i * line_size, line_size);
+        }
 
-            default:
-                return;
-            }
+        if (height == 1)
+            return;
 
-            src += line_size;
-            dest -= line_size;
-        }
+        for (int i = 0; i < rows; ++i)
+            flipDxtRow(dest + i * line_size, line_size, height, format);
     }
 
     void DirectDrawSurface::flipVertical(const void* from_data, void* to_data) const
@@ -167,21 +209,15 @@ namespace RoxFormats
             }
 
             case DXT1:
-            {
-                unsigned int size = ((current_width > 4 ? current_width : 4) / 4) *
-                    ((current_height > 4 ? current_height : 4) / 4) * 8;
-                flipDxt(current_width, current_height, pixel_format, src_mip, dest_mip);
-                offset += size;
-                break;
-            }
-
             case DXT2:
-            case DirectDrawSurface::DXT3:
-            case DirectDrawSurface::DXT4:
-            case DirectDrawSurface::DXT5:
+            case DXT3:
+            case DXT4:
+            case DXT5:
+            case BC4:
+            case BC5:
             {
                 unsigned int size = ((current_width > 4 ? current_width : 4) / 4) *
-                    ((current_height > 4 ? current_height : 4) / 4) * 16;
+                    ((current_height > 4 ? current_height : 4) / 4) * blockBytes(pixel_format);
                 flipDxt(current_width, current_height, pixel_format, src_mip, dest_mip);
                 offset += size;
                 break;
@@ -209,13 +245,14 @@ namespace RoxFormats
         }
     }
 
-    std::size_t DirectDrawSurface::getDecodedSize() const
+    std::size_t DirectDrawSurface::getDecodedSize(int mip_count) const
     {
         std::size_t size = 0;
         unsigned int current_width = width;
         unsigned int current_height = height;
 
-        for (unsigned int i = 0; i < mipmap_count; ++i)
+        const unsigned int decoded_mips = (mip_count < 0 || unsigned(mip_count) > mipmap_count) ? mipmap_count : unsigned(mip_count);
+        for (unsigned int i = 0; i < decoded_mips; ++i)
         {
             size += current_width * current_height * 4;
             current_width = (current_width > 1) ? (current_width / 2) : 1;
@@ -241,140 +278,361 @@ namespace RoxFormats
             std::memcpy(out, &palette[*indices], 4);
     }
 
-    inline int unpack565(const unsigned char* src, unsigned char* dst)
+    namespace
     {
         using uchar = unsigned char;
 
-        int value = static_cast<int>(src[0]) | (static_cast<int>(src[1]) << 8);
+        int unpack565(const uchar* src, uchar* dst)
+        {
+            int value = static_cast<int>(src[0]) | (static_cast<int>(src[1]) << 8);
 
-        uchar r = static_cast<uchar>((value >> 11) & 0x1F);
-        uchar g = static_cast<uchar>((value >> 5) & 0x3F);
-        uchar b = static_cast<uchar>(value & 0x1F);
+            uchar r = static_cast<uchar>((value >> 11) & 0x1F);
+            uchar g = static_cast<uchar>((value >> 5) & 0x3F);
+            uchar b = static_cast<uchar>(value & 0x1F);
 
-        dst[0] = (r << 3) | (r >> 2);
-        dst[1] = (g << 2) | (g >> 4);
-        dst[2] = (b << 3) | (b >> 2);
-        dst[3] = 255;
+            dst[0] = (r << 3) | (r >> 2);
+            dst[1] = (g << 2) | (g >> 4);
+            dst[2] = (b << 3) | (b >> 2);
+            dst[3] = 255;
 
-        return value;
-    }
+            return value;
+        }
 
-    inline void decompressColor(const void* src, void* dst, bool is_dxt1)
-    {
-        using uchar = unsigned char;
+        // 4 rgba colors of the color block
+        void unpackColorPalette(const uchar* src, bool is_dxt1, uchar* codes)
+        {
+            int a = unpack565(src, codes);
+            int b = unpack565(src + 2, codes + 4);
+
+            for (int i = 0; i < 3; ++i)
+            {
+                int c = codes[i];
+                int d = codes[i + 4];
 
-        const uchar* src_buf = static_cast<const uchar*>(src);
-        if (!is_dxt1)
-            src_buf += 8;
+                if (is_dxt1 && a <= b)
+                {
+                    codes[i + 8] = static_cast<uchar>((c + d) / 2);
+                    codes[i + 12] = 0;
+                }
+                else
+                {
+                    codes[i + 8] = static_cast<uchar>((c * 2 + d) / 3);
+                    codes[i + 12] = static_cast<uchar>((c + d * 2) / 3);
+                }
+            }
 
-        uchar codes[16];
-        int a = unpack565(src_buf, codes);
-        int b = unpack565(src_buf + 2, codes + 4);
+            codes[11] = 255;
+            codes[15] = (is_dxt1 && a <= b) ? 0 : 255;
+        }
 
-        for (int i = 0; i < 3; ++i)
+        // 8 values of the dxt5 alpha or bc4/bc5 channel block
+        void unpackChannelCodes(const uchar* src, uchar* codes)
         {
-            int c = codes[i];
-            int d = codes[i + 4];
+            int alpha0 = src[0];
+            int alpha1 = src[1];
 
-            if (is_dxt1 && a <= b)
+            codes[0] = src[0];
+            codes[1] = src[1];
+            if (alpha0 <= alpha1)
             {
-                codes[i + 8] = static_cast<uchar>((c + d) / 2);
-                codes[i + 12] = 0;
+                for (int i = 1; i < 5; ++i)
+                    codes[i + 1] = static_cast<uchar>(((5 - i) * alpha0 + i * alpha1) / 5);
+
+                codes[6] = 0;
+                codes[7] = 255;
             }
             else
             {
-                codes[i + 8] = static_cast<uchar>((c * 2 + d) / 3);
-                codes[i + 12] = static_cast<uchar>((c + d * 2) / 3);
+                for (int i = 1; i < 7; ++i)
+                    codes[i + 1] = static_cast<uchar>(((7 - i) * alpha0 + i * alpha1) / 7);
             }
         }
 
-        codes[11] = 255;
-        codes[15] = (is_dxt1 && a <= b) ? 0 : 255;
+        void unpackChannelIndices(const uchar* src, uchar* indices)
+        {
+            src += 2;
+            for (int i = 0; i < 2; ++i, src += 3)
+            {
+                const unsigned int value = src[0] | (src[1] << 8) | (src[2] << 16);
+                for (int j = 0; j < 8; ++j)
+                    *indices++ = static_cast<uchar>((value >> (3 * j)) & 0x7);
+            }
+        }
 
-        uchar indices[16];
-        for (int i = 0; i < 4; ++i)
+        void unpackChannel(const uchar* src, uchar* values)
         {
-            uchar packed = src_buf[i + 4];
-            indices[i * 4 + 0] = packed & 0x3;
-            indices[i * 4 + 1] = (packed >> 2) & 0x3;
-            indices[i * 4 + 2] = (packed >> 4) & 0x3;
-            indices[i * 4 + 3] = (packed >> 6) & 0x3;
+            uchar codes[8], indices[16];
+            unpackChannelCodes(src, codes);
+            unpackChannelIndices(src, indices);
+            for (int i = 0; i < 16; ++i)
+                values[i] = codes[indices[i]];
         }
 
-        for (int i = 0; i < 16; ++i)
+        // decodes a block into 16 rgba pixels
+        void decodeBlockPixels(DirectDrawSurface::PIXEL_FORMAT format, const uchar* src, uchar* rgba)
         {
-            uchar offset = indices[i] * 4;
-            for (int j = 0; j < 4; ++j)
-                static_cast<uchar*>(dst)[i * 4 + j] = codes[offset + j];
+            if (format <= DirectDrawSurface::DXT5)
+            {
+                const bool is_dxt1 = format == DirectDrawSurface::DXT1;
+                const uchar* color = is_dxt1 ? src : src + 8;
+
+                uint32_t palette[4];
+                unpackColorPalette(color, is_dxt1, reinterpret_cast<uchar*>(palette));
+                for (int i = 0; i < 16; ++i)
+                    std::memcpy(rgba + i * 4, &palette[(color[4 + i / 4] >> (2 * (i % 4))) & 0x3], 4);
+
+                if (format == DirectDrawSurface::DXT2 || format == DirectDrawSurface::DXT3)
+                {
+                    for (int i = 0; i < 8; ++i)
+                    {
+                        const uchar lo = src[i] & 0x0F;
+                        const uchar hi = src[i] & 0xF0;
+                        rgba[i * 8 + 3] = lo | (lo << 4);
+                        rgba[i * 8 + 7] = hi | (hi >> 4);
+                    }
+                }
+                else if (format != DirectDrawSurface::DXT1)
+                {
+                    uchar alpha[16];
+                    unpackChannel(src, alpha);
+                    for (int i = 0; i < 16; ++i)
+                        rgba[i * 4 + 3] = alpha[i];
+                }
+                return;
+            }
+
+            uchar red[16], green[16] = {};
+            unpackChannel(src, red);
+            if (format == DirectDrawSurface::BC5)
+                unpackChannel(src + 8, green);
+
+            for (int i = 0; i < 16; ++i)
+            {
+                uchar* p = rgba + i * 4;
+                p[0] = red[i];
+                p[1] = green[i];
+                p[2] = 0;
+                p[3] = 255;
+            }
         }
-    }
 
-    inline void decompressDxt3Alpha(const void* src, void* dst)
-    {
-        using uchar = unsigned char;
+        // decodes a block into 4 rows of 4 rgba pixels, pitch is in bytes and may be negative
+        void decodeBlock(DirectDrawSurface::PIXEL_FORMAT format, const uchar* src, uchar* rgba, std::ptrdiff_t pitch)
+        {
+            alignas(16) uchar pixels[64];
+            decodeBlockPixels(format, src, pixels);
+            for (int r = 0; r < 4; ++r)
+                std::memcpy(rgba + r * pitch, pixels + r * 16, 16);
+        }
 
-        const uchar* src_buf = static_cast<const uchar*>(src);
-        uchar* dst_buf = static_cast<uchar*>(dst);
+#ifdef ROX_DDS_X86
+        // pshufb masks: palette lookup for each packed indices byte of a color row,
+        // placing of 4 values of a row into the given channel of 4 pixels
+        // and gathering of the 3-bit channel indices into 16-bit lanes with their shift multipliers
+        struct ShuffleTables
+        {
+            alignas(16) uchar color_rows[256][16];
+            alignas(16) uchar channel_rows[4][4][16];
+            alignas(16) uchar index_gather[2][16];
+            alignas(16) unsigned short index_shift[2][8];
+
+            ShuffleTables()
+            {
+                for (int b = 0; b < 256; ++b)
+                {
+                    for (int k = 0; k < 16; ++k)
+                        color_rows[b][k] = static_cast<uchar>(((b >> (2 * (k / 4))) & 0x3) * 4 + k % 4);
+                }
+
+                std::memset(channel_rows, 0x80, sizeof(channel_rows));
+                for (int c = 0; c < 4; ++c)
+                {
+                    for (int r = 0; r < 4; ++r)
+                    {
+                        for (int k = 0; k < 4; ++k)
+                            channel_rows[c][r][k * 4 + c] = static_cast<uchar>(r * 4 + k);
+                    }
+                }
+
+                for (int i = 0; i < 16; ++i)
+                {
+                    const int bit = 16 + i * 3;
+                    index_gather[i / 8][(i % 8) * 2] = static_cast<uchar>(bit / 8);
+                    index_gather[i / 8][(i % 8) * 2 + 1] = static_cast<uchar>(bit / 8 + 1);
+                    index_shift[i / 8][i % 8] = static_cast<unsigned short>(1 << (7 - bit % 8));
+                }
+            }
+        };
 
-        for (int i = 0; i < 64; i += 8, ++src_buf)
+        const ShuffleTables& shuffleTables()
         {
-            uchar lo = *src_buf & 0x0F;
-            uchar hi = *src_buf & 0xF0;
-            dst_buf[i + 3] = lo | (lo << 4);
-            dst_buf[i + 7] = hi | (hi >> 4);
+            static const ShuffleTables tables;
+            return tables;
         }
-    }
 
-    inline void decompressDxt5Alpha(const void* src, void* dst)
-    {
-        using uchar = unsigned char;
+        ROX_DDS_TARGET("ssse3") __m128i unpackChannelSsse3(const uchar* src)
+        {
+            const ShuffleTables& t = shuffleTables();
 
-        const uchar* src_buf = static_cast<const uchar*>(src);
-        uchar* dst_buf = static_cast<uchar*>(dst);
+            // interpolated values, x/7 and x/5 are exact as (x*9363)>>16 and (x*13108)>>16 for the used range
+            const __m128i a0 = _mm_set1_epi16(src[0]), a1 = _mm_set1_epi16(src[1]);
+            __m128i codes;
+            if (src[0] > src[1])
+            {
+                codes = _mm_add_epi16(_mm_mullo_epi16(a0, _mm_setr_epi16(7, 0, 6, 5, 4, 3, 2, 1)),
+                                      _mm_mullo_epi16(a1, _mm_setr_epi16(0, 7, 1, 2, 3, 4, 5, 6)));
+                codes = _mm_mulhi_epu16(codes, _mm_set1_epi16(9363));
+            }
+            else
+            {
+                codes = _mm_add_epi16(_mm_mullo_epi16(a0, _mm_setr_epi16(5, 0, 4, 3, 2, 1, 0, 0)),
+                                      _mm_mullo_epi16(a1, _mm_setr_epi16(0, 5, 1, 2, 3, 4, 0, 0)));
+                codes = _mm_or_si128(_mm_mulhi_epu16(codes, _mm_set1_epi16(13108)), _mm_setr_epi16(0, 0, 0, 0, 0, 0, 0, 255));
+            }
+            codes = _mm_packus_epi16(codes, codes);
 
-        int alpha0 = src_buf[0];
-        int alpha1 = src_buf[1];
+            // 3-bit indices, each is shifted to the bits 7..9 of its 16-bit lane
+            const __m128i block = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+            const __m128i mask = _mm_set1_epi16(7);
+            __m128i lo = _mm_shuffle_epi8(block, _mm_load_si128(reinterpret_cast<const __m128i*>(t.index_gather[0])));
+            __m128i hi = _mm_shuffle_epi8(block, _mm_load_si128(reinterpret_cast<const __m128i*>(t.index_gather[1])));
+            lo = _mm_and_si128(_mm_srli_epi16(_mm_mullo_epi16(lo, _mm_load_si128(reinterpret_cast<const __m128i*>(t.index_shift[0]))), 7), mask);
+            hi = _mm_and_si128(_mm_srli_epi16(_mm_mullo_epi16(hi, _mm_load_si128(reinterpret_cast<const __m128i*>(t.index_shift[1]))), 7), mask);
 
-        uchar codes[8];
-        codes[0] = src_buf[0];
-        codes[1] = src_buf[1];
-        if (alpha0 <= alpha1)
+            return _mm_shuffle_epi8(codes, _mm_packus_epi16(lo, hi));
+        }
+
+        ROX_DDS_TARGET("ssse3") void decodeBlockSsse3(DirectDrawSurface::PIXEL_FORMAT format, const uchar* src, uchar* rgba, std::ptrdiff_t pitch)
         {
-            for (int i = 1; i < 5; ++i)
-                codes[i + 1] = static_cast<uchar>(((5 - i) * alpha0 + i * alpha1) / 5);
+            const ShuffleTables& t = shuffleTables();
+            __m128i rows[4];
+
+            if (format <= DirectDrawSurface::DXT5)
+            {
+                const bool is_dxt1 = format == DirectDrawSurface::DXT1;
+                const uchar* color = is_dxt1 ? src : src + 8;
+
+                alignas(16) uchar codes[16];
+                unpackColorPalette(color, is_dxt1, codes);
+                const __m128i palette = _mm_load_si128(reinterpret_cast<const __m128i*>(codes));
+                for (int r = 0; r < 4; ++r)
+                    rows[r] = _mm_shuffle_epi8(palette, _mm_load_si128(reinterpret_cast<const __m128i*>(t.color_rows[color[4 + r]])));
+
+                if (!is_dxt1)
+                {
+                    __m128i alpha;
+                    if (format == DirectDrawSurface::DXT2 || format == DirectDrawSurface::DXT3)
+                    {
+                        const __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+                        const __m128i nibbles = _mm_set1_epi8(0x0F);
+                        alpha = _mm_unpacklo_epi8(_mm_and_si128(packed, nibbles), _mm_and_si128(_mm_srli_epi16(packed, 4), nibbles));
+                        alpha = _mm_or_si128(alpha, _mm_slli_epi16(alpha, 4));
+                    }
+                    else
+                        alpha = unpackChannelSsse3(src);
 
-            codes[6] = 0;
-            codes[7] = 255;
+                    const __m128i rgb_mask = _mm_set1_epi32(0x00FFFFFF);
+                    for (int r = 0; r < 4; ++r)
+                    {
+                        const __m128i a = _mm_shuffle_epi8(alpha, _mm_load_si128(reinterpret_cast<const __m128i*>(t.channel_rows[3][r])));
+                        rows[r] = _mm_or_si128(_mm_and_si128(rows[r], rgb_mask), a);
+                    }
+                }
+            }
+            else
+            {
+                const __m128i red = unpackChannelSsse3(src);
+                const __m128i green = format == DirectDrawSurface::BC5 ? unpackChannelSsse3(src + 8) : _mm_setzero_si128();
+                const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xFF000000));
+                for (int r = 0; r < 4; ++r)
+                {
+                    rows[r] = _mm_or_si128(opaque, _mm_shuffle_epi8(red, _mm_load_si128(reinterpret_cast<const __m128i*>(t.channel_rows[0][r]))));
+                    rows[r] = _mm_or_si128(rows[r], _mm_shuffle_epi8(green, _mm_load_si128(reinterpret_cast<const __m128i*>(t.channel_rows[1][r]))));
+                }
+            }
+
+            for (int r = 0; r < 4; ++r)
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + r * pitch), rows[r]);
         }
-        else
+
+        bool hasSsse3()
         {
-            for (int i = 1; i < 7; ++i)
-                codes[i + 1] = static_cast<uchar>(((7 - i) * alpha0 + i * alpha1) / 7);
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 1);
+            static const bool supported = (info[2] & (1 << 9)) != 0;
+#else
+            static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("ssse3") != 0);
+#endif
+            return supported;
         }
+#endif
+
+        typedef void (*DecodeBlockFunc)(DirectDrawSurface::PIXEL_FORMAT format, const uchar* src, uchar* rgba, std::ptrdiff_t pitch);
 
-        src_buf += 2;
-        uchar indices[16];
-        uchar* dest = indices;
-        for (int i = 0; i < 2; ++i)
+        // a range of block rows of one mip
+        struct DecodeBand
         {
-            unsigned int value = 0;
-            for (int j = 0; j < 3; ++j)
-                value |= (static_cast<unsigned int>(*src_buf++) << (8 * j));
+            const uchar* src;
+            uchar* dst;
+            unsigned int width, height;
+            unsigned int from, to;
+        };
 
-            for (int j = 0; j < 8; ++j)
-                *dest++ = static_cast<uchar>((value >> (3 * j)) & 0x7);
-        }
+        void decodeBand(const DecodeBand& band, DirectDrawSurface::PIXEL_FORMAT format, DecodeBlockFunc decode, bool flip)
+        {
+            const unsigned int blocks_x = (band.width + 3) / 4;
+            const int block_bytes = blockBytes(format);
+            const std::ptrdiff_t pitch = flip ? -std::ptrdiff_t(band.width) * 4 : std::ptrdiff_t(band.width) * 4;
+            const uchar* src = band.src + std::size_t(band.from) * blocks_x * block_bytes;
+            uchar* first_row = band.dst + (flip ? std::size_t(band.height - 1) * band.width * 4 : 0);
+
+            alignas(16) uchar rgba[64];
+            for (unsigned int by = band.from; by < band.to; ++by)
+            {
+                const unsigned int y = by * 4;
+                const unsigned int rows = (band.height - y < 4) ? band.height - y : 4;
+                uchar* dst = first_row + std::ptrdiff_t(y) * pitch;
+
+                unsigned int x = 0;
+                if (rows == 4)
+                {
+                    for (; x + 4 <= band.width; x += 4, src += block_bytes)
+                        decode(format, src, dst + x * 4, pitch);
+                }
+
+                for (; x < band.width; x += 4, src += block_bytes)
+                {
+                    decode(format, src, rgba, 16);
 
-        for (int i = 0; i < 16; ++i)
-            dst_buf[4 * i + 3] = codes[indices[i]];
+                    const std::size_t bytes = ((x + 4 <= band.width) ? 4 : band.width - x) * 4;
+                    for (unsigned int r = 0; r < rows; ++r)
+                        std::memcpy(dst + r * pitch + x * 4, rgba + r * 16, bytes);
+                }
+            }
+        }
     }
 
-    void DirectDrawSurface::decodeDxt(void* decoded_data) const
+    void DirectDrawSurface::decodeDxt(void* decoded_data, bool flip_vertical, int mip_count) const
     {
-        using uint = unsigned int;
-        const char* src_buf = static_cast<const char*>(data);
-        const uint bytes_per_block = (pixel_format == DXT1) ? 8 : 16;
+        if (!isBlockCompressed())
+            return;
 
+        DecodeBlockFunc decode = decodeBlock;
+#ifdef ROX_DDS_X86
+        if (hasSsse3())
+            decode = decodeBlockSsse3;
+#endif
+
+        // block rows are split into bands, big textures are decoded on the thread pool
+        const unsigned int band_rows = 16;
+        std::vector<DecodeBand> bands;
+        std::size_t decoded_size = 0;
+
+        // the source faces are stepped over all of their mips, skipped ones included
+        const unsigned int decoded_mips = (mip_count < 0 || unsigned(mip_count) > mipmap_count) ? mipmap_count : unsigned(mip_count);
+        const uchar* src = static_cast<const uchar*>(data);
+        uchar* dst = static_cast<uchar*>(decoded_data);
         for (int f = 0; f < ((type == TEXTURE_CUBE) ? 6 : 1); ++f)
         {
             unsigned int current_width = width;
@@ -382,51 +640,59 @@ namespace RoxFormats
 
             for (uint i = 0; i < mipmap_count; ++i)
             {
-                for (uint y = 0; y < current_height; y += 4)
+                const unsigned int blocks_y = (current_height + 3) / 4;
+                if (i < decoded_mips)
                 {
-                    for (uint x = 0; x < current_width; x += 4)
+                    for (unsigned int by = 0; by < blocks_y; by += band_rows)
                     {
-                        uint rgba[16];
-
-                        switch (pixel_format)
-                        {
-                        case DXT1:
-                            decompressColor(src_buf, rgba, true);
-                            break;
-
-                        case DXT2:
-                        case DXT3:
-                            decompressColor(src_buf, rgba, false);
-                            decompressDxt3Alpha(src_buf, rgba);
-                            break;
-
-                        case DXT4:
-                        case DXT5:
-                            decompressColor(src_buf, rgba, false);
-                            decompressDxt5Alpha(src_buf, rgba);
-                            break;
-
-                        default:
-                            return;
-                        }
-
-                        for (uint py = 0, sy = y; py < 16 && sy < current_height; py += 4, ++sy)
-                            std::memcpy(static_cast<uint*>(decoded_data) + current_width * sy + x,
-                                &rgba[py],
-                                ((x + 4 < current_width) ? 4 : (current_width - x)) * sizeof(uint));
-
-                        src_buf += bytes_per_block;
+                        DecodeBand band = { src, dst, current_width, current_height, by, by + band_rows < blocks_y ? by + band_rows : blocks_y };
+                        bands.push_back(band);
                     }
+
+                    dst += std::size_t(current_width) * current_height * 4;
+                    decoded_size += std::size_t(current_width) * current_height * 4;
                 }
 
-                decoded_data = static_cast<char*>(decoded_data) + (current_width * current_height) * 4;
+                src += std::size_t((current_width + 3) / 4) * blocks_y * blockBytes(pixel_format);
                 current_width = (current_width > 1) ? (current_width / 2) : 1;
                 current_height = (current_height > 1) ? (current_height / 2) : 1;
             }
         }
+
+        const PIXEL_FORMAT format = pixel_format;
+        auto job = [&](int idx) { decodeBand(bands[idx], format, decode, flip_vertical); };
+
+        if (bands.size() > 1 && decoded_size >= 512 * 1024)
+            RoxMemory::RoxThreadPool::get().run(static_cast<int>(bands.size()), job);
+        else
+        {
+            for (int i = 0; i < static_cast<int>(bands.size()); ++i)
+                job(i);
+        }
     }
 
     std::size_t DirectDrawSurface::decodeHeader(const void* data_ptr, std::size_t size)
+    {
+        const std::size_t header_size = decodeHeaderInfo(data_ptr, size);
+        if (!header_size)
+            return 0;
+
+        RoxMemory::RoxMemoryReader reader(data_ptr, size);
+        reader.seek(header_size);
+        if (!reader.checkRemained(this->data_size))
+        {
+            this->mipmap_count = static_cast<unsigned int>(-1);
+            // Probably broken, try to load at least the first mipmap
+            if (!reader.checkRemained(this->data_size))
+                return 0;
+        }
+
+        this->data = reader.getData();
+
+        return reader.getOffset();
+    }
+
+    std::size_t DirectDrawSurface::decodeHeaderInfo(const void* data_ptr, std::size_t size)
     {
         *this = DirectDrawSurface();
 
@@ -490,13 +756,21 @@ namespace RoxFormats
             case 0x35545844: // '5TXD'
                 this->pixel_format = DXT5;
                 break;
+            case 0x31495441: // '1ITA'
+            case 0x55344342: // 'U4CB'
+                this->pixel_format = BC4;
+                break;
+            case 0x32495441: // '2ITA'
+            case 0x55354342: // 'U5CB'
+                this->pixel_format = BC5;
+                break;
             default:
                 return 0;
             }
 
             for (uint i = 0, w = width, h = height; i < mipmap_count; ++i, w /= 2, h /= 2)
             {
-                uint size = ((w > 4 ? w : 4) / 4) * ((h > 4 ? h : 4) / 4) * ((this->pixel_format == DXT1) ? 8 : 16);
+                uint size = ((w > 4 ? w : 4) / 4) * ((h > 4 ? h : 4) / 4) * blockBytes(this->pixel_format);
                 this->data_size += size;
             }
         }
@@ -538,18 +812,7 @@ namespace RoxFormats
             this->data_size *= 6;
         }
 
-        reader.seek(128);
-        if (!reader.checkRemained(this->data_size))
-        {
-            this->mipmap_count = static_cast<unsigned int>(-1);
-            // Probably broken, try to load at least the first mipmap
-            if (!reader.checkRemained(this->data_size))
-                return 0;
-        }
-
-        this->data = reader.getData();
-
-        return reader.getOffset();
+        return 128;
     }
 
     std::size_t DirectDrawSurface::getMipSize(int mip_idx) const
@@ -562,15 +825,15 @@ namespace RoxFormats
         w1 = (w1 > 1) ? w1 : 1;
         h1 = (h1 > 1) ? h1 : 1;
 
-        if (pixel_format <= DXT5)
+        if (isBlockCompressed())
         {
             return ((w1 > 4 ? w1 : 4) / 4) * ((h1 > 4 ? h1 : 4) / 4) *
-                ((pixel_format == DXT1) ? 8 : 16) *
+                blockBytes(pixel_format) *
                 ((type == TEXTURE_CUBE) ? 6 : 1);
         }
 
         return (w1) * (h1) *
-            ((pixel_format == BGRA) ? 4 : ((pixel_format == BGR) ? 3 : 1)) *
+            ((pixel_format == RGBA || pixel_format == BGRA) ? 4 : ((pixel_format == RGB || pixel_format == BGR) ? 3 : 1)) *
             ((type == TEXTURE_CUBE) ? 6 : 1);
     }
 
@@ -31,6 +31,8 @@ namespace RoxFormats
             DXT3,
             DXT4,
             DXT5,
+            BC4, // single channel, decoded to red
+            BC5, // two channels, decoded to red and green
             RGBA,
             BGRA,
             RGB,
@@ -50,12 +52,16 @@ namespace RoxFormats
 
     public:
         std::size_t decodeHeader(const void* data, std::size_t size); // Returns 0 if invalid
-        void flipVertical(const void* from_data, void* to_data) const;
+        std::size_t decodeHeaderInfo(const void* data, std::size_t size); // Needs only the header, leaves data unset, returns data offset or 0
+        void flipVertical(const void* from_data, void* to_data) const; // Can be done in place
         std::size_t getMipSize(int mip_idx) const;
 
-        std::size_t getDecodedSize() const;
+        bool isBlockCompressed() const { return pixel_format <= BC5; }
+
+        // mip_count limits the decoded mips of every face, all of them by default
+        std::size_t getDecodedSize(int mip_count = -1) const;
         void decodePalette8RGBA(void* decoded_data) const; // Requires width*height*4 buffer
-        void decodeDxt(void* decoded_data) const; // Requires allocation with getDecodedSize()
+        void decodeDxt(void* decoded_data, bool flip_vertical = false, int mip_count = -1) const; // Requires allocation with getDecodedSize(mip_count), decodes DXT1-5 and BC4/BC5 to rgba
     };
 
 } // namespace RoxFormats
@@ -27,10 +27,34 @@ namespace RoxFormats
     };
 
     std::size_t KhronosTexture::decodeHeader(const void* data_ptr, std::size_t size)
+    {
+        if (!data_ptr || size < 128)
+        {
+            *this = KhronosTexture();
+            return 0;
+        }
+
+        const std::size_t header_size = decodeHeaderInfo(data_ptr, size);
+        if (!header_size)
+            return 0;
+
+        RoxMemory::RoxMemoryReader reader(data_ptr, size);
+        if (!reader.seek(header_size) || !reader.checkRemained(data_size))
+        {
+            *this = KhronosTexture();
+            return 0;
+        }
+
+        data = reader.getData();
+
+        return reader.getOffset();
+    }
+
+    std::size_t KhronosTexture::decodeHeaderInfo(const void* data_ptr, std::size_t size)
     {
         *this = KhronosTexture();
 
-        if (!data_ptr || size < 128)
+        if (!data_ptr || size < 12 + sizeof(KtxHeader))
             return 0;
 
         using uint = uint32_t;
@@ -43,8 +67,6 @@ namespace RoxFormats
         if (header.endianess != 0x04030201)
             return 0;
 
-        reader.skip(header.key_value_size);
-
         const bool is_cubemap = header.faces_count == 6;
         if (is_cubemap || header.faces_count != 1)
             return 0;
@@ -86,35 +108,36 @@ namespace RoxFormats
         if (!header.mipmap_count)
             return 0;
 
-        std::size_t calculated_data_size = 0;
-        unsigned int current_width = header.width;
-        unsigned int current_height = header.height;
+        width = header.width;
+        height = header.height;
+        mipmap_count = header.mipmap_count;
+        pf = pixel_format;
 
-        for (uint i = 0; i < header.mipmap_count; ++i, current_width = (current_width > 1) ? (current_width / 2) : 1, current_height = (current_height > 1) ? (current_height / 2) : 1)
-        {
-            if (pixel_format < ETC1)
-                calculated_data_size += current_width * current_height * ((pixel_format == RGB) ? 3 : 4);
-            else if (pixel_format == PVR_RGB2B || pixel_format == PVR_RGBA2B)
-                calculated_data_size += ((current_width > 16 ? current_width : 16) * (current_height > 8 ? current_height : 8) * 2 + 7) / 8;
-            else if (pixel_format == PVR_RGB4B || pixel_format == PVR_RGBA4B)
-                calculated_data_size += ((current_width > 8 ? current_width : 8) * (current_height > 8 ? current_height : 8) * 4 + 7) / 8;
-            else
-                calculated_data_size += ((current_width + 3) >> 2) * ((current_height + 3) >> 2) * ((pixel_format == ETC2_EAC) ? 16 : 8);
-        }
+        data_size = header.mipmap_count * 4;
+        for (uint i = 0; i < header.mipmap_count; ++i)
+            data_size += getMipSize(i);
 
-        calculated_data_size += header.mipmap_count * 4;
+        return 12 + sizeof(KtxHeader) + header.key_value_size;
+    }
 
-        if (!reader.checkRemained(calculated_data_size))
+    std::size_t KhronosTexture::getMipSize(int mip_idx) const
+    {
+        if (mip_idx < 0 || mip_idx >= static_cast<int>(mipmap_count))
             return 0;
 
-        width = header.width;
-        height = header.height;
-        data_size = calculated_data_size;
-        data = reader.getData();
-        mipmap_count = header.mipmap_count;
-        pf = pixel_format;
+        unsigned int w = width >> mip_idx;
+        unsigned int h = height >> mip_idx;
+        w = (w > 1) ? w : 1;
+        h = (h > 1) ? h : 1;
 
-        return reader.getOffset();
+        if (pf < ETC1)
+            return w * h * ((pf == RGB) ? 3 : 4);
+        if (pf == PVR_RGB2B || pf == PVR_RGBA2B)
+            return ((w > 16 ? w : 16) * (h > 8 ? h : 8) * 2 + 7) / 8;
+        if (pf == PVR_RGB4B || pf == PVR_RGBA4B)
+            return ((w > 8 ? w : 8) * (h > 8 ? h : 8) * 4 + 7) / 8;
+
+        return ((w + 3) >> 2) * ((h + 3) >> 2) * ((pf == ETC2_EAC) ? 16 : 8);
     }
 
 }
\ No newline at end of file
@@ -53,6 +53,8 @@ namespace RoxFormats
 
     public:
         std::size_t decodeHeader(const void* data, std::size_t size); // Returns 0 if invalid
+        std::size_t decodeHeaderInfo(const void* data, std::size_t size); // Needs only the header, leaves data unset, returns data offset or 0
+        std::size_t getMipSize(int mip_idx) const; // Without the size prefix
     };
 
 } // namespace RoxFormats
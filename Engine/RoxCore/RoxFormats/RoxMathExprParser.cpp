@@ -3,12 +3,14 @@
 #include "RoxMathExprParser.h"
 #include "RoxMath/RoxScalar.h"
 #include "RoxMath/RoxConstants.h"
+#include "RoxMath/RoxSimd.h"
 
 #include <sstream>
 #include <stack>
 #include <ctime>
 #include <cstdlib>
 #include <cstring>
+#include <map>
 
 namespace RoxFormats
 {
@@ -254,12 +256,11 @@ namespace RoxFormats
 
         m_ops.clear();
         m_opsCount = 0;
-        m_stack.setConstant(0.0f);
+        m_code.clear();
+        m_results.clear();
         if (!expr)
             return false;
 
-        struct InitRand { InitRand() { srand(static_cast<unsigned int>(time(nullptr))); rand(); } } static once;
-
         std::vector<OpStruct> ops;
         for (const char* c = expr; *c; ++c)
         {
@@ -449,15 +450,6 @@ namespace RoxFormats
             return false;
         }
 
-        // ToDo: Precalculate constant values
-
-        if (m_ops.size() == 2 && m_ops[0] == READ_CONST)
-        {
-            m_stack.setConstant(*reinterpret_cast<const float*>(&m_ops[1]));
-            m_ops.clear();
-            return true;
-        }
-
         m_opsCount = static_cast<int>(m_ops.size());
 
         RoxStackValidator v(m_ops);
@@ -469,7 +461,13 @@ namespace RoxFormats
             return false;
         }
 
-        m_stack.setSize(v.getSize());
+        if (!compile())
+        {
+            m_ops.clear();
+            m_opsCount = 0;
+            return false;
+        }
+
         return true;
     }
 
@@ -737,13 +735,839 @@ namespace RoxFormats
         return stack.get();
     }
 
-    void RoxMathExprParser::RoxStack::call(const UserFunction& f)
+    namespace
     {
-        float ret[32];
-        m_pos -= f.argsCount - 1;
-        f.f(&m_buf[m_pos], ret);
-        std::memcpy(&m_buf[m_pos], ret, f.returnCount * sizeof(float));
-        m_pos += f.returnCount - 1;
+        const int batchBlock = 64; // elements per register in calculateN, multiple of 4
+        const int maxLocalRegs = 128; // scalar registers kept on the stack
+
+        enum BytecodeOp
+        {
+            BC_END,
+            BC_ADD,
+            BC_SUB,
+            BC_MUL,
+            BC_DIV,
+            BC_MADD, // a*b+c
+            BC_MSUB, // a*b-c
+            BC_NEG,
+            BC_POW,
+            BC_LESS,
+            BC_MORE,
+            BC_LESS_EQ,
+            BC_MORE_EQ,
+            BC_SIN,
+            BC_COS,
+            BC_TAN,
+            BC_ATAN2,
+            BC_SQRT,
+            BC_ABS,
+            BC_FLOOR,
+            BC_CEIL,
+            BC_FRACT,
+            BC_MIN,
+            BC_MAX,
+            BC_MOD,
+            BC_CLAMP,
+            BC_LERP,
+            BC_NORM_FIRST, // first normalized component, a - component, b - length
+            BC_NORM_NEXT,
+            BC_RAND,
+            BC_RAND2,
+            BC_CALL // a - function, b - operands offset
+        };
+
+        inline bool isPure(int op) { return op != BC_RAND && op != BC_RAND2 && op != BC_CALL; }
+
+        inline int argsCount(int op)
+        {
+            switch (op)
+            {
+            case BC_RAND: return 0;
+            case BC_NEG: case BC_SIN: case BC_COS: case BC_TAN: case BC_SQRT:
+            case BC_ABS: case BC_FLOOR: case BC_CEIL: case BC_FRACT: return 1;
+            case BC_MADD: case BC_MSUB: case BC_CLAMP: case BC_LERP: return 3;
+            default: break;
+            }
+
+            return 2;
+        }
+
+        thread_local unsigned int randomState = 0;
+
+        inline float randf()
+        {
+            unsigned int x = randomState;
+            if (!x)
+                x = (static_cast<unsigned int>(time(nullptr)) ^ static_cast<unsigned int>(reinterpret_cast<size_t>(&randomState))) | 1;
+
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            randomState = x;
+            return static_cast<float>(x >> 8) * (1.0f / 16777216.0f);
+        }
+
+        inline float normFirst(float a, float len) { return len < 1.0e-6f ? 1.0f : a * (1.0f / len); }
+        inline float normNext(float a, float len) { return len < 1.0e-6f ? 0.0f : a * (1.0f / len); }
+        inline float fract(float a) { float i; return modff(a, &i); }
+
+        float evalPure(int op, float a, float b, float c)
+        {
+            switch (op)
+            {
+            case BC_ADD: return a + b;
+            case BC_SUB: return a - b;
+            case BC_MUL: return a * b;
+            case BC_DIV: return a / b;
+            case BC_MADD: return a * b + c;
+            case BC_MSUB: return a * b - c;
+            case BC_NEG: return -a;
+            case BC_POW: return powf(a, b);
+            case BC_LESS: return static_cast<float>(a < b);
+            case BC_MORE: return static_cast<float>(a > b);
+            case BC_LESS_EQ: return static_cast<float>(a <= b);
+            case BC_MORE_EQ: return static_cast<float>(a >= b);
+            case BC_SIN: return sinf(a);
+            case BC_COS: return cosf(a);
+            case BC_TAN: return tanf(a);
+            case BC_ATAN2: return atan2f(a, b);
+            case BC_SQRT: return sqrtf(a);
+            case BC_ABS: return fabsf(a);
+            case BC_FLOOR: return floorf(a);
+            case BC_CEIL: return ceilf(a);
+            case BC_FRACT: return fract(a);
+            case BC_MIN: return RoxMath::min(a, b);
+            case BC_MAX: return RoxMath::max(a, b);
+            case BC_MOD: return fmodf(a, b);
+            case BC_CLAMP: return RoxMath::clamp(a, b, c);
+            case BC_LERP: return RoxMath::lerp(a, b, c);
+            case BC_NORM_FIRST: return normFirst(a, b);
+            case BC_NORM_NEXT: return normNext(a, b);
+            default: break;
+            }
+
+            return 0.0f;
+        }
+
+        // builds ssa code from the validated rpn, folds constants and merges common subexpressions
+        struct ExprCompiler
+        {
+            struct Value
+            {
+                bool isConst;
+                float constValue;
+                int instr; // producing instruction, -1 for vars and constants
+            };
+
+            struct Ssa
+            {
+                int op;
+                int args[3];
+                int callOffset; // BC_CALL: args followed by results in callValues
+                int func;
+                int dst;
+                bool live;
+            };
+
+            std::vector<Value> values;
+            std::vector<Ssa> code;
+            std::vector<int> callValues;
+            typedef std::pair<unsigned long long, unsigned long long> ExprKey; // op and a, b and c
+            std::map<ExprKey, int> exprCache;
+            std::map<unsigned int, int> constCache;
+
+            int addValue(bool isConst, float constValue, int instr)
+            {
+                const Value v = { isConst, constValue, instr };
+                values.push_back(v);
+                return static_cast<int>(values.size()) - 1;
+            }
+
+            int constant(float f)
+            {
+                unsigned int bits;
+                memcpy(&bits, &f, sizeof(bits));
+                std::map<unsigned int, int>::const_iterator it = constCache.find(bits);
+                if (it != constCache.end())
+                    return it->second;
+
+                const int idx = addValue(true, f, -1);
+                constCache[bits] = idx;
+                return idx;
+            }
+
+            int emit(int op, int a = 0, int b = 0, int c = 0)
+            {
+                const int count = argsCount(op);
+                const int args[3] = { a, b, c };
+
+                if (isPure(op))
+                {
+                    bool allConst = true;
+                    for (int i = 0; i < count; ++i)
+                        allConst = allConst && values[args[i]].isConst;
+
+                    if (allConst)
+                        return constant(evalPure(op, values[a].constValue, count > 1 ? values[b].constValue : 0.0f,
+                                                 count > 2 ? values[c].constValue : 0.0f));
+
+                    const ExprKey key((static_cast<unsigned long long>(op) << 32) | static_cast<unsigned int>(count > 0 ? a : 0),
+                                      (static_cast<unsigned long long>(static_cast<unsigned int>(count > 1 ? b : 0)) << 32) |
+                                      static_cast<unsigned int>(count > 2 ? c : 0));
+
+                    std::map<ExprKey, int>::const_iterator it = exprCache.find(key);
+                    if (it != exprCache.end())
+                        return it->second;
+
+                    const int dst = addSsa(op, args, count);
+                    exprCache[key] = dst;
+                    return dst;
+                }
+
+                return addSsa(op, args, count);
+            }
+
+            int addSsa(int op, const int* args, int count)
+            {
+                Ssa s;
+                s.op = op;
+                for (int i = 0; i < 3; ++i)
+                    s.args[i] = i < count ? args[i] : -1;
+                s.callOffset = s.func = -1;
+                s.live = true;
+                s.dst = addValue(false, 0.0f, static_cast<int>(code.size()));
+                code.push_back(s);
+                return s.dst;
+            }
+
+            void call(int func, int argsCount, int returnCount, std::vector<int>& stack)
+            {
+                Ssa s;
+                s.op = BC_CALL;
+                s.args[0] = s.args[1] = s.args[2] = -1;
+                s.func = func;
+                s.dst = -1;
+                s.live = true;
+                s.callOffset = static_cast<int>(callValues.size());
+
+                const size_t first = stack.size() - argsCount;
+                callValues.insert(callValues.end(), stack.begin() + first, stack.end());
+                stack.resize(first);
+
+                for (int i = 0; i < returnCount; ++i)
+                {
+                    const int v = addValue(false, 0.0f, static_cast<int>(code.size()));
+                    callValues.push_back(v);
+                    stack.push_back(v);
+                }
+
+                code.push_back(s);
+            }
+
+            int length(const int* v, int count)
+            {
+                int sq = emit(BC_MUL, v[0], v[0]);
+                for (int i = 1; i < count; ++i)
+                    sq = emit(BC_ADD, sq, emit(BC_MUL, v[i], v[i]));
+                return emit(BC_SQRT, sq);
+            }
+        };
+    }
+
+    bool RoxMathExprParser::compile()
+    {
+        const size_t maxOperand = 0xFFFF;
+
+        m_code.clear();
+        m_callOperands.clear();
+        m_constValues.clear();
+        m_results.clear();
+        m_regsCount = m_compiledVarsCount = 0;
+
+        ExprCompiler c;
+        const int varsCount = getVarsCount();
+        for (int i = 0; i < varsCount; ++i)
+            c.addValue(false, 0.0f, -1);
+
+        std::vector<int> st;
+        int k;
+        const size_t opsSize = m_ops.size();
+        for (size_t i = 0; i < opsSize; ++i)
+        {
+            const size_t size = st.size();
+            switch (m_ops[i])
+            {
+            case READ_CONST: st.push_back(c.constant(*reinterpret_cast<const float*>(&m_ops[++i]))); break;
+            case READ_VAR: st.push_back(m_ops[++i]); break;
+
+            case OP_SUB_SCALAR: case OP_SUB_VEC2: case OP_SUB_VEC3: case OP_SUB_VEC4:
+            case OP_ADD_SCALAR: case OP_ADD_VEC2: case OP_ADD_VEC3: case OP_ADD_VEC4:
+            {
+                const bool sub = m_ops[i] < OP_ADD;
+                k = m_ops[i] - (sub ? OP_SUB : OP_ADD);
+                for (int j = 0; j < k; ++j)
+                    st[size - 2 * k + j] = c.emit(sub ? BC_SUB : BC_ADD, st[size - 2 * k + j], st[size - k + j]);
+                st.resize(size - k);
+                break;
+            }
+
+            case OP_MUL_SCALAR: case OP_MUL_VEC2_SCALAR: case OP_MUL_VEC3_SCALAR: case OP_MUL_VEC4_SCALAR:
+                k = m_ops[i] - OP_MUL;
+                for (int j = 0; j < k; ++j)
+                    st[size - 1 - k + j] = c.emit(BC_MUL, st[size - 1 - k + j], st[size - 1]);
+                st.pop_back();
+                break;
+
+            case OP_DIV: st[size - 2] = c.emit(BC_DIV, st[size - 2], st[size - 1]); st.pop_back(); break;
+            case OP_POW: st[size - 2] = c.emit(BC_POW, st[size - 2], st[size - 1]); st.pop_back(); break;
+            case OP_LESS: st[size - 2] = c.emit(BC_LESS, st[size - 2], st[size - 1]); st.pop_back(); break;
+            case OP_MORE: st[size - 2] = c.emit(BC_MORE, st[size - 2], st[size - 1]); st.pop_back(); break;
+            case OP_LESS_EQ: st[size - 2] = c.emit(BC_LESS_EQ, st[size - 2], st[size - 1]); st.pop_back(); break;
+            case OP_MORE_EQ: st[size - 2] = c.emit(BC_MORE_EQ, st[size - 2], st[size - 1]); st.pop_back(); break;
+            case OP_NEG: st[size - 1] = c.emit(BC_NEG, st[size - 1]); break;
+
+            case OP_FUNC:
+                switch (m_ops[++i])
+                {
+                case FUNC_RAND: st.push_back(c.emit(BC_RAND)); break;
+                case FUNC_SIN: st[size - 1] = c.emit(BC_SIN, st[size - 1]); break;
+                case FUNC_COS: st[size - 1] = c.emit(BC_COS, st[size - 1]); break;
+                case FUNC_TAN: st[size - 1] = c.emit(BC_TAN, st[size - 1]); break;
+                case FUNC_SQRT: st[size - 1] = c.emit(BC_SQRT, st[size - 1]); break;
+                case FUNC_ABS: st[size - 1] = c.emit(BC_ABS, st[size - 1]); break;
+                case FUNC_FLOOR: st[size - 1] = c.emit(BC_FLOOR, st[size - 1]); break;
+                case FUNC_CEIL: st[size - 1] = c.emit(BC_CEIL, st[size - 1]); break;
+                case FUNC_FRACT: st[size - 1] = c.emit(BC_FRACT, st[size - 1]); break;
+                case FUNC_ATAN2: st[size - 2] = c.emit(BC_ATAN2, st[size - 2], st[size - 1]); st.pop_back(); break;
+                case FUNC_MIN: st[size - 2] = c.emit(BC_MIN, st[size - 2], st[size - 1]); st.pop_back(); break;
+                case FUNC_MAX: st[size - 2] = c.emit(BC_MAX, st[size - 2], st[size - 1]); st.pop_back(); break;
+                case FUNC_MOD: st[size - 2] = c.emit(BC_MOD, st[size - 2], st[size - 1]); st.pop_back(); break;
+                case FUNC_RAND2: st[size - 2] = c.emit(BC_RAND2, st[size - 2], st[size - 1]); st.pop_back(); break;
+                case FUNC_CLAMP: st[size - 3] = c.emit(BC_CLAMP, st[size - 3], st[size - 2], st[size - 1]); st.resize(size - 2); break;
+                case FUNC_LERP: st[size - 3] = c.emit(BC_LERP, st[size - 3], st[size - 2], st[size - 1]); st.resize(size - 2); break;
+
+                case FUNC_LEN2: case FUNC_LEN3: case FUNC_LEN4:
+                    k = m_ops[i] - FUNC_LEN + 1;
+                    st[size - k] = c.length(&st[size - k], k);
+                    st.resize(size - k + 1);
+                    break;
+
+                case FUNC_NORM2: case FUNC_NORM3: case FUNC_NORM4:
+                {
+                    k = m_ops[i] - FUNC_NORM + 1;
+                    const int len = c.length(&st[size - k], k);
+                    for (int j = 0; j < k; ++j)
+                        st[size - k + j] = c.emit(j ? BC_NORM_NEXT : BC_NORM_FIRST, st[size - k + j], len);
+                    break;
+                }
+
+                default: break; // vec markers and scalar normalize
+                }
+                break;
+
+            case OP_USER_FUNC:
+            {
+                const UserFunction& f = m_functions[m_ops[++i]];
+                c.call(m_ops[i], f.argsCount, f.returnCount, st);
+                break;
+            }
+
+            default:
+                return false;
+            }
+        }
+
+        if (st.empty())
+            return false;
+
+        if (st.size() > 4)
+            st.erase(st.begin(), st.end() - 4);
+
+        // instructions hold 16-bit operands
+        if (c.values.size() > maxOperand || m_functions.size() > maxOperand)
+            return false;
+
+        std::vector<int> uses(c.values.size(), 0);
+        const int resultUse = 1 << 20;
+        for (size_t i = 0; i < st.size(); ++i)
+            uses[st[i]] += resultUse;
+
+        // dead code removal, calls are always kept
+        for (int i = static_cast<int>(c.code.size()) - 1; i >= 0; --i)
+        {
+            ExprCompiler::Ssa& s = c.code[i];
+            if (s.op != BC_CALL && !uses[s.dst])
+            {
+                s.live = false;
+                continue;
+            }
+
+            if (s.op == BC_CALL)
+            {
+                for (int j = 0; j < m_functions[s.func].argsCount; ++j)
+                    ++uses[c.callValues[s.callOffset + j]];
+                continue;
+            }
+
+            for (int j = 0; j < 3 && s.args[j] >= 0; ++j)
+                ++uses[s.args[j]];
+        }
+
+        // fuse single-use multiplications into add/sub
+        for (size_t i = 0; i < c.code.size(); ++i)
+        {
+            ExprCompiler::Ssa& s = c.code[i];
+            if (!s.live || (s.op != BC_ADD && s.op != BC_SUB))
+                continue;
+
+            for (int j = 0; j < 2; ++j)
+            {
+                if (s.op == BC_SUB && j == 1)
+                    break;
+
+                const int instr = c.values[s.args[j]].instr;
+                if (instr < 0 || uses[s.args[j]] != 1)
+                    continue;
+
+                ExprCompiler::Ssa& m = c.code[instr];
+                if (m.op != BC_MUL || !m.live)
+                    continue;
+
+                m.live = false;
+                s.args[2] = s.args[1 - j];
+                s.args[0] = m.args[0];
+                s.args[1] = m.args[1];
+                s.op = s.op == BC_ADD ? BC_MADD : BC_MSUB;
+                break;
+            }
+        }
+
+        // register allocation
+        std::vector<int> lastUse(c.values.size(), -1);
+        for (size_t i = 0; i < c.code.size(); ++i)
+        {
+            const ExprCompiler::Ssa& s = c.code[i];
+            if (!s.live)
+                continue;
+
+            if (s.op == BC_CALL)
+            {
+                for (int j = 0; j < m_functions[s.func].argsCount; ++j)
+                    lastUse[c.callValues[s.callOffset + j]] = static_cast<int>(i);
+                continue;
+            }
+
+            for (int j = 0; j < 3 && s.args[j] >= 0; ++j)
+                lastUse[s.args[j]] = static_cast<int>(i);
+        }
+
+        for (size_t i = 0; i < st.size(); ++i)
+            lastUse[st[i]] = resultUse;
+
+        std::vector<int> regs(c.values.size(), -1);
+        for (int i = 0; i < varsCount; ++i)
+            regs[i] = i;
+
+        for (size_t i = varsCount; i < c.values.size(); ++i)
+        {
+            if (!c.values[i].isConst || lastUse[i] < 0)
+                continue;
+
+            regs[i] = varsCount + static_cast<int>(m_constValues.size());
+            m_constValues.push_back(c.values[i].constValue);
+        }
+
+        const int firstTemp = varsCount + static_cast<int>(m_constValues.size());
+        int regsCount = firstTemp;
+        std::vector<int> freeRegs;
+
+        for (size_t i = 0; i < c.code.size(); ++i)
+        {
+            const ExprCompiler::Ssa& s = c.code[i];
+            if (!s.live)
+                continue;
+
+            std::vector<int> operands;
+            const int operandsCount = s.op == BC_CALL ? m_functions[s.func].argsCount : argsCount(s.op);
+            for (int j = 0; j < operandsCount; ++j)
+                operands.push_back(s.op == BC_CALL ? c.callValues[s.callOffset + j] : s.args[j]);
+
+            Instruction ins = { static_cast<unsigned char>(s.op), 0, 0, 0, 0 };
+            unsigned short* args[3] = { &ins.a, &ins.b, &ins.c };
+            if (s.op == BC_CALL)
+            {
+                ins.a = static_cast<unsigned short>(s.func);
+                ins.b = static_cast<unsigned short>(m_callOperands.size());
+                for (int j = 0; j < operandsCount; ++j)
+                    m_callOperands.push_back(static_cast<unsigned short>(regs[operands[j]]));
+            }
+            else
+            {
+                for (int j = 0; j < operandsCount; ++j)
+                    *args[j] = static_cast<unsigned short>(regs[operands[j]]);
+            }
+
+            for (int j = 0; j < operandsCount; ++j)
+            {
+                const int v = operands[j];
+                if (lastUse[v] == static_cast<int>(i) && regs[v] >= firstTemp)
+                {
+                    freeRegs.push_back(regs[v]);
+                    lastUse[v] = -1;
+                }
+            }
+
+            const int dstCount = s.op == BC_CALL ? m_functions[s.func].returnCount : 1;
+            for (int j = 0; j < dstCount; ++j)
+            {
+                const int v = s.op == BC_CALL ? c.callValues[s.callOffset + operandsCount + j] : s.dst;
+                if (freeRegs.empty())
+                    regs[v] = regsCount++;
+                else
+                {
+                    regs[v] = freeRegs.back();
+                    freeRegs.pop_back();
+                }
+
+                if (s.op == BC_CALL)
+                    m_callOperands.push_back(static_cast<unsigned short>(regs[v]));
+                else
+                    ins.dst = static_cast<unsigned short>(regs[v]);
+            }
+
+            for (int j = 0; j < dstCount; ++j)
+            {
+                const int v = s.op == BC_CALL ? c.callValues[s.callOffset + operandsCount + j] : s.dst;
+                if (lastUse[v] < 0)
+                    freeRegs.push_back(regs[v]);
+            }
+
+            m_code.push_back(ins);
+        }
+
+        if (static_cast<size_t>(regsCount) > maxOperand || m_callOperands.size() > maxOperand)
+        {
+            m_code.clear();
+            m_callOperands.clear();
+            m_constValues.clear();
+            return false;
+        }
+
+        const Instruction end = { BC_END, 0, 0, 0, 0 };
+        m_code.push_back(end);
+
+        for (size_t i = 0; i < st.size(); ++i)
+            m_results.push_back(static_cast<unsigned short>(regs[st[i]]));
+
+        m_regsCount = regsCount;
+        m_compiledVarsCount = varsCount;
+        return true;
+    }
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define ROX_EXPR_THREADED_DISPATCH
+#endif
+
+    void RoxMathExprParser::execute(float* r, void* userData) const
+    {
+        const Instruction* ip = &m_code[0] - 1;
+
+#ifdef ROX_EXPR_THREADED_DISPATCH
+        static const void* const labels[] =
+        {
+            &&op_BC_END, &&op_BC_ADD, &&op_BC_SUB, &&op_BC_MUL, &&op_BC_DIV, &&op_BC_MADD, &&op_BC_MSUB, &&op_BC_NEG,
+            &&op_BC_POW, &&op_BC_LESS, &&op_BC_MORE, &&op_BC_LESS_EQ, &&op_BC_MORE_EQ, &&op_BC_SIN, &&op_BC_COS,
+            &&op_BC_TAN, &&op_BC_ATAN2, &&op_BC_SQRT, &&op_BC_ABS, &&op_BC_FLOOR, &&op_BC_CEIL, &&op_BC_FRACT,
+            &&op_BC_MIN, &&op_BC_MAX, &&op_BC_MOD, &&op_BC_CLAMP, &&op_BC_LERP, &&op_BC_NORM_FIRST, &&op_BC_NORM_NEXT,
+            &&op_BC_RAND, &&op_BC_RAND2, &&op_BC_CALL
+        };
+
+        #define ROX_OP(name) op_##name:
+        #define ROX_NEXT goto *labels[(++ip)->op]
+        ROX_NEXT;
+#else
+        #define ROX_OP(name) case name:
+        #define ROX_NEXT continue
+        for (;;)
+        {
+            switch ((++ip)->op)
+            {
+#endif
+        ROX_OP(BC_ADD) r[ip->dst] = r[ip->a] + r[ip->b]; ROX_NEXT;
+        ROX_OP(BC_SUB) r[ip->dst] = r[ip->a] - r[ip->b]; ROX_NEXT;
+        ROX_OP(BC_MUL) r[ip->dst] = r[ip->a] * r[ip->b]; ROX_NEXT;
+        ROX_OP(BC_DIV) r[ip->dst] = r[ip->a] / r[ip->b]; ROX_NEXT;
+        ROX_OP(BC_MADD) r[ip->dst] = r[ip->a] * r[ip->b] + r[ip->c]; ROX_NEXT;
+        ROX_OP(BC_MSUB) r[ip->dst] = r[ip->a] * r[ip->b] - r[ip->c]; ROX_NEXT;
+        ROX_OP(BC_NEG) r[ip->dst] = -r[ip->a]; ROX_NEXT;
+        ROX_OP(BC_POW) r[ip->dst] = powf(r[ip->a], r[ip->b]); ROX_NEXT;
+        ROX_OP(BC_LESS) r[ip->dst] = static_cast<float>(r[ip->a] < r[ip->b]); ROX_NEXT;
+        ROX_OP(BC_MORE) r[ip->dst] = static_cast<float>(r[ip->a] > r[ip->b]); ROX_NEXT;
+        ROX_OP(BC_LESS_EQ) r[ip->dst] = static_cast<float>(r[ip->a] <= r[ip->b]); ROX_NEXT;
+        ROX_OP(BC_MORE_EQ) r[ip->dst] = static_cast<float>(r[ip->a] >= r[ip->b]); ROX_NEXT;
+        ROX_OP(BC_SIN) r[ip->dst] = sinf(r[ip->a]); ROX_NEXT;
+        ROX_OP(BC_COS) r[ip->dst] = cosf(r[ip->a]); ROX_NEXT;
+        ROX_OP(BC_TAN) r[ip->dst] = tanf(r[ip->a]); ROX_NEXT;
+        ROX_OP(BC_ATAN2) r[ip->dst] = atan2f(r[ip->a], r[ip->b]); ROX_NEXT;
+        ROX_OP(BC_SQRT) r[ip->dst] = sqrtf(r[ip->a]); ROX_NEXT;
+        ROX_OP(BC_ABS) r[ip->dst] = fabsf(r[ip->a]); ROX_NEXT;
+        ROX_OP(BC_FLOOR) r[ip->dst] = floorf(r[ip->a]); ROX_NEXT;
+        ROX_OP(BC_CEIL) r[ip->dst] = ceilf(r[ip->a]); ROX_NEXT;
+        ROX_OP(BC_FRACT) r[ip->dst] = fract(r[ip->a]); ROX_NEXT;
+        ROX_OP(BC_MIN) r[ip->dst] = RoxMath::min(r[ip->a], r[ip->b]); ROX_NEXT;
+        ROX_OP(BC_MAX) r[ip->dst] = RoxMath::max(r[ip->a], r[ip->b]); ROX_NEXT;
+        ROX_OP(BC_MOD) r[ip->dst] = fmodf(r[ip->a], r[ip->b]); ROX_NEXT;
+        ROX_OP(BC_CLAMP) r[ip->dst] = RoxMath::clamp(r[ip->a], r[ip->b], r[ip->c]); ROX_NEXT;
+        ROX_OP(BC_LERP) r[ip->dst] = RoxMath::lerp(r[ip->a], r[ip->b], r[ip->c]); ROX_NEXT;
+        ROX_OP(BC_NORM_FIRST) r[ip->dst] = normFirst(r[ip->a], r[ip->b]); ROX_NEXT;
+        ROX_OP(BC_NORM_NEXT) r[ip->dst] = normNext(r[ip->a], r[ip->b]); ROX_NEXT;
+        ROX_OP(BC_RAND) r[ip->dst] = randf(); ROX_NEXT;
+        ROX_OP(BC_RAND2) r[ip->dst] = r[ip->a] + randf() * (r[ip->b] - r[ip->a]); ROX_NEXT;
+        ROX_OP(BC_CALL)
+        {
+            const UserFunction& f = m_functions[ip->a];
+            const unsigned short* operands = &m_callOperands[ip->b];
+            float args[32], ret[32];
+            for (int i = 0; i < f.argsCount; ++i)
+                args[i] = r[operands[i]];
+            f.f(args, ret, 0, userData);
+            for (int i = 0; i < f.returnCount; ++i)
+                r[operands[f.argsCount + i]] = ret[i];
+        }
+        ROX_NEXT;
+        ROX_OP(BC_END) return;
+#ifndef ROX_EXPR_THREADED_DISPATCH
+            }
+        }
+#endif
+        #undef ROX_OP
+        #undef ROX_NEXT
+    }
+
+    namespace
+    {
+        inline void addN(float* to, const float* a, const float* b, int count)
+        {
+            int i = 0;
+            for (; i + 4 <= count; i += 4)
+                (RoxMath::SimdVec4(a + i) + RoxMath::SimdVec4(b + i)).get(to + i);
+            for (; i < count; ++i)
+                to[i] = a[i] + b[i];
+        }
+
+        inline void subN(float* to, const float* a, const float* b, int count)
+        {
+            int i = 0;
+            for (; i + 4 <= count; i += 4)
+                (RoxMath::SimdVec4(a + i) - RoxMath::SimdVec4(b + i)).get(to + i);
+            for (; i < count; ++i)
+                to[i] = a[i] - b[i];
+        }
+
+        inline void mulN(float* to, const float* a, const float* b, int count)
+        {
+            int i = 0;
+            for (; i + 4 <= count; i += 4)
+                (RoxMath::SimdVec4(a + i) * RoxMath::SimdVec4(b + i)).get(to + i);
+            for (; i < count; ++i)
+                to[i] = a[i] * b[i];
+        }
+
+        inline void maddN(float* to, const float* a, const float* b, const float* c, int count)
+        {
+            int i = 0;
+            for (; i + 4 <= count; i += 4)
+                (RoxMath::SimdVec4(a + i) * RoxMath::SimdVec4(b + i) + RoxMath::SimdVec4(c + i)).get(to + i);
+            for (; i < count; ++i)
+                to[i] = a[i] * b[i] + c[i];
+        }
+
+        inline void msubN(float* to, const float* a, const float* b, const float* c, int count)
+        {
+            int i = 0;
+            for (; i + 4 <= count; i += 4)
+                (RoxMath::SimdVec4(a + i) * RoxMath::SimdVec4(b + i) - RoxMath::SimdVec4(c + i)).get(to + i);
+            for (; i < count; ++i)
+                to[i] = a[i] * b[i] - c[i];
+        }
+
+        inline void fillN(float* to, float value, int count)
+        {
+            const RoxMath::SimdVec4 v(value);
+            int i = 0;
+            for (; i + 4 <= count; i += 4)
+                v.get(to + i);
+            for (; i < count; ++i)
+                to[i] = value;
+        }
+    }
+
+    void RoxMathExprParser::executeBlock(float* const* r, int count, int offset, void* userData) const
+    {
+        #define ROX_LANES(expr) for (int l = 0; l < count; ++l) { expr; } break
+
+        for (const Instruction* ip = &m_code[0]; ip->op != BC_END; ++ip)
+        {
+            float* d = r[ip->dst];
+            const float* a = r[ip->a];
+            const float* b = r[ip->b];
+            const float* c = r[ip->c];
+
+            switch (ip->op)
+            {
+            case BC_ADD: addN(d, a, b, count); break;
+            case BC_SUB: subN(d, a, b, count); break;
+            case BC_MUL: mulN(d, a, b, count); break;
+            case BC_MADD: maddN(d, a, b, c, count); break;
+            case BC_MSUB: msubN(d, a, b, c, count); break;
+            case BC_DIV: ROX_LANES(d[l] = a[l] / b[l]);
+            case BC_NEG: ROX_LANES(d[l] = -a[l]);
+            case BC_POW: ROX_LANES(d[l] = powf(a[l], b[l]));
+            case BC_LESS: ROX_LANES(d[l] = static_cast<float>(a[l] < b[l]));
+            case BC_MORE: ROX_LANES(d[l] = static_cast<float>(a[l] > b[l]));
+            case BC_LESS_EQ: ROX_LANES(d[l] = static_cast<float>(a[l] <= b[l]));
+            case BC_MORE_EQ: ROX_LANES(d[l] = static_cast<float>(a[l] >= b[l]));
+            case BC_SIN: ROX_LANES(d[l] = sinf(a[l]));
+            case BC_COS: ROX_LANES(d[l] = cosf(a[l]));
+            case BC_TAN: ROX_LANES(d[l] = tanf(a[l]));
+            case BC_ATAN2: ROX_LANES(d[l] = atan2f(a[l], b[l]));
+            case BC_SQRT: ROX_LANES(d[l] = sqrtf(a[l]));
+            case BC_ABS: ROX_LANES(d[l] = fabsf(a[l]));
+            case BC_FLOOR: ROX_LANES(d[l] = floorf(a[l]));
+            case BC_CEIL: ROX_LANES(d[l] = ceilf(a[l]));
+            case BC_FRACT: ROX_LANES(d[l] = fract(a[l]));
+            case BC_MIN: ROX_LANES(d[l] = RoxMath::min(a[l], b[l]));
+            case BC_MAX: ROX_LANES(d[l] = RoxMath::max(a[l], b[l]));
+            case BC_MOD: ROX_LANES(d[l] = fmodf(a[l], b[l]));
+            case BC_CLAMP: ROX_LANES(d[l] = RoxMath::clamp(a[l], b[l], c[l]));
+            case BC_LERP: ROX_LANES(d[l] = RoxMath::lerp(a[l], b[l], c[l]));
+            case BC_NORM_FIRST: ROX_LANES(d[l] = normFirst(a[l], b[l]));
+            case BC_NORM_NEXT: ROX_LANES(d[l] = normNext(a[l], b[l]));
+            case BC_RAND: ROX_LANES(d[l] = randf());
+            case BC_RAND2: ROX_LANES(d[l] = a[l] + randf() * (b[l] - a[l]));
+            case BC_CALL:
+            {
+                const UserFunction& f = m_functions[ip->a];
+                const unsigned short* operands = &m_callOperands[ip->b];
+                if (f.fn)
+                {
+                    const float* argsN[32];
+                    float* retN[32];
+                    for (int i = 0; i < f.argsCount; ++i)
+                        argsN[i] = r[operands[i]];
+                    for (int i = 0; i < f.returnCount; ++i)
+                        retN[i] = r[operands[f.argsCount + i]];
+                    f.fn(argsN, retN, count, offset, userData);
+                    break;
+                }
+
+                float args[32], ret[32];
+                for (int l = 0; l < count; ++l)
+                {
+                    for (int i = 0; i < f.argsCount; ++i)
+                        args[i] = r[operands[i]][l];
+                    f.f(args, ret, offset + l, userData);
+                    for (int i = 0; i < f.returnCount; ++i)
+                        r[operands[f.argsCount + i]][l] = ret[i];
+                }
+                break;
+            }
+            }
+        }
+
+        #undef ROX_LANES
+    }
+
+    void RoxMathExprParser::calculateN(const float* const* vars, float* result, int count, void* userData) const
+    {
+        if (!result || count <= 0)
+            return;
+
+        if (m_results.empty())
+        {
+            fillN(result, 0.0f, count);
+            return;
+        }
+
+        const int constsCount = static_cast<int>(m_constValues.size());
+        const int firstTemp = m_compiledVarsCount + constsCount;
+
+        // not thread_local: user functions may evaluate other expressions
+        std::vector<float> buf(static_cast<size_t>(m_regsCount - m_compiledVarsCount) * batchBlock);
+        std::vector<float*> regs(m_regsCount);
+
+        for (int i = 0; i < constsCount; ++i)
+        {
+            regs[m_compiledVarsCount + i] = &buf[i * batchBlock];
+            fillN(regs[m_compiledVarsCount + i], m_constValues[i], batchBlock);
+        }
+
+        for (int i = firstTemp; i < m_regsCount; ++i)
+            regs[i] = &buf[(i - m_compiledVarsCount) * batchBlock];
+
+        for (int offset = 0; offset < count; offset += batchBlock)
+        {
+            const int blockCount = RoxMath::min(count - offset, batchBlock);
+            for (int i = 0; i < m_compiledVarsCount; ++i)
+                regs[i] = const_cast<float*>(vars[i]) + offset;
+
+            executeBlock(&regs[0], blockCount, offset, userData);
+            memcpy(result + offset, regs[m_results.back()], blockCount * sizeof(float));
+        }
+    }
+
+    void RoxMathExprParser::run(float* regs, const float* vars, void* userData) const
+    {
+        if (m_compiledVarsCount)
+            memcpy(regs, vars, m_compiledVarsCount * sizeof(float));
+        if (!m_constValues.empty())
+            memcpy(regs + m_compiledVarsCount, &m_constValues[0], m_constValues.size() * sizeof(float));
+
+        execute(regs, userData);
+    }
+
+    float RoxMathExprParser::calculateVars(const float* vars, void* userData) const
+    {
+        if (m_results.empty())
+            return 0.0f;
+
+        float local[maxLocalRegs];
+        std::vector<float> heap;
+        float* regs = m_regsCount <= maxLocalRegs ? local : (heap.resize(m_regsCount), &heap[0]);
+        run(regs, vars, userData);
+        return regs[m_results.back()];
+    }
+
+    float RoxMathExprParser::calculate(void* userData) const
+    {
+        return calculateVars(m_vars.empty() ? nullptr : &m_vars[0], userData);
+    }
+
+    RoxMath::Vector4 RoxMathExprParser::calculateVec4(void* userData) const
+    {
+        if (m_results.empty())
+            return RoxMath::Vector4();
+
+        float local[maxLocalRegs];
+        std::vector<float> heap;
+        float* regs = m_regsCount <= maxLocalRegs ? local : (heap.resize(m_regsCount), &heap[0]);
+        run(regs, m_vars.empty() ? nullptr : &m_vars[0], userData);
+
+        float v[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (size_t i = 0; i < m_results.size(); ++i)
+            v[i] = regs[m_results[i]];
+
+        return RoxMath::Vector4(v[0], v[1], v[2], v[3]);
+    }
+
+    void RoxMathExprParser::setRandomSeed(unsigned int seed)
+    {
+        seed ^= seed >> 16;
+        seed *= 0x7feb352d;
+        seed ^= seed >> 15;
+        seed *= 0x846ca68b;
+        seed ^= seed >> 16;
+        randomState = seed ? seed : 0x9e3779b9;
     }
 
     void RoxMathExprParser::RoxStackValidator::call(const UserFunction& f)
@@ -777,11 +1601,13 @@ namespace RoxFormats
         switch (m_ops[idx])
         {
         case FUNC_LEN:
-            m_ops[idx] += type2;
+            m_ops[idx] = type2 > 1 ? FUNC_LEN + type2 - 1 : FUNC_ABS;
             m_buf.resize(m_buf.size() - (type2 - 1));
+            m_buf.back() = 1;
             return;
         case FUNC_NORM:
-            m_ops[idx] += type2;
+            if (type2 > 1)
+                m_ops[idx] = FUNC_NORM + type2 - 1;
             return;
         }
 
@@ -824,38 +1650,6 @@ namespace RoxFormats
         m_valid = false;
     }
 
-    float RoxMathExprParser::calculate() const { return calculate(m_stack); }
-
-    RoxMath::Vector4 RoxMathExprParser::calculateVec4() const
-    {
-        RoxMath::Vector4 result;
-        result.x = calculate(m_stack);
-        m_stack.pop();
-        if (m_stack.empty())
-            return result;
-
-        result.y = m_stack.get();
-        m_stack.pop();
-        if (m_stack.empty())
-        {
-            std::swap(result.x, result.y);
-            return result;
-        }
-
-        result.z = m_stack.get();
-        m_stack.pop();
-        if (m_stack.empty())
-        {
-            std::swap(result.x, result.z);
-            return result;
-        }
-
-        std::swap(result.y, result.z);
-        result.w = result.x;
-        result.x = m_stack.get();
-        return result;
-    }
-
     void RoxMathExprParser::setConstant(const char* name, float value)
     {
         if (!name)
@@ -926,9 +1720,9 @@ namespace RoxFormats
     const float* RoxMathExprParser::getVars() const { return m_vars.empty() ? nullptr : &m_vars[0]; }
     float* RoxMathExprParser::getVars() { return m_vars.empty() ? nullptr : &m_vars[0]; }
 
-    void RoxMathExprParser::setFunction(const char* name, int argsCount, int returnCount, Function f)
+    void RoxMathExprParser::setFunction(const char* name, int argsCount, int returnCount, Function f, FunctionN fn)
     {
-        if (!name || !f || returnCount < 1 || returnCount > 32)
+        if (!name || !f || argsCount < 0 || argsCount > 32 || returnCount < 1 || returnCount > 32)
             return;
 
         for (size_t i = 0; i < m_functions.size(); ++i)
@@ -937,11 +1731,12 @@ namespace RoxFormats
             {
                 m_functions[i].argsCount = argsCount;
                 m_functions[i].f = f;
+                m_functions[i].fn = fn;
                 return;
             }
         }
 
-        m_functions.emplace_back(UserFunction{ name, static_cast<char>(argsCount), static_cast<char>(returnCount), f });
+        m_functions.emplace_back(UserFunction{ name, static_cast<char>(argsCount), static_cast<char>(returnCount), f, fn });
     }
 
 }
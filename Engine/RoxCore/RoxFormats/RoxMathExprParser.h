@@ -12,9 +12,15 @@ namespace RoxFormats
     class RoxMathExprParser
     {
     public:
-        using Function = void (*)(float* args, float* return_value);
+        // idx is the element index when called from calculateN, 0 otherwise
+        // userData is passed through from the calculate call
+        using Function = void (*)(float* args, float* return_value, int idx, void* userData);
 
-        void setFunction(const char* name, int argsCount, int returnCount, Function f);
+        // optional batched version used by calculateN, args and return values point to count elements
+        // starting at element offset, return values may alias args
+        using FunctionN = void (*)(const float* const* args, float* const* return_values, int count, int offset, void* userData);
+
+        void setFunction(const char* name, int argsCount, int returnCount, Function f, FunctionN fn = nullptr);
         void setConstant(const char* name, float value);
 
     public:
@@ -30,17 +36,31 @@ namespace RoxFormats
         float* getVars();
 
     public:
-        float calculate() const;
-        RoxMath::Vector4 calculateVec4() const;
+        float calculate(void* userData = nullptr) const;
+        RoxMath::Vector4 calculateVec4(void* userData = nullptr) const;
+
+        // uses vars[getVarsCount()] instead of the values set by setVar, safe to call from several threads
+        float calculateVars(const float* vars, void* userData = nullptr) const;
+
+        // evaluates the expression for count elements at once, vars[i] points to count values of the i-th var
+        void calculateN(const float* const* vars, float* result, int count, void* userData = nullptr) const;
 
     public:
-        RoxMathExprParser() : m_opsCount(0) {}
+        // rand() and rand2() use a per thread generator
+        static void setRandomSeed(unsigned int seed);
+
+    public:
+        RoxMathExprParser() : m_opsCount(0), m_regsCount(0), m_compiledVarsCount(0) {}
         RoxMathExprParser(const char* expr) { parse(expr); }
 
     private:
         int addVar(const char* name);
         template<typename T>
         float calculate(T& stack) const;
+        bool compile();
+        void execute(float* regs, void* userData) const;
+        void executeBlock(float* const* regs, int count, int offset, void* userData) const;
+        void run(float* regs, const float* vars, void* userData) const;
 
     private:
         std::vector<std::pair<std::string, float>> m_constants;
@@ -54,6 +74,7 @@ namespace RoxFormats
             char argsCount;
             char returnCount;
             Function f;
+            FunctionN fn;
         };
         std::vector<UserFunction> m_functions;
 
@@ -102,49 +123,21 @@ namespace RoxFormats
             int m_size;
         };
 
-        class RoxStack
-        {
-        public:
-            void clear() { m_pos = 0; }
-            void add(const float& f) { m_buf[++m_pos] = f; }
-            float& get() { return m_buf[m_pos]; }
-            RoxMath::Vector2& get2() { return getN<RoxMath::Vector2>(); }
-            RoxMath::Vector3& get3() { return getN<RoxMath::Vector3>(); }
-            RoxMath::Vector4& get4() { return getN<RoxMath::Vector4>(); }
-
-            template<int Count> void pop() { m_pos -= Count; }
-            void pop() { --m_pos; }
-            void call(const UserFunction& f);
-            bool empty() const { return m_pos <= 0; }
-
-        public:
-            // m_buf[0] is reserved for constant state
-            void setSize(int size) { m_buf.resize(size + 1, 0.0f); m_pos = 0; }
-            void setConstant(float value) { m_buf.resize(1, value); m_pos = 0; }
-
-        public:
-            RoxStack() { setConstant(0.0f); }
-
-        public:
-            void validateOp(size_t idx) {}
-
-        public:
-            void markScalar() {}
-            void markVec2() {}
-            void markVec3() {}
-            void markVec4() {}
-
-        private:
-            template<typename T>
-            T& getN() { return *(reinterpret_cast<T*>(&m_buf[m_pos - sizeof(T) / sizeof(float) + 1])); }
+        int m_opsCount;
 
-        private:
-            std::vector<float> m_buf;
-            int m_pos;
+        // compiled register bytecode, registers are [vars][constants][temporaries]
+        struct Instruction
+        {
+            unsigned char op;
+            unsigned short a, b, c, dst;
         };
 
-        mutable RoxStack m_stack;
-        int m_opsCount;
+        std::vector<Instruction> m_code;
+        std::vector<unsigned short> m_callOperands; // call args followed by return registers
+        std::vector<float> m_constValues;
+        std::vector<unsigned short> m_results; // up to 4 top stack values, the last one is the scalar result
+        int m_regsCount;
+        int m_compiledVarsCount;
     };
 
 } // namespace RoxFormats
@@ -1,10 +1,13 @@
 //nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
 
 #include "RoxMesh.h"
+#include "RoxMath/RoxScalar.h"
 #include "RoxMemory/RoxMemoryReader.h"
 #include "RoxMemory/RoxMemoryWriter.h"
 #include "RoxMemory/RoxInvalidObject.h"
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include <stdint.h>
 
 namespace { const char nms_sign[] = { 'n','y','a',' ','m','e','s','h' }; }
@@ -163,14 +166,14 @@ namespace RoxFormats
             e.type = reader.read<uchar>();
             e.dimension = reader.read<uchar>();
             e.data_type = version > 1 ? (vertex_atrib_type)reader.read<uchar>() : float32;
-            switch (e.data_type)
+            const unsigned int type_size = get_type_size(e.data_type);
+            if (!type_size)
             {
-            case float16: vertex_stride += e.dimension * 2; break;
-            case float32: vertex_stride += e.dimension * 4; break;
-            default:
                 *this = nms_mesh_chunk();
                 return 0;
-            };
+            }
+
+            vertex_stride += e.dimension * type_size;
             e.semantics = reader.readString();
         }
 
@@ -244,6 +247,59 @@ namespace RoxFormats
         return reader.getOffset();
     }
 
+    void nms_mesh_chunk::read_element(const element& e, unsigned int vertex_idx, float* out) const
+    {
+        const char* data = (const char*)vertices_data + size_t(vertex_idx) * vertex_stride + e.offset;
+        for (unsigned int i = 0; i < e.dimension; ++i)
+        {
+            switch (e.data_type)
+            {
+            case float32: memcpy(out + i, data + i * 4, 4); break;
+            case float16:
+            {
+                uint16_t h;
+                memcpy(&h, data + i * 2, 2);
+                out[i] = RoxMath::half_to_float(h);
+            }
+            break;
+            case uint8: out[i] = ((const uint8_t*)data)[i] / 255.0f; break;
+            case int8: out[i] = std::max(((const int8_t*)data)[i] / 127.0f, -1.0f); break;
+            case uint16:
+            case int16:
+            {
+                uint16_t v;
+                memcpy(&v, data + i * 2, 2);
+                out[i] = e.data_type == uint16 ? v / 65535.0f : std::max(int16_t(v) / 32767.0f, -1.0f);
+            }
+            break;
+            }
+        }
+
+        if (e.type != pos || (e.data_type != int16 && e.data_type != uint16))
+            return;
+
+        for (unsigned int i = 0; i < e.dimension && i < 3; ++i)
+        {
+            const float from = (&aabb_min.x)[i], to = (&aabb_max.x)[i];
+            out[i] = e.data_type == uint16 ? from + out[i] * (to - from) : (from + to) * 0.5f + out[i] * (to - from) * 0.5f;
+        }
+    }
+
+    unsigned int nms_mesh_chunk::get_type_size(vertex_atrib_type type)
+    {
+        switch (type)
+        {
+        case float32: return 4;
+        case float16:
+        case int16:
+        case uint16: return 2;
+        case uint8:
+        case int8: return 1;
+        }
+
+        return 0;
+    }
+
     size_t nms_mesh_chunk::write_to_buf(void* to_data, size_t to_size) const
     {
         RoxMemory::RoxMemoryWriter writer(to_data, to_size);
@@ -595,4 +651,73 @@ namespace RoxFormats
         return writer.getOffset();
     }
 
+    bool nms_clusters_chunk::read(const void* data, size_t size, int /*version*/)
+    {
+        *this = nms_clusters_chunk();
+
+        if (!data || !size)
+            return false;
+
+        RoxMemory::RoxMemoryReader reader(data, size);
+
+        lods.resize(reader.read<uint16_t>());
+        for (size_t i = 0; i < lods.size(); ++i)
+        {
+            lod& l = lods[i];
+            l.groups.resize(reader.read<uint16_t>());
+            for (size_t j = 0; j < l.groups.size(); ++j)
+            {
+                const uint32_t count = reader.read<uint32_t>();
+                if (!reader.checkRemained(size_t(count) * sizeof(float) * 10))
+                {
+                    *this = nms_clusters_chunk();
+                    return false;
+                }
+
+                std::vector<cluster>& clusters = l.groups[j].clusters;
+                clusters.resize(count);
+                for (size_t k = 0; k < clusters.size(); ++k)
+                {
+                    cluster& c = clusters[k];
+                    c.offset = reader.read<uint32_t>();
+                    c.count = reader.read<uint32_t>();
+                    c.center = reader.read<RoxMath::Vector3>();
+                    c.radius = reader.read<float>();
+                    c.cone_axis = reader.read<RoxMath::Vector3>();
+                    c.cone_cutoff = reader.read<float>();
+                }
+            }
+        }
+
+        return true;
+    }
+
+    size_t nms_clusters_chunk::write_to_buf(void* to_data, size_t to_size) const
+    {
+        RoxMemory::RoxMemoryWriter writer(to_data, to_size);
+        writer.writeUshort((unsigned short)lods.size());
+        for (size_t i = 0; i < lods.size(); ++i)
+        {
+            const lod& l = lods[i];
+            writer.writeUshort((unsigned short)l.groups.size());
+            for (size_t j = 0; j < l.groups.size(); ++j)
+            {
+                const std::vector<cluster>& clusters = l.groups[j].clusters;
+                writer.writeUint((unsigned int)clusters.size());
+                for (size_t k = 0; k < clusters.size(); ++k)
+                {
+                    const cluster& c = clusters[k];
+                    writer.writeUint(c.offset);
+                    writer.writeUint(c.count);
+                    writer.write(c.center);
+                    writer.writeFloat(c.radius);
+                    writer.write(c.cone_axis);
+                    writer.writeFloat(c.cone_cutoff);
+                }
+            }
+        }
+
+        return writer.getOffset();
+    }
+
 }
@@ -28,7 +28,8 @@ namespace RoxFormats
             mesh_data,
             skeleton,
             materials,
-            general
+            general,
+            clusters
         };
 
         std::vector<chunk_info> chunks;
@@ -79,11 +80,15 @@ namespace RoxFormats
             tc0 = 100
         };
 
+        //integer types are normalized, positions stored as int16 or uint16 map [-1,1] or [0,1] to the chunk aabb
         enum vertex_atrib_type
         {
             float16,
             float32,
-            uint8
+            uint8,
+            int16,
+            uint16,
+            int8
         };
 
         enum ind_size
@@ -150,6 +155,10 @@ namespace RoxFormats
     public:
         size_t read_header(const void* data, size_t size, int version); //0 if invalid
 
+    public:
+        void read_element(const element& e, unsigned int vertex_idx, float* out) const; //out must hold e.dimension floats, positions are dequantized
+        static unsigned int get_type_size(vertex_atrib_type type);
+
     public:
         size_t get_chunk_size() const { return write_to_buf(0, 0); }
         size_t write_to_buf(void* to_data, size_t to_size) const;
@@ -235,6 +244,37 @@ namespace RoxFormats
         size_t write_to_buf(void* to_data, size_t to_size) const;
     };
 
+    //triangle ranges of the mesh chunk groups with their bounds, for culling parts of a group
+    struct nms_clusters_chunk
+    {
+        struct cluster
+        {
+            unsigned int offset; //in the mesh indices, the clusters of a group cover it in order
+            unsigned int count;
+
+            RoxMath::Vector3 center;
+            float radius;
+
+            //back facing from the camera if dot(center-camera,cone_axis)>=cone_cutoff*length(center-camera)+radius
+            RoxMath::Vector3 cone_axis;
+            float cone_cutoff; //1 if never back facing
+
+            cluster() : offset(0), count(0), radius(0.0f), cone_cutoff(1.0f) {}
+        };
+
+        struct group { std::vector<cluster> clusters; };
+        struct lod { std::vector<group> groups; };
+
+        std::vector<lod> lods; //as in the mesh chunk
+
+    public:
+        bool read(const void* data, size_t size, int version);
+
+    public:
+        size_t get_chunk_size() const { return write_to_buf(0, 0); }
+        size_t write_to_buf(void* to_data, size_t to_size) const;
+    };
+
     struct nms_general_chunk
     {
         struct string_param
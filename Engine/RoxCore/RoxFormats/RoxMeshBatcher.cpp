@@ -0,0 +1,384 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#include "RoxMeshBatcher.h"
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+namespace RoxFormats
+{
+
+    namespace
+    {
+        struct source
+        {
+            nms_mesh_chunk mesh;
+            nms_material_chunk materials;
+        };
+
+        bool has_word(const std::string& semantics, const char* word) { return semantics.find(word) != std::string::npos; }
+
+        bool is_direction(const nms_mesh_chunk::element& e)
+        {
+            return e.type == nms_mesh_chunk::normal || has_word(e.semantics, "tangent") || has_word(e.semantics, "binormal");
+        }
+
+        bool read_source(const void* data, size_t size, source& out)
+        {
+            nms file;
+            if (!file.read_chunks_info(data, size))
+                return false;
+
+            int meshes = 0;
+            for (size_t i = 0; i < file.chunks.size(); ++i)
+            {
+                const nms::chunk_info& c = file.chunks[i];
+                switch (c.type)
+                {
+                case nms::mesh_data:
+                    if (meshes++ || !out.mesh.read_header(c.data, c.size, file.version))
+                        return false;
+                    break;
+
+                case nms::materials:
+                    if (!out.materials.read(c.data, c.size, file.version))
+                        return false;
+                    break;
+
+                case nms::skeleton:
+                {
+                    nms_skeleton_chunk skeleton;
+                    if (!skeleton.read(c.data, c.size, file.version) || !skeleton.bones.empty())
+                        return false;
+                }
+                break;
+                }
+            }
+
+            if (!meshes || out.mesh.lods.empty() || !out.mesh.verts_count || !out.mesh.vertices_data)
+                return false;
+
+            const std::vector<nms_mesh_chunk::group>& groups = out.mesh.lods[0].groups;
+            for (size_t i = 0; i < groups.size(); ++i)
+            {
+                if (groups[i].element_type != nms_mesh_chunk::triangles)
+                    return false;
+            }
+
+            return true;
+        }
+
+        bool merged_layout(const nms_mesh_chunk& mesh, std::vector<nms_mesh_chunk::element>& out, std::string& key)
+        {
+            out.resize(mesh.elements.size());
+            key.clear();
+            unsigned int offset = 0;
+            bool has_pos = false;
+            for (size_t i = 0; i < mesh.elements.size(); ++i)
+            {
+                const nms_mesh_chunk::element& e = mesh.elements[i];
+                nms_mesh_chunk::element& o = out[i] = e;
+                if (e.type == nms_mesh_chunk::pos)
+                {
+                    o.data_type = nms_mesh_chunk::float32;
+                    o.dimension = 3;
+                    has_pos = true;
+                }
+                else if (is_direction(e))
+                {
+                    //packed directions would have to be decoded first
+                    if ((e.data_type != nms_mesh_chunk::float32 && e.data_type != nms_mesh_chunk::float16) || e.dimension < 3 || e.dimension > 4)
+                        return false;
+
+                    o.data_type = nms_mesh_chunk::float32;
+                }
+
+                o.offset = offset;
+                offset += o.dimension * nms_mesh_chunk::get_type_size(o.data_type);
+
+                char buf[64];
+                snprintf(buf, sizeof(buf), "%u:%u:%d:", o.type, o.dimension, int(o.data_type));
+                key.append(buf).append(o.semantics).append(";");
+            }
+
+            return has_pos && offset > 0;
+        }
+
+        bool is_same(const nms_material_chunk::material_info& a, const nms_material_chunk::material_info& b)
+        {
+            if (a.name != b.name || a.textures.size() != b.textures.size() || a.strings.size() != b.strings.size()
+                || a.vectors.size() != b.vectors.size() || a.ints.size() != b.ints.size())
+                return false;
+
+            for (size_t i = 0; i < a.textures.size(); ++i)
+            {
+                if (a.textures[i].semantics != b.textures[i].semantics || a.textures[i].filename != b.textures[i].filename)
+                    return false;
+            }
+
+            for (size_t i = 0; i < a.strings.size(); ++i)
+            {
+                if (a.strings[i].name != b.strings[i].name || a.strings[i].value != b.strings[i].value)
+                    return false;
+            }
+
+            for (size_t i = 0; i < a.vectors.size(); ++i)
+            {
+                const RoxMath::Vector4& va = a.vectors[i].value, & vb = b.vectors[i].value;
+                if (a.vectors[i].name != b.vectors[i].name || va.x != vb.x || va.y != vb.y || va.z != vb.z || va.w != vb.w)
+                    return false;
+            }
+
+            for (size_t i = 0; i < a.ints.size(); ++i)
+            {
+                if (a.ints[i].name != b.ints[i].name || a.ints[i].value != b.ints[i].value)
+                    return false;
+            }
+
+            return true;
+        }
+
+        unsigned int read_index(const nms_mesh_chunk& mesh, unsigned int idx)
+        {
+            switch (mesh.index_size)
+            {
+            case nms_mesh_chunk::index2b: return ((const unsigned short*)mesh.indices_data)[idx];
+            case nms_mesh_chunk::index4b: return ((const unsigned int*)mesh.indices_data)[idx];
+            default: return idx;
+            }
+        }
+    }
+
+    bool nms_static_batcher::get_layout_key(const void* data, size_t size, std::string& key)
+    {
+        source s;
+        std::vector<nms_mesh_chunk::element> elements;
+        return read_source(data, size, s) && merged_layout(s.mesh, elements, key);
+    }
+
+    bool nms_static_batcher::add(const void* data, size_t size, const RoxMath::Vector3& pos, const RoxMath::Quaternion& rot, const RoxMath::Vector3& scale)
+    {
+        source s;
+        std::vector<nms_mesh_chunk::element> elements;
+        std::string key;
+        if (!read_source(data, size, s) || !merged_layout(s.mesh, elements, key))
+            return false;
+
+        if (m_elements.empty())
+        {
+            m_elements = elements;
+            m_layout_key = key;
+            m_stride = elements.back().offset + elements.back().dimension * nms_mesh_chunk::get_type_size(elements.back().data_type);
+        }
+        else if (key != m_layout_key)
+            return false;
+
+        const nms_mesh_chunk& mesh = s.mesh;
+        const unsigned int base = m_verts_count;
+        m_vertices.resize(m_vertices.size() + size_t(mesh.verts_count) * m_stride);
+        std::vector<RoxMath::Vector3> positions(mesh.verts_count);
+        for (unsigned int i = 0; i < mesh.verts_count; ++i)
+        {
+            char* to = &m_vertices[size_t(base + i) * m_stride];
+            for (size_t j = 0; j < elements.size(); ++j)
+            {
+                const nms_mesh_chunk::element& from = mesh.elements[j];
+                const nms_mesh_chunk::element& e = elements[j];
+                if (e.type != nms_mesh_chunk::pos && !is_direction(e))
+                {
+                    memcpy(to + e.offset, (const char*)mesh.vertices_data + size_t(i) * mesh.vertex_stride + from.offset,
+                           e.dimension * nms_mesh_chunk::get_type_size(e.data_type));
+                    continue;
+                }
+
+                float v[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                mesh.read_element(from, i, v);
+                RoxMath::Vector3 r(v[0], v[1], v[2]);
+                if (e.type == nms_mesh_chunk::pos)
+                    positions[i] = r = rot.rotate(r * scale) + pos;
+                else if (e.type == nms_mesh_chunk::normal)
+                    r = RoxMath::Vector3::normalize(rot.rotate(r / scale));
+                else
+                    r = RoxMath::Vector3::normalize(rot.rotate(r * scale));
+
+                float* out = (float*)(to + e.offset);
+                out[0] = r.x, out[1] = r.y, out[2] = r.z;
+                if (e.dimension > 3)
+                    out[3] = v[3];
+            }
+        }
+
+        //mirroring transforms flip the winding
+        const bool flip = scale.x * scale.y * scale.z < 0.0f;
+
+        const std::vector<nms_mesh_chunk::group>& groups = mesh.lods[0].groups;
+        for (size_t i = 0; i < groups.size(); ++i)
+        {
+            const nms_mesh_chunk::group& g = groups[i];
+            if (g.count < 3 || g.offset + g.count > (mesh.index_size ? mesh.indices_count : mesh.verts_count))
+                continue;
+
+            nms_material_chunk::material_info default_material;
+            const nms_material_chunk::material_info& m = g.material_idx < s.materials.materials.size() ? s.materials.materials[g.material_idx] : default_material;
+            size_t material_idx = 0;
+            while (material_idx < m_materials.materials.size() && !is_same(m_materials.materials[material_idx], m))
+                ++material_idx;
+
+            if (material_idx == m_materials.materials.size())
+            {
+                m_materials.materials.push_back(m);
+                m_groups.resize(m_groups.size() + 1);
+            }
+
+            batch_group& bg = m_groups[material_idx];
+            nms_clusters_chunk::cluster submesh;
+            submesh.offset = (unsigned int)bg.indices.size();
+            submesh.count = g.count - g.count % 3;
+
+            RoxMath::Vector3 amin, amax;
+            for (unsigned int j = 0; j < submesh.count; j += 3)
+            {
+                unsigned int t[3];
+                for (int k = 0; k < 3; ++k)
+                {
+                    t[k] = read_index(mesh, g.offset + j + k);
+                    if (t[k] >= mesh.verts_count)
+                        t[k] = 0;
+
+                    const RoxMath::Vector3& p = positions[t[k]];
+                    amin = j || k ? RoxMath::Vector3::min(amin, p) : p;
+                    amax = j || k ? RoxMath::Vector3::max(amax, p) : p;
+                }
+
+                if (flip)
+                    std::swap(t[1], t[2]);
+
+                for (int k = 0; k < 3; ++k)
+                    bg.indices.push_back(base + t[k]);
+            }
+
+            submesh.center = (amin + amax) * 0.5f;
+            for (unsigned int j = 0; j < submesh.count; ++j)
+                submesh.radius = std::max(submesh.radius, (positions[bg.indices[submesh.offset + j] - base] - submesh.center).length());
+
+            bg.aabb_min = bg.submeshes.empty() ? amin : RoxMath::Vector3::min(bg.aabb_min, amin);
+            bg.aabb_max = bg.submeshes.empty() ? amax : RoxMath::Vector3::max(bg.aabb_max, amax);
+            bg.submeshes.push_back(submesh);
+
+            ++m_stats.groups_before;
+            m_stats.triangles += submesh.count / 3;
+        }
+
+        m_verts_count += mesh.verts_count;
+        m_stats.verts = m_verts_count;
+        m_stats.groups_after = (unsigned int)m_groups.size();
+        ++m_stats.meshes;
+        return true;
+    }
+
+    bool nms_static_batcher::build(nms_mesh_chunk& mesh, nms_material_chunk& materials, nms_clusters_chunk& clusters)
+    {
+        if (!m_verts_count)
+            return false;
+
+        mesh = nms_mesh_chunk();
+        mesh.elements = m_elements;
+        mesh.verts_count = m_verts_count;
+        mesh.vertex_stride = m_stride;
+        mesh.vertices_data = m_vertices.data();
+        mesh.index_size = m_verts_count > 65536 ? nms_mesh_chunk::index4b : nms_mesh_chunk::index2b;
+
+        unsigned int count = 0;
+        for (size_t i = 0; i < m_groups.size(); ++i)
+            count += (unsigned int)m_groups[i].indices.size();
+
+        m_indices.resize(size_t(count) * mesh.index_size);
+        mesh.indices_count = count;
+        mesh.indices_data = m_indices.data();
+        mesh.lods.resize(1);
+        clusters.lods.clear();
+        clusters.lods.resize(1);
+
+        unsigned int offset = 0;
+        for (size_t i = 0; i < m_groups.size(); ++i)
+        {
+            const batch_group& bg = m_groups[i];
+            for (size_t j = 0; j < bg.indices.size(); ++j)
+            {
+                if (mesh.index_size == nms_mesh_chunk::index2b)
+                    ((unsigned short*)mesh.indices_data)[offset + j] = (unsigned short)bg.indices[j];
+                else
+                    ((unsigned int*)mesh.indices_data)[offset + j] = bg.indices[j];
+            }
+
+            nms_mesh_chunk::group g;
+            g.name = m_materials.materials[i].name;
+            g.material_idx = (unsigned int)i;
+            g.offset = offset;
+            g.count = (unsigned int)bg.indices.size();
+            g.aabb_min = bg.aabb_min;
+            g.aabb_max = bg.aabb_max;
+            mesh.lods[0].groups.push_back(g);
+
+            mesh.aabb_min = i ? RoxMath::Vector3::min(mesh.aabb_min, bg.aabb_min) : bg.aabb_min;
+            mesh.aabb_max = i ? RoxMath::Vector3::max(mesh.aabb_max, bg.aabb_max) : bg.aabb_max;
+
+            nms_clusters_chunk::group cg;
+            cg.clusters = bg.submeshes;
+            for (size_t j = 0; j < cg.clusters.size(); ++j)
+                cg.clusters[j].offset += offset;
+            clusters.lods[0].groups.push_back(cg);
+
+            offset += g.count;
+        }
+
+        materials = m_materials;
+        return true;
+    }
+
+    bool nms_static_batcher::build_nms(std::vector<char>& out)
+    {
+        nms_mesh_chunk mesh;
+        nms_material_chunk materials;
+        nms_clusters_chunk clusters;
+        if (!build(mesh, materials, clusters))
+            return false;
+
+        std::vector<char> chunks[3];
+        chunks[0].resize(mesh.get_chunk_size());
+        mesh.write_to_buf(chunks[0].data(), chunks[0].size());
+        chunks[1].resize(materials.get_chunk_size());
+        materials.write_to_buf(chunks[1].data(), chunks[1].size());
+        chunks[2].resize(clusters.get_chunk_size());
+        clusters.write_to_buf(chunks[2].data(), chunks[2].size());
+
+        const unsigned int types[3] = { nms::mesh_data, nms::materials, nms::clusters };
+        nms file;
+        file.version = nms::latest_version;
+        for (int i = 0; i < 3; ++i)
+        {
+            nms::chunk_info c;
+            c.type = types[i];
+            c.size = (unsigned int)chunks[i].size();
+            c.data = chunks[i].data();
+            file.chunks.push_back(c);
+        }
+
+        out.resize(file.get_nms_size());
+        return file.write_to_buf(out.data(), out.size()) == out.size();
+    }
+
+    void nms_static_batcher::clear()
+    {
+        m_elements.clear();
+        m_layout_key.clear();
+        m_stride = m_verts_count = 0;
+        m_vertices.clear();
+        m_indices.clear();
+        m_materials = nms_material_chunk();
+        m_groups.clear();
+        m_stats = stats();
+    }
+
+}
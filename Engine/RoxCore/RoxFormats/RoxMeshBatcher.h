@@ -0,0 +1,69 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#pragma once
+
+#include "RoxMesh.h"
+#include "RoxMath/RoxQuaternion.h"
+#include <vector>
+#include <string>
+#include <stddef.h>
+
+namespace RoxFormats
+{
+
+    //merges static meshes into a single one with their transforms applied to the vertices
+    //groups with equal materials are joined, the merged source groups become their clusters so that they are still culled separately
+    //positions, normals and elements named "tangent" or "binormal" become float32, other elements are copied as is
+    //only the first lod of the source meshes is merged, meshes with a skeleton or non-triangle groups can't be batched
+    class nms_static_batcher
+    {
+    public:
+        struct stats
+        {
+            unsigned int meshes;
+            unsigned int groups_before; //of the added meshes
+            unsigned int groups_after;
+            unsigned int verts;
+            unsigned int triangles;
+
+            stats() : meshes(0), groups_before(0), groups_after(0), verts(0), triangles(0) {}
+        };
+
+    public:
+        //describes the merged vertex layout, meshes with equal keys can be merged together, false if the nms can't be batched
+        static bool get_layout_key(const void* data, size_t size, std::string& key);
+
+        //false if the nms can't be batched or its layout differs from the added meshes
+        bool add(const void* data, size_t size, const RoxMath::Vector3& pos, const RoxMath::Quaternion& rot, const RoxMath::Vector3& scale);
+
+        //the mesh chunk points to the batcher buffers, false if nothing was added
+        bool build(nms_mesh_chunk& mesh, nms_material_chunk& materials, nms_clusters_chunk& clusters);
+        bool build_nms(std::vector<char>& out);
+
+        void clear();
+
+        const stats& get_stats() const { return m_stats; }
+
+    private:
+        struct batch_group
+        {
+            std::vector<unsigned int> indices;
+            std::vector<nms_clusters_chunk::cluster> submeshes; //offsets are within the group
+            RoxMath::Vector3 aabb_min, aabb_max;
+        };
+
+        std::vector<nms_mesh_chunk::element> m_elements;
+        std::string m_layout_key;
+        unsigned int m_stride;
+        unsigned int m_verts_count;
+        std::vector<char> m_vertices;
+        std::vector<char> m_indices;
+        nms_material_chunk m_materials;
+        std::vector<batch_group> m_groups; //per material
+        stats m_stats;
+
+    public:
+        nms_static_batcher() : m_stride(0), m_verts_count(0) {}
+    };
+
+}
@@ -0,0 +1,353 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#include "RoxMeshClusterizer.h"
+#include <algorithm>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+namespace RoxFormats
+{
+
+    namespace
+    {
+        typedef RoxMath::Vector3 vec3;
+
+        //greedy growth over the shared vertices, the next triangle is the nearest to the cluster center
+        //with a penalty for the normals deviation, sizes receive the triangles count of each cluster
+        void build_clusters(const std::vector<vec3>& positions, const unsigned int* indices, unsigned int tris,
+                            unsigned int max_triangles, float cone_weight, std::vector<unsigned int>& order, std::vector<unsigned int>& sizes)
+        {
+            std::vector<vec3> centroids(tris), normals(tris);
+            for (unsigned int i = 0; i < tris; ++i)
+            {
+                const vec3& a = positions[indices[i * 3]], & b = positions[indices[i * 3 + 1]], & c = positions[indices[i * 3 + 2]];
+                centroids[i] = (a + b + c) / 3.0f;
+                const vec3 n = vec3::cross(b - a, c - a);
+                const float len = n.length();
+                normals[i] = len > 0.0f ? n / len : vec3();
+            }
+
+            std::vector<unsigned int> first(positions.size() + 1, 0), adjacent(size_t(tris) * 3);
+            for (size_t i = 0; i < adjacent.size(); ++i)
+                ++first[indices[i] + 1];
+            for (size_t i = 1; i < first.size(); ++i)
+                first[i] += first[i - 1];
+
+            std::vector<unsigned int> fill(first.begin(), first.end() - 1);
+            for (size_t i = 0; i < adjacent.size(); ++i)
+                adjacent[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+            std::vector<char> used(tris, 0);
+            std::vector<unsigned int> stamps(tris, 0), candidates;
+            unsigned int done = 0, scan = 0, stamp = 0;
+            while (done < tris)
+            {
+                //the next cluster starts next to the previous one, so that the leftovers stay connected
+                unsigned int t = tris;
+                for (size_t i = 0; i < candidates.size() && t == tris; ++i)
+                {
+                    if (!used[candidates[i]])
+                        t = candidates[i];
+                }
+
+                if (t == tris)
+                {
+                    while (used[scan])
+                        ++scan;
+                    t = scan;
+                }
+
+                candidates.clear();
+                ++stamp;
+
+                vec3 center, normal;
+                unsigned int size = 0;
+                for (;;)
+                {
+                    used[t] = 1;
+                    order.push_back(t);
+                    ++done;
+                    ++size;
+                    center += (centroids[t] - center) / float(size);
+                    normal += normals[t];
+
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        const unsigned int v = indices[t * 3 + k];
+                        for (unsigned int j = first[v]; j < first[v + 1]; ++j)
+                        {
+                            const unsigned int a = adjacent[j];
+                            if (used[a] || stamps[a] == stamp)
+                                continue;
+
+                            stamps[a] = stamp;
+                            candidates.push_back(a);
+                        }
+                    }
+
+                    if (size >= max_triangles || done == tris)
+                        break;
+
+                    const float normal_len = normal.length();
+                    const vec3 axis = normal_len > 0.0f ? normal / normal_len : vec3();
+
+                    int best = -1;
+                    float best_score = 0.0f;
+                    for (int i = 0; i < (int)candidates.size(); ++i)
+                    {
+                        const unsigned int c = candidates[i];
+                        if (used[c])
+                        {
+                            candidates[i--] = candidates.back();
+                            candidates.pop_back();
+                            continue;
+                        }
+
+                        const float score = (centroids[c] - center).length() * (1.0f + cone_weight * (1.0f - normals[c].dot(axis)));
+                        if (best < 0 || score < best_score)
+                            best = i, best_score = score;
+                    }
+
+                    if (best >= 0)
+                    {
+                        t = candidates[best];
+                        candidates[best] = candidates.back();
+                        candidates.pop_back();
+                        continue;
+                    }
+
+                    //not connected, the nearest of the next triangles in the group order
+                    while (used[scan])
+                        ++scan;
+
+                    t = tris;
+                    for (unsigned int i = scan, checked = 0; i < tris && checked < 64; ++i)
+                    {
+                        if (used[i])
+                            continue;
+
+                        const float score = (centroids[i] - center).lengthSq();
+                        if (t == tris || score < best_score)
+                            t = i, best_score = score;
+                        ++checked;
+                    }
+                }
+
+                sizes.push_back(size);
+            }
+        }
+
+        void cluster_bounds(const std::vector<vec3>& positions, const unsigned int* indices, unsigned int tris, nms_clusters_chunk::cluster& c)
+        {
+            vec3 pmin = positions[indices[0]], pmax = pmin, normal;
+            for (unsigned int i = 0; i < tris * 3; ++i)
+            {
+                pmin = vec3::min(pmin, positions[indices[i]]);
+                pmax = vec3::max(pmax, positions[indices[i]]);
+            }
+
+            c.center = (pmin + pmax) * 0.5f;
+            c.radius = 0.0f;
+            for (unsigned int i = 0; i < tris * 3; ++i)
+                c.radius = std::max(c.radius, (positions[indices[i]] - c.center).length());
+
+            std::vector<vec3> normals(tris);
+            for (unsigned int i = 0; i < tris; ++i)
+            {
+                const vec3& a = positions[indices[i * 3]], & b = positions[indices[i * 3 + 1]], & d = positions[indices[i * 3 + 2]];
+                const vec3 n = vec3::cross(b - a, d - a);
+                const float len = n.length();
+                normals[i] = len > 0.0f ? n / len : vec3();
+                normal += normals[i];
+            }
+
+            c.cone_cutoff = 1.0f;
+            const float normal_len = normal.length();
+            if (normal_len <= 0.0f)
+                return;
+
+            c.cone_axis = normal / normal_len;
+            float min_dot = 1.0f;
+            for (unsigned int i = 0; i < tris; ++i)
+            {
+                if (normals[i].lengthSq() > 0.0f)
+                    min_dot = std::min(min_dot, normals[i].dot(c.cone_axis));
+            }
+
+            //the sine of the cone spread, the test uses the sphere instead of the cone apex
+            if (min_dot > 0.0f)
+                c.cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+        }
+    }
+
+    bool nms_mesh_clusterizer::clusterize(nms_mesh_chunk& chunk, nms_clusters_chunk& out)
+    {
+        m_stats = stats();
+        out = nms_clusters_chunk();
+        if (!m_max_triangles || !chunk.indices_data || !chunk.verts_count)
+            return false;
+
+        if (chunk.index_size != nms_mesh_chunk::index2b && chunk.index_size != nms_mesh_chunk::index4b)
+            return false;
+
+        const nms_mesh_chunk::element* pos = 0;
+        for (size_t i = 0; i < chunk.elements.size() && !pos; ++i)
+        {
+            if (chunk.elements[i].type == nms_mesh_chunk::pos)
+                pos = &chunk.elements[i];
+        }
+
+        if (!pos || pos->dimension > 4)
+            return false;
+
+        std::vector<vec3> positions(chunk.verts_count);
+        for (unsigned int i = 0; i < chunk.verts_count; ++i)
+        {
+            float v[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            chunk.read_element(*pos, i, v);
+            positions[i] = vec3(v[0], v[1], v[2]);
+        }
+
+        std::vector<unsigned int> indices(chunk.indices_count);
+        for (unsigned int i = 0; i < chunk.indices_count; ++i)
+        {
+            indices[i] = chunk.index_size == nms_mesh_chunk::index2b ? ((const uint16_t*)chunk.indices_data)[i] : ((const uint32_t*)chunk.indices_data)[i];
+            if (indices[i] >= chunk.verts_count)
+                return false;
+        }
+
+        struct range { unsigned int offset, count; size_t lod, group; };
+        std::vector<range> ranges;
+        std::vector<unsigned int> order, sizes, reordered;
+
+        out.lods.resize(chunk.lods.size());
+        for (size_t l = 0; l < chunk.lods.size(); ++l)
+        {
+            out.lods[l].groups.resize(chunk.lods[l].groups.size());
+            for (size_t g = 0; g < chunk.lods[l].groups.size(); ++g)
+            {
+                const nms_mesh_chunk::group& from = chunk.lods[l].groups[g];
+                if (from.element_type != nms_mesh_chunk::triangles || !from.count || from.count % 3)
+                    continue;
+
+                if (from.offset > chunk.indices_count || from.count > chunk.indices_count - from.offset)
+                    return false;
+
+                //levels may share index ranges, partly overlapping ones are left as is
+                bool skip = false;
+                for (size_t i = 0; i < ranges.size() && !skip; ++i)
+                {
+                    const range& r = ranges[i];
+                    if (r.offset == from.offset && r.count == from.count)
+                        out.lods[l].groups[g] = out.lods[r.lod].groups[r.group];
+                    if (r.offset < from.offset + from.count && from.offset < r.offset + r.count)
+                        skip = true;
+                }
+
+                if (skip)
+                    continue;
+
+                const unsigned int tris = from.count / 3;
+                unsigned int* group_indices = &indices[from.offset];
+
+                order.clear();
+                sizes.clear();
+                build_clusters(positions, group_indices, tris, m_max_triangles, m_cone_weight, order, sizes);
+
+                //the triangles of a cluster keep their previous order, which is optimized for the vertex cache
+                for (size_t i = 0, first = 0; i < sizes.size(); first += sizes[i++])
+                    std::sort(order.begin() + first, order.begin() + first + sizes[i]);
+
+                reordered.resize(from.count);
+                for (unsigned int i = 0; i < tris; ++i)
+                    memcpy(&reordered[i * 3], group_indices + order[i] * 3, sizeof(unsigned int) * 3);
+                memcpy(group_indices, reordered.data(), sizeof(unsigned int) * from.count);
+
+                std::vector<nms_clusters_chunk::cluster>& clusters = out.lods[l].groups[g].clusters;
+                clusters.resize(sizes.size());
+                for (size_t i = 0, offset = from.offset; i < sizes.size(); offset += sizes[i++] * 3)
+                {
+                    nms_clusters_chunk::cluster& c = clusters[i];
+                    c.offset = (unsigned int)offset;
+                    c.count = sizes[i] * 3;
+                    cluster_bounds(positions, &indices[offset], sizes[i], c);
+                    if (c.cone_cutoff < 1.0f)
+                        ++m_stats.cone_clusters;
+                }
+
+                m_stats.triangles += tris;
+                m_stats.clusters += (unsigned int)clusters.size();
+
+                range r = { from.offset, from.count, l, g };
+                ranges.push_back(r);
+            }
+        }
+
+        m_indices.resize(size_t(chunk.indices_count) * chunk.index_size);
+        for (unsigned int i = 0; i < chunk.indices_count; ++i)
+        {
+            if (chunk.index_size == nms_mesh_chunk::index2b)
+                ((uint16_t*)m_indices.data())[i] = (uint16_t)indices[i];
+            else
+                ((uint32_t*)m_indices.data())[i] = indices[i];
+        }
+
+        chunk.indices_data = m_indices.data();
+        return true;
+    }
+
+    bool nms_mesh_clusterizer::clusterize_nms(const void* data, size_t size, std::vector<char>& out)
+    {
+        nms file;
+        if (!file.read_chunks_info(data, size))
+            return false;
+
+        stats total;
+        m_chunks.clear();
+        for (size_t i = 0; i < file.chunks.size(); ++i)
+        {
+            if (file.chunks[i].type == nms::clusters)
+            {
+                file.chunks.erase(file.chunks.begin() + i--);
+                continue;
+            }
+
+            nms::chunk_info& c = file.chunks[i];
+            if (c.type != nms::mesh_data)
+                continue;
+
+            nms_mesh_chunk mesh;
+            nms_clusters_chunk clusters;
+            if (!mesh.read_header(c.data, c.size, file.version) || !clusterize(mesh, clusters))
+                return false;
+
+            total.triangles += m_stats.triangles;
+            total.clusters += m_stats.clusters;
+            total.cone_clusters += m_stats.cone_clusters;
+
+            m_chunks.push_back(std::vector<char>(mesh.get_chunk_size()));
+            mesh.write_to_buf(m_chunks.back().data(), m_chunks.back().size());
+            c.data = m_chunks.back().data();
+            c.size = (unsigned int)m_chunks.back().size();
+
+            m_chunks.push_back(std::vector<char>(clusters.get_chunk_size()));
+            clusters.write_to_buf(m_chunks.back().data(), m_chunks.back().size());
+
+            nms::chunk_info ci;
+            ci.type = nms::clusters;
+            ci.data = m_chunks.back().data();
+            ci.size = (unsigned int)m_chunks.back().size();
+            file.chunks.insert(file.chunks.begin() + ++i, ci);
+        }
+
+        m_stats = total;
+        m_indices.clear();
+
+        out.resize(file.get_nms_size());
+        const bool result = file.write_to_buf(out.data(), out.size()) == out.size();
+        m_chunks.clear();
+        return result;
+    }
+
+}
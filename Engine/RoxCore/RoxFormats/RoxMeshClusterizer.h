@@ -0,0 +1,49 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#pragma once
+
+#include "RoxMesh.h"
+#include <vector>
+#include <stddef.h>
+
+namespace RoxFormats
+{
+
+    //splits the indexed triangle groups into spatially compact clusters with bounding spheres and normal cones,
+    //the triangles are reordered within their groups so that every cluster is a continuous index range
+    //run after the optimizer and the lods generation, they remove the clusters chunk
+    class nms_mesh_clusterizer
+    {
+    public:
+        struct stats
+        {
+            unsigned int triangles; //in the clustered groups
+            unsigned int clusters;
+            unsigned int cone_clusters; //that can be back facing
+
+            stats() : triangles(0), clusters(0), cone_clusters(0) {}
+        };
+
+    public:
+        //the chunk points to the clusterizer indices afterwards, out has the layout of the chunk lods
+        bool clusterize(nms_mesh_chunk& chunk, nms_clusters_chunk& out);
+
+        //all mesh chunks of an nms file, each one is followed by its clusters chunk, old clusters chunks are removed
+        bool clusterize_nms(const void* data, size_t size, std::vector<char>& out);
+
+        const stats& get_stats() const { return m_stats; }
+
+    public:
+        //the cone weight trades the clusters compactness for narrower normal cones
+        nms_mesh_clusterizer(unsigned int max_triangles = 128, float cone_weight = 0.5f) :
+            m_max_triangles(max_triangles), m_cone_weight(cone_weight) {}
+
+    private:
+        unsigned int m_max_triangles;
+        float m_cone_weight;
+        stats m_stats;
+        std::vector<char> m_indices;
+        std::vector<std::vector<char> > m_chunks;
+    };
+
+}
@@ -0,0 +1,528 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#include "RoxMeshOptimizer.h"
+#include "RoxMemory/RoxHash.h"
+#include <algorithm>
+#include <string.h>
+#include <stdint.h>
+
+namespace RoxFormats
+{
+
+    namespace
+    {
+        bool read_positions(const nms_mesh_chunk& chunk, std::vector<RoxMath::Vector3>& out)
+        {
+            const nms_mesh_chunk::element* pos = 0;
+            for (size_t i = 0; i < chunk.elements.size(); ++i)
+            {
+                if (chunk.elements[i].type == nms_mesh_chunk::pos)
+                    pos = &chunk.elements[i];
+            }
+
+            if (!pos || !pos->dimension || pos->dimension > 4)
+                return false;
+
+            out.resize(chunk.verts_count);
+            for (unsigned int i = 0; i < chunk.verts_count; ++i)
+            {
+                float v[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                chunk.read_element(*pos, i, v);
+                out[i] = RoxMath::Vector3(v[0], v[1], v[2]);
+            }
+
+            return true;
+        }
+
+        //remap points every vertex to the first one with the same bytes, returns the unique count
+        unsigned int weld(const char* verts, unsigned int count, unsigned int stride, std::vector<unsigned int>& remap)
+        {
+            size_t table_size = 1;
+            while (table_size < size_t(count) * 2)
+                table_size *= 2;
+
+            std::vector<unsigned int> table(table_size, ~0u);
+            remap.resize(count);
+            unsigned int unique = 0;
+            for (unsigned int i = 0; i < count; ++i)
+            {
+                const char* v = verts + size_t(i) * stride;
+                size_t slot = size_t(RoxMemory::hash64((const void*)v, stride)) & (table_size - 1);
+                while (table[slot] != ~0u && memcmp(verts + size_t(table[slot]) * stride, v, stride) != 0)
+                    slot = (slot + 1) & (table_size - 1);
+
+                if (table[slot] == ~0u)
+                {
+                    table[slot] = i;
+                    ++unique;
+                }
+
+                remap[i] = table[slot];
+            }
+
+            return unique;
+        }
+
+        //Sander et al. 2007, fans around the vertices still in the cache, falls back to recently used ones at dead ends
+        void tipsify(const unsigned int* indices, size_t count, unsigned int verts_count, unsigned int cache_size, unsigned int* out)
+        {
+            const size_t tris_count = count / 3;
+
+            std::vector<unsigned int> live(verts_count, 0);
+            for (size_t i = 0; i < count; ++i)
+                ++live[indices[i]];
+
+            std::vector<unsigned int> adj_offset(verts_count + 1, 0);
+            for (unsigned int v = 0; v < verts_count; ++v)
+                adj_offset[v + 1] = adj_offset[v] + live[v];
+
+            std::vector<unsigned int> adj(count), fill(adj_offset.begin(), adj_offset.end() - 1);
+            for (size_t i = 0; i < count; ++i)
+                adj[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+            std::vector<unsigned int> cache_time(verts_count, 0);
+            std::vector<char> emitted(tris_count, 0);
+            std::vector<unsigned int> dead_end, candidates;
+            dead_end.reserve(count);
+            unsigned int time = cache_size + 1;
+            unsigned int cursor = 0;
+            size_t out_count = 0;
+
+            int fanning = count ? (int)indices[0] : -1;
+            while (fanning >= 0)
+            {
+                candidates.clear();
+                for (unsigned int a = adj_offset[fanning]; a < adj_offset[fanning + 1]; ++a)
+                {
+                    const unsigned int t = adj[a];
+                    if (emitted[t])
+                        continue;
+
+                    emitted[t] = 1;
+                    for (int j = 0; j < 3; ++j)
+                    {
+                        const unsigned int v = indices[t * 3 + j];
+                        out[out_count++] = v;
+                        dead_end.push_back(v);
+                        candidates.push_back(v);
+                        --live[v];
+                        if (time - cache_time[v] > cache_size)
+                            cache_time[v] = time++;
+                    }
+                }
+
+                //the candidate that stays in the cache longest while its remaining triangles are emitted
+                int best = -1, best_priority = -1;
+                for (size_t i = 0; i < candidates.size(); ++i)
+                {
+                    const unsigned int v = candidates[i];
+                    if (!live[v])
+                        continue;
+
+                    int priority = 0;
+                    if (time - cache_time[v] + 2 * live[v] <= cache_size)
+                        priority = int(time - cache_time[v]);
+
+                    if (priority > best_priority)
+                    {
+                        best_priority = priority;
+                        best = (int)v;
+                    }
+                }
+
+                if (best < 0)
+                {
+                    while (!dead_end.empty() && best < 0)
+                    {
+                        const unsigned int v = dead_end.back();
+                        dead_end.pop_back();
+                        if (live[v])
+                            best = (int)v;
+                    }
+
+                    while (best < 0 && cursor < verts_count)
+                    {
+                        if (live[cursor])
+                            best = (int)cursor;
+                        ++cursor;
+                    }
+                }
+
+                fanning = best;
+            }
+        }
+
+        //splits the cache-ordered triangles into clusters that can be reordered at a small acmr cost,
+        //then draws the clusters facing outwards first, they are likely to occlude the rest
+        void sort_clusters(unsigned int* indices, size_t count, const std::vector<RoxMath::Vector3>& positions,
+                           unsigned int cache_size, float threshold)
+        {
+            const size_t tris_count = count / 3;
+            if (tris_count < 2)
+                return;
+
+            std::vector<unsigned int> tri_misses(tris_count);
+            std::vector<unsigned int> cache_time(positions.size(), 0);
+            unsigned int time = cache_size + 1;
+            for (size_t t = 0; t < tris_count; ++t)
+            {
+                unsigned int misses = 0;
+                for (int j = 0; j < 3; ++j)
+                {
+                    const unsigned int v = indices[t * 3 + j];
+                    if (time - cache_time[v] > cache_size)
+                    {
+                        cache_time[v] = time++;
+                        ++misses;
+                    }
+                }
+
+                tri_misses[t] = misses;
+            }
+
+            //hard boundaries where the cache is cold anyway, soft ones where the cluster so far is as good as the whole
+            std::vector<size_t> hard;
+            for (size_t t = 0; t < tris_count; ++t)
+            {
+                if (t == 0 || tri_misses[t] == 3)
+                    hard.push_back(t);
+            }
+
+            std::vector<size_t> split;
+            for (size_t c = 0; c < hard.size(); ++c)
+            {
+                const size_t from = hard[c], to = c + 1 < hard.size() ? hard[c + 1] : tris_count;
+                unsigned int total = 0;
+                for (size_t t = from; t < to; ++t)
+                    total += tri_misses[t];
+
+                //each soft cluster is measured from a cold cache, advancing the time invalidates it
+                const float limit = float(total) / (to - from) * threshold;
+                split.push_back(from);
+                time += cache_size + 1;
+                unsigned int misses = 0;
+                size_t start = from;
+                for (size_t t = from; t + 1 < to; ++t)
+                {
+                    for (int j = 0; j < 3; ++j)
+                    {
+                        const unsigned int v = indices[t * 3 + j];
+                        if (time - cache_time[v] > cache_size)
+                        {
+                            cache_time[v] = time++;
+                            ++misses;
+                        }
+                    }
+
+                    if (float(misses) <= limit * (t + 1 - start))
+                    {
+                        split.push_back(t + 1);
+                        start = t + 1;
+                        misses = 0;
+                        time += cache_size + 1;
+                    }
+                }
+            }
+
+            if (split.size() < 2)
+                return;
+
+            std::vector<RoxMath::Vector3> centers(split.size()), normals(split.size());
+            RoxMath::Vector3 mesh_center;
+            float mesh_area = 0.0f;
+            for (size_t c = 0; c < split.size(); ++c)
+            {
+                const size_t from = split[c], to = c + 1 < split.size() ? split[c + 1] : tris_count;
+                float area = 0.0f;
+                for (size_t t = from; t < to; ++t)
+                {
+                    const RoxMath::Vector3& a = positions[indices[t * 3]];
+                    const RoxMath::Vector3& b = positions[indices[t * 3 + 1]];
+                    const RoxMath::Vector3& d = positions[indices[t * 3 + 2]];
+                    const RoxMath::Vector3 n = RoxMath::Vector3::cross(b - a, d - a);
+                    const float tri_area = n.length();
+                    centers[c] += (a + b + d) * (tri_area / 3.0f);
+                    normals[c] += n;
+                    area += tri_area;
+                }
+
+                mesh_center += centers[c];
+                mesh_area += area;
+                if (area > 0.0f)
+                    centers[c] *= 1.0f / area;
+            }
+
+            if (mesh_area > 0.0f)
+                mesh_center *= 1.0f / mesh_area;
+
+            std::vector<std::pair<float, size_t> > keys(split.size());
+            for (size_t c = 0; c < split.size(); ++c)
+                keys[c] = std::make_pair(RoxMath::Vector3::dot(centers[c] - mesh_center, RoxMath::Vector3::normalize(normals[c])), c);
+
+            std::stable_sort(keys.begin(), keys.end(), [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) { return a.first > b.first; });
+
+            std::vector<unsigned int> sorted;
+            sorted.reserve(count);
+            for (size_t c = 0; c < keys.size(); ++c)
+            {
+                const size_t i = keys[c].second;
+                const size_t from = split[i], to = i + 1 < split.size() ? split[i + 1] : tris_count;
+                sorted.insert(sorted.end(), indices + from * 3, indices + to * 3);
+            }
+
+            std::copy(sorted.begin(), sorted.end(), indices);
+        }
+
+        unsigned int count_referenced(const unsigned int* indices, size_t count, std::vector<char>& used)
+        {
+            unsigned int referenced = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (!used[indices[i]])
+                {
+                    used[indices[i]] = 1;
+                    ++referenced;
+                }
+            }
+
+            for (size_t i = 0; i < count; ++i)
+                used[indices[i]] = 0;
+
+            return referenced;
+        }
+    }
+
+    unsigned int nms_mesh_optimizer::count_cache_misses(const unsigned int* indices, size_t count, unsigned int verts_count, unsigned int cache_size)
+    {
+        std::vector<unsigned int> cache_time(verts_count, 0);
+        unsigned int time = cache_size + 1, misses = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const unsigned int v = indices[i];
+            if (v >= verts_count)
+                continue;
+
+            if (time - cache_time[v] > cache_size)
+            {
+                cache_time[v] = time++;
+                ++misses;
+            }
+        }
+
+        return misses;
+    }
+
+    bool nms_mesh_optimizer::optimize(nms_mesh_chunk& chunk)
+    {
+        m_stats = stats();
+
+        if (!chunk.vertices_data || !chunk.vertex_stride || !chunk.verts_count)
+            return false;
+
+        std::vector<unsigned int> indices;
+        switch (chunk.index_size)
+        {
+        case nms_mesh_chunk::no_indices:
+            indices.resize(chunk.verts_count);
+            for (unsigned int i = 0; i < chunk.verts_count; ++i)
+                indices[i] = i;
+            break;
+
+        case nms_mesh_chunk::index2b:
+        {
+            indices.resize(chunk.indices_count);
+            const uint16_t* from = (const uint16_t*)chunk.indices_data;
+            for (unsigned int i = 0; i < chunk.indices_count; ++i)
+                indices[i] = from[i];
+        }
+        break;
+
+        case nms_mesh_chunk::index4b:
+            indices.resize(chunk.indices_count);
+            memcpy(indices.data(), chunk.indices_data, indices.size() * 4);
+            break;
+        }
+
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            if (indices[i] >= chunk.verts_count)
+                return false;
+        }
+
+        //triangle ranges of all lods, a range shared by several groups is optimized once
+        std::vector<std::pair<unsigned int, unsigned int> > ranges;
+        std::vector<char> touched(indices.size(), 0);
+        for (size_t i = 0; i < chunk.lods.size(); ++i)
+        {
+            for (size_t j = 0; j < chunk.lods[i].groups.size(); ++j)
+            {
+                const nms_mesh_chunk::group& g = chunk.lods[i].groups[j];
+                if (size_t(g.offset) + g.count > indices.size())
+                    return false;
+
+                const unsigned int count = g.count - g.count % 3;
+                if (g.element_type != nms_mesh_chunk::triangles || !count)
+                    continue;
+
+                bool overlaps = false;
+                for (unsigned int k = g.offset; k < g.offset + count && !overlaps; ++k)
+                    overlaps = touched[k] != 0;
+
+                if (overlaps)
+                    continue;
+
+                std::fill(touched.begin() + g.offset, touched.begin() + g.offset + count, 1);
+                ranges.push_back(std::make_pair(g.offset, count));
+            }
+        }
+
+        m_stats.index_size_before = chunk.index_size;
+        std::vector<char> used(chunk.verts_count, 0);
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            const unsigned int* r = indices.data() + ranges[i].first;
+            m_stats.triangles += ranges[i].second / 3;
+            m_stats.misses_before += count_cache_misses(r, ranges[i].second, chunk.verts_count, m_cache_size);
+            m_stats.verts_before += count_referenced(r, ranges[i].second, used);
+        }
+
+        std::vector<unsigned int> remap;
+        weld((const char*)chunk.vertices_data, chunk.verts_count, chunk.vertex_stride, remap);
+        for (size_t i = 0; i < indices.size(); ++i)
+            indices[i] = remap[indices[i]];
+
+        std::vector<RoxMath::Vector3> positions;
+        const bool has_positions = read_positions(chunk, positions);
+
+        //groups are optimized in local vertex ids to keep the tables small
+        std::vector<unsigned int> local_id(chunk.verts_count, ~0u), global_id, local, reordered;
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            unsigned int* r = indices.data() + ranges[i].first;
+            const unsigned int count = ranges[i].second;
+
+            global_id.clear();
+            local.resize(count);
+            for (unsigned int k = 0; k < count; ++k)
+            {
+                unsigned int& id = local_id[r[k]];
+                if (id == ~0u)
+                {
+                    id = (unsigned int)global_id.size();
+                    global_id.push_back(r[k]);
+                }
+
+                local[k] = id;
+            }
+
+            for (size_t k = 0; k < global_id.size(); ++k)
+                local_id[global_id[k]] = ~0u;
+
+            reordered.resize(count);
+            tipsify(local.data(), count, (unsigned int)global_id.size(), m_cache_size, reordered.data());
+
+            for (unsigned int k = 0; k < count; ++k)
+                r[k] = global_id[reordered[k]];
+
+            if (has_positions)
+                sort_clusters(r, count, positions, m_cache_size, m_overdraw_threshold);
+        }
+
+        //vertices in the order of the first use, unreferenced ones are dropped
+        std::vector<unsigned int> new_id(chunk.verts_count, ~0u);
+        unsigned int verts_count = 0;
+        m_vertices.resize(size_t(chunk.verts_count) * chunk.vertex_stride);
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            unsigned int& id = new_id[indices[i]];
+            if (id == ~0u)
+            {
+                id = verts_count++;
+                memcpy(&m_vertices[size_t(id) * chunk.vertex_stride], (const char*)chunk.vertices_data + size_t(indices[i]) * chunk.vertex_stride, chunk.vertex_stride);
+            }
+
+            indices[i] = id;
+        }
+
+        m_vertices.resize(size_t(verts_count) * chunk.vertex_stride);
+
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            const unsigned int* r = indices.data() + ranges[i].first;
+            m_stats.misses_after += count_cache_misses(r, ranges[i].second, verts_count, m_cache_size);
+            m_stats.verts_after += count_referenced(r, ranges[i].second, used);
+        }
+
+        if (verts_count <= 65536)
+        {
+            m_indices.resize(indices.size() * 2);
+            uint16_t* to = (uint16_t*)m_indices.data();
+            for (size_t i = 0; i < indices.size(); ++i)
+                to[i] = (uint16_t)indices[i];
+            chunk.index_size = nms_mesh_chunk::index2b;
+        }
+        else
+        {
+            m_indices.resize(indices.size() * 4);
+            memcpy(m_indices.data(), indices.data(), m_indices.size());
+            chunk.index_size = nms_mesh_chunk::index4b;
+        }
+
+        m_stats.index_size_after = chunk.index_size;
+
+        chunk.verts_count = verts_count;
+        chunk.vertices_data = m_vertices.data();
+        chunk.indices_count = (unsigned int)indices.size();
+        chunk.indices_data = m_indices.data();
+        return true;
+    }
+
+    bool nms_mesh_optimizer::optimize_nms(const void* data, size_t size, std::vector<char>& out)
+    {
+        nms file;
+        if (!file.read_chunks_info(data, size))
+            return false;
+
+        stats total;
+        m_chunks.clear();
+        for (size_t i = 0; i < file.chunks.size(); ++i)
+        {
+            nms::chunk_info& c = file.chunks[i];
+            if (c.type == nms::clusters) //built for the previous index order
+            {
+                file.chunks.erase(file.chunks.begin() + i--);
+                continue;
+            }
+
+            if (c.type != nms::mesh_data)
+                continue;
+
+            nms_mesh_chunk mesh;
+            if (!mesh.read_header(c.data, c.size, file.version) || !optimize(mesh))
+                return false;
+
+            total.triangles += m_stats.triangles;
+            total.misses_before += m_stats.misses_before;
+            total.misses_after += m_stats.misses_after;
+            total.verts_before += m_stats.verts_before;
+            total.verts_after += m_stats.verts_after;
+            total.index_size_before = std::max(total.index_size_before, m_stats.index_size_before);
+            total.index_size_after = std::max(total.index_size_after, m_stats.index_size_after);
+
+            m_chunks.push_back(std::vector<char>(mesh.get_chunk_size()));
+            mesh.write_to_buf(m_chunks.back().data(), m_chunks.back().size());
+            c.data = m_chunks.back().data();
+            c.size = (unsigned int)m_chunks.back().size();
+        }
+
+        m_stats = total;
+        m_vertices.clear();
+        m_indices.clear();
+
+        out.resize(file.get_nms_size());
+        const bool result = file.write_to_buf(out.data(), out.size()) == out.size();
+        m_chunks.clear();
+        return result;
+    }
+
+}
@@ -0,0 +1,59 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#pragma once
+
+#include "RoxMesh.h"
+#include <vector>
+#include <stddef.h>
+
+namespace RoxFormats
+{
+
+    //welds equal vertices, reorders the triangles of each group for the post-transform cache and overdraw (tipsify),
+    //then reorders the vertices by the first use and picks 2-byte indices whenever the vertex count allows
+    class nms_mesh_optimizer
+    {
+    public:
+        struct stats
+        {
+            unsigned int triangles;
+            unsigned int misses_before, misses_after; //simulated fifo cache misses
+            unsigned int verts_before, verts_after; //referenced by the triangles
+            unsigned int index_size_before, index_size_after;
+
+            float acmr_before() const { return triangles ? float(misses_before) / triangles : 0.0f; } //transformed vertices per triangle
+            float acmr_after() const { return triangles ? float(misses_after) / triangles : 0.0f; }
+            float atvr_before() const { return verts_before ? float(misses_before) / verts_before : 0.0f; } //1.0 is the best possible
+            float atvr_after() const { return verts_after ? float(misses_after) / verts_after : 0.0f; }
+
+            stats() : triangles(0), misses_before(0), misses_after(0), verts_before(0), verts_after(0), index_size_before(0), index_size_after(0) {}
+        };
+
+    public:
+        //the chunk points to the optimizer buffers afterwards, groups keep their index ranges
+        //strips, lines and points are only reindexed
+        bool optimize(nms_mesh_chunk& chunk);
+
+        //all mesh chunks of an nms file, clusters chunks are removed, other chunks are copied as is, stats are summed over the mesh chunks
+        bool optimize_nms(const void* data, size_t size, std::vector<char>& out);
+
+        const stats& get_stats() const { return m_stats; }
+
+    public:
+        static unsigned int count_cache_misses(const unsigned int* indices, size_t count, unsigned int verts_count, unsigned int cache_size);
+
+    public:
+        //threshold is the acmr increase allowed to split the triangles into more clusters for overdraw sorting
+        nms_mesh_optimizer(unsigned int cache_size = 16, float overdraw_threshold = 1.05f) :
+            m_cache_size(cache_size), m_overdraw_threshold(overdraw_threshold) {}
+
+    private:
+        unsigned int m_cache_size;
+        float m_overdraw_threshold;
+        stats m_stats;
+        std::vector<char> m_vertices;
+        std::vector<char> m_indices;
+        std::vector<std::vector<char> > m_chunks;
+    };
+
+}
@@ -0,0 +1,358 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#include "RoxMeshQuantizer.h"
+#include "RoxStringConvert.h"
+#include "RoxMath/RoxScalar.h"
+#include <algorithm>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+namespace RoxFormats
+{
+
+    namespace
+    {
+        enum packing
+        {
+            pack_keep,
+            pack_position,
+            pack_octahedral,
+            pack_skin_weights,
+            pack_skin_indices,
+            pack_unorm8,
+            pack_half
+        };
+
+        struct element_packing
+        {
+            packing pack;
+            nms_mesh_chunk::element from;
+            nms_mesh_chunk::element to;
+        };
+
+        bool has_word(const std::string& semantics, const char* word) { return semantics.find(word) != std::string::npos; }
+
+        int16_t to_snorm16(float v) { return int16_t(floorf(RoxMath::clamp(v, -1.0f, 1.0f) * 32767.0f + 0.5f)); }
+        uint16_t to_unorm16(float v) { return uint16_t(floorf(RoxMath::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f)); }
+        uint8_t to_unorm8(float v) { return uint8_t(floorf(RoxMath::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f)); }
+
+        void octahedral_encode(const float* n, float* out)
+        {
+            const float len = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+            float x = len > 0.0f ? n[0] / len : 1.0f, y = len > 0.0f ? n[1] / len : 0.0f;
+            if (len > 0.0f && n[2] < 0.0f)
+            {
+                const float ox = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+                y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+                x = ox;
+            }
+
+            out[0] = x;
+            out[1] = y;
+        }
+
+        //the 4-byte aligned dimension of a packed element
+        unsigned int aligned_dimension(nms_mesh_chunk::vertex_atrib_type type, unsigned int dimension)
+        {
+            const unsigned int size = nms_mesh_chunk::get_type_size(type);
+            while ((dimension * size) % 4)
+                ++dimension;
+
+            return dimension;
+        }
+
+        packing choose_packing(const nms_mesh_chunk& chunk, const nms_mesh_chunk::element& e, nms_mesh_chunk::vertex_atrib_type position_type, bool octahedral)
+        {
+            if (e.data_type != nms_mesh_chunk::float32 && e.data_type != nms_mesh_chunk::float16)
+                return pack_keep;
+
+            if (e.type == nms_mesh_chunk::pos)
+                return position_type == nms_mesh_chunk::uint16 || position_type == nms_mesh_chunk::int16 ? pack_position : pack_keep;
+
+            const bool is_direction = e.type == nms_mesh_chunk::normal || has_word(e.semantics, "tangent") || has_word(e.semantics, "binormal");
+            if (is_direction)
+                return octahedral && (e.dimension == 3 || (e.dimension == 4 && e.type != nms_mesh_chunk::normal)) ? pack_octahedral : pack_keep;
+
+            float v[4];
+            if (has_word(e.semantics, "bone"))
+            {
+                const bool weights = has_word(e.semantics, "weight");
+                for (unsigned int i = 0; i < chunk.verts_count; ++i)
+                {
+                    chunk.read_element(e, i, v);
+                    for (unsigned int j = 0; j < e.dimension; ++j)
+                    {
+                        if (weights ? (v[j] < 0.0f || v[j] > 1.0f) : (v[j] < 0.0f || v[j] > 255.0f || v[j] != floorf(v[j])))
+                            return pack_keep;
+                    }
+                }
+
+                return weights ? pack_skin_weights : pack_skin_indices;
+            }
+
+            const bool is_color = e.type == nms_mesh_chunk::color;
+            for (unsigned int i = 0; i < chunk.verts_count; ++i)
+            {
+                chunk.read_element(e, i, v);
+                for (unsigned int j = 0; j < e.dimension; ++j)
+                {
+                    if (is_color ? (v[j] < 0.0f || v[j] > 1.0f) : fabsf(RoxMath::half_to_float(RoxMath::float_to_half(v[j])) - v[j]) > 1.0f / 1024.0f)
+                        return pack_keep;
+                }
+            }
+
+            return is_color ? pack_unorm8 : (e.data_type == nms_mesh_chunk::float16 ? pack_keep : pack_half);
+        }
+
+        void pack_vertex(const nms_mesh_chunk& chunk, const element_packing& p, unsigned int idx, const float* dequant_offset, const float* dequant_scale, char* to)
+        {
+            float v[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            chunk.read_element(p.from, idx, v);
+            const unsigned int dim = p.to.dimension;
+
+            switch (p.pack)
+            {
+            case pack_keep:
+                memcpy(to, (const char*)chunk.vertices_data + size_t(idx) * chunk.vertex_stride + p.from.offset,
+                       p.from.dimension * nms_mesh_chunk::get_type_size(p.from.data_type));
+                break;
+
+            case pack_position:
+            {
+                int16_t* out = (int16_t*)to;
+                for (unsigned int i = 0; i < dim; ++i)
+                {
+                    const float f = i < 3 ? (dequant_scale[i] > 0.0f ? (v[i] - dequant_offset[i]) / dequant_scale[i] : 0.0f) : 1.0f;
+                    if (p.to.data_type == nms_mesh_chunk::uint16)
+                        ((uint16_t*)out)[i] = to_unorm16(i < p.from.dimension || i == 3 ? f : 0.0f);
+                    else
+                        out[i] = to_snorm16(i < p.from.dimension || i == 3 ? f : 0.0f);
+                }
+            }
+            break;
+
+            case pack_octahedral:
+            {
+                float e[2];
+                octahedral_encode(v, e);
+                int16_t* out = (int16_t*)to;
+                out[0] = to_snorm16(e[0]);
+                out[1] = to_snorm16(e[1]);
+                if (dim > 2)
+                {
+                    out[2] = to_snorm16(p.from.dimension > 3 ? (v[3] < 0.0f ? -1.0f : 1.0f) : 0.0f);
+                    out[3] = 0;
+                }
+            }
+            break;
+
+            case pack_skin_weights:
+            {
+                //rounded so that the weights still sum to 255
+                uint8_t* out = (uint8_t*)to;
+                int sum = 0, largest = 0;
+                for (unsigned int i = 0; i < dim; ++i)
+                {
+                    out[i] = i < p.from.dimension ? to_unorm8(v[i]) : 0;
+                    sum += out[i];
+                    if (out[i] > out[largest])
+                        largest = i;
+                }
+
+                if (sum > 0)
+                    out[largest] = uint8_t(RoxMath::clamp(float(out[largest] + 255 - sum), 0.0f, 255.0f));
+            }
+            break;
+
+            case pack_skin_indices:
+                for (unsigned int i = 0; i < dim; ++i)
+                    ((uint8_t*)to)[i] = i < p.from.dimension ? uint8_t(v[i]) : 0;
+                break;
+
+            case pack_unorm8:
+                for (unsigned int i = 0; i < dim; ++i)
+                    ((uint8_t*)to)[i] = i < p.from.dimension ? to_unorm8(v[i]) : 255;
+                break;
+
+            case pack_half:
+                for (unsigned int i = 0; i < dim; ++i)
+                    ((uint16_t*)to)[i] = RoxMath::float_to_half(i < p.from.dimension ? v[i] : 0.0f);
+                break;
+            }
+        }
+    }
+
+    bool nms_mesh_quantizer::quantize(nms_mesh_chunk& chunk)
+    {
+        m_stats = stats();
+        if (!chunk.vertices_data || !chunk.vertex_stride || !chunk.verts_count)
+            return false;
+
+        std::vector<element_packing> packings(chunk.elements.size());
+        const nms_mesh_chunk::element* pos = 0;
+        for (size_t i = 0; i < chunk.elements.size(); ++i)
+        {
+            const nms_mesh_chunk::element& e = chunk.elements[i];
+            if (e.dimension > 4)
+                return false;
+
+            element_packing& p = packings[i];
+            p.from = p.to = e;
+            p.pack = choose_packing(chunk, e, m_position_type, m_octahedral);
+            if (e.type == nms_mesh_chunk::pos)
+                pos = &e;
+
+            switch (p.pack)
+            {
+            case pack_keep: break;
+            case pack_position: p.to.data_type = m_position_type; p.to.dimension = 4; break;
+            case pack_octahedral: p.to.data_type = nms_mesh_chunk::int16; p.to.dimension = e.dimension > 3 ? 4 : 2; break;
+            case pack_skin_weights:
+            case pack_skin_indices:
+            case pack_unorm8: p.to.data_type = nms_mesh_chunk::uint8; p.to.dimension = aligned_dimension(nms_mesh_chunk::uint8, e.dimension); break;
+            case pack_half: p.to.data_type = nms_mesh_chunk::float16; p.to.dimension = aligned_dimension(nms_mesh_chunk::float16, e.dimension); break;
+            }
+        }
+
+        //the quantization range covers all positions, the chunk aabb may be only an estimate
+        float offset[3] = { 0.0f, 0.0f, 0.0f }, scale[3] = { 1.0f, 1.0f, 1.0f };
+        if (pos && m_position_type != nms_mesh_chunk::float32)
+        {
+            float v[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            chunk.read_element(*pos, 0, v);
+            float pmin[3] = { v[0], v[1], v[2] }, pmax[3] = { v[0], v[1], v[2] };
+            for (unsigned int i = 1; i < chunk.verts_count; ++i)
+            {
+                chunk.read_element(*pos, i, v);
+                for (int j = 0; j < 3; ++j)
+                {
+                    pmin[j] = std::min(pmin[j], v[j]);
+                    pmax[j] = std::max(pmax[j], v[j]);
+                }
+            }
+
+            chunk.aabb_min = RoxMath::Vector3(pmin);
+            chunk.aabb_max = RoxMath::Vector3(pmax);
+            for (int j = 0; j < 3; ++j)
+            {
+                const bool unorm = m_position_type == nms_mesh_chunk::uint16;
+                offset[j] = unorm ? pmin[j] : (pmin[j] + pmax[j]) * 0.5f;
+                scale[j] = unorm ? pmax[j] - pmin[j] : (pmax[j] - pmin[j]) * 0.5f;
+            }
+        }
+
+        unsigned int stride = 0;
+        for (size_t i = 0; i < packings.size(); ++i)
+        {
+            packings[i].to.offset = stride;
+            stride += packings[i].to.dimension * nms_mesh_chunk::get_type_size(packings[i].to.data_type);
+        }
+
+        m_stats.verts = chunk.verts_count;
+        m_stats.bytes_before = size_t(chunk.vertex_stride) * chunk.verts_count;
+        m_stats.bytes_after = size_t(stride) * chunk.verts_count;
+
+        m_vertices.resize(size_t(stride) * chunk.verts_count);
+        for (unsigned int i = 0; i < chunk.verts_count; ++i)
+        {
+            char* to = &m_vertices[size_t(i) * stride];
+            for (size_t j = 0; j < packings.size(); ++j)
+                pack_vertex(chunk, packings[j], i, offset, scale, to + packings[j].to.offset);
+        }
+
+        for (size_t i = 0; i < packings.size(); ++i)
+            chunk.elements[i] = packings[i].to;
+
+        chunk.vertex_stride = stride;
+        chunk.vertices_data = m_vertices.data();
+        return true;
+    }
+
+    bool nms_mesh_quantizer::quantize_nms(const void* data, size_t size, std::vector<char>& out)
+    {
+        nms file;
+        if (!file.read_chunks_info(data, size))
+            return false;
+
+        //materials are numbered across the material chunks in file order, as the scene mesh appends them
+        std::vector<bool> packed_materials;
+        for (size_t i = 0; i < file.chunks.size(); ++i)
+        {
+            const nms::chunk_info& c = file.chunks[i];
+            if (c.type != nms::materials)
+                continue;
+
+            nms_material_chunk materials;
+            if (!materials.read(c.data, c.size, file.version))
+                return false;
+
+            for (size_t j = 0; j < materials.materials.size(); ++j)
+            {
+                bool packed = false;
+                const std::vector<nms_material_chunk::string_param>& strings = materials.materials[j].strings;
+                for (size_t k = 0; k < strings.size(); ++k)
+                {
+                    if (strings[k].name == "nya_packed_vertices")
+                        packed = boolFromString(strings[k].value.c_str());
+                }
+                packed_materials.push_back(packed);
+            }
+        }
+
+        stats total;
+        m_chunks.clear();
+        for (size_t i = 0; i < file.chunks.size(); ++i)
+        {
+            nms::chunk_info& c = file.chunks[i];
+            if (c.type != nms::mesh_data)
+                continue;
+
+            nms_mesh_chunk mesh;
+            if (!mesh.read_header(c.data, c.size, file.version))
+                return false;
+
+            if (!mesh.verts_count)
+                continue;
+
+            //the groups share the vertex buffer, so every material they use has to decode it
+            bool packed = true;
+            for (size_t l = 0; l < mesh.lods.size(); ++l)
+            {
+                for (size_t g = 0; g < mesh.lods[l].groups.size(); ++g)
+                {
+                    const unsigned int idx = mesh.lods[l].groups[g].material_idx;
+                    if (idx >= packed_materials.size() || !packed_materials[idx])
+                        packed = false;
+                }
+            }
+
+            if (!packed)
+            {
+                ++total.skipped_chunks;
+                continue;
+            }
+
+            if (!quantize(mesh))
+                return false;
+
+            total.verts += m_stats.verts;
+            total.bytes_before += m_stats.bytes_before;
+            total.bytes_after += m_stats.bytes_after;
+
+            m_chunks.push_back(std::vector<char>(mesh.get_chunk_size()));
+            mesh.write_to_buf(m_chunks.back().data(), m_chunks.back().size());
+            c.data = m_chunks.back().data();
+            c.size = (unsigned int)m_chunks.back().size();
+        }
+
+        m_stats = total;
+        m_vertices.clear();
+
+        out.resize(file.get_nms_size());
+        const bool result = file.write_to_buf(out.data(), out.size()) == out.size();
+        m_chunks.clear();
+        return result;
+    }
+
+}
@@ -0,0 +1,56 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#pragma once
+
+#include "RoxMesh.h"
+#include <vector>
+#include <stddef.h>
+
+namespace RoxFormats
+{
+
+    //packs float vertex elements into the normalized integer and half types, every element stays 4-byte aligned
+    //positions: uint16 or int16 x4 relative to the chunk aabb, w is 1, shaders apply "nya pos dequant offset/scale"
+    //normals and elements named "tangent" or "binormal": int16 octahedral xy, a 4th tangent component goes to z
+    //  vec3 n=vec3(e.xy,1.0-abs(e.x)-abs(e.y)); float t=max(-n.z,0.0); n.xy+=vec2(n.x>=0.0?-t:t,n.y>=0.0?-t:t); n=normalize(n);
+    //elements named "bone": uint8, weights are normalized to sum 1, indices are scaled by 1/255 and must be integers up to 255
+    //colors within [0,1]: uint8, other float elements: half if it keeps them within 1/1024
+    //no engine shader decodes this layout, so quantize_nms packs only the meshes whose materials all opt in
+    //with the "nya_packed_vertices" string set to true, their shaders have to decode the elements as above
+    class nms_mesh_quantizer
+    {
+    public:
+        struct stats
+        {
+            unsigned int verts;
+            size_t bytes_before, bytes_after; //vertex data
+            unsigned int skipped_chunks; //left as is by quantize_nms since a material didn't opt in
+
+            stats() : verts(0), bytes_before(0), bytes_after(0), skipped_chunks(0) {}
+        };
+
+    public:
+        //the chunk points to the quantizer buffers afterwards, already packed elements are kept as is
+        bool quantize(nms_mesh_chunk& chunk);
+
+        //the mesh chunks of an nms file with opted in materials, other chunks are copied as is, stats are summed over the mesh chunks
+        bool quantize_nms(const void* data, size_t size, std::vector<char>& out);
+
+        const stats& get_stats() const { return m_stats; }
+
+    public:
+        void set_position_type(nms_mesh_chunk::vertex_atrib_type type) { m_position_type = type; } //uint16, int16 or float32 to keep
+        void set_octahedral_normals(bool enable) { m_octahedral = enable; }
+
+    public:
+        nms_mesh_quantizer() : m_position_type(nms_mesh_chunk::uint16), m_octahedral(true) {}
+
+    private:
+        nms_mesh_chunk::vertex_atrib_type m_position_type;
+        bool m_octahedral;
+        stats m_stats;
+        std::vector<char> m_vertices;
+        std::vector<std::vector<char> > m_chunks;
+    };
+
+}
@@ -0,0 +1,618 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#include "RoxMeshSimplifier.h"
+#include "RoxMemory/RoxThreadPool.h"
+#include <algorithm>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+namespace RoxFormats
+{
+
+    namespace
+    {
+        struct quadric
+        {
+            double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+            double weight;
+
+            void add_plane(const RoxMath::Vector3& n, double d, double w)
+            {
+                xx += w * n.x * n.x; xy += w * n.x * n.y; xz += w * n.x * n.z; xw += w * n.x * d;
+                yy += w * n.y * n.y; yz += w * n.y * n.z; yw += w * n.y * d;
+                zz += w * n.z * n.z; zw += w * n.z * d;
+                ww += w * d * d;
+                weight += w;
+            }
+
+            void add(const quadric& q)
+            {
+                xx += q.xx; xy += q.xy; xz += q.xz; xw += q.xw;
+                yy += q.yy; yz += q.yz; yw += q.yw;
+                zz += q.zz; zw += q.zw;
+                ww += q.ww;
+                weight += q.weight;
+            }
+
+            //mean squared distance to the planes
+            double eval(const RoxMath::Vector3& p) const
+            {
+                const double x = p.x, y = p.y, z = p.z;
+                const double e = x * x * xx + y * y * yy + z * z * zz + 2.0 * (x * y * xy + x * z * xz + y * z * yz)
+                    + 2.0 * (x * xw + y * yw + z * zw) + ww;
+                return weight > 0.0 ? std::max(e / weight, 0.0) : 0.0;
+            }
+
+            quadric() { memset(this, 0, sizeof(*this)); }
+        };
+
+        //vertex data shared by the groups, positions are scaled so that the errors are relative to the mesh size
+        struct mesh_data
+        {
+            std::vector<RoxMath::Vector3> positions;
+            std::vector<unsigned int> position_id; //first vertex with the same position
+            std::vector<float> attributes; //weighted, attributes_count per vertex
+            unsigned int attributes_count;
+
+            float attribute_distance(unsigned int a, unsigned int b) const
+            {
+                const float* fa = &attributes[size_t(a) * attributes_count];
+                const float* fb = &attributes[size_t(b) * attributes_count];
+                float d = 0.0f;
+                for (unsigned int i = 0; i < attributes_count; ++i)
+                    d += (fa[i] - fb[i]) * (fa[i] - fb[i]);
+
+                return d;
+            }
+
+            mesh_data() : attributes_count(0) {}
+        };
+
+        bool read_mesh_data(const nms_mesh_chunk& chunk, float attribute_weight, float skin_weight, mesh_data& out)
+        {
+            const nms_mesh_chunk::element* pos = 0;
+            for (size_t i = 0; i < chunk.elements.size(); ++i)
+            {
+                const nms_mesh_chunk::element& e = chunk.elements[i];
+                if (e.dimension > 4)
+                    return false;
+
+                if (e.type == nms_mesh_chunk::pos)
+                    pos = &e;
+                else
+                    out.attributes_count += e.dimension;
+            }
+
+            if (!pos)
+                return false;
+
+            out.positions.resize(chunk.verts_count);
+            RoxMath::Vector3 pmin, pmax;
+            for (unsigned int i = 0; i < chunk.verts_count; ++i)
+            {
+                float v[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                chunk.read_element(*pos, i, v);
+                out.positions[i] = RoxMath::Vector3(v[0], v[1], v[2]);
+                pmin = i ? RoxMath::Vector3::min(pmin, out.positions[i]) : out.positions[i];
+                pmax = i ? RoxMath::Vector3::max(pmax, out.positions[i]) : out.positions[i];
+            }
+
+            const RoxMath::Vector3 size = pmax - pmin;
+            const float extent = std::max(std::max(size.x, size.y), size.z);
+            const float scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+            for (unsigned int i = 0; i < chunk.verts_count; ++i)
+                out.positions[i] = (out.positions[i] - pmin) * scale;
+
+            out.attributes.resize(size_t(chunk.verts_count) * out.attributes_count);
+            unsigned int offset = 0;
+            for (size_t i = 0; i < chunk.elements.size(); ++i)
+            {
+                const nms_mesh_chunk::element& e = chunk.elements[i];
+                if (e.type == nms_mesh_chunk::pos)
+                    continue;
+
+                const float w = e.semantics.find("bone") != std::string::npos ? skin_weight : attribute_weight;
+                for (unsigned int j = 0; j < chunk.verts_count; ++j)
+                {
+                    float* to = &out.attributes[size_t(j) * out.attributes_count + offset];
+                    chunk.read_element(e, j, to);
+                    for (unsigned int k = 0; k < e.dimension; ++k)
+                        to[k] *= w;
+                }
+
+                offset += e.dimension;
+            }
+
+            std::vector<unsigned int> order(chunk.verts_count);
+            for (unsigned int i = 0; i < chunk.verts_count; ++i)
+                order[i] = i;
+
+            const std::vector<RoxMath::Vector3>& p = out.positions;
+            std::sort(order.begin(), order.end(), [&p](unsigned int a, unsigned int b)
+            {
+                if (p[a].x != p[b].x) return p[a].x < p[b].x;
+                if (p[a].y != p[b].y) return p[a].y < p[b].y;
+                if (p[a].z != p[b].z) return p[a].z < p[b].z;
+                return a < b;
+            });
+
+            out.position_id.resize(chunk.verts_count);
+            for (unsigned int i = 0; i < chunk.verts_count; ++i)
+            {
+                const unsigned int v = order[i], prev = i ? order[i - 1] : v;
+                const bool same = i && p[v].x == p[prev].x && p[v].y == p[prev].y && p[v].z == p[prev].z;
+                out.position_id[v] = same ? out.position_id[prev] : v;
+            }
+
+            return true;
+        }
+
+        inline uint64_t edge_key(unsigned int a, unsigned int b) { return (uint64_t(a) << 32) | b; }
+
+        //simplifies one group through the levels, each level starts from the previous one
+        class group_simplifier
+        {
+        public:
+            group_simplifier(const mesh_data& data, const unsigned int* indices, size_t count) : m_data(data)
+            {
+                m_vertices.assign(indices, indices + count);
+                std::sort(m_vertices.begin(), m_vertices.end());
+                m_vertices.erase(std::unique(m_vertices.begin(), m_vertices.end()), m_vertices.end());
+
+                m_tris.resize(count);
+                for (size_t i = 0; i < count; ++i)
+                    m_tris[i] = local_id(indices[i]);
+
+                std::vector<unsigned int> positions(m_vertices.size());
+                for (size_t i = 0; i < m_vertices.size(); ++i)
+                    positions[i] = m_data.position_id[m_vertices[i]];
+
+                std::vector<unsigned int> unique_positions(positions);
+                std::sort(unique_positions.begin(), unique_positions.end());
+                unique_positions.erase(std::unique(unique_positions.begin(), unique_positions.end()), unique_positions.end());
+
+                m_slot.resize(m_vertices.size());
+                std::vector<unsigned int> slot_vertices(unique_positions.size(), 0);
+                for (size_t i = 0; i < m_vertices.size(); ++i)
+                {
+                    m_slot[i] = (unsigned int)(std::lower_bound(unique_positions.begin(), unique_positions.end(), positions[i]) - unique_positions.begin());
+                    ++slot_vertices[m_slot[i]];
+                }
+
+                //vertices split by attributes stay, so the seams keep their shape and uvs
+                m_locked.resize(m_vertices.size(), 0);
+                for (size_t i = 0; i < m_vertices.size(); ++i)
+                {
+                    if (slot_vertices[m_slot[i]] > 1)
+                        m_locked[i] = 1;
+                }
+
+                m_quadrics.resize(unique_positions.size());
+                for (size_t t = 0; t + 2 < m_tris.size(); t += 3)
+                {
+                    const RoxMath::Vector3& a = pos(m_tris[t]), & b = pos(m_tris[t + 1]), & c = pos(m_tris[t + 2]);
+                    RoxMath::Vector3 n = RoxMath::Vector3::cross(b - a, c - a);
+                    const float area = n.length();
+                    if (area <= 0.0f)
+                        continue;
+
+                    n *= 1.0f / area;
+                    const double d = -RoxMath::Vector3::dot(n, a);
+                    for (int j = 0; j < 3; ++j)
+                        m_quadrics[m_slot[m_tris[t + j]]].add_plane(n, d, area);
+                }
+
+                //border vertices may only slide along the border, complex and non-manifold ones are kept
+                build_edges();
+                m_border.resize(m_vertices.size(), 0);
+                std::vector<unsigned int> border_edges(unique_positions.size(), 0);
+                for (size_t t = 0; t + 2 < m_tris.size(); t += 3)
+                {
+                    for (int j = 0; j < 3; ++j)
+                    {
+                        const unsigned int a = m_tris[t + j], b = m_tris[t + (j + 1) % 3];
+                        const int uses = edge_uses(m_slot[a], m_slot[b]);
+                        if (uses > 1 || edge_uses(m_slot[b], m_slot[a]) > 1)
+                        {
+                            m_locked[a] = m_locked[b] = 1;
+                            continue;
+                        }
+
+                        if (edge_uses(m_slot[b], m_slot[a]))
+                            continue;
+
+                        m_border[a] = m_border[b] = 1;
+                        ++border_edges[m_slot[a]];
+                        ++border_edges[m_slot[b]];
+
+                        //a plane through the edge, perpendicular to the triangle, keeps the outline
+                        const RoxMath::Vector3& pa = pos(a), & pb = pos(b), & pc = pos(m_tris[t + (j + 2) % 3]);
+                        const RoxMath::Vector3 edge = pb - pa;
+                        RoxMath::Vector3 n = RoxMath::Vector3::cross(edge, RoxMath::Vector3::cross(edge, pc - pa));
+                        const float len = n.length();
+                        if (len <= 0.0f)
+                            continue;
+
+                        n *= 1.0f / len;
+                        const double w = edge.lengthSq() * 10.0;
+                        m_quadrics[m_slot[a]].add_plane(n, -RoxMath::Vector3::dot(n, pa), w);
+                        m_quadrics[m_slot[b]].add_plane(n, -RoxMath::Vector3::dot(n, pa), w);
+                    }
+                }
+
+                for (size_t i = 0; i < m_vertices.size(); ++i)
+                {
+                    if (border_edges[m_slot[i]] > 2)
+                        m_locked[i] = 1;
+                }
+            }
+
+            //returns the error reached
+            float simplify(size_t target_count, float max_error)
+            {
+                const double max_cost = double(max_error) * max_error;
+                double reached = 0.0;
+                std::vector<unsigned int> collapse(m_vertices.size());
+                std::vector<char> touched(m_vertices.size());
+
+                while (m_tris.size() > target_count)
+                {
+                    build_edges();
+                    build_adjacency();
+
+                    m_candidates.clear();
+                    for (size_t t = 0; t + 2 < m_tris.size(); t += 3)
+                    {
+                        for (int j = 0; j < 3; ++j)
+                        {
+                            const unsigned int a = m_tris[t + j], b = m_tris[t + (j + 1) % 3];
+                            add_candidate(a, b);
+                            add_candidate(b, a);
+                        }
+                    }
+
+                    std::sort(m_candidates.begin(), m_candidates.end());
+
+                    for (size_t i = 0; i < collapse.size(); ++i)
+                        collapse[i] = (unsigned int)i;
+
+                    std::fill(touched.begin(), touched.end(), 0);
+                    const size_t needed = (m_tris.size() - target_count) / 3;
+                    size_t removed = 0;
+                    bool collapsed = false;
+                    for (size_t i = 0; i < m_candidates.size() && removed < needed; ++i)
+                    {
+                        const candidate& c = m_candidates[i];
+                        if (c.cost > max_cost)
+                            break;
+
+                        if (touched[c.from] || touched[c.to] || flips(c.from, c.to))
+                            continue;
+
+                        collapse[c.from] = c.to;
+                        for (unsigned int a = m_adj_offset[c.from]; a < m_adj_offset[c.from + 1]; ++a)
+                        {
+                            const unsigned int t = m_adj[a];
+                            touched[m_tris[t * 3]] = touched[m_tris[t * 3 + 1]] = touched[m_tris[t * 3 + 2]] = 1;
+                        }
+
+                        m_quadrics[m_slot[c.to]].add(m_quadrics[m_slot[c.from]]);
+                        removed += is_border_edge(c.from, c.to) ? 1 : 2;
+                        reached = std::max(reached, c.cost);
+                        collapsed = true;
+                    }
+
+                    if (!collapsed)
+                        break;
+
+                    size_t count = 0;
+                    for (size_t t = 0; t + 2 < m_tris.size(); t += 3)
+                    {
+                        const unsigned int a = collapse[m_tris[t]], b = collapse[m_tris[t + 1]], c = collapse[m_tris[t + 2]];
+                        if (m_slot[a] == m_slot[b] || m_slot[b] == m_slot[c] || m_slot[a] == m_slot[c])
+                            continue;
+
+                        m_tris[count++] = a;
+                        m_tris[count++] = b;
+                        m_tris[count++] = c;
+                    }
+
+                    m_tris.resize(count);
+                }
+
+                return float(sqrt(reached));
+            }
+
+            void get_indices(std::vector<unsigned int>& out) const
+            {
+                out.resize(m_tris.size());
+                for (size_t i = 0; i < m_tris.size(); ++i)
+                    out[i] = m_vertices[m_tris[i]];
+            }
+
+            size_t get_count() const { return m_tris.size(); }
+
+        private:
+            struct candidate
+            {
+                double cost;
+                unsigned int from, to;
+
+                bool operator < (const candidate& other) const { return cost < other.cost; }
+            };
+
+            unsigned int local_id(unsigned int v) const { return (unsigned int)(std::lower_bound(m_vertices.begin(), m_vertices.end(), v) - m_vertices.begin()); }
+            const RoxMath::Vector3& pos(unsigned int local) const { return m_data.positions[m_vertices[local]]; }
+
+            void build_edges()
+            {
+                m_edges.clear();
+                for (size_t t = 0; t + 2 < m_tris.size(); t += 3)
+                {
+                    for (int j = 0; j < 3; ++j)
+                        m_edges.push_back(edge_key(m_slot[m_tris[t + j]], m_slot[m_tris[t + (j + 1) % 3]]));
+                }
+
+                std::sort(m_edges.begin(), m_edges.end());
+            }
+
+            int edge_uses(unsigned int a, unsigned int b) const
+            {
+                const std::pair<std::vector<uint64_t>::const_iterator, std::vector<uint64_t>::const_iterator> r = std::equal_range(m_edges.begin(), m_edges.end(), edge_key(a, b));
+                return int(r.second - r.first);
+            }
+
+            bool is_border_edge(unsigned int a, unsigned int b) const { return !edge_uses(m_slot[a], m_slot[b]) || !edge_uses(m_slot[b], m_slot[a]); }
+
+            void build_adjacency()
+            {
+                m_adj_offset.assign(m_vertices.size() + 1, 0);
+                for (size_t i = 0; i < m_tris.size(); ++i)
+                    ++m_adj_offset[m_tris[i] + 1];
+
+                for (size_t i = 1; i < m_adj_offset.size(); ++i)
+                    m_adj_offset[i] += m_adj_offset[i - 1];
+
+                m_adj.resize(m_tris.size());
+                std::vector<unsigned int> fill(m_adj_offset.begin(), m_adj_offset.end() - 1);
+                for (size_t i = 0; i < m_tris.size(); ++i)
+                    m_adj[fill[m_tris[i]]++] = (unsigned int)(i / 3);
+            }
+
+            void add_candidate(unsigned int from, unsigned int to)
+            {
+                if (m_locked[from])
+                    return;
+
+                if (m_border[from] && !is_border_edge(from, to))
+                    return;
+
+                candidate c;
+                c.cost = m_quadrics[m_slot[from]].eval(pos(to)) + m_data.attribute_distance(m_vertices[from], m_vertices[to]);
+                c.from = from;
+                c.to = to;
+                m_candidates.push_back(c);
+            }
+
+            //a triangle around the moved vertex turning over
+            bool flips(unsigned int from, unsigned int to) const
+            {
+                const RoxMath::Vector3& p = pos(to);
+                for (unsigned int a = m_adj_offset[from]; a < m_adj_offset[from + 1]; ++a)
+                {
+                    const unsigned int* t = &m_tris[m_adj[a] * 3];
+                    if (m_slot[t[0]] == m_slot[to] || m_slot[t[1]] == m_slot[to] || m_slot[t[2]] == m_slot[to])
+                        continue;
+
+                    const RoxMath::Vector3& p0 = pos(t[0]), & p1 = pos(t[1]), & p2 = pos(t[2]);
+                    const RoxMath::Vector3 before = RoxMath::Vector3::cross(p1 - p0, p2 - p0);
+                    const RoxMath::Vector3 after = RoxMath::Vector3::cross((t[1] == from ? p : p1) - (t[0] == from ? p : p0),
+                                                                           (t[2] == from ? p : p2) - (t[0] == from ? p : p0));
+                    if (RoxMath::Vector3::dot(before, after) <= 0.0f)
+                        return true;
+                }
+
+                return false;
+            }
+
+        private:
+            const mesh_data& m_data;
+            std::vector<unsigned int> m_vertices; //local to chunk vertex
+            std::vector<unsigned int> m_slot; //local position
+            std::vector<unsigned int> m_tris;
+            std::vector<char> m_locked;
+            std::vector<char> m_border;
+            std::vector<quadric> m_quadrics; //by position
+            std::vector<uint64_t> m_edges;
+            std::vector<unsigned int> m_adj_offset, m_adj;
+            std::vector<candidate> m_candidates;
+        };
+
+        void read_indices(const nms_mesh_chunk& chunk, std::vector<unsigned int>& out)
+        {
+            if (chunk.index_size == nms_mesh_chunk::no_indices)
+            {
+                out.resize(chunk.verts_count);
+                for (unsigned int i = 0; i < chunk.verts_count; ++i)
+                    out[i] = i;
+                return;
+            }
+
+            out.resize(chunk.indices_count);
+            for (unsigned int i = 0; i < chunk.indices_count; ++i)
+            {
+                out[i] = chunk.index_size == nms_mesh_chunk::index2b ? ((const uint16_t*)chunk.indices_data)[i] :
+                    ((const uint32_t*)chunk.indices_data)[i];
+            }
+        }
+    }
+
+    bool nms_mesh_simplifier::generate_lods(nms_mesh_chunk& chunk, const level* levels, int count)
+    {
+        m_stats = stats();
+
+        if (!chunk.vertices_data || !chunk.verts_count || chunk.lods.empty() || count < 0 || (count && !levels))
+            return false;
+
+        mesh_data data;
+        if (!read_mesh_data(chunk, m_attribute_weight, m_skin_weight, data))
+            return false;
+
+        std::vector<unsigned int> indices;
+        read_indices(chunk, indices);
+
+        const std::vector<nms_mesh_chunk::group>& groups = chunk.lods[0].groups;
+        for (size_t i = 0; i < groups.size(); ++i)
+        {
+            if (size_t(groups[i].offset) + groups[i].count > indices.size())
+                return false;
+        }
+
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            if (indices[i] >= chunk.verts_count)
+                return false;
+        }
+
+        //levels of each group, the groups are independent
+        std::vector<std::vector<std::vector<unsigned int> > > result(groups.size());
+        std::vector<std::vector<float> > errors(groups.size());
+        RoxMemory::RoxThreadPool::get().run((int)groups.size(), [&](int idx)
+        {
+            const nms_mesh_chunk::group& g = groups[idx];
+            result[idx].resize(count);
+            errors[idx].resize(count, 0.0f);
+            if (g.element_type != nms_mesh_chunk::triangles || g.count < 3)
+                return;
+
+            const size_t tris_count = g.count - g.count % 3;
+            group_simplifier s(data, &indices[g.offset], tris_count);
+            for (int i = 0; i < count; ++i)
+            {
+                const size_t target = size_t(tris_count / 3 * std::max(levels[i].ratio, 0.0f)) * 3;
+                errors[idx][i] = s.simplify(target, levels[i].max_error);
+                s.get_indices(result[idx][i]);
+            }
+        });
+
+        //the detailed level is compacted to the start of the buffer, old less detailed levels are dropped
+        std::vector<unsigned int> out;
+        std::vector<nms_mesh_chunk::lod> lods(1);
+        lods[0].groups = groups;
+        for (size_t i = 0; i < groups.size(); ++i)
+        {
+            lods[0].groups[i].offset = (unsigned int)out.size();
+            out.insert(out.end(), indices.begin() + groups[i].offset, indices.begin() + groups[i].offset + groups[i].count);
+            if (groups[i].element_type == nms_mesh_chunk::triangles)
+                m_stats.triangles += groups[i].count / 3;
+        }
+
+        unsigned int prev_triangles = m_stats.triangles;
+        for (int l = 0; l < count; ++l)
+        {
+            unsigned int triangles = 0;
+            float error = 0.0f;
+            for (size_t i = 0; i < groups.size(); ++i)
+            {
+                if (groups[i].element_type == nms_mesh_chunk::triangles)
+                    triangles += (unsigned int)result[i][l].size() / 3;
+                error = std::max(error, errors[i][l]);
+            }
+
+            if (triangles * 20 > prev_triangles * 19 || !triangles)
+                break;
+
+            nms_mesh_chunk::lod lod;
+            lod.groups = groups;
+            for (size_t i = 0; i < groups.size(); ++i)
+            {
+                nms_mesh_chunk::group& g = lod.groups[i];
+                g.offset = (unsigned int)out.size();
+                if (g.element_type == nms_mesh_chunk::triangles && groups[i].count >= 3)
+                {
+                    g.count = (unsigned int)result[i][l].size();
+                    out.insert(out.end(), result[i][l].begin(), result[i][l].end());
+                }
+                else
+                    out.insert(out.end(), indices.begin() + groups[i].offset, indices.begin() + groups[i].offset + groups[i].count);
+            }
+
+            lods.push_back(lod);
+            m_stats.level_triangles.push_back(triangles);
+            m_stats.level_errors.push_back(error);
+            prev_triangles = triangles;
+        }
+
+        if (chunk.index_size == nms_mesh_chunk::no_indices)
+            chunk.index_size = chunk.verts_count <= 65536 ? nms_mesh_chunk::index2b : nms_mesh_chunk::index4b;
+
+        m_indices.resize(out.size() * chunk.index_size);
+        if (chunk.index_size == nms_mesh_chunk::index2b)
+        {
+            uint16_t* to = (uint16_t*)m_indices.data();
+            for (size_t i = 0; i < out.size(); ++i)
+                to[i] = (uint16_t)out[i];
+        }
+        else if (!out.empty())
+            memcpy(m_indices.data(), out.data(), m_indices.size());
+
+        chunk.indices_count = (unsigned int)out.size();
+        chunk.indices_data = m_indices.data();
+        chunk.lods.swap(lods);
+        return true;
+    }
+
+    bool nms_mesh_simplifier::generate_lods_nms(const void* data, size_t size, const level* levels, int count, std::vector<char>& out)
+    {
+        nms file;
+        if (!file.read_chunks_info(data, size))
+            return false;
+
+        stats total;
+        m_chunks.clear();
+        for (size_t i = 0; i < file.chunks.size(); ++i)
+        {
+            nms::chunk_info& c = file.chunks[i];
+            if (c.type == nms::clusters) //built for the previous index order
+            {
+                file.chunks.erase(file.chunks.begin() + i--);
+                continue;
+            }
+
+            if (c.type != nms::mesh_data)
+                continue;
+
+            nms_mesh_chunk mesh;
+            if (!mesh.read_header(c.data, c.size, file.version) || !generate_lods(mesh, levels, count))
+                return false;
+
+            total.triangles += m_stats.triangles;
+            for (size_t l = 0; l < m_stats.level_triangles.size(); ++l)
+            {
+                if (l >= total.level_triangles.size())
+                {
+                    total.level_triangles.push_back(0);
+                    total.level_errors.push_back(0.0f);
+                }
+
+                total.level_triangles[l] += m_stats.level_triangles[l];
+                total.level_errors[l] = std::max(total.level_errors[l], m_stats.level_errors[l]);
+            }
+
+            m_chunks.push_back(std::vector<char>(mesh.get_chunk_size()));
+            mesh.write_to_buf(m_chunks.back().data(), m_chunks.back().size());
+            c.data = m_chunks.back().data();
+            c.size = (unsigned int)m_chunks.back().size();
+        }
+
+        m_stats = total;
+        m_indices.clear();
+
+        out.resize(file.get_nms_size());
+        const bool result = file.write_to_buf(out.data(), out.size()) == out.size();
+        m_chunks.clear();
+        return result;
+    }
+
+}
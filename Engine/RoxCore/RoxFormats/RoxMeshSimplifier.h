@@ -0,0 +1,60 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#pragma once
+
+#include "RoxMesh.h"
+#include <vector>
+#include <stddef.h>
+
+namespace RoxFormats
+{
+
+    //quadric error edge collapse into existing vertices, the vertex buffer stays as is and the levels only add indices
+    //open borders collapse only along themselves, vertices split by attributes (uv seams, hard normals) are kept
+    class nms_mesh_simplifier
+    {
+    public:
+        struct level
+        {
+            float ratio; //of the detailed triangles count
+            float max_error; //relative to the mesh size, the level stops earlier if reached
+
+            level(float ratio = 0.5f, float max_error = 0.05f) : ratio(ratio), max_error(max_error) {}
+        };
+
+        struct stats
+        {
+            unsigned int triangles; //of the detailed level
+            std::vector<unsigned int> level_triangles;
+            std::vector<float> level_errors;
+
+            stats() : triangles(0) {}
+        };
+
+    public:
+        //replaces the less detailed levels of the chunk, the chunk points to the simplifier indices afterwards
+        //a level is skipped, along with the rest, if it removes less than 5% of the previous level triangles
+        bool generate_lods(nms_mesh_chunk& chunk, const level* levels, int count);
+
+        //all mesh chunks of an nms file, clusters chunks are removed, other chunks are copied as is
+        bool generate_lods_nms(const void* data, size_t size, const level* levels, int count, std::vector<char>& out);
+
+        const stats& get_stats() const { return m_stats; }
+
+    public:
+        //penalties for collapsing into a vertex with other attributes, skin is for the elements named with "bone"
+        void set_attribute_weight(float weight) { m_attribute_weight = weight; }
+        void set_skin_weight(float weight) { m_skin_weight = weight; }
+
+    public:
+        nms_mesh_simplifier() : m_attribute_weight(0.05f), m_skin_weight(1.0f) {}
+
+    private:
+        float m_attribute_weight;
+        float m_skin_weight;
+        stats m_stats;
+        std::vector<char> m_indices;
+        std::vector<std::vector<char> > m_chunks;
+    };
+
+}
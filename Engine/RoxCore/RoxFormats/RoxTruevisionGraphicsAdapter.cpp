@@ -15,11 +15,19 @@
 #include "RoxTruevisionGraphicsAdapter.h"
 #include "RoxMemory/RoxMemoryReader.h"
 #include "RoxMemory/RoxTmpBuffers.h"
+#include "RoxMemory/RoxThreadPool.h"
 #include "RoxResources/RoxResources.h"
 
 #include <cstdio> 
 #include <cstdint>
 #include <cstring>
+#include <atomic>
+#include <utility>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define ROX_TGA_SSE2
+    #include <emmintrin.h>
+#endif
 
 namespace RoxFormats
 {
@@ -150,48 +158,313 @@ namespace RoxFormats
         return TGA::header_size;
     }
 
+    namespace
+    {
+        using uchar = unsigned char;
+
+        template<int c, bool reversed, bool swap_rb> void copyPixels(const uchar* from, uchar* to, int count)
+        {
+            const int step = reversed ? -c : c;
+            int i = 0;
+#ifdef ROX_TGA_SSE2
+            if (c == 4)
+            {
+                // 4 pixels at a time, reversed rows store them backwards from the last one
+                const __m128i ga = _mm_set1_epi32(int(0xff00ff00));
+                const __m128i b = _mm_set1_epi32(0xff);
+                for (; i + 4 <= count; i += 4, from += 16, to += step * 4)
+                {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from));
+                    if (swap_rb)
+                        v = _mm_or_si128(_mm_and_si128(v, ga), _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 16), b), _mm_slli_epi32(_mm_and_si128(v, b), 16)));
+                    if (reversed)
+                        v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(reversed ? to - 12 : to), v);
+                }
+            }
+#endif
+            for (; i < count; ++i, from += c, to += step)
+            {
+                to[0] = from[swap_rb ? 2 : 0];
+                if (c > 1)
+                {
+                    to[1] = from[1];
+                    to[2] = from[swap_rb ? 0 : 2];
+                }
+                if (c > 3)
+                    to[3] = from[3];
+            }
+        }
+
+        template<int c> void copyPixels(const uchar* from, uchar* to, int count, bool reversed, bool swap_rb)
+        {
+            if (reversed)
+                swap_rb ? copyPixels<c, true, true>(from, to, count) : copyPixels<c, true, false>(from, to, count);
+            else
+                swap_rb ? copyPixels<c, false, true>(from, to, count) : copyPixels<c, false, false>(from, to, count);
+        }
+
+        // copies count pixels, backwards from to when reversed
+        void copyPixels(const uchar* from, uchar* to, int count, int channels, bool reversed, bool swap_rb)
+        {
+            if (!reversed && !swap_rb)
+            {
+                std::memcpy(to, from, count * channels);
+                return;
+            }
+
+            switch (channels)
+            {
+            case 1: copyPixels<1>(from, to, count, reversed, false); break;
+            case 3: copyPixels<3>(from, to, count, reversed, swap_rb); break;
+            case 4: copyPixels<4>(from, to, count, reversed, swap_rb); break;
+            }
+        }
+
+        void fillPixels(const uchar* pixel, uchar* to, int count, int channels)
+        {
+            if (channels == 1)
+            {
+                std::memset(to, *pixel, count);
+                return;
+            }
+
+            int i = 0;
+#ifdef ROX_TGA_SSE2
+            if (channels == 4)
+            {
+                uint32_t p;
+                std::memcpy(&p, pixel, 4);
+                const __m128i v = _mm_set1_epi32(int(p));
+                for (; i + 4 <= count; i += 4, to += 16)
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(to), v);
+            }
+            else if (count >= 6)
+            {
+                // 16 byte pattern advanced by 4 pixels, each store overlaps the previous one by a third of a pixel
+                uchar pattern[16];
+                for (int j = 0; j < 16; ++j)
+                    pattern[j] = pixel[j % 3];
+
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+                for (; i + 6 <= count; i += 4, to += 12)
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(to), v);
+            }
+#endif
+            for (; i < count; ++i, to += channels)
+                std::memcpy(to, pixel, channels);
+        }
+
+        struct RleBand
+        {
+            const uchar* in; // packet containing the first pixel of the band
+            int skip; // pixels of that packet which belong to the previous band
+            int y0, y1;
+        };
+
+        struct RleTarget
+        {
+            uchar* out;
+            int width, height, channels;
+            std::size_t line;
+            bool horisontal_flip, vertical_flip, swap_rb;
+
+            uchar* row(int y) const { return out + (vertical_flip ? height - 1 - y : y) * line; }
+        };
+
+        // walks the packet headers only, validates the stream and records where each band of rows starts
+        bool scanRle(const uchar* in, const uchar* last, const RleTarget& t, int band_rows, std::vector<RleBand>& bands)
+        {
+            const std::size_t total = std::size_t(t.width) * t.height;
+            const std::size_t band_pixels = std::size_t(t.width) * band_rows;
+            std::size_t p = 0, next = 0;
+
+            while (p < total)
+            {
+                if (in >= last)
+                    return false;
+
+                const uchar* packet = in;
+                const int count = (*in & 0x7f) + 1;
+                const std::size_t payload = (*in++ & 0x80) ? t.channels : std::size_t(count) * t.channels;
+                if (payload > std::size_t(last - in))
+                    return false;
+
+                for (; next < p + count && next < total; next += band_pixels)
+                {
+                    const RleBand band = { packet, int(next - p), int(next / t.width), 0 };
+                    if (!bands.empty())
+                        bands.back().y1 = band.y0;
+                    bands.push_back(band);
+                }
+
+                in += payload;
+                p += count;
+            }
+
+            if (p != total || bands.empty())
+                return false;
+
+            bands.back().y1 = t.height;
+            return true;
+        }
+
+        // runs are written straight to their final place, packets may cross rows
+        bool decodeRleRows(const RleTarget& t, const uchar* in, const uchar* last, int skip, int y0, int y1)
+        {
+            const int c = t.channels;
+            int x = 0, y = y0;
+            uchar* row = t.row(y);
+
+            while (y < y1)
+            {
+                if (in >= last)
+                    return false;
+
+                const bool run = (*in & 0x80) != 0;
+                int count = (*in++ & 0x7f) + 1;
+                if (in + (run ? c : count * c) > last)
+                    return false;
+
+                uchar pixel[4];
+                if (run)
+                {
+                    std::memcpy(pixel, in, c);
+                    if (t.swap_rb)
+                        std::swap(pixel[0], pixel[2]);
+                    in += c;
+                }
+
+                if (skip)
+                {
+                    count -= skip;
+                    if (!run)
+                        in += skip * c;
+                    skip = 0;
+                }
+
+                while (count > 0)
+                {
+                    if (y == y1)
+                        return y1 < t.height; // the last packet of a band continues in the next one
+
+                    const int n = count < t.width - x ? count : t.width - x;
+                    if (run)
+                        fillPixels(pixel, row + (t.horisontal_flip ? t.width - x - n : x) * c, n, c);
+                    else
+                    {
+                        copyPixels(in, row + (t.horisontal_flip ? t.width - 1 - x : x) * c, n, c, t.horisontal_flip, t.swap_rb);
+                        in += n * c;
+                    }
+
+                    count -= n;
+                    x += n;
+                    if (x == t.width)
+                    {
+                        x = 0;
+                        ++y;
+                        row = t.row(y);
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        bool decodeRle(const RleTarget& t, const uchar* in, std::size_t size)
+        {
+            const uchar* const last = in + size;
+            const std::size_t band_size = 256 * 1024;
+            const int threads = RoxMemory::RoxThreadPool::get().getThreadsCount();
+            if (threads < 2 || t.line * t.height < band_size * 2)
+                return decodeRleRows(t, in, last, 0, 0, t.height);
+
+            // the serial scan over packet headers is cheap, it lets the rows be decoded in parallel
+            std::vector<RleBand> bands;
+            const int band_rows = t.line < band_size ? int(band_size / t.line) : 1;
+            if (!scanRle(in, last, t, band_rows, bands))
+                return false;
+
+            std::atomic<bool> result(true);
+            RoxMemory::RoxThreadPool::get().run(static_cast<int>(bands.size()), [&](int idx)
+            {
+                const RleBand& b = bands[idx];
+                if (!decodeRleRows(t, b.in, last, b.skip, b.y0, b.y1))
+                    result = false;
+            });
+
+            return result;
+        }
+    }
+
     bool TGA::decodeRLE(void* decoded_data) const
     {
-        if (!decoded_data || !rle)
+        if (!decoded_data || !data || !rle || width <= 0 || height <= 0)
             return false;
 
-        using uchar = unsigned char;
-        const uchar* cur = static_cast<const uchar*>(data);
-        const uchar* const last = cur + compressed_size;
+        const RleTarget t = { static_cast<uchar*>(decoded_data), width, height, static_cast<int>(channels),
+                              std::size_t(width) * static_cast<int>(channels), false, false, false };
+        return decodeRle(t, static_cast<const uchar*>(data), compressed_size);
+    }
+
+    bool TGA::decode(void* decoded_data, bool swap_rb) const
+    {
+        if (!decoded_data || !data || width <= 0 || height <= 0)
+            return false;
+
+        const int c = static_cast<int>(channels);
+        const std::size_t line = std::size_t(width) * c;
+        swap_rb = swap_rb && c >= 3;
+
         uchar* out = static_cast<uchar*>(decoded_data);
-        const uchar* const outLast = out + uncompressed_size;
+        const uchar* in = static_cast<const uchar*>(data);
 
-        while (out < outLast)
+        if (!rle)
         {
-            if (cur >= last)
+            if (compressed_size < uncompressed_size)
                 return false;
 
-            if (*cur & 0x80)
+            if (in != out)
             {
-                const uchar* to = out + (*cur++ - 127) * static_cast<int>(channels);
-                if (cur + static_cast<int>(channels) > last || to > outLast)
-                    return false;
-
-                while (out < to)
+                for (int y = 0; y < height; ++y)
                 {
-                    std::memcpy(out, cur, static_cast<int>(channels));
-                    out += static_cast<int>(channels);
+                    uchar* row = out + (vertical_flip ? height - 1 - y : y) * line;
+                    copyPixels(in + y * line, horisontal_flip ? row + line - c : row, width, c, horisontal_flip, swap_rb);
                 }
-                cur += static_cast<int>(channels);
+                return true;
             }
-            else // raw
+
+            if (!vertical_flip && !horisontal_flip && !swap_rb)
+                return true;
+
+            // in place: rows are exchanged with their mirror through a line buffer
+            std::vector<uchar> tmp(line);
+            for (int y = 0; y < (height + 1) / 2; ++y)
             {
-                const std::size_t size = (*cur++ + 1) * static_cast<int>(channels);
-                if (cur + size > last || out + size > outLast)
-                    return false;
+                uchar* a = out + y * line;
+                uchar* b = out + (height - 1 - y) * line;
 
-                std::memcpy(out, cur, size);
-                cur += size;
-                out += size;
+                copyPixels(a, horisontal_flip ? &tmp[0] + line - c : &tmp[0], width, c, horisontal_flip, swap_rb);
+                if (vertical_flip)
+                {
+                    if (a != b)
+                        copyPixels(b, horisontal_flip ? a + line - c : a, width, c, horisontal_flip, swap_rb);
+                    std::memcpy(b, &tmp[0], line);
+                    continue;
+                }
+
+                std::memcpy(a, &tmp[0], line);
+                if (a == b)
+                    continue;
+
+                copyPixels(b, horisontal_flip ? &tmp[0] + line - c : &tmp[0], width, c, horisontal_flip, swap_rb);
+                std::memcpy(b, &tmp[0], line);
             }
+            return true;
         }
 
-        return true;
+        const RleTarget t = { out, width, height, c, line, horisontal_flip, vertical_flip, swap_rb };
+        return decodeRle(t, in, compressed_size);
     }
 
     std::size_t TGA::encodeRLE(void* to_data, std::size_t to_size)
@@ -45,6 +45,9 @@ namespace RoxFormats
     public:
         std::size_t decodeHeader(const void* data, std::size_t size); // Returns 0 if invalid
         bool decodeRLE(void* decoded_data) const; // decoded_data must be allocated with uncompressedSize
+        // Decodes rle, applies the flips and optionally swaps bgr to rgb in a single pass
+        // decoded_data must be allocated with uncompressed_size, for uncompressed images it may be data itself
+        bool decode(void* decoded_data, bool swap_rb) const;
         void flipHorisontal(const void* from_data, void* to_data); // to_data must be allocated; can be equal to from_data
         void flipVertical(const void* from_data, void* to_data);
 
@@ -15,6 +15,8 @@
 #pragma once
 
 #include <cmath>
+#include <cstring>
+#include <stdint.h>
 
 #ifdef _MSC_VER
   #ifdef min
@@ -60,4 +62,52 @@ inline float fade(float time,float time_max,float start_period,float end_period)
     return 1.0f;
 }
 
+inline float half_to_float(uint16_t h)
+{
+    const uint32_t sign=uint32_t(h&0x8000)<<16;
+    uint32_t exp=(h>>10)&0x1f;
+    uint32_t mant=h&0x3ff;
+    uint32_t bits;
+    if(exp==0x1f)
+        bits=sign|0x7f800000|(mant<<13);
+    else if(exp)
+        bits=sign|((exp+112)<<23)|(mant<<13);
+    else if(mant)
+    {
+        exp=113;
+        while(!(mant&0x400))
+        {
+            mant<<=1;
+            --exp;
+        }
+        bits=sign|(exp<<23)|((mant&0x3ff)<<13);
+    }
+    else
+        bits=sign;
+
+    float f;
+    memcpy(&f,&bits,4);
+    return f;
+}
+
+//rounds to nearest, overflows to infinity, flushes values below the half normals to zero
+inline uint16_t float_to_half(float f)
+{
+    uint32_t bits;
+    memcpy(&bits,&f,4);
+    const uint16_t sign=uint16_t((bits>>16)&0x8000);
+    const uint32_t abs_bits=bits&0x7fffffff;
+    if(abs_bits>=0x7f800000)
+        return sign|0x7c00|(abs_bits>0x7f800000?0x200:0);
+
+    if(abs_bits>=0x477ff000)
+        return sign|0x7c00;
+
+    if(abs_bits<0x38800000)
+        return sign;
+
+    const uint32_t rounded=abs_bits+0xfff+((abs_bits>>13)&1);
+    return sign|uint16_t((rounded-0x38000000)>>13);
+}
+
 }
@@ -0,0 +1,96 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#include "RoxHash.h"
+#include <cstring>
+
+namespace RoxMemory
+{
+
+namespace
+{
+    const uint64_t prime1=0x9E3779B185EBCA87ULL;
+    const uint64_t prime2=0xC2B2AE3D27D4EB4FULL;
+    const uint64_t prime3=0x165667B19E3779F9ULL;
+    const uint64_t prime4=0x85EBCA77C2B2AE63ULL;
+    const uint64_t prime5=0x27D4EB2F165667C5ULL;
+
+    inline uint64_t rotl(uint64_t v,int r) { return (v<<r)|(v>>(64-r)); }
+
+    inline uint64_t read64(const unsigned char *p) { uint64_t v; memcpy(&v,p,8); return v; }
+    inline uint32_t read32(const unsigned char *p) { uint32_t v; memcpy(&v,p,4); return v; }
+
+    inline uint64_t round(uint64_t acc,uint64_t input)
+    {
+        acc+=input*prime2;
+        acc=rotl(acc,31);
+        return acc*prime1;
+    }
+
+    inline uint64_t merge(uint64_t acc,uint64_t val)
+    {
+        acc^=round(0,val);
+        return acc*prime1+prime4;
+    }
+}
+
+uint64_t hash64(const void *data,size_t size,uint64_t seed)
+{
+    const unsigned char *p=(const unsigned char *)data;
+    const unsigned char *const end=p+size;
+    uint64_t h;
+
+    if(size>=32)
+    {
+        uint64_t v1=seed+prime1+prime2;
+        uint64_t v2=seed+prime2;
+        uint64_t v3=seed;
+        uint64_t v4=seed-prime1;
+
+        const unsigned char *const limit=end-32;
+        do
+        {
+            v1=round(v1,read64(p));
+            v2=round(v2,read64(p+8));
+            v3=round(v3,read64(p+16));
+            v4=round(v4,read64(p+24));
+            p+=32;
+        }
+        while(p<=limit);
+
+        h=rotl(v1,1)+rotl(v2,7)+rotl(v3,12)+rotl(v4,18);
+        h=merge(h,v1);
+        h=merge(h,v2);
+        h=merge(h,v3);
+        h=merge(h,v4);
+    }
+    else
+        h=seed+prime5;
+
+    h+=uint64_t(size);
+
+    for(;p+8<=end;p+=8)
+        h=rotl(h^round(0,read64(p)),27)*prime1+prime4;
+
+    if(p+4<=end)
+    {
+        h=rotl(h^(uint64_t(read32(p))*prime1),23)*prime2+prime3;
+        p+=4;
+    }
+
+    for(;p<end;++p)
+        h=rotl(h^(*p*prime5),11)*prime1;
+
+    h^=h>>33;
+    h*=prime2;
+    h^=h>>29;
+    h*=prime3;
+    h^=h>>32;
+    return h;
+}
+
+uint64_t hash64(const char *str,uint64_t seed)
+{
+    return str?hash64(str,strlen(str),seed):hash64(0,0,seed);
+}
+
+}
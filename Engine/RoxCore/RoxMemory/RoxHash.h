@@ -0,0 +1,15 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace RoxMemory
+{
+
+//xxh64, fast enough to key caches by the whole content of the source files
+uint64_t hash64(const void *data,size_t size,uint64_t seed=0);
+uint64_t hash64(const char *str,uint64_t seed=0);
+
+}
@@ -0,0 +1,136 @@
+// Updated By the ROX_ENGINE
+// Copyright  2024 Torox Project
+// Portions Copyright  2013 nyan.developer@gmail.com (nya-engine)
+//
+// This file was modified by the Torox Project.
+// 
+// This file incorporates code from the nya-engine project, which is licensed under the MIT License.
+// See the LICENSE-MIT file in the root directory for more information.
+//
+// This file is also part of the Rox-engine, which is licensed under a dual-license system:
+// 1. Free Use License (for non-commercial and commercial use under specific conditions)
+// 2. Commercial License (for use on proprietary platforms)
+// See the LICENSE file in the root directory for the full Rox-engine license terms.
+
+#include "RoxThreadPool.h"
+
+namespace RoxMemory
+{
+
+namespace { thread_local bool inJob = false; }
+
+void RoxThreadPool::run(int count, const Job& job)
+{
+    if (count <= 0)
+        return;
+
+    std::unique_lock<std::mutex> runLock(m_runMutex, std::defer_lock);
+    if (count == 1 || m_threads.empty() || inJob || !runLock.try_lock())
+    {
+        for (int i = 0; i < count; ++i)
+            job(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &job;
+        m_count = count;
+        m_next = 0;
+        m_finished = 0;
+        ++m_generation;
+    }
+
+    m_wake.notify_all();
+    runJobs();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_finished == m_count; });
+    m_job = 0;
+}
+
+void RoxThreadPool::runJobs()
+{
+    inJob = true;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_job && m_next < m_count)
+    {
+        const int idx = m_next++;
+        const Job& job = *m_job;
+        lock.unlock();
+        job(idx);
+        lock.lock();
+
+        if (++m_finished == m_count)
+            m_done.notify_all();
+    }
+
+    inJob = false;
+}
+
+void RoxThreadPool::work()
+{
+    unsigned int generation = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_quit || m_generation != generation; });
+            if (m_quit)
+                return;
+
+            generation = m_generation;
+        }
+
+        runJobs();
+    }
+}
+
+void RoxThreadPool::setThreadsCount(int count)
+{
+    if (count <= 0)
+        count = static_cast<int>(std::thread::hardware_concurrency());
+
+    if (count < 1)
+        count = 1;
+
+    std::lock_guard<std::mutex> runLock(m_runMutex);
+    stop();
+
+    m_quit = false;
+    for (int i = 1; i < count; ++i)
+        m_threads.emplace_back(&RoxThreadPool::work, this);
+}
+
+void RoxThreadPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+
+    m_wake.notify_all();
+    for (size_t i = 0; i < m_threads.size(); ++i)
+        m_threads[i].join();
+    m_threads.clear();
+}
+
+RoxThreadPool& RoxThreadPool::get()
+{
+    static RoxThreadPool pool;
+    return pool;
+}
+
+RoxThreadPool::RoxThreadPool(int threadsCount) : m_job(0), m_count(0), m_next(0), m_finished(0), m_generation(0), m_quit(false)
+{
+    setThreadsCount(threadsCount);
+}
+
+RoxThreadPool::~RoxThreadPool()
+{
+    std::lock_guard<std::mutex> runLock(m_runMutex);
+    stop();
+}
+
+}
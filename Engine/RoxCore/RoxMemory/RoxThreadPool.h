@@ -0,0 +1,63 @@
+// Updated By the ROX_ENGINE
+// Copyright  2024 Torox Project
+// Portions Copyright  2013 nyan.developer@gmail.com (nya-engine)
+//
+// This file was modified by the Torox Project.
+// 
+// This file incorporates code from the nya-engine project, which is licensed under the MIT License.
+// See the LICENSE-MIT file in the root directory for more information.
+//
+// This file is also part of the Rox-engine, which is licensed under a dual-license system:
+// 1. Free Use License (for non-commercial and commercial use under specific conditions)
+// 2. Commercial License (for use on proprietary platforms)
+// See the LICENSE file in the root directory for the full Rox-engine license terms.
+
+#pragma once
+
+#include "RoxNonCopyable.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RoxMemory
+{
+	class RoxThreadPool : public RoxNonCopyable
+	{
+	public:
+		using Job = std::function<void(int idx)>;
+
+		// calls job(0..count-1) on the pool threads and the calling thread, returns when all are done
+		// nested calls from a job and calls while another run is in progress are executed inline
+		void run(int count, const Job& job);
+
+		int getThreadsCount() const { return static_cast<int>(m_threads.size()) + 1; }
+		void setThreadsCount(int count); // including the calling thread, 0 for hardware concurrency
+
+	public:
+		static RoxThreadPool& get();
+
+	public:
+		RoxThreadPool(int threadsCount = 0);
+		~RoxThreadPool();
+
+	private:
+		void stop();
+		void work();
+		void runJobs();
+
+	private:
+		std::vector<std::thread> m_threads;
+		std::mutex m_mutex;
+		std::mutex m_runMutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_done;
+		const Job* m_job;
+		int m_count;
+		int m_next;
+		int m_finished;
+		unsigned int m_generation;
+		bool m_quit;
+	};
+}
@@ -91,6 +91,7 @@ namespace RoxResources
 	{
 	public:
 		size_t getSize() override { return m_size; }
+		uint64_t getModificationTime() override { return m_time; }
 
 		bool readAll(void* data) override;
 		bool readChunk(void* data, size_t size, size_t offset) override;
@@ -99,7 +100,7 @@ namespace RoxResources
 		bool open(const char* file_name);
 		void release() override;
 
-		RoxFileResource() : m_size(0)
+		RoxFileResource() : m_size(0), m_time(0)
 		{
 		}
 
@@ -108,6 +109,7 @@ namespace RoxResources
 	private:
 		RoxFileReference m_file;
 		size_t m_size;
+		uint64_t m_time;
 	};
 }
 
@@ -410,6 +412,7 @@ namespace RoxResources
 		m_file.free();
 
 		m_size = 0;
+		m_time = 0;
 
 		if (!file_name)
 			return false;
@@ -424,6 +427,16 @@ namespace RoxResources
 
 		m_size = ftell(file);
 
+#ifdef _WIN32
+		struct _stat sb;
+		if (_fstat(_fileno(file), &sb) == 0)
+			m_time = uint64_t(sb.st_mtime);
+#else
+		struct stat sb;
+		if (fstat(fileno(file), &sb) == 0)
+			m_time = uint64_t(sb.st_mtime);
+#endif
+
 		return true;
 	}
 
@@ -18,6 +18,7 @@
 #include "RoxMemory/RoxMutex.h"
 #include "RoxMemory/RoxTmpBuffers.h"
 #include <cstddef>
+#include <cstdint>
 
 namespace RoxResources
 {
@@ -29,6 +30,8 @@ namespace RoxResources
     {
     public:
         virtual size_t getSize() { return 0; }
+        //last modification time in provider units, 0 if unknown
+        virtual uint64_t getModificationTime() { return 0; }
 
     public:
         virtual bool readAll(void* data) { return false; }
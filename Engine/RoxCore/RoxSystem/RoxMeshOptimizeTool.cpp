@@ -0,0 +1,256 @@
+// Copyright © 2024 Torox Project
+// Portions Copyright © 2013 nyan.developer@gmail.com (nya-engine)
+//
+// This file was modified by the Torox Project.
+//
+// This file incorporates code from the nya-engine project, which is licensed under the MIT License.
+// See the LICENSE-MIT file in the root directory for more information.
+//
+// This file is also part of the Rox-engine, which is licensed under a dual-license system:
+// 1. Free Use License (for non-commercial and commercial use under specific conditions)
+// 2. Commercial License (for use on proprietary platforms)
+// See the LICENSE file in the root directory for the full Rox-engine license terms.
+
+#include "RoxMeshOptimizeTool.h"
+#include "RoxSystem.h"
+#include "RoxFormats/RoxMeshOptimizer.h"
+#include "RoxFormats/RoxMeshClusterizer.h"
+#include "RoxFormats/RoxMeshQuantizer.h"
+#include "RoxResources/RoxFileResourcesProvider.h"
+#include "RoxMemory/RoxThreadPool.h"
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace RoxSystem
+{
+	namespace
+	{
+		std::mutex logMutex;
+
+		bool readFile(const char* filename, std::vector<char>& data)
+		{
+			data.clear();
+			FILE* f = fopen(filename, "rb");
+			if (!f)
+				return false;
+
+			if (fseek(f, 0, SEEK_END) == 0)
+			{
+				const long size = ftell(f);
+				if (size > 0)
+				{
+					data.resize(size);
+					fseek(f, 0, SEEK_SET);
+					if (fread(data.data(), size, 1, f) != 1)
+						data.clear();
+				}
+			}
+
+			fclose(f);
+			return !data.empty();
+		}
+
+		//written aside and renamed, the source stays intact if anything fails
+		bool writeFile(const char* filename, const std::vector<char>& data)
+		{
+			const std::string tmpName = std::string(filename) + ".tmp";
+			FILE* f = fopen(tmpName.c_str(), "wb");
+			if (!f)
+				return false;
+
+			const bool written = fwrite(data.data(), data.size(), 1, f) == 1;
+			if (fclose(f) != 0 || !written)
+			{
+				remove(tmpName.c_str());
+				return false;
+			}
+
+			//rename replaces the target atomically except on windows
+			if (rename(tmpName.c_str(), filename) != 0)
+			{
+				remove(filename);
+				if (rename(tmpName.c_str(), filename) != 0)
+				{
+					remove(tmpName.c_str());
+					return false;
+				}
+			}
+
+			return true;
+		}
+	}
+
+	bool quantizeNmsFile(const char* filename)
+	{
+		if (!filename)
+			return false;
+
+		std::vector<char> data;
+		if (!readFile(filename, data))
+		{
+			std::lock_guard<std::mutex> lock(logMutex);
+			log() << "unable to read nms file " << filename << "\n";
+			return false;
+		}
+
+		RoxFormats::nms_mesh_quantizer quantizer;
+		std::vector<char> result;
+		if (!quantizer.quantize_nms(data.data(), data.size(), result))
+		{
+			std::lock_guard<std::mutex> lock(logMutex);
+			log() << "unable to quantize nms file " << filename << "\n";
+			return false;
+		}
+
+		{
+			const RoxFormats::nms_mesh_quantizer::stats& s = quantizer.get_stats();
+			std::lock_guard<std::mutex> lock(logMutex);
+			log() << filename << ": " << s.verts << " vertices, " << (unsigned int)s.bytes_before << " -> " << (unsigned int)s.bytes_after << " bytes\n";
+			if (s.skipped_chunks)
+				log() << filename << ": " << s.skipped_chunks << " meshes kept, their materials don't set nya_packed_vertices\n";
+		}
+
+		return writeFile(filename, result);
+	}
+
+	bool clusterizeNmsFile(const char* filename, unsigned int maxTriangles)
+	{
+		if (!filename)
+			return false;
+
+		std::vector<char> data;
+		if (!readFile(filename, data))
+		{
+			std::lock_guard<std::mutex> lock(logMutex);
+			log() << "unable to read nms file " << filename << "\n";
+			return false;
+		}
+
+		RoxFormats::nms_mesh_clusterizer clusterizer(maxTriangles);
+		std::vector<char> result;
+		if (!clusterizer.clusterize_nms(data.data(), data.size(), result))
+		{
+			std::lock_guard<std::mutex> lock(logMutex);
+			log() << "unable to clusterize nms file " << filename << "\n";
+			return false;
+		}
+
+		{
+			const RoxFormats::nms_mesh_clusterizer::stats& s = clusterizer.get_stats();
+			std::lock_guard<std::mutex> lock(logMutex);
+			log() << filename << ": " << s.triangles << " triangles, " << s.clusters << " clusters, " << s.cone_clusters << " with normal cones\n";
+		}
+
+		return writeFile(filename, result);
+	}
+
+	bool optimizeNmsFile(const char* filename, unsigned int cacheSize)
+	{
+		if (!filename)
+			return false;
+
+		std::vector<char> data;
+		if (!readFile(filename, data))
+		{
+			std::lock_guard<std::mutex> lock(logMutex);
+			log() << "unable to read nms file " << filename << "\n";
+			return false;
+		}
+
+		RoxFormats::nms_mesh_optimizer optimizer(cacheSize);
+		std::vector<char> result;
+		if (!optimizer.optimize_nms(data.data(), data.size(), result))
+		{
+			std::lock_guard<std::mutex> lock(logMutex);
+			log() << "unable to optimize nms file " << filename << "\n";
+			return false;
+		}
+
+		{
+			const RoxFormats::nms_mesh_optimizer::stats& s = optimizer.get_stats();
+			std::lock_guard<std::mutex> lock(logMutex);
+			log() << filename << ": " << s.triangles << " triangles, acmr " << s.acmr_before() << " -> " << s.acmr_after()
+				<< ", atvr " << s.atvr_before() << " -> " << s.atvr_after() << ", vertices " << s.verts_before << " -> " << s.verts_after
+				<< ", index size " << s.index_size_before << " -> " << s.index_size_after << "\n";
+		}
+
+		return writeFile(filename, result);
+	}
+
+	bool generateNmsLods(const char* filename, const RoxFormats::nms_mesh_simplifier::level* levels, int count, bool optimize)
+	{
+		if (!filename)
+			return false;
+
+		std::vector<char> data;
+		if (!readFile(filename, data))
+		{
+			std::lock_guard<std::mutex> lock(logMutex);
+			log() << "unable to read nms file " << filename << "\n";
+			return false;
+		}
+
+		RoxFormats::nms_mesh_simplifier simplifier;
+		std::vector<char> result;
+		if (!simplifier.generate_lods_nms(data.data(), data.size(), levels, count, result))
+		{
+			std::lock_guard<std::mutex> lock(logMutex);
+			log() << "unable to generate lods for nms file " << filename << "\n";
+			return false;
+		}
+
+		{
+			const RoxFormats::nms_mesh_simplifier::stats& s = simplifier.get_stats();
+			std::lock_guard<std::mutex> lock(logMutex);
+			log() << filename << ": " << s.triangles << " triangles";
+			for (size_t i = 0; i < s.level_triangles.size(); ++i)
+				log() << ", lod" << int(i + 1) << " " << s.level_triangles[i] << " (error " << s.level_errors[i] << ")";
+			log() << "\n";
+		}
+
+		if (!writeFile(filename, result))
+			return false;
+
+		return !optimize || optimizeNmsFile(filename);
+	}
+
+	int generateNmsLodsInFolder(const char* folder, const RoxFormats::nms_mesh_simplifier::level* levels, int count, bool optimize)
+	{
+		if (!folder)
+			return 0;
+
+		RoxResources::RoxFileResourcesProvider files;
+		if (!files.setFolder(folder))
+			return 0;
+
+		std::string path(folder);
+		if (!path.empty() && path[path.length() - 1] != '/' && path[path.length() - 1] != '\\')
+			path.push_back('/');
+
+		std::vector<std::string> names;
+		for (int i = 0; i < files.getResourcesCount(); ++i)
+		{
+			const char* name = files.getResourceName(i);
+			const size_t len = name ? strlen(name) : 0;
+			if (len > 4 && strcmp(name + len - 4, ".nms") == 0)
+				names.push_back(path + name);
+		}
+
+		//files on the pool threads, the groups of each file are simplified inline then
+		std::vector<char> failed(names.size(), 0);
+		RoxMemory::RoxThreadPool::get().run((int)names.size(), [&](int idx)
+		{
+			failed[idx] = !generateNmsLods(names[idx].c_str(), levels, count, optimize);
+		});
+
+		int failedCount = 0;
+		for (size_t i = 0; i < failed.size(); ++i)
+			failedCount += failed[i];
+
+		return failedCount;
+	}
+}
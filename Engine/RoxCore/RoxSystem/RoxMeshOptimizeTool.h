@@ -0,0 +1,36 @@
+// Copyright © 2024 Torox Project
+// Portions Copyright © 2013 nyan.developer@gmail.com (nya-engine)
+//
+// This file was modified by the Torox Project.
+//
+// This file incorporates code from the nya-engine project, which is licensed under the MIT License.
+// See the LICENSE-MIT file in the root directory for more information.
+//
+// This file is also part of the Rox-engine, which is licensed under a dual-license system:
+// 1. Free Use License (for non-commercial and commercial use under specific conditions)
+// 2. Commercial License (for use on proprietary platforms)
+// See the LICENSE file in the root directory for the full Rox-engine license terms.
+
+#pragma once
+
+#include "RoxFormats/RoxMeshSimplifier.h"
+
+namespace RoxSystem
+{
+	//asset build steps, files are rewritten in place and are not meant to be opened through the resources provider
+
+	//RoxFormats::nms_mesh_quantizer, packs the meshes whose materials set nya_packed_vertices, logs the vertex data size before and after
+	bool quantizeNmsFile(const char* filename);
+
+	//RoxFormats::nms_mesh_optimizer, logs acmr/atvr before and after
+	bool optimizeNmsFile(const char* filename, unsigned int cacheSize = 16);
+
+	//RoxFormats::nms_mesh_clusterizer, the last step as the others drop the clusters
+	bool clusterizeNmsFile(const char* filename, unsigned int maxTriangles = 128);
+
+	//less detailed levels from RoxFormats::nms_mesh_simplifier, optionally optimized afterwards
+	bool generateNmsLods(const char* filename, const RoxFormats::nms_mesh_simplifier::level* levels, int count, bool optimize = true);
+
+	//every .nms file in the folder and its subfolders, the files are processed in parallel, returns the count of failed ones
+	int generateNmsLodsInFolder(const char* folder, const RoxFormats::nms_mesh_simplifier::level* levels, int count, bool optimize = true);
+}
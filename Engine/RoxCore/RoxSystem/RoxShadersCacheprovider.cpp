@@ -13,15 +13,55 @@
 // See the LICENSE file in the root directory for the full Rox-engine license terms.
 
 #include "RoxShadersCacheprovider.h"
-#include "RoxResources/RoxResources.h"
+#include "RoxRender/IRoxRenderAPI.h"
+#include "RoxMemory/RoxHash.h"
 
 #include <cstring>
 #include <cstdio>
 
-//ToDo: hash collisions
-
 namespace RoxSystem
 {
+	namespace
+	{
+		const char packName[] = "shaders.rsp";
+		const char packMagic[8] = { 'r', 'o', 'x', ' ', 'r', 's', 'p', 0 };
+		const uint32_t packVersion = 1;
+		const size_t packHeaderSize = sizeof(packMagic) + sizeof(uint32_t);
+		const size_t entryHeaderSize = sizeof(uint64_t) * 2 + sizeof(uint32_t); // key and data size
+
+		bool writeHeader(FILE* f)
+		{
+			return fwrite(packMagic, sizeof(packMagic), 1, f) == 1 && fwrite(&packVersion, sizeof(packVersion), 1, f) == 1;
+		}
+
+		bool writeEntry(FILE* f, const std::pair<uint64_t, uint64_t>& key, const std::vector<char>& data)
+		{
+			const uint32_t size = (uint32_t)data.size();
+			return fwrite(&key.first, sizeof(key.first), 1, f) == 1 && fwrite(&key.second, sizeof(key.second), 1, f) == 1
+				&& fwrite(&size, sizeof(size), 1, f) == 1 && (data.empty() || fwrite(data.data(), data.size(), 1, f) == 1);
+		}
+	}
+
+	void RoxShaderCacheProvider::setLoadPath(const char* path)
+	{
+		waitPrewarm();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		close();
+		m_load_path.assign(path ? path : "");
+	}
+
+	void RoxShaderCacheProvider::setSavePath(const char* path)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_save_path.assign(path ? path : "");
+	}
+
+	void RoxShaderCacheProvider::setDeviceId(const char* id)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_device_id.assign(id ? id : "");
+	}
+
 	bool RoxShaderCacheProvider::get(const char* text, RoxRender::RoxCompiledShader& shader)
 	{
 		shader = RoxRender::RoxCompiledShader();
@@ -29,17 +69,31 @@ namespace RoxSystem
 		if (!text)
 			return false;
 
-		RoxResources::IRoxResourceData* data =
-			RoxResources::getResourcesProvider().access((m_load_path + crc(text) + ".rsc").c_str());
+		const Key key = getKey(text);
 
-		if (!data)
+		std::lock_guard<std::mutex> lock(m_mutex);
+		open();
+		m_used.insert(key);
+
+		std::map<Key, std::vector<char> >::const_iterator warm = m_warm.find(key);
+		if (warm != m_warm.end())
+		{
+			shader = RoxRender::RoxCompiledShader(warm->second.size());
+			if (!warm->second.empty())
+				memcpy(shader.getData(), warm->second.data(), warm->second.size());
+			return true;
+		}
+
+		std::map<Key, Entry>::const_iterator it = m_index.find(key);
+		if (it == m_index.end())
 			return false;
 
-		shader = RoxRender::RoxCompiledShader(data->getSize());
-		data->readAll(shader.getData());
-		data->release();
+		shader = RoxRender::RoxCompiledShader(it->second.size);
+		if (!it->second.size || m_pack->readChunk(shader.getData(), it->second.size, it->second.offset))
+			return true;
 
-		return true;
+		shader = RoxRender::RoxCompiledShader();
+		return false;
 	}
 
 	bool RoxShaderCacheProvider::set(const char* text, const RoxRender::RoxCompiledShader& shader)
@@ -51,48 +105,241 @@ namespace RoxSystem
 		if (!data)
 			return false;
 
-		FILE* f = fopen((m_save_path + crc(text) + ".rsc").c_str(), "wb");
+		const Key key = getKey(text);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		open();
+		m_used.insert(key);
+
+		if (m_index.find(key) != m_index.end() || m_warm.find(key) != m_warm.end())
+			m_stale_size += entryHeaderSize + shader.getSize();
+
+		std::vector<char>& warm = m_warm[key];
+		warm.assign((const char*)data, (const char*)data + shader.getSize());
+
+		// a pack with a broken tail is rewritten rather than appended to, as is one mostly made of replaced entries
+		if (m_pack_valid_size != m_pack_size || (m_pack_valid_size > 0 && m_stale_size > m_pack_valid_size / 2))
+			return compactLocked(false);
+
+		return append(key, warm);
+	}
+
+	void RoxShaderCacheProvider::prewarm(const char* const* texts, int count)
+	{
+		if (!texts || count <= 0)
+			return;
+
+		std::vector<Key> keys;
+		for (int i = 0; i < count; ++i)
+		{
+			if (texts[i])
+				keys.push_back(getKey(texts[i]));
+		}
+
+		startPrewarm(keys, false);
+	}
+
+	void RoxShaderCacheProvider::prewarmAll()
+	{
+		startPrewarm(std::vector<Key>(), true);
+	}
+
+	void RoxShaderCacheProvider::waitPrewarm()
+	{
+		if (m_prewarm.joinable())
+			m_prewarm.join();
+	}
+
+	bool RoxShaderCacheProvider::compact(bool dropUnused)
+	{
+		waitPrewarm();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		open();
+		return compactLocked(dropUnused);
+	}
+
+	RoxShaderCacheProvider::~RoxShaderCacheProvider()
+	{
+		waitPrewarm();
+		close();
+	}
+
+	RoxShaderCacheProvider::Key RoxShaderCacheProvider::getKey(const char* text)
+	{
+		std::string device;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			device = m_device_id;
+		}
+
+		if (device.empty())
+			device = RoxRender::getAPIInterface().getDeviceId();
+
+		const uint64_t seed = RoxMemory::hash64(device.c_str());
+		return Key(RoxMemory::hash64(text, seed), RoxMemory::hash64(text, ~seed));
+	}
+
+	void RoxShaderCacheProvider::open()
+	{
+		if (m_opened)
+			return;
+
+		m_opened = true;
+		m_pack = RoxResources::getResourcesProvider().access((m_load_path + packName).c_str());
+		if (!m_pack)
+			return;
+
+		m_pack_size = m_pack->getSize();
+
+		char header[packHeaderSize];
+		uint32_t version = 0;
+		if (m_pack_size < packHeaderSize || !m_pack->readChunk(header, packHeaderSize, 0))
+			return;
+
+		memcpy(&version, header + sizeof(packMagic), sizeof(version));
+		if (memcmp(header, packMagic, sizeof(packMagic)) != 0 || version != packVersion)
+			return;
+
+		// entries after a truncated one are ignored, the next write rewrites the pack
+		size_t offset = packHeaderSize;
+		while (offset + entryHeaderSize <= m_pack_size)
+		{
+			char buf[entryHeaderSize];
+			if (!m_pack->readChunk(buf, entryHeaderSize, offset))
+				break;
+
+			Key key;
+			uint32_t size;
+			memcpy(&key.first, buf, sizeof(key.first));
+			memcpy(&key.second, buf + sizeof(key.first), sizeof(key.second));
+			memcpy(&size, buf + sizeof(key.first) * 2, sizeof(size));
+			if (size > m_pack_size - offset - entryHeaderSize)
+				break;
+
+			std::map<Key, Entry>::iterator it = m_index.find(key);
+			if (it != m_index.end())
+				m_stale_size += entryHeaderSize + it->second.size;
+
+			Entry& e = m_index[key];
+			e.offset = offset + entryHeaderSize;
+			e.size = size;
+			offset = e.offset + size;
+		}
+
+		m_pack_valid_size = offset;
+	}
+
+	void RoxShaderCacheProvider::close()
+	{
+		if (m_pack)
+			m_pack->release();
+
+		m_pack = 0;
+		m_pack_size = m_pack_valid_size = m_stale_size = 0;
+		m_index.clear();
+		m_opened = false;
+	}
+
+	bool RoxShaderCacheProvider::read(const Entry& e, std::vector<char>& out)
+	{
+		out.resize(e.size);
+		return !e.size || (m_pack && m_pack->readChunk(out.data(), e.size, e.offset));
+	}
+
+	bool RoxShaderCacheProvider::append(const Key& key, const std::vector<char>& data)
+	{
+		FILE* f = fopen((m_save_path + packName).c_str(), "ab");
 		if (!f)
 			return false;
 
-		fwrite(data, shader.getSize(), 1, f);
-		fclose(f);
+		bool written = fseek(f, 0, SEEK_END) == 0;
+		if (written && ftell(f) == 0)
+			written = writeHeader(f);
 
-		return true;
+		written = written && writeEntry(f, key, data);
+		return fclose(f) == 0 && written;
 	}
 
-	std::string RoxShaderCacheProvider::crc(const char* text)
+	bool RoxShaderCacheProvider::compactLocked(bool dropUnused)
 	{
-		if (!text)
-			return "";
-
-		static unsigned int crc_table[256];
-		static bool initialised = false;
-		if (!initialised)
+		std::map<Key, std::vector<char> > entries;
+		for (std::map<Key, Entry>::const_iterator it = m_index.begin(); it != m_index.end(); ++it)
 		{
-			for (int i = 0; i < 256; i++)
-			{
-				unsigned int crc = i;
-				for (int j = 0; j < 8; j++)
-					crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320UL : crc >> 1;
+			if (m_warm.find(it->first) != m_warm.end() || (dropUnused && m_used.find(it->first) == m_used.end()))
+				continue;
 
-				crc_table[i] = crc;
-			};
+			if (!read(it->second, entries[it->first]))
+				entries.erase(it->first);
+		}
 
-			initialised = true;
+		for (std::map<Key, std::vector<char> >::const_iterator it = m_warm.begin(); it != m_warm.end(); ++it)
+		{
+			if (!dropUnused || m_used.find(it->first) != m_used.end())
+				entries[it->first] = it->second;
 		}
 
-		unsigned int crc = 0xFFFFFFFFUL;
-		size_t len = strlen(text);
-		unsigned char* buf = (unsigned char*)text;
-		while (len--)
-			crc = crc_table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+		// written aside and renamed, so a crash never leaves a truncated pack
+		const std::string name = m_save_path + packName;
+		const std::string tmp_name = name + ".tmp";
+		FILE* f = fopen(tmp_name.c_str(), "wb");
+		if (!f)
+			return false;
+
+		bool written = writeHeader(f);
+		for (std::map<Key, std::vector<char> >::const_iterator it = entries.begin(); written && it != entries.end(); ++it)
+			written = writeEntry(f, it->first, it->second);
+
+		if (fclose(f) != 0 || !written)
+		{
+			remove(tmp_name.c_str());
+			return false;
+		}
 
-		char tmp[256];
-		//sprintf(tmp, "%u", crc);
-		snprintf(tmp, sizeof(tmp), "%u", crc);
+		// the pack may be the file being replaced, rename replaces it atomically except on windows
+		close();
+		if (rename(tmp_name.c_str(), name.c_str()) != 0)
+		{
+			remove(name.c_str());
+			if (rename(tmp_name.c_str(), name.c_str()) != 0)
+			{
+				remove(tmp_name.c_str());
+				return false;
+			}
+		}
 
-		return std::string(tmp);
+		return true;
 	}
 
+	void RoxShaderCacheProvider::startPrewarm(const std::vector<Key>& keys, bool all)
+	{
+		waitPrewarm();
+		m_prewarm = std::thread([this, keys, all]()
+		{
+			std::vector<Key> toRead;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				open();
+				if (all)
+				{
+					for (std::map<Key, Entry>::const_iterator it = m_index.begin(); it != m_index.end(); ++it)
+						toRead.push_back(it->first);
+				}
+				else
+					toRead = keys;
+			}
+
+			// one entry per lock, so that get() on the render thread isn't held up by the whole pack
+			for (size_t i = 0; i < toRead.size(); ++i)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_warm.find(toRead[i]) != m_warm.end())
+					continue;
+
+				std::map<Key, Entry>::const_iterator it = m_index.find(toRead[i]);
+				std::vector<char> data;
+				if (it != m_index.end() && read(it->second, data))
+					m_warm[toRead[i]].swap(data);
+			}
+		});
+	}
 }
@@ -14,17 +14,27 @@
 #pragma once
 
 #include "RoxRender/RoxShader.h"
+#include "RoxResources/RoxResources.h"
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace RoxRender{ class CompiledShader; }
 
 namespace RoxSystem
 {
+	// compiled shaders are keyed by a 128-bit hash of the text and the render device id (backend and driver)
+	// and stored in a single pack file: a header and keyed entries, new ones are appended, the last entry of a key wins
 	class RoxShaderCacheProvider : public RoxRender::IRoxCompiledShadersProvider
 	{
 	public:
-		void setLoadPath(const char* path) { m_load_path.assign(path ? path : ""); }
-		void setSavePath(const char* path) { m_save_path.assign(path ? path : ""); }
+		void setLoadPath(const char* path); // the pack is read through the resources provider
+		void setSavePath(const char* path);
+		void setDeviceId(const char* id); // RoxRender::getAPIInterface().getDeviceId() if not set
 
 	public:
 		static RoxShaderCacheProvider& get()
@@ -37,11 +47,49 @@ namespace RoxSystem
 		bool get(const char* text, RoxRender::RoxCompiledShader& shader) override;
 		bool set(const char* text, const RoxRender::RoxCompiledShader& shader) override;
 
+	public:
+		// reads the entries of the texts, or the whole pack, on a background thread, so that the first frame doesn't wait for the file
+		void prewarm(const char* const* texts, int count);
+		void prewarmAll();
+		void waitPrewarm();
+
+		// rewrites the pack without the replaced entries, and without the ones not requested since it was opened if dropUnused
+		bool compact(bool dropUnused = false);
+
+	public:
+		RoxShaderCacheProvider() : m_pack(0), m_pack_size(0), m_pack_valid_size(0), m_stale_size(0), m_opened(false) {}
+		~RoxShaderCacheProvider();
+
 	private:
-		std::string crc(const char* text);
+		typedef std::pair<uint64_t, uint64_t> Key;
+
+		struct Entry
+		{
+			size_t offset;
+			unsigned int size;
+		};
+
+		Key getKey(const char* text);
+		void open();
+		void close();
+		bool read(const Entry& e, std::vector<char>& out);
+		bool append(const Key& key, const std::vector<char>& data);
+		bool compactLocked(bool dropUnused);
+		void startPrewarm(const std::vector<Key>& keys, bool all);
 
 	private:
 		std::string m_load_path;
 		std::string m_save_path;
+		std::string m_device_id;
+		std::mutex m_mutex;
+		RoxResources::IRoxResourceData* m_pack;
+		size_t m_pack_size;
+		size_t m_pack_valid_size;
+		size_t m_stale_size;
+		bool m_opened;
+		std::map<Key, Entry> m_index;
+		std::map<Key, std::vector<char> > m_warm; // prewarmed and written this session
+		std::set<Key> m_used;
+		std::thread m_prewarm;
 	};
 }
@@ -0,0 +1,76 @@
+// Copyright © 2024 Torox Project
+// Portions Copyright © 2013 nyan.developer@gmail.com (nya-engine)
+//
+// This file was modified by the Torox Project.
+//
+// This file incorporates code from the nya-engine project, which is licensed under the MIT License.
+// See the LICENSE-MIT file in the root directory for more information.
+//
+// This file is also part of the Rox-engine, which is licensed under a dual-license system:
+// 1. Free Use License (for non-commercial and commercial use under specific conditions)
+// 2. Commercial License (for use on proprietary platforms)
+// See the LICENSE file in the root directory for the full Rox-engine license terms.
+
+#include "RoxTextureCacheProvider.h"
+#include "RoxResources/RoxResources.h"
+#include "RoxMemory/RoxTmpBuffers.h"
+
+#include <cstdio>
+
+namespace RoxSystem
+{
+	bool RoxTextureCacheProvider::get(const char* key, RoxMemory::RoxTmpBufferRef& data)
+	{
+		if (!key)
+			return false;
+
+		RoxResources::IRoxResourceData* res =
+			RoxResources::getResourcesProvider().access((m_load_path + key + ".rtc").c_str());
+
+		if (!res)
+			return false;
+
+		data.allocate(res->getSize());
+		const bool result = res->readAll(data.getData());
+		res->release();
+
+		if (!result)
+			data.free();
+
+		return result;
+	}
+
+	bool RoxTextureCacheProvider::set(const char* key, const void* data, size_t size)
+	{
+		if (!key || !data || !size)
+			return false;
+
+		//written aside and renamed, so a crash or a concurrent run never leaves a truncated entry
+		const std::string name = m_save_path + key + ".rtc";
+		const std::string tmp_name = name + ".tmp";
+
+		FILE* f = fopen(tmp_name.c_str(), "wb");
+		if (!f)
+			return false;
+
+		const bool written = fwrite(data, size, 1, f) == 1;
+		if (fclose(f) != 0 || !written)
+		{
+			remove(tmp_name.c_str());
+			return false;
+		}
+
+		//rename replaces the target atomically except on windows
+		if (rename(tmp_name.c_str(), name.c_str()) != 0)
+		{
+			remove(name.c_str());
+			if (rename(tmp_name.c_str(), name.c_str()) != 0)
+			{
+				remove(tmp_name.c_str());
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
@@ -187,6 +187,7 @@ namespace RoxRender
 	public:
 		virtual int setProgramBinaryShader(const char* vertex_code, const char* pixel_code, RoxCompiledShader& cmp_shdr) { return -1; }
 		virtual bool getProgramBinaryShader(int idx, RoxCompiledShader& cmp_shdr) { return false; }
+		virtual const char* getDeviceId() { return ""; } // backend and driver, program binaries are valid only for the same id
 
 	public:
 		virtual void setCamera(const RoxMath::Matrix4& model_view, const RoxMath::Matrix4& projection)
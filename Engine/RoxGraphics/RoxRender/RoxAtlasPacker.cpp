@@ -0,0 +1,131 @@
+// Updated By the ROX_ENGINE
+// Copyright (C) 2024 Torox Project
+// Portions Copyright (C) 2013 nyan.developer@gmail.com (nya-engine)
+//
+// This file was modified by the Torox Project.
+// 
+// This file incorporates code from the nya-engine project, which is licensed under the MIT License.
+// See the LICENSE-MIT file in the root directory for more information.
+//
+// This file is also part of the Rox-engine, which is licensed under a dual-license system:
+// 1. Free Use License (for non-commercial and commercial use under specific conditions)
+// 2. Commercial License (for use on proprietary platforms)
+// See the LICENSE file in the root directory for the full Rox-engine license terms.
+
+
+#include "RoxAtlasPacker.h"
+
+namespace RoxRender
+{
+	void RoxAtlasPacker::init(uint width, uint height)
+	{
+		m_width = width;
+		m_height = height;
+		clear();
+	}
+
+	void RoxAtlasPacker::clear()
+	{
+		m_skyline.clear();
+		m_usedArea = 0;
+
+		Node n = { 0, 0, m_width };
+		m_skyline.push_back(n);
+	}
+
+	bool RoxAtlasPacker::fit(size_t idx, uint width, uint height, uint& y) const
+	{
+		const uint x = m_skyline[idx].x;
+		if (x + width > m_width)
+			return false;
+
+		y = 0;
+		for (uint left = width; left > 0; ++idx)
+		{
+			if (idx >= m_skyline.size())
+				return false;
+
+			if (m_skyline[idx].y > y)
+				y = m_skyline[idx].y;
+			if (y + height > m_height)
+				return false;
+
+			left = m_skyline[idx].width >= left ? 0 : left - m_skyline[idx].width;
+		}
+
+		return true;
+	}
+
+	bool RoxAtlasPacker::add(uint width, uint height, uint& x, uint& y)
+	{
+		if (!width || !height || width > m_width || height > m_height)
+			return false;
+
+		size_t best = m_skyline.size();
+		uint bestTop = 0, bestWidth = 0;
+		for (size_t i = 0; i < m_skyline.size(); ++i)
+		{
+			uint top;
+			if (!fit(i, width, height, top))
+				continue;
+
+			top += height;
+			if (best == m_skyline.size() || top < bestTop || (top == bestTop && m_skyline[i].width < bestWidth))
+			{
+				best = i;
+				bestTop = top;
+				bestWidth = m_skyline[i].width;
+			}
+		}
+
+		if (best == m_skyline.size())
+			return false;
+
+		x = m_skyline[best].x;
+		y = bestTop - height;
+
+		Node n = { x, bestTop, width };
+		m_skyline.insert(m_skyline.begin() + best, n);
+
+		//shrink or remove the nodes now covered by the new one
+		for (size_t i = best + 1; i < m_skyline.size();)
+		{
+			const uint end = n.x + n.width;
+			if (m_skyline[i].x >= end)
+				break;
+
+			const uint nodeEnd = m_skyline[i].x + m_skyline[i].width;
+			if (nodeEnd <= end)
+			{
+				m_skyline.erase(m_skyline.begin() + i);
+				continue;
+			}
+
+			m_skyline[i].width = nodeEnd - end;
+			m_skyline[i].x = end;
+			break;
+		}
+
+		for (size_t i = 0; i + 1 < m_skyline.size();)
+		{
+			if (m_skyline[i].y == m_skyline[i + 1].y)
+			{
+				m_skyline[i].width += m_skyline[i + 1].width;
+				m_skyline.erase(m_skyline.begin() + i + 1);
+			}
+			else
+				++i;
+		}
+
+		m_usedArea += size_t(width) * height;
+		return true;
+	}
+
+	float RoxAtlasPacker::getOccupancy() const
+	{
+		if (!m_width || !m_height)
+			return 0.0f;
+
+		return float(m_usedArea) / (float(m_width) * m_height);
+	}
+}
@@ -0,0 +1,56 @@
+// Updated By the ROX_ENGINE
+// Copyright (C) 2024 Torox Project
+// Portions Copyright (C) 2013 nyan.developer@gmail.com (nya-engine)
+//
+// This file was modified by the Torox Project.
+// 
+// This file incorporates code from the nya-engine project, which is licensed under the MIT License.
+// See the LICENSE-MIT file in the root directory for more information.
+//
+// This file is also part of the Rox-engine, which is licensed under a dual-license system:
+// 1. Free Use License (for non-commercial and commercial use under specific conditions)
+// 2. Commercial License (for use on proprietary platforms)
+// See the LICENSE file in the root directory for the full Rox-engine license terms.
+
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+namespace RoxRender
+{
+	//skyline bottom-left rectangle packer, rects can't be freed one by one, clear and add them again to repack
+	class RoxAtlasPacker
+	{
+	public:
+		typedef unsigned int uint;
+
+		void init(uint width, uint height);
+		void clear();
+
+		bool add(uint width, uint height, uint& x, uint& y);
+
+		uint getWidth() const { return m_width; }
+		uint getHeight() const { return m_height; }
+		float getOccupancy() const;
+
+	public:
+		RoxAtlasPacker(): m_width(0), m_height(0), m_usedArea(0) {}
+		RoxAtlasPacker(uint width, uint height) { init(width, height); }
+
+	private:
+		bool fit(size_t idx, uint width, uint height, uint& y) const;
+
+	private:
+		struct Node
+		{
+			uint x, y, width;
+		};
+
+		std::vector<Node> m_skyline;
+		uint m_width;
+		uint m_height;
+		size_t m_usedArea;
+	};
+}
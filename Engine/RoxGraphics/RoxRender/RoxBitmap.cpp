@@ -13,14 +13,68 @@
 // See the LICENSE file in the root directory for the full Rox-engine license terms.
 
 #include "RoxBitmap.h"
+#include "RoxBitmapSimd.h"
 #include "RoxMemory/RoxAlignAlloc.h"
 #include "RoxMemory/RoxTmpBuffers.h"
+#include "RoxMemory/RoxThreadPool.h"
 
+#include <atomic>
 #include <cstring>
 #include <vector>
 
 namespace RoxRender
 {
+	namespace
+	{
+		BitmapSimd simdLimit = BITMAP_SIMD_AVX2;
+		bool parallelEnabled = true;
+		int parallelThreshold = 512 * 1024;
+		const int bandBytes = 64 * 1024; // about the L2 share of one core, input and output
+
+		bool isParallel(size_t bytes)
+		{
+			return parallelEnabled && bytes >= (size_t)parallelThreshold && RoxMemory::RoxThreadPool::get().getThreadsCount() > 1;
+		}
+
+		// calls f(from, to) for bands of rows, on the thread pool for large images
+		// band sizes are multiples of align rows so SIMD kernels don't get split
+		template<typename F>
+		void forRowBands(int rows, size_t rowBytes, int align, const F& f)
+		{
+			if (rows <= 0)
+				return;
+
+			if (rows < 2 * align || !isParallel(rowBytes * rows))
+			{
+				f(0, rows);
+				return;
+			}
+
+			int band = rowBytes < (size_t)bandBytes ? (int)(bandBytes / rowBytes) : 1;
+			band = (band + align - 1) / align * align;
+			RoxMemory::RoxThreadPool::get().run((rows + band - 1) / band, [&](int idx) {
+				const int from = idx * band;
+				f(from, from + band < rows ? from + band : rows);
+			});
+		}
+
+		template<typename F>
+		void forPixelBands(int count, int bytesPerPixel, const F& f) { forRowBands(count, bytesPerPixel, 64, f); }
+
+		bool overlaps(const uint8_t* a, size_t aSize, const uint8_t* b, size_t bSize) { return a < b + bSize && b < a + aSize; }
+	}
+
+	void bitmapSetSimd(BitmapSimd simd) { simdLimit = simd; }
+
+	BitmapSimd bitmapGetSimd()
+	{
+		const BitmapSimd supported = bitmapSupportedSimd();
+		return simdLimit < supported ? simdLimit : supported;
+	}
+
+	void bitmapSetParallel(bool enable) { parallelEnabled = enable; }
+	void bitmapSetParallelThreshold(int bytes) { parallelThreshold = bytes; }
+
 	inline uint32_t average(uint32_t a, uint32_t b) { return (((a ^ b) & 0xfefefefeL) >> 1) + (a & b); }
 
 	void bitmap_downsample_x(const uint32_t* data32, int width, int height, int channels, uint32_t* out32)
@@ -72,8 +126,73 @@ namespace RoxRender
 		}
 	}
 
+	// rows is the count of the output rows, nested gives the in place result which averages the horizontal averages
+	void bitmap_downsample_xy(const uint8_t* data, int width, int rows, int channels, bool nested, uint8_t* out)
+	{
+		if (channels == 4 && (nested || RoxMemory::isAligned(data, 4)) && simdDownsample2xRgba(data, width, rows * 2, out))
+			return;
+
+		if (channels == 4 && RoxMemory::isAligned(data, 4))
+		{
+			const uint32_t* data32 = (uint32_t*)data;
+			uint32_t* out32 = (uint32_t*)out;
+			for (int h = 0; h < rows; ++h)
+			{
+				const uint32_t* hdata = data32 + (h * 2) * width;
+				for (int w = 0; w < width / 2; ++w, hdata += 2)
+					*out32++ = average(average(hdata[0], hdata[1]), average(hdata[width], hdata[width + 1]));
+			}
+			return;
+		}
+
+		for (int h = 0; h < rows; ++h)
+		{
+			const uint8_t* hdata = data + (h * channels * 2) * width;
+			for (int w = 0; w < width / 2; ++w, hdata += channels * 2)
+			{
+				const uint8_t* wdata = hdata;
+				for (int c = 0; c < channels; ++c, ++wdata)
+				{
+					if (nested)
+					{
+						*out++ = ((wdata[0] + wdata[channels]) / 2 +
+							(wdata[channels * width] + wdata[channels * width + channels]) / 2) / 2;
+					}
+					else
+					{
+						*out++ = (wdata[0] +
+							wdata[channels] +
+							wdata[channels * width] +
+							wdata[channels * width + channels]) / 4;
+					}
+				}
+			}
+		}
+	}
+
+	void bitmap_downsample_xy_bands(const uint8_t* data, int width, int height, int channels, bool nested, uint8_t* out)
+	{
+		const int line_size = width * channels;
+		const int out_line_size = width / 2 * channels;
+		forRowBands(height / 2, line_size * 2, 1, [&](int from, int to) {
+			bitmap_downsample_xy(data + from * 2 * line_size, width, to - from, channels, nested, out + from * out_line_size);
+		});
+	}
+
 	void bitmapDownsample2x(uint8_t* data, int width, int height, int channels)
 	{
+		if (width > 1 && height > 1 && isParallel(width * height * channels))
+		{
+			RoxMemory::RoxTmpBufferScoped buf((width / 2) * (height / 2) * channels);
+			bitmap_downsample_xy_bands(data, width, height, channels, true, (uint8_t*)buf.getData());
+			buf.copyTo(data, buf.getSize());
+			return;
+		}
+
+		// both scalar paths are a floor average of the x averages here, so the alignment doesn't matter
+		if (channels == 4 && width > 1 && height > 1 && simdDownsample2xRgba(data, width, height, data))
+			return;
+
 		if (channels == 4 && RoxMemory::isAligned(data, 4))
 		{
 			if (width > 1)
@@ -112,34 +231,7 @@ namespace RoxRender
 			return;
 		}
 
-		if (channels == 4 && RoxMemory::isAligned(data, 4))
-		{
-			const uint32_t* data32 = (uint32_t*)data;
-			uint32_t* out32 = (uint32_t*)out;
-			for (int h = 0; h < height / 2; ++h)
-			{
-				const uint32_t* hdata = data32 + (h * 2) * width;
-				for (int w = 0; w < width / 2; ++w, hdata += 2)
-					*out32++ = average(average(hdata[0], hdata[1]), average(hdata[width], hdata[width + 1]));
-			}
-			return;
-		}
-
-		for (int h = 0; h < height / 2; ++h)
-		{
-			const uint8_t* hdata = data + (h * channels * 2) * width;
-			for (int w = 0; w < width / 2; ++w, hdata += channels * 2)
-			{
-				const uint8_t* wdata = hdata;
-				for (int c = 0; c < channels; ++c, ++wdata)
-				{
-					*out++ = (wdata[0] +
-						wdata[channels] +
-						wdata[channels * width] +
-						wdata[channels * width + channels]) / 4;
-				}
-			}
-		}
+		bitmap_downsample_xy_bands(data, width, height, channels, false, out);
 	}
 
 	//================ Flip =================
@@ -153,30 +245,33 @@ namespace RoxRender
 	void bitmapFlipVertical(uint8_t* data, int width, int height, int channels)
 	{
 		const int line_size = width * channels;
-		const int half = line_size * (height / 2);
-		const int top = line_size * (height - 1);
-		std::vector<uint8_t> line_data(line_size);
-		uint8_t *line = &line_data[0], *from = data, *to = data + top;
-
-		for (int offset = 0; offset < half; offset += line_size)
-		{
-			uint8_t *f = from + offset, *t = to - offset;
-			memcpy(line, f, line_size);
-			memcpy(f, t, line_size);
-			memcpy(t, line, line_size);
-		}
+		forRowBands(height / 2, line_size * 2, 1, [&](int from, int to) {
+			std::vector<uint8_t> line_data(line_size);
+			uint8_t* line = &line_data[0];
+			for (int y = from; y < to; ++y)
+			{
+				uint8_t *f = data + y * line_size, *t = data + (height - 1 - y) * line_size;
+				memcpy(line, f, line_size);
+				memcpy(f, t, line_size);
+				memcpy(t, line, line_size);
+			}
+		});
 	}
 
 	void bitmapFlipVertical(const uint8_t* data, int width, int height, int channels, uint8_t* out)
 	{
 		const int line_size = width * channels;
-		out += line_size * (height - 1);
-		for (int y = 0; y < height; ++y, data += line_size, out -= line_size)
-			memcpy(out, data, line_size);
+		forRowBands(height, line_size, 1, [&](int from, int to) {
+			for (int y = from; y < to; ++y)
+				memcpy(out + (height - 1 - y) * line_size, data + y * line_size, line_size);
+		});
 	}
 
-	void bitmapFlipHorisontal(uint8_t* data, int width, int height, int channels)
+	void bitmap_flip_horisontal(uint8_t* data, int width, int height, int channels)
 	{
+		if (channels == 4 && simdFlipHorisontalRgba(data, width, height))
+			return;
+
 		const int line_size = width * channels;
 		const int size = width * height * channels;
 		const int half = line_size / 2;
@@ -191,8 +286,11 @@ namespace RoxRender
 		}
 	}
 
-	void bitmapFlipHorisontal(const uint8_t* data, int width, int height, int channels, uint8_t* out)
+	void bitmap_flip_horisontal(const uint8_t* data, int width, int height, int channels, uint8_t* out)
 	{
+		if (channels == 4 && simdFlipHorisontalRgba(data, width, height, out))
+			return;
+
 		const int line_size = width * channels;
 		out += (width - 1) * channels;
 		for (int y = 0; y < height; ++y, data += line_size, out += line_size)
@@ -202,10 +300,54 @@ namespace RoxRender
 		}
 	}
 
+	void bitmapFlipHorisontal(uint8_t* data, int width, int height, int channels)
+	{
+		const int line_size = width * channels;
+		forRowBands(height, line_size, 1, [&](int from, int to) {
+			bitmap_flip_horisontal(data + from * line_size, width, to - from, channels);
+		});
+	}
+
+	void bitmapFlipHorisontal(const uint8_t* data, int width, int height, int channels, uint8_t* out)
+	{
+		const int line_size = width * channels;
+		forRowBands(height, line_size, 1, [&](int from, int to) {
+			bitmap_flip_horisontal(data + from * line_size, width, to - from, channels, out + from * line_size);
+		});
+	}
+
 	//================ Rotate =================
+	void bitmap_rotate_90(const uint8_t* data, int width, int height, int channels, bool left, int from, int to, uint8_t* out)
+	{
+		if (channels == 4 && simdRotate90Rgba(data, width, height, left, from, to, out))
+			return;
+
+		data += from * width * channels;
+		for (int x = from; x < to; ++x)
+		{
+			for (int y = 0; y < width; ++y, data += channels)
+			{
+				if (left)
+					memcpy(out + (y * height + height - x - 1) * channels, data, channels);
+				else
+					memcpy(out + ((width - y - 1) * height + x) * channels, data, channels);
+			}
+		}
+	}
+
+	void bitmap_rotate_90_bands(const uint8_t* data, int width, int height, int channels, bool left, uint8_t* out)
+	{
+		// source rows become output columns, tiles of 16 rows keep the output writes a cache line wide
+		const int tile = 16;
+		forRowBands(height, width * channels, tile, [&](int from, int to) {
+			for (int x = from; x < to; x += tile)
+				bitmap_rotate_90(data, width, height, channels, left, x, x + tile < to ? x + tile : to, out);
+		});
+	}
+
 	void bitmapRotate_90_left(uint8_t* data, int width, int height, int channels)
 	{
-		if (width != height)
+		if (width != height || (channels == 4 && bitmapGetSimd() != BITMAP_SIMD_NONE) || isParallel(width * height * channels))
 		{
 			RoxMemory::RoxTmpBufferScoped buf(width * height * channels);
 			bitmapRotate_90_left(data, width, height, channels, (uint8_t*)buf.getData());
@@ -224,16 +366,12 @@ namespace RoxRender
 
 	void bitmapRotate_90_left(const uint8_t* data, int width, int height, int channels, uint8_t* out)
 	{
-		for (int x = 0; x < height; ++x)
-		{
-			for (int y = 0; y < width; ++y, data += channels)
-				memcpy(out + (y * height + height - x - 1) * channels, data, channels);
-		}
+		bitmap_rotate_90_bands(data, width, height, channels, true, out);
 	}
 
 	void bitmapRotate_90_right(uint8_t* data, int width, int height, int channels)
 	{
-		if (width != height)
+		if (width != height || (channels == 4 && bitmapGetSimd() != BITMAP_SIMD_NONE) || isParallel(width * height * channels))
 		{
 			RoxMemory::RoxTmpBufferScoped buf(width * height * channels);
 			bitmapRotate_90_right(data, width, height, channels, (uint8_t*)buf.getData());
@@ -252,15 +390,33 @@ namespace RoxRender
 
 	void bitmapRotate_90_right(const uint8_t* data, int width, int height, int channels, uint8_t* out)
 	{
-		for (int x = 0; x < height; ++x)
-		{
-			for (int y = 0; y < width; ++y, data += channels)
-				memcpy(out + ((width - y - 1) * height + x) * channels, data, channels);
-		}
+		bitmap_rotate_90_bands(data, width, height, channels, false, out);
+	}
+
+	// reverses the order of count pixels
+	void bitmap_reverse(const uint8_t* data, int count, int channels, uint8_t* out)
+	{
+		if (channels == 4 && simdFlipHorisontalRgba(data, count, 1, out))
+			return;
+
+		out += (count - 1) * channels;
+		for (int i = 0; i < count; ++i, out -= channels, data += channels)
+			memcpy(out, data, channels);
 	}
 
 	void bitmapRotate_180(uint8_t* data, int width, int height, int channels)
 	{
+		if (isParallel(width * height * channels))
+		{
+			RoxMemory::RoxTmpBufferScoped buf(width * height * channels);
+			bitmapRotate_180(data, width, height, channels, (uint8_t*)buf.getData());
+			buf.copyTo(data, buf.getSize());
+			return;
+		}
+
+		if (channels == 4 && simdFlipHorisontalRgba(data, width * height, 1))
+			return;
+
 		const int line_size = width * channels;
 		const int size = width * height * channels;
 		const int top = line_size * (height - 1);
@@ -285,9 +441,10 @@ namespace RoxRender
 
 	void bitmapRotate_180(const uint8_t* data, int width, int height, int channels, uint8_t* out)
 	{
-		out += (height - 1) * width * channels + (width - 1) * channels;
-		for (int i = 0; i < width * height; ++i, out -= channels, data += channels)
-			memcpy(out, data, channels);
+		const int line_size = width * channels;
+		forRowBands(height, line_size, 1, [&](int from, int to) {
+			bitmap_reverse(data + from * line_size, (to - from) * width, channels, out + (height - to) * line_size);
+		});
 	}
 
 	//================================================
@@ -313,20 +470,35 @@ namespace RoxRender
 		data += (width * y + x) * channels;
 		const int line_size = width * channels;
 		const int crop_line_size = crop_width * channels;
-		for (int i = 0; i < crop_height; ++i, out += crop_line_size, data += line_size)
-			memmove(out, data, crop_line_size);
+
+		// rows move towards the start when cropping in place, so the order matters
+		if (overlaps(data, line_size * crop_height, out, crop_line_size * crop_height))
+		{
+			for (int i = 0; i < crop_height; ++i, out += crop_line_size, data += line_size)
+				memmove(out, data, crop_line_size);
+			return;
+		}
+
+		forRowBands(crop_height, crop_line_size, 1, [&](int from, int to) {
+			for (int i = from; i < to; ++i)
+				memcpy(out + i * crop_line_size, data + i * line_size, crop_line_size);
+		});
 	}
 
 	//================ Resize =================
-	void bitmapResize(const uint8_t* data, int width, int height, int new_width, int new_height, int channels,
-	                  uint8_t* out)
+	void bitmap_resize(const uint8_t* data, int width, int height, int new_width, int new_height, int channels,
+	                   int from, int to, uint8_t* out)
 	{
+		if (channels == 4 && simdResizeRgba(data, width, height, new_width, new_height, from, to, out))
+			return;
+
 		const uint32_t stride = width * channels;
 		const uint32_t stride_1 = (width + 1) * channels;
 		const uint32_t x_ratio = ((width - 1) << 16) / new_width;
 		const uint32_t y_ratio = ((height - 1) << 16) / new_height;
-		uint64_t y = 0;
-		for (int i = 0; i < new_height; ++i)
+		uint64_t y = (uint64_t)y_ratio * from;
+		out += from * new_width * channels;
+		for (int i = from; i < to; ++i)
 		{
 			const uint32_t yr = (uint32_t)(y >> 16), y_index = yr * width;
 			const uint64_t dy = y - (yr << 16), dy2 = (1 << 16) - dy;
@@ -349,20 +521,28 @@ namespace RoxRender
 		}
 	}
 
+	void bitmapResize(const uint8_t* data, int width, int height, int new_width, int new_height, int channels,
+	                  uint8_t* out)
+	{
+		forRowBands(new_height, new_width * channels, 1, [&](int from, int to) {
+			bitmap_resize(data, width, height, new_width, new_height, channels, from, to, out);
+		});
+	}
+
 	//================ RGB to BGR =================
-	void bitmapRgbToBgr(uint8_t* data, int width, int height, int channels)
+	void bitmap_rgb_to_bgr(uint8_t* data, int count, int channels)
 	{
-		if (channels < 3)
+		if (simdRgbToBgr(data, count, 1, channels, data))
 			return;
 
 		if (channels == 4 && RoxMemory::isAligned(data, 4))
 		{
-			for (const uint8_t* to = data + width * height * 4; data < to; data += 4)
+			for (const uint8_t* to = data + count * 4; data < to; data += 4)
 				*(uint32_t*)(data) = (data[0] << 16) | (data[1] << 8) | data[2] | (data[3] << 24);
 			return;
 		}
 
-		for (int i = 0; i < width * height; ++i, data += channels)
+		for (int i = 0; i < count; ++i, data += channels)
 		{
 			const uint8_t tmp = data[0];
 			data[0] = data[2];
@@ -370,11 +550,14 @@ namespace RoxRender
 		}
 	}
 
-	void bitmapRgbToBgr(const uint8_t* data, int width, int height, int channels, uint8_t* out)
+	void bitmap_rgb_to_bgr(const uint8_t* data, int count, int channels, uint8_t* out)
 	{
+		if (simdRgbToBgr(data, count, 1, channels, out))
+			return;
+
 		if (channels == 3)
 		{
-			for (int i = 0; i < width * height; ++i, data += 3, out += 3)
+			for (int i = 0; i < count; ++i, data += 3, out += 3)
 				out[0] = data[2], out[1] = data[1], out[2] = data[0];
 		}
 		else if (channels == 4)
@@ -382,12 +565,12 @@ namespace RoxRender
 			if (RoxMemory::isAligned(out, 4))
 			{
 				uint32_t* out32 = (uint32_t*)out;
-				for (const uint8_t* to = data + width * height * 4; data < to; data += 4)
+				for (const uint8_t* to = data + count * 4; data < to; data += 4)
 					*out32++ = (data[0] << 16) | (data[1] << 8) | data[2] | (data[3] << 24);
 				return;
 			}
 
-			for (int i = 0; i < width * height; ++i, data += 4, out += 4)
+			for (int i = 0; i < count; ++i, data += 4, out += 4)
 			{
 				out[0] = data[2];
 				out[1] = data[1];
@@ -396,18 +579,33 @@ namespace RoxRender
 			}
 		}
 		else
-			memcpy(out, data, width * height * channels);
+			memcpy(out, data, count * channels);
 	}
 
-	//================ RGBA to RGB =================
-	void bitmapRgbaToRgb(uint8_t* data, int width, int height)
+	void bitmapRgbToBgr(uint8_t* data, int width, int height, int channels)
 	{
-		bitmapRgbaToRgb(data, width, height, data);
+		if (channels < 3)
+			return;
+
+		forPixelBands(width * height, channels, [&](int from, int to) {
+			bitmap_rgb_to_bgr(data + from * channels, to - from, channels);
+		});
 	}
 
-	void bitmapRgbaToRgb(const uint8_t* data, int width, int height, uint8_t* out)
+	void bitmapRgbToBgr(const uint8_t* data, int width, int height, int channels, uint8_t* out)
+	{
+		forPixelBands(width * height, channels, [&](int from, int to) {
+			bitmap_rgb_to_bgr(data + from * channels, to - from, channels, out + from * channels);
+		});
+	}
+
+	//================ RGBA to RGB =================
+	void bitmap_rgba_to_rgb(const uint8_t* data, int count, uint8_t* out)
 	{
-		for (const uint8_t* to = data + width * height * 4; data < to; data += 4, out += 3)
+		if (simdRgbaToRgb(data, count, 1, false, out))
+			return;
+
+		for (const uint8_t* to = data + count * 4; data < to; data += 4, out += 3)
 		{
 			out[0] = data[0];
 			out[1] = data[1];
@@ -415,8 +613,43 @@ namespace RoxRender
 		}
 	}
 
+	void bitmap_rgra_to_rgb(const uint8_t* data, int count, uint8_t* out)
+	{
+		if (simdRgbaToRgb(data, count, 1, true, out))
+			return;
+
+		for (const uint8_t* to = data + count * 4; data < to; data += 4, out += 3)
+		{
+			out[0] = data[2];
+			out[1] = data[1];
+			out[2] = data[0];
+		}
+	}
+
+	void bitmapRgbaToRgb(uint8_t* data, int width, int height)
+	{
+		// the output overlaps the input of the other bands, so in place is serial
+		bitmap_rgba_to_rgb(data, width * height, data);
+	}
+
+	void bitmapRgbaToRgb(const uint8_t* data, int width, int height, uint8_t* out)
+	{
+		if (overlaps(data, width * height * 4, out, width * height * 3))
+		{
+			bitmap_rgba_to_rgb(data, width * height, out);
+			return;
+		}
+
+		forPixelBands(width * height, 4, [&](int from, int to) {
+			bitmap_rgba_to_rgb(data + from * 4, to - from, out + from * 3);
+		});
+	}
+
 	void bitmapRgraToRgb(uint8_t* data, int width, int height)
 	{
+		if (simdRgbaToRgb(data, width * height, 1, true, data))
+			return;
+
 		const uint8_t* to = data + width * height * 4;
 		uint8_t* out = data;
 
@@ -438,61 +671,87 @@ namespace RoxRender
 
 	void bitmapRgraToRgb(const uint8_t* data, int width, int height, uint8_t* out)
 	{
-		for (const uint8_t* to = data + width * height * 4; data < to; data += 4, out += 3)
+		if (overlaps(data, width * height * 4, out, width * height * 3))
 		{
-			out[0] = data[2];
-			out[1] = data[1];
-			out[2] = data[0];
+			bitmap_rgra_to_rgb(data, width * height, out);
+			return;
 		}
+
+		forPixelBands(width * height, 4, [&](int from, int to) {
+			bitmap_rgra_to_rgb(data + from * 4, to - from, out + from * 3);
+		});
 	}
 
 	//================ RGB to RGBA =================
-	void bitmapRgbToRgba(const uint8_t* data, int width, int height, uint8_t alpha, uint8_t* out)
+	void bitmap_rgb_to_rgba(const uint8_t* data, int count, uint8_t alpha, bool bgra, uint8_t* out)
 	{
-		data += width * height * 3;
-		out += width * height * 4;
-		for (int i = 0; i < width * height; ++i)
+		if (simdRgbToRgba(data, count, 1, alpha, bgra, out))
+			return;
+
+		data += count * 3;
+		out += count * 4;
+		for (int i = 0; i < count; ++i)
 		{
 			out -= 4, data -= 3;
-			out[0] = data[0];
-			out[1] = data[1];
-			out[2] = data[2];
+			const uint8_t c0 = data[bgra ? 2 : 0], c1 = data[1], c2 = data[bgra ? 0 : 2]; // the first pixels overlap when converting in place
+			out[0] = c0;
+			out[1] = c1;
+			out[2] = c2;
 			out[3] = alpha;
 		}
 	}
 
-	void bitmapRgbToBgra(const uint8_t* data, int width, int height, uint8_t alpha, uint8_t* out)
+	void bitmap_rgb_to_rgba_bands(const uint8_t* data, int width, int height, uint8_t alpha, bool bgra, uint8_t* out)
 	{
-		data += width * height * 3;
-		out += width * height * 4;
-		for (int i = 0; i < width * height; ++i)
+		if (overlaps(data, width * height * 3, out, width * height * 4))
 		{
-			out -= 4, data -= 3;
-			out[0] = data[2];
-			out[1] = data[1];
-			out[2] = data[0];
-			out[3] = alpha;
+			bitmap_rgb_to_rgba(data, width * height, alpha, bgra, out);
+			return;
 		}
+
+		forPixelBands(width * height, 4, [&](int from, int to) {
+			bitmap_rgb_to_rgba(data + from * 3, to - from, alpha, bgra, out + from * 4);
+		});
 	}
 
-	//================ RGB to BGRA =================
-	void bitmapArgbToRgba(uint8_t* data, int width, int height)
+	void bitmapRgbToRgba(const uint8_t* data, int width, int height, uint8_t alpha, uint8_t* out)
 	{
-		bitmapArgbToRgba(data, width, height, data);
+		bitmap_rgb_to_rgba_bands(data, width, height, alpha, false, out);
 	}
 
-	void bitmapArgbToRgba(const uint8_t* data, int width, int height, uint8_t* out)
+	void bitmapRgbToBgra(const uint8_t* data, int width, int height, uint8_t alpha, uint8_t* out)
+	{
+		bitmap_rgb_to_rgba_bands(data, width, height, alpha, true, out);
+	}
+
+	//================ RGB to BGRA =================
+	void bitmap_argb_to_rgba(const uint8_t* data, int count, bool bgra, uint8_t* out)
 	{
+		if (simdArgbToRgba(data, count, 1, bgra, out))
+			return;
+
 		const uint32_t* data32 = (uint32_t*)data;
 		uint32_t* out32 = (uint32_t*)out;
-		const uint32_t* to = data32 + width * height;
+		const uint32_t* to = data32 + count;
 		while (data32 < to)
 		{
 			const uint32_t c = *data32++;
-			*out32++ = c << 24 | c >> 8;
+			*out32++ = bgra ? (c << 24 | (c << 8 & 0x00FF0000) | (c >> 8 & 0x0000FF00) | c >> 24) : (c << 24 | c >> 8);
 		}
 	}
 
+	void bitmapArgbToRgba(uint8_t* data, int width, int height)
+	{
+		bitmapArgbToRgba(data, width, height, data);
+	}
+
+	void bitmapArgbToRgba(const uint8_t* data, int width, int height, uint8_t* out)
+	{
+		forPixelBands(width * height, 4, [&](int from, int to) {
+			bitmap_argb_to_rgba(data + from * 4, to - from, false, out + from * 4);
+		});
+	}
+
 	void bitmapArgbToBgra(uint8_t* data, int width, int height)
 	{
 		bitmapArgbToBgra(data, width, height, data);
@@ -500,38 +759,46 @@ namespace RoxRender
 
 	void bitmapArgbToBgra(const uint8_t* data, int width, int height, uint8_t* out)
 	{
-		const uint32_t* data32 = (uint32_t*)data;
-		uint32_t* out32 = (uint32_t*)out;
-		const uint32_t* to = data32 + width * height;
-		while (data32 < to)
-		{
-			const uint32_t c = *data32++;
-			*out32++ = c << 24 | (c << 8 & 0x00FF0000) | (c >> 8 & 0x0000FF00) | c >> 24;
-		}
+		forPixelBands(width * height, 4, [&](int from, int to) {
+			bitmap_argb_to_rgba(data + from * 4, to - from, true, out + from * 4);
+		});
 	}
 
 	//================ RGB to YUV420 =================
-	inline void colorToYuv420(const uint8_t* data[3], int width, int height, int channels, uint8_t* out)
+	inline void colorToYuv420(const uint8_t* data[3], int width, int height, int channels, bool bgr, uint8_t* out)
 	{
-		int image_size = width * height;
+		const int image_size = width * height;
 		uint8_t* dst_y = out;
 		uint8_t* dst_u = dst_y + image_size;
 		uint8_t* dst_v = dst_u + image_size / 4;
-		image_size *= channels;
-
-		for (int i = 0; i < image_size; i += channels)
-			*dst_y++ = ((66 * data[0][i] + 129 * data[1][i] + 25 * data[2][i]) >> 8) + 16;
 
 		const int stride = width * channels;
 		const int channels2 = channels * 2;
-		for (int y = 0, i = 0; y < height; y += 2, i += stride)
-		{
-			for (int x = 0; x < width; x += 2, i += channels2)
+		const int half_width = (width + 1) / 2;
+
+		// bands of row pairs, each pair gives a row of chroma
+		forRowBands((height + 1) / 2, stride * 2, 1, [&](int from, int to) {
+			const int luma_from = from * 2 * width;
+			const int luma_to = (to * 2 < height ? to * 2 : height) * width;
+			const int luma_count = luma_to - luma_from;
+			if (channels < 3 || !simdLumaFromRgb(data[bgr ? 2 : 0] + luma_from * channels, luma_count, channels, bgr, dst_y + luma_from))
 			{
-				*dst_u++ = ((-38 * data[0][i] - 74 * data[1][i] + 112 * data[2][i]) >> 8) + 128;
-				*dst_v++ = ((112 * data[0][i] - 94 * data[1][i] - 18 * data[2][i]) >> 8) + 128;
+				uint8_t* y_out = dst_y + luma_from;
+				for (int i = luma_from * channels; i < luma_to * channels; i += channels)
+					*y_out++ = ((66 * data[0][i] + 129 * data[1][i] + 25 * data[2][i]) >> 8) + 16;
 			}
-		}
+
+			uint8_t* u_out = dst_u + from * half_width;
+			uint8_t* v_out = dst_v + from * half_width;
+			for (int y = from * 2, i = from * (stride + half_width * channels2); y < to * 2; y += 2, i += stride)
+			{
+				for (int x = 0; x < width; x += 2, i += channels2)
+				{
+					*u_out++ = ((-38 * data[0][i] - 74 * data[1][i] + 112 * data[2][i]) >> 8) + 128;
+					*v_out++ = ((112 * data[0][i] - 94 * data[1][i] - 18 * data[2][i]) >> 8) + 128;
+				}
+			}
+		});
 	}
 
 	void bitmapRgbToYuv420(const uint8_t* data, int width, int height, int channels, uint8_t* out)
@@ -539,7 +806,7 @@ namespace RoxRender
 		const uint8_t* rgb[] = {data, data + 1, data + 2};
 		if (channels == 1)
 			rgb[2] = rgb[1] = rgb[0];
-		colorToYuv420(rgb, width, height, channels, out);
+		colorToYuv420(rgb, width, height, channels, false, out);
 	}
 
 	void bitmapBgrToYuv420(const uint8_t* data, int width, int height, int channels, uint8_t* out)
@@ -547,19 +814,24 @@ namespace RoxRender
 		const uint8_t* bgr[] = {data + 2, data + 1, data};
 		if (channels == 1)
 			bgr[0] = bgr[1] = bgr[2];
-		colorToYuv420(bgr, width, height, channels, out);
+		colorToYuv420(bgr, width, height, channels, true, out);
 	}
 
 	inline uint8_t clamp(int c) { return c < 0 ? 0 : (c > 255 ? 255 : c); }
 
-	void bitmapYuv420ToRgb(const uint8_t* data, int width, int height, uint8_t* out)
+	void bitmap_yuv420_to_rgb(const uint8_t* data, int width, int height, int from, int to, uint8_t* out)
 	{
+		if (simdYuv420ToRgb(data, width, height, from, to, out))
+			return;
+
 		const size_t image_size = width * height;
 		const uint8_t* udata = data + image_size;
 		const uint8_t* vdata = udata + image_size / 4;
 		const int half_width = width / 2;
 
-		for (int y = 0; y < height; ++y)
+		data += from * width;
+		out += from * width * 3;
+		for (int y = from; y < to; ++y)
 		{
 			const int hidx = y / 2 * half_width;
 			for (int x = 0; x < width; ++x)
@@ -580,11 +852,22 @@ namespace RoxRender
 		}
 	}
 
+	void bitmapYuv420ToRgb(const uint8_t* data, int width, int height, uint8_t* out)
+	{
+		forRowBands(height, width * 3, 1, [&](int from, int to) {
+			bitmap_yuv420_to_rgb(data, width, height, from, to, out);
+		});
+	}
+
 	//================ RGBA to RGB =================
-	bool bitmapIsFullAlpha(const uint8_t* data, int width, int height)
+	bool bitmap_is_full_alpha(const uint8_t* data, int count)
 	{
+		const int simd = simdIsFullAlpha(data, count, 1);
+		if (simd >= 0)
+			return simd > 0;
+
 		data += 3;
-		const uint8_t* to = data + width * height * 4;
+		const uint8_t* to = data + count * 4;
 		while (data < to)
 		{
 			if (*data != 0xff)
@@ -594,4 +877,14 @@ namespace RoxRender
 		return true;
 	}
 
+	bool bitmapIsFullAlpha(const uint8_t* data, int width, int height)
+	{
+		std::atomic<bool> full(true);
+		forPixelBands(width * height, 4, [&](int from, int to) {
+			if (full.load(std::memory_order_relaxed) && !bitmap_is_full_alpha(data + from * 4, to - from))
+				full.store(false, std::memory_order_relaxed);
+		});
+		return full.load();
+	}
+
 }
@@ -66,4 +66,21 @@ void bitmapYuv420ToRgb(const uint8_t *data,int width,int height,uint8_t *out);
 
 bool bitmapIsFullAlpha(const uint8_t *data,int width,int height);
 
+enum BitmapSimd
+{
+    BITMAP_SIMD_NONE,
+    BITMAP_SIMD_SSE2,
+    BITMAP_SIMD_SSSE3,
+    BITMAP_SIMD_AVX2
+};
+
+//the best instruction set supported by cpu is used by default, results are the same for any of them
+//lower levels could be set for testing and benchmarks, higher than supported are clamped
+void bitmapSetSimd(BitmapSimd simd);
+BitmapSimd bitmapGetSimd();
+
+//images bigger than the threshold are processed in row bands on RoxMemory::RoxThreadPool, results are the same as serial
+void bitmapSetParallel(bool enable);
+void bitmapSetParallelThreshold(int bytes); //512kb by default
+
 }
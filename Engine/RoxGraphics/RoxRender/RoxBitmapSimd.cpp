@@ -0,0 +1,748 @@
+// Updated By the ROX_ENGINE
+// Copyright (C) 2024 Torox Project
+// Portions Copyright (C) 2013 nyan.developer@gmail.com (nya-engine)
+//
+// This file was modified by the Torox Project.
+// 
+// This file incorporates code from the nya-engine project, which is licensed under the MIT License.
+// See the LICENSE-MIT file in the root directory for more information.
+//
+// This file is also part of the Rox-engine, which is licensed under a dual-license system:
+// 1. Free Use License (for non-commercial and commercial use under specific conditions)
+// 2. Commercial License (for use on proprietary platforms)
+// See the LICENSE file in the root directory for the full Rox-engine license terms.
+
+#include "RoxBitmapSimd.h"
+
+#include <cstring>
+
+// sse2 is required for the dispatch code itself, so 32-bit x86 is only handled when built with it
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define ROX_BITMAP_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define ROX_TARGET(x)
+	#else
+		#define ROX_TARGET(x) __attribute__((target(x)))
+	#endif
+#endif
+
+namespace RoxRender
+{
+#ifdef ROX_BITMAP_X86
+	namespace
+	{
+		BitmapSimd detectSimd()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			const int max_leaf = info[0];
+			__cpuid(info, 1);
+			const bool sse2 = (info[3] & (1 << 26)) != 0;
+			const bool ssse3 = (info[2] & (1 << 9)) != 0;
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool avx2 = false;
+			if (max_leaf >= 7 && osxsave && (_xgetbv(0) & 6) == 6)
+			{
+				__cpuidex(info, 7, 0);
+				avx2 = (info[1] & (1 << 5)) != 0;
+			}
+#else
+			__builtin_cpu_init();
+			const bool sse2 = __builtin_cpu_supports("sse2");
+			const bool ssse3 = __builtin_cpu_supports("ssse3");
+			const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+			if (avx2 && ssse3)
+				return BITMAP_SIMD_AVX2;
+			if (ssse3)
+				return BITMAP_SIMD_SSSE3;
+			return sse2 ? BITMAP_SIMD_SSE2 : BITMAP_SIMD_NONE;
+		}
+
+		inline bool has(BitmapSimd simd) { return bitmapGetSimd() >= simd; }
+
+		inline uint32_t average(uint32_t a, uint32_t b) { return (((a ^ b) & 0xfefefefeL) >> 1) + (a & b); }
+
+		inline void copyPixel(uint8_t* to, const uint8_t* from) { memcpy(to, from, 4); }
+
+		//================ Downsample =================
+		ROX_TARGET("sse2") inline __m128i averageSse2(__m128i a, __m128i b)
+		{
+			const __m128i shifted = _mm_and_si128(_mm_srli_epi16(_mm_xor_si128(a, b), 1), _mm_set1_epi8(0x7f));
+			return _mm_add_epi8(_mm_and_si128(a, b), shifted);
+		}
+
+		ROX_TARGET("sse2") void downsample2xRgbaSse2(const uint8_t* data, int width, int height, uint8_t* out)
+		{
+			const int half_width = width / 2;
+			for (int h = 0; h < height / 2; ++h)
+			{
+				const uint8_t* row0 = data + (h * 2) * width * 4;
+				const uint8_t* row1 = row0 + width * 4;
+				uint8_t* o = out + h * half_width * 4;
+
+				int w = 0;
+				for (; w + 4 <= half_width; w += 4)
+				{
+					const __m128 a0 = _mm_loadu_ps((const float*)(row0 + w * 8));
+					const __m128 a1 = _mm_loadu_ps((const float*)(row0 + w * 8 + 16));
+					const __m128 b0 = _mm_loadu_ps((const float*)(row1 + w * 8));
+					const __m128 b1 = _mm_loadu_ps((const float*)(row1 + w * 8 + 16));
+
+					const __m128i top = averageSse2(_mm_castps_si128(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0))),
+					                                _mm_castps_si128(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1))));
+					const __m128i bottom = averageSse2(_mm_castps_si128(_mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0))),
+					                                   _mm_castps_si128(_mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1))));
+					_mm_storeu_si128((__m128i*)(o + w * 4), averageSse2(top, bottom));
+				}
+
+				for (; w < half_width; ++w)
+				{
+					uint32_t p[4], r;
+					memcpy(p, row0 + w * 8, 8);
+					memcpy(p + 2, row1 + w * 8, 8);
+					r = average(average(p[0], p[1]), average(p[2], p[3]));
+					memcpy(o + w * 4, &r, 4);
+				}
+			}
+		}
+
+		ROX_TARGET("avx2") inline __m256i averageAvx2(__m256i a, __m256i b)
+		{
+			const __m256i shifted = _mm256_and_si256(_mm256_srli_epi16(_mm256_xor_si256(a, b), 1), _mm256_set1_epi8(0x7f));
+			return _mm256_add_epi8(_mm256_and_si256(a, b), shifted);
+		}
+
+		ROX_TARGET("avx2") void downsample2xRgbaAvx2(const uint8_t* data, int width, int height, uint8_t* out)
+		{
+			const int half_width = width / 2;
+			for (int h = 0; h < height / 2; ++h)
+			{
+				const uint8_t* row0 = data + (h * 2) * width * 4;
+				const uint8_t* row1 = row0 + width * 4;
+				uint8_t* o = out + h * half_width * 4;
+
+				int w = 0;
+				for (; w + 8 <= half_width; w += 8)
+				{
+					const __m256 a0 = _mm256_loadu_ps((const float*)(row0 + w * 8));
+					const __m256 a1 = _mm256_loadu_ps((const float*)(row0 + w * 8 + 32));
+					const __m256 b0 = _mm256_loadu_ps((const float*)(row1 + w * 8));
+					const __m256 b1 = _mm256_loadu_ps((const float*)(row1 + w * 8 + 32));
+
+					const __m256i top = averageAvx2(_mm256_castps_si256(_mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0))),
+					                                _mm256_castps_si256(_mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1))));
+					const __m256i bottom = averageAvx2(_mm256_castps_si256(_mm256_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0))),
+					                                   _mm256_castps_si256(_mm256_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1))));
+					const __m256i r = _mm256_permute4x64_epi64(averageAvx2(top, bottom), _MM_SHUFFLE(3, 1, 2, 0));
+					_mm256_storeu_si256((__m256i*)(o + w * 4), r);
+				}
+
+				for (; w < half_width; ++w)
+				{
+					uint32_t p[4], r;
+					memcpy(p, row0 + w * 8, 8);
+					memcpy(p + 2, row1 + w * 8, 8);
+					r = average(average(p[0], p[1]), average(p[2], p[3]));
+					memcpy(o + w * 4, &r, 4);
+				}
+			}
+		}
+
+		//================ Flip and rotate =================
+		ROX_TARGET("sse2") inline __m128i reverseSse2(__m128i v) { return _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3)); }
+
+		ROX_TARGET("sse2") void flipRowRgbaSse2(uint8_t* row, int width)
+		{
+			int i = 0, j = width - 4;
+			for (; i + 4 <= j; i += 4, j -= 4)
+			{
+				const __m128i a = _mm_loadu_si128((const __m128i*)(row + i * 4));
+				const __m128i b = _mm_loadu_si128((const __m128i*)(row + j * 4));
+				_mm_storeu_si128((__m128i*)(row + i * 4), reverseSse2(b));
+				_mm_storeu_si128((__m128i*)(row + j * 4), reverseSse2(a));
+			}
+
+			for (int a = i, b = j + 3; a < b; ++a, --b)
+			{
+				uint8_t tmp[4];
+				copyPixel(tmp, row + a * 4);
+				copyPixel(row + a * 4, row + b * 4);
+				copyPixel(row + b * 4, tmp);
+			}
+		}
+
+		ROX_TARGET("sse2") void flipRowRgbaSse2(const uint8_t* row, int width, uint8_t* out)
+		{
+			int x = 0;
+			for (; x + 4 <= width; x += 4)
+				_mm_storeu_si128((__m128i*)(out + (width - 4 - x) * 4), reverseSse2(_mm_loadu_si128((const __m128i*)(row + x * 4))));
+
+			for (; x < width; ++x)
+				copyPixel(out + (width - 1 - x) * 4, row + x * 4);
+		}
+
+		ROX_TARGET("sse2") void rotate90RgbaSse2(const uint8_t* data, int width, int height, bool left, int from, int to, uint8_t* out)
+		{
+			// out is height wide and width tall
+			// columns outside so that the blocks of a band fill a contiguous piece of each output row
+			const int w4 = width & ~3;
+			const int blocks_to = from + ((to - from) & ~3);
+			for (int y = 0; y < w4; y += 4)
+			{
+				for (int x = from; x < blocks_to; x += 4)
+				{
+					__m128 r0 = _mm_loadu_ps((const float*)(data + (x * width + y) * 4));
+					__m128 r1 = _mm_loadu_ps((const float*)(data + ((x + 1) * width + y) * 4));
+					__m128 r2 = _mm_loadu_ps((const float*)(data + ((x + 2) * width + y) * 4));
+					__m128 r3 = _mm_loadu_ps((const float*)(data + ((x + 3) * width + y) * 4));
+					_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+					const __m128i t[4] = { _mm_castps_si128(r0), _mm_castps_si128(r1), _mm_castps_si128(r2), _mm_castps_si128(r3) };
+
+					for (int k = 0; k < 4; ++k)
+					{
+						if (left)
+							_mm_storeu_si128((__m128i*)(out + ((y + k) * height + height - 4 - x) * 4), reverseSse2(t[k]));
+						else
+							_mm_storeu_si128((__m128i*)(out + ((width - 1 - y - k) * height + x) * 4), t[k]);
+					}
+				}
+			}
+
+			for (int x = from; x < to; ++x)
+			{
+				for (int y = x < blocks_to ? w4 : 0; y < width; ++y)
+				{
+					const uint8_t* pixel = data + (x * width + y) * 4;
+					if (left)
+						copyPixel(out + (y * height + height - x - 1) * 4, pixel);
+					else
+						copyPixel(out + ((width - y - 1) * height + x) * 4, pixel);
+				}
+			}
+		}
+
+		//================ Resize =================
+		ROX_TARGET("sse2") inline __m128i mulLo32Sse2(__m128i a, __m128i b)
+		{
+			const __m128i p02 = _mm_mul_epu32(a, b);
+			const __m128i p13 = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+			return _mm_unpacklo_epi32(_mm_shuffle_epi32(p02, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(p13, _MM_SHUFFLE(0, 0, 2, 0)));
+		}
+
+		ROX_TARGET("sse2") inline __m128i loadPixelSse2(const uint8_t* p)
+		{
+			int v;
+			memcpy(&v, p, 4);
+			const __m128i zero = _mm_setzero_si128();
+			return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+		}
+
+		ROX_TARGET("sse2") void resizeRgbaSse2(const uint8_t* data, int width, int height, int new_width, int new_height, int from, int to, uint8_t* out)
+		{
+			const uint32_t stride = width * 4;
+			const uint32_t x_ratio = ((width - 1) << 16) / new_width;
+			const uint32_t y_ratio = ((height - 1) << 16) / new_height;
+			uint64_t y = (uint64_t)y_ratio * from;
+			out += from * new_width * 4;
+			for (int i = from; i < to; ++i, y += y_ratio)
+			{
+				const uint32_t yr = (uint32_t)(y >> 16);
+				const uint32_t dy = (uint32_t)(y - (yr << 16)), dy2 = (1 << 16) - dy;
+				const __m128i vdy = _mm_set_epi32(0, dy, 0, dy), vdy2 = _mm_set_epi32(0, dy2, 0, dy2);
+				const uint8_t* row = data + yr * stride;
+
+				uint64_t x = 0;
+				for (int j = 0; j < new_width; ++j, x += x_ratio, out += 4)
+				{
+					const uint32_t xr = (uint32_t)(x >> 16);
+					const uint32_t dx = (uint32_t)(x - (xr << 16)), dx2 = (1 << 16) - dx;
+					const __m128i vdx = _mm_set1_epi32(dx), vdx2 = _mm_set1_epi32(dx2);
+					const uint8_t* c = row + xr * 4;
+
+					const __m128i t0 = _mm_add_epi32(mulLo32Sse2(loadPixelSse2(c), vdx2), mulLo32Sse2(loadPixelSse2(c + 4), vdx));
+					const __m128i t1 = _mm_add_epi32(mulLo32Sse2(loadPixelSse2(c + stride), vdx2), mulLo32Sse2(loadPixelSse2(c + stride + 4), vdx));
+
+					const __m128i s02 = _mm_add_epi64(_mm_mul_epu32(t0, vdy2), _mm_mul_epu32(t1, vdy));
+					const __m128i s13 = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(t0, 32), vdy2), _mm_mul_epu32(_mm_srli_epi64(t1, 32), vdy));
+					const __m128i r = _mm_unpacklo_epi32(_mm_shuffle_epi32(s02, _MM_SHUFFLE(0, 0, 3, 1)), _mm_shuffle_epi32(s13, _MM_SHUFFLE(0, 0, 3, 1)));
+					const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(r, r), r);
+					const int v = _mm_cvtsi128_si32(packed);
+					memcpy(out, &v, 4);
+				}
+			}
+		}
+
+		//================ Channel swizzles =================
+		ROX_TARGET("sse2") void swapRbRgbaSse2(const uint8_t* data, int count, uint8_t* out)
+		{
+			const __m128i mask_ga = _mm_set1_epi32((int)0xff00ff00), mask_b = _mm_set1_epi32(0xff);
+			int i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i v = _mm_loadu_si128((const __m128i*)(data + i * 4));
+				const __m128i r = _mm_or_si128(_mm_and_si128(v, mask_ga),
+				                               _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 16), mask_b), _mm_slli_epi32(_mm_and_si128(v, mask_b), 16)));
+				_mm_storeu_si128((__m128i*)(out + i * 4), r);
+			}
+
+			for (; i < count; ++i)
+			{
+				const uint8_t* d = data + i * 4;
+				const uint8_t p[4] = { d[2], d[1], d[0], d[3] };
+				copyPixel(out + i * 4, p);
+			}
+		}
+
+		ROX_TARGET("ssse3") int shuffleRgbaSsse3(const uint8_t* data, int count, __m128i mask, uint8_t* out)
+		{
+			int i = 0;
+			for (; i + 4 <= count; i += 4)
+				_mm_storeu_si128((__m128i*)(out + i * 4), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 4)), mask));
+			return i;
+		}
+
+		ROX_TARGET("avx2") int shuffleRgbaAvx2(const uint8_t* data, int count, __m128i mask, uint8_t* out)
+		{
+			const __m256i mask2 = _mm256_broadcastsi128_si256(mask);
+			int i = 0;
+			for (; i + 8 <= count; i += 8)
+				_mm256_storeu_si256((__m256i*)(out + i * 4), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(data + i * 4)), mask2));
+			return i;
+		}
+
+		ROX_TARGET("ssse3") int swapRbRgbSsse3(const uint8_t* data, int count, uint8_t* out)
+		{
+			// 5 pixels per step, the 16th byte is written back unchanged
+			const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+			int i = 0;
+			for (; (i + 5) * 3 + 1 <= count * 3; i += 5)
+				_mm_storeu_si128((__m128i*)(out + i * 3), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 3)), mask));
+			return i;
+		}
+
+		ROX_TARGET("ssse3") int rgbaToRgbSsse3(const uint8_t* data, int count, bool swap_rb, uint8_t* out)
+		{
+			const __m128i mask = swap_rb ? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+			                             : _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+			int i = 0;
+			for (; i + 4 <= count && i * 3 + 16 <= count * 3; i += 4)
+				_mm_storeu_si128((__m128i*)(out + i * 3), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 4)), mask));
+			return i;
+		}
+
+		ROX_TARGET("ssse3") int rgbToRgbaSsse3(const uint8_t* data, int count, uint8_t alpha, bool swap_rb, uint8_t* out)
+		{
+			// goes backwards so out may be the same buffer as data
+			const int groups = count * 3 >= 16 ? (count * 3 - 16) / 12 + 1 : 0;
+			if (!groups)
+				return 0;
+
+			for (int i = count - 1; i >= groups * 4; --i)
+			{
+				const uint8_t* d = data + i * 3;
+				const uint8_t p[4] = { d[swap_rb ? 2 : 0], d[1], d[swap_rb ? 0 : 2], alpha };
+				copyPixel(out + i * 4, p);
+			}
+
+			const __m128i mask = swap_rb ? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+			                             : _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+			const __m128i a = _mm_set1_epi32((int)((uint32_t)alpha << 24));
+			for (int g = groups - 1; g >= 0; --g)
+				_mm_storeu_si128((__m128i*)(out + g * 16), _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + g * 12)), mask), a));
+			return count;
+		}
+
+		ROX_TARGET("sse2") int argbToRgbaSse2(const uint8_t* data, int count, bool swap_rb, uint8_t* out)
+		{
+			const __m128i m1 = _mm_set1_epi32(0x00ff0000), m2 = _mm_set1_epi32(0x0000ff00);
+			int i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i v = _mm_loadu_si128((const __m128i*)(data + i * 4));
+				__m128i r;
+				if (swap_rb)
+				{
+					r = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(v, 24), _mm_srli_epi32(v, 24)),
+					                 _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 8), m1), _mm_and_si128(_mm_srli_epi32(v, 8), m2)));
+				}
+				else
+					r = _mm_or_si128(_mm_slli_epi32(v, 24), _mm_srli_epi32(v, 8));
+				_mm_storeu_si128((__m128i*)(out + i * 4), r);
+			}
+			return i;
+		}
+
+		ROX_TARGET("avx2") int argbToRgbaAvx2(const uint8_t* data, int count, uint8_t* out)
+		{
+			int i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256i v = _mm256_loadu_si256((const __m256i*)(data + i * 4));
+				_mm256_storeu_si256((__m256i*)(out + i * 4), _mm256_or_si256(_mm256_slli_epi32(v, 24), _mm256_srli_epi32(v, 8)));
+			}
+			return i;
+		}
+
+		//================ YUV =================
+		ROX_TARGET("sse2") inline __m128i lumaSse2(__m128i r, __m128i g, __m128i b)
+		{
+			// values fit 16 bits, so the 16-bit multiply is exact for the 32-bit lanes
+			const __m128i y = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi16(r, _mm_set1_epi32(66)), _mm_mullo_epi16(g, _mm_set1_epi32(129))),
+			                                _mm_mullo_epi16(b, _mm_set1_epi32(25)));
+			return _mm_add_epi32(_mm_srli_epi32(y, 8), _mm_set1_epi32(16));
+		}
+
+		ROX_TARGET("sse2") int lumaRgbaSse2(const uint8_t* data, int count, bool bgr, uint8_t* out)
+		{
+			const __m128i m = _mm_set1_epi32(0xff);
+			int i = 0;
+			for (; i + 16 <= count; i += 16)
+			{
+				__m128i y[4];
+				for (int k = 0; k < 4; ++k)
+				{
+					const __m128i v = _mm_loadu_si128((const __m128i*)(data + (i + k * 4) * 4));
+					const __m128i c0 = _mm_and_si128(v, m), c1 = _mm_and_si128(_mm_srli_epi32(v, 8), m), c2 = _mm_and_si128(_mm_srli_epi32(v, 16), m);
+					y[k] = bgr ? lumaSse2(c2, c1, c0) : lumaSse2(c0, c1, c2);
+				}
+				_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(_mm_packs_epi32(y[0], y[1]), _mm_packs_epi32(y[2], y[3])));
+			}
+			return i;
+		}
+
+		ROX_TARGET("ssse3") int lumaRgbSsse3(const uint8_t* data, int count, bool bgr, uint8_t* out)
+		{
+			const __m128i m0 = _mm_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1);
+			const __m128i m1 = _mm_setr_epi8(1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1);
+			const __m128i m2 = _mm_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+			int i = 0;
+			for (; (i + 16) * 3 + 4 <= count * 3; i += 16)
+			{
+				__m128i y[4];
+				for (int k = 0; k < 4; ++k)
+				{
+					const __m128i v = _mm_loadu_si128((const __m128i*)(data + (i + k * 4) * 3));
+					const __m128i c0 = _mm_shuffle_epi8(v, m0), c1 = _mm_shuffle_epi8(v, m1), c2 = _mm_shuffle_epi8(v, m2);
+					y[k] = bgr ? lumaSse2(c2, c1, c0) : lumaSse2(c0, c1, c2);
+				}
+				_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(_mm_packs_epi32(y[0], y[1]), _mm_packs_epi32(y[2], y[3])));
+			}
+			return i;
+		}
+
+		inline uint8_t clamp(int c) { return c < 0 ? 0 : (c > 255 ? 255 : c); }
+
+		ROX_TARGET("ssse3") void yuv420ToRgbSsse3(const uint8_t* data, int width, int height, int from, int to, uint8_t* out)
+		{
+			const size_t image_size = width * height;
+			const uint8_t* udata = data + image_size;
+			const uint8_t* vdata = udata + image_size / 4;
+			const int half_width = width / 2;
+
+			const __m128i zero = _mm_setzero_si128(), c128 = _mm_set1_epi16(128), c16 = _mm_set1_epi8(16);
+			const __m128i kr = _mm_setr_epi16(1192, 1634, 1192, 1634, 1192, 1634, 1192, 1634);
+			const __m128i kg = _mm_setr_epi16(1192, -832, 1192, -832, 1192, -832, 1192, -832);
+			const __m128i ku = _mm_setr_epi16(-400, 0, -400, 0, -400, 0, -400, 0);
+			const __m128i kb = _mm_setr_epi16(1192, 2066, 1192, 2066, 1192, 2066, 1192, 2066);
+			const __m128i rg0 = _mm_setr_epi8(0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5);
+			const __m128i b0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+			const __m128i rg1 = _mm_setr_epi8(13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+			const __m128i b1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+
+			data += from * width;
+			out += from * width * 3;
+			for (int y = from; y < to; ++y)
+			{
+				const int hidx = y / 2 * half_width;
+				int x = 0;
+				for (; x + 8 <= width; x += 8, data += 8, out += 24)
+				{
+					int u4, v4;
+					memcpy(&u4, udata + hidx + x / 2, 4);
+					memcpy(&v4, vdata + hidx + x / 2, 4);
+
+					const __m128i yv = _mm_unpacklo_epi8(_mm_subs_epu8(_mm_loadl_epi64((const __m128i*)data), c16), zero);
+					const __m128i uu = _mm_cvtsi32_si128(u4), vv = _mm_cvtsi32_si128(v4);
+					const __m128i u = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(uu, uu), zero), c128);
+					const __m128i v = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(vv, vv), zero), c128);
+
+					const __m128i yv_lo = _mm_unpacklo_epi16(yv, v), yv_hi = _mm_unpackhi_epi16(yv, v);
+					const __m128i yu_lo = _mm_unpacklo_epi16(yv, u), yu_hi = _mm_unpackhi_epi16(yv, u);
+					const __m128i uu_lo = _mm_unpacklo_epi16(u, u), uu_hi = _mm_unpackhi_epi16(u, u);
+
+					const __m128i r = _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(yv_lo, kr), 10), _mm_srai_epi32(_mm_madd_epi16(yv_hi, kr), 10));
+					const __m128i g = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yv_lo, kg), _mm_madd_epi16(uu_lo, ku)), 10),
+					                                  _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yv_hi, kg), _mm_madd_epi16(uu_hi, ku)), 10));
+					const __m128i b = _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(yu_lo, kb), 10), _mm_srai_epi32(_mm_madd_epi16(yu_hi, kb), 10));
+
+					const __m128i rg = _mm_packus_epi16(r, g);
+					const __m128i bb = _mm_packus_epi16(b, b);
+					_mm_storeu_si128((__m128i*)out, _mm_or_si128(_mm_shuffle_epi8(rg, rg0), _mm_shuffle_epi8(bb, b0)));
+					_mm_storel_epi64((__m128i*)(out + 16), _mm_or_si128(_mm_shuffle_epi8(rg, rg1), _mm_shuffle_epi8(bb, b1)));
+				}
+
+				for (; x < width; ++x)
+				{
+					const int y0 = (int)*data++;
+					const int idx = hidx + x / 2;
+					const int u0 = (int)udata[idx] - 128;
+					const int v0 = (int)vdata[idx] - 128;
+
+					const int y1 = 1192 * (y0 > 16 ? y0 - 16 : 0);
+					const int u1 = 400 * u0, u2 = 2066 * u0;
+					const int v1 = 1634 * v0, v2 = 832 * v0;
+
+					*out++ = clamp((y1 + v1) >> 10);
+					*out++ = clamp((y1 - v2 - u1) >> 10);
+					*out++ = clamp((y1 + u2) >> 10);
+				}
+			}
+		}
+
+		//================ Alpha =================
+		ROX_TARGET("sse2") int isFullAlphaSse2(const uint8_t* data, int count)
+		{
+			const __m128i mask = _mm_set1_epi32((int)0xff000000);
+			int i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(data + i * 4)), mask);
+				if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, mask)) != 0xffff)
+					return 0;
+			}
+
+			for (; i < count; ++i)
+			{
+				if (data[i * 4 + 3] != 0xff)
+					return 0;
+			}
+
+			return 1;
+		}
+
+		ROX_TARGET("avx2") int isFullAlphaAvx2(const uint8_t* data, int count)
+		{
+			const __m256i mask = _mm256_set1_epi32((int)0xff000000);
+			int i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256i a = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(data + i * 4)), mask);
+				if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, mask)) != -1)
+					return 0;
+			}
+
+			return isFullAlphaSse2(data + i * 4, count - i);
+		}
+	}
+
+	BitmapSimd bitmapSupportedSimd()
+	{
+		static const BitmapSimd simd = detectSimd();
+		return simd;
+	}
+
+	bool simdDownsample2xRgba(const uint8_t* data, int width, int height, uint8_t* out)
+	{
+		if (has(BITMAP_SIMD_AVX2))
+			downsample2xRgbaAvx2(data, width, height, out);
+		else if (has(BITMAP_SIMD_SSE2))
+			downsample2xRgbaSse2(data, width, height, out);
+		else
+			return false;
+
+		return true;
+	}
+
+	bool simdFlipHorisontalRgba(uint8_t* data, int width, int height)
+	{
+		if (!has(BITMAP_SIMD_SSE2))
+			return false;
+
+		for (int y = 0; y < height; ++y)
+			flipRowRgbaSse2(data + y * width * 4, width);
+		return true;
+	}
+
+	bool simdFlipHorisontalRgba(const uint8_t* data, int width, int height, uint8_t* out)
+	{
+		if (!has(BITMAP_SIMD_SSE2))
+			return false;
+
+		for (int y = 0; y < height; ++y)
+			flipRowRgbaSse2(data + y * width * 4, width, out + y * width * 4);
+		return true;
+	}
+
+	bool simdRotate90Rgba(const uint8_t* data, int width, int height, bool left, int from, int to, uint8_t* out)
+	{
+		if (!has(BITMAP_SIMD_SSE2))
+			return false;
+
+		rotate90RgbaSse2(data, width, height, left, from, to, out);
+		return true;
+	}
+
+	bool simdResizeRgba(const uint8_t* data, int width, int height, int new_width, int new_height, int from, int to, uint8_t* out)
+	{
+		if (!has(BITMAP_SIMD_SSE2))
+			return false;
+
+		resizeRgbaSse2(data, width, height, new_width, new_height, from, to, out);
+		return true;
+	}
+
+	bool simdRgbToBgr(const uint8_t* data, int width, int height, int channels, uint8_t* out)
+	{
+		const int count = width * height;
+		int done = 0;
+		if (channels == 4)
+		{
+			const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+			if (has(BITMAP_SIMD_AVX2))
+				done = shuffleRgbaAvx2(data, count, mask, out);
+			if (has(BITMAP_SIMD_SSSE3))
+				done += shuffleRgbaSsse3(data + done * 4, count - done, mask, out + done * 4);
+			else if (has(BITMAP_SIMD_SSE2))
+			{
+				swapRbRgbaSse2(data, count, out);
+				return true;
+			}
+			else
+				return false;
+
+			for (; done < count; ++done)
+			{
+				const uint8_t* d = data + done * 4;
+				const uint8_t p[4] = { d[2], d[1], d[0], d[3] };
+				copyPixel(out + done * 4, p);
+			}
+			return true;
+		}
+
+		if (channels != 3 || !has(BITMAP_SIMD_SSSE3))
+			return false;
+
+		done = swapRbRgbSsse3(data, count, out);
+		for (; done < count; ++done)
+		{
+			const uint8_t* d = data + done * 3;
+			const uint8_t r = d[0], g = d[1], b = d[2];
+			uint8_t* o = out + done * 3;
+			o[0] = b, o[1] = g, o[2] = r;
+		}
+		return true;
+	}
+
+	bool simdRgbaToRgb(const uint8_t* data, int width, int height, bool swap_rb, uint8_t* out)
+	{
+		const int count = width * height;
+		if (!has(BITMAP_SIMD_SSSE3) || count < 8)
+			return false;
+
+		// the scalar tail starts past the pixels where in-place writes could overtake the reads
+		for (int i = rgbaToRgbSsse3(data, count, swap_rb, out); i < count; ++i)
+		{
+			const uint8_t* d = data + i * 4;
+			uint8_t* o = out + i * 3;
+			o[0] = d[swap_rb ? 2 : 0];
+			o[1] = d[1];
+			o[2] = d[swap_rb ? 0 : 2];
+		}
+		return true;
+	}
+
+	bool simdRgbToRgba(const uint8_t* data, int width, int height, uint8_t alpha, bool swap_rb, uint8_t* out)
+	{
+		if (!has(BITMAP_SIMD_SSSE3))
+			return false;
+
+		return rgbToRgbaSsse3(data, width * height, alpha, swap_rb, out) > 0;
+	}
+
+	bool simdArgbToRgba(const uint8_t* data, int width, int height, bool swap_rb, uint8_t* out)
+	{
+		const int count = width * height;
+		int done = 0;
+		if (swap_rb && has(BITMAP_SIMD_SSSE3))
+		{
+			const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+			if (has(BITMAP_SIMD_AVX2))
+				done = shuffleRgbaAvx2(data, count, mask, out);
+			done += shuffleRgbaSsse3(data + done * 4, count - done, mask, out + done * 4);
+		}
+		else if (has(BITMAP_SIMD_SSE2))
+		{
+			if (!swap_rb && has(BITMAP_SIMD_AVX2))
+				done = argbToRgbaAvx2(data, count, out);
+			done += argbToRgbaSse2(data + done * 4, count - done, swap_rb, out + done * 4);
+		}
+		else
+			return false;
+
+		for (; done < count; ++done)
+		{
+			uint32_t c;
+			memcpy(&c, data + done * 4, 4);
+			c = swap_rb ? (c << 24 | (c << 8 & 0x00FF0000) | (c >> 8 & 0x0000FF00) | c >> 24) : (c << 24 | c >> 8);
+			memcpy(out + done * 4, &c, 4);
+		}
+		return true;
+	}
+
+	bool simdLumaFromRgb(const uint8_t* data, int count, int channels, bool bgr, uint8_t* out)
+	{
+		int done;
+		if (channels == 4 && has(BITMAP_SIMD_SSE2))
+			done = lumaRgbaSse2(data, count, bgr, out);
+		else if (channels == 3 && has(BITMAP_SIMD_SSSE3))
+			done = lumaRgbSsse3(data, count, bgr, out);
+		else
+			return false;
+
+		for (; done < count; ++done)
+		{
+			const uint8_t* d = data + done * channels;
+			const int r = d[bgr ? 2 : 0], g = d[1], b = d[bgr ? 0 : 2];
+			out[done] = ((66 * r + 129 * g + 25 * b) >> 8) + 16;
+		}
+		return true;
+	}
+
+	bool simdYuv420ToRgb(const uint8_t* data, int width, int height, int from, int to, uint8_t* out)
+	{
+		if (!has(BITMAP_SIMD_SSSE3))
+			return false;
+
+		yuv420ToRgbSsse3(data, width, height, from, to, out);
+		return true;
+	}
+
+	int simdIsFullAlpha(const uint8_t* data, int width, int height)
+	{
+		if (has(BITMAP_SIMD_AVX2))
+			return isFullAlphaAvx2(data, width * height);
+		if (has(BITMAP_SIMD_SSE2))
+			return isFullAlphaSse2(data, width * height);
+		return -1;
+	}
+#else
+	BitmapSimd bitmapSupportedSimd() { return BITMAP_SIMD_NONE; }
+
+	bool simdDownsample2xRgba(const uint8_t*, int, int, uint8_t*) { return false; }
+	bool simdFlipHorisontalRgba(uint8_t*, int, int) { return false; }
+	bool simdFlipHorisontalRgba(const uint8_t*, int, int, uint8_t*) { return false; }
+	bool simdRotate90Rgba(const uint8_t*, int, int, bool, int, int, uint8_t*) { return false; }
+	bool simdResizeRgba(const uint8_t*, int, int, int, int, int, int, uint8_t*) { return false; }
+	bool simdRgbToBgr(const uint8_t*, int, int, int, uint8_t*) { return false; }
+	bool simdRgbaToRgb(const uint8_t*, int, int, bool, uint8_t*) { return false; }
+	bool simdRgbToRgba(const uint8_t*, int, int, uint8_t, bool, uint8_t*) { return false; }
+	bool simdArgbToRgba(const uint8_t*, int, int, bool, uint8_t*) { return false; }
+	bool simdLumaFromRgb(const uint8_t*, int, int, bool, uint8_t*) { return false; }
+	bool simdYuv420ToRgb(const uint8_t*, int, int, int, int, uint8_t*) { return false; }
+	int simdIsFullAlpha(const uint8_t*, int, int) { return -1; }
+#endif
+}
@@ -0,0 +1,39 @@
+// Updated By the ROX_ENGINE
+// Copyright (C) 2024 Torox Project
+// Portions Copyright (C) 2013 nyan.developer@gmail.com (nya-engine)
+//
+// This file was modified by the Torox Project.
+// 
+// This file incorporates code from the nya-engine project, which is licensed under the MIT License.
+// See the LICENSE-MIT file in the root directory for more information.
+//
+// This file is also part of the Rox-engine, which is licensed under a dual-license system:
+// 1. Free Use License (for non-commercial and commercial use under specific conditions)
+// 2. Commercial License (for use on proprietary platforms)
+// See the LICENSE file in the root directory for the full Rox-engine license terms.
+
+#pragma once
+
+#include "RoxBitmap.h"
+
+// SIMD versions of the RoxBitmap kernels, used by RoxBitmap.cpp
+// each returns false if it can't handle the case with the current instruction set,
+// the results are bit-exact with the scalar code
+
+namespace RoxRender
+{
+	BitmapSimd bitmapSupportedSimd();
+
+	bool simdDownsample2xRgba(const uint8_t* data, int width, int height, uint8_t* out);
+	bool simdFlipHorisontalRgba(uint8_t* data, int width, int height);
+	bool simdFlipHorisontalRgba(const uint8_t* data, int width, int height, uint8_t* out);
+	bool simdRotate90Rgba(const uint8_t* data, int width, int height, bool left, int from, int to, uint8_t* out); // source rows from..to
+	bool simdResizeRgba(const uint8_t* data, int width, int height, int new_width, int new_height, int from, int to, uint8_t* out); // output rows from..to
+	bool simdRgbToBgr(const uint8_t* data, int width, int height, int channels, uint8_t* out);
+	bool simdRgbaToRgb(const uint8_t* data, int width, int height, bool swap_rb, uint8_t* out);
+	bool simdRgbToRgba(const uint8_t* data, int width, int height, uint8_t alpha, bool swap_rb, uint8_t* out);
+	bool simdArgbToRgba(const uint8_t* data, int width, int height, bool swap_rb, uint8_t* out);
+	bool simdLumaFromRgb(const uint8_t* data, int count, int channels, bool bgr, uint8_t* out);
+	bool simdYuv420ToRgb(const uint8_t* data, int width, int height, int from, int to, uint8_t* out); // rows from..to
+	int simdIsFullAlpha(const uint8_t* data, int width, int height); // -1 if not handled
+}
@@ -0,0 +1,654 @@
+// Updated By the ROX_ENGINE
+// Copyright (C) 2024 Torox Project
+// Portions Copyright (C) 2013 nyan.developer@gmail.com (nya-engine)
+//
+// This file was modified by the Torox Project.
+// 
+// This file incorporates code from the nya-engine project, which is licensed under the MIT License.
+// See the LICENSE-MIT file in the root directory for more information.
+//
+// This file is also part of the Rox-engine, which is licensed under a dual-license system:
+// 1. Free Use License (for non-commercial and commercial use under specific conditions)
+// 2. Commercial License (for use on proprietary platforms)
+// See the LICENSE file in the root directory for the full Rox-engine license terms.
+
+
+#include "RoxBlockCompression.h"
+#include "RoxMemory/RoxThreadPool.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define ROX_BLOCK_SSE2
+	#include <emmintrin.h>
+#endif
+
+namespace RoxRender
+{
+	namespace
+	{
+		//================ Color blocks =================
+		inline int expand5(int v) { return (v << 3) | (v >> 2); }
+		inline int expand6(int v) { return (v << 2) | (v >> 4); }
+		inline int clamp255(int v) { return v < 0 ? 0 : (v > 255 ? 255 : v); }
+
+		uint16_t pack565(const int* c)
+		{
+			return uint16_t(((c[0] * 31 + 127) / 255) << 11 | ((c[1] * 63 + 127) / 255) << 5 | ((c[2] * 31 + 127) / 255));
+		}
+
+		// palette as RoxFormats::DirectDrawSurface decodes it
+		void colorPalette(uint16_t c0, uint16_t c1, bool four_colors, int palette[4][3])
+		{
+			palette[0][0] = expand5(c0 >> 11), palette[0][1] = expand6((c0 >> 5) & 63), palette[0][2] = expand5(c0 & 31);
+			palette[1][0] = expand5(c1 >> 11), palette[1][1] = expand6((c1 >> 5) & 63), palette[1][2] = expand5(c1 & 31);
+			for (int k = 0; k < 3; ++k)
+			{
+				if (four_colors)
+				{
+					palette[2][k] = (palette[0][k] * 2 + palette[1][k]) / 3;
+					palette[3][k] = (palette[0][k] + palette[1][k] * 2) / 3;
+				}
+				else
+				{
+					palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+					palette[3][k] = 0;
+				}
+			}
+		}
+
+		// endpoints that interpolate to a single 8-bit value as close as possible, per 5 and 6 bit channel
+		struct SingleColorTables
+		{
+			uint8_t match5[256][2];
+			uint8_t match6[256][2];
+
+			static void build(uint8_t (*match)[2], int bits)
+			{
+				const int count = 1 << bits;
+				for (int v = 0; v < 256; ++v)
+				{
+					int best = 256;
+					for (int a = 0; a < count; ++a)
+					{
+						for (int b = 0; b < count; ++b)
+						{
+							const int ea = bits == 5 ? expand5(a) : expand6(a), eb = bits == 5 ? expand5(b) : expand6(b);
+							const int error = (ea * 2 + eb) / 3 - v;
+							if ((error < 0 ? -error : error) < best)
+							{
+								best = error < 0 ? -error : error;
+								match[v][0] = uint8_t(a), match[v][1] = uint8_t(b);
+							}
+						}
+					}
+				}
+			}
+
+			SingleColorTables() { build(match5, 5); build(match6, 6); }
+		};
+
+		const SingleColorTables& singleColorTables()
+		{
+			static const SingleColorTables tables;
+			return tables;
+		}
+
+		struct ColorBlock
+		{
+			int rgb[16][3];
+#ifdef ROX_BLOCK_SSE2
+			alignas(16) int16_t channels[3][16];
+#endif
+			bool transparent[16];
+			int opaque_count;
+			bool has_transparent;
+		};
+
+		// nearest palette entries, transparent pixels take index 3 of the 3 colors mode, returns the squared error
+		int selectColorIndices(const ColorBlock& block, const int palette[4][3], bool four_colors, uint8_t* indices)
+		{
+#ifdef ROX_BLOCK_SSE2
+			if (four_colors)
+			{
+				int error = 0;
+				for (int half = 0; half < 2; ++half)
+				{
+					// 8 pixels as 16-bit lanes, squared distances are summed with madd into 32-bit lanes of 4 pixels
+					const __m128i vr = _mm_load_si128((const __m128i*)(block.channels[0] + half * 8));
+					const __m128i vg = _mm_load_si128((const __m128i*)(block.channels[1] + half * 8));
+					const __m128i vb = _mm_load_si128((const __m128i*)(block.channels[2] + half * 8));
+					const __m128i zero = _mm_setzero_si128();
+					__m128i best[2], best_idx[2];
+					for (int p = 0; p < 4; ++p)
+					{
+						const __m128i dr = _mm_sub_epi16(vr, _mm_set1_epi16(int16_t(palette[p][0])));
+						const __m128i dg = _mm_sub_epi16(vg, _mm_set1_epi16(int16_t(palette[p][1])));
+						const __m128i db = _mm_sub_epi16(vb, _mm_set1_epi16(int16_t(palette[p][2])));
+						for (int q = 0; q < 2; ++q)
+						{
+							const __m128i rg = q ? _mm_unpackhi_epi16(dr, dg) : _mm_unpacklo_epi16(dr, dg);
+							const __m128i bz = q ? _mm_unpackhi_epi16(db, zero) : _mm_unpacklo_epi16(db, zero);
+							const __m128i dist = _mm_add_epi32(_mm_madd_epi16(rg, rg), _mm_madd_epi16(bz, bz));
+							if (!p)
+							{
+								best[q] = dist;
+								best_idx[q] = zero;
+								continue;
+							}
+
+							const __m128i less = _mm_cmplt_epi32(dist, best[q]);
+							best[q] = _mm_or_si128(_mm_and_si128(less, dist), _mm_andnot_si128(less, best[q]));
+							best_idx[q] = _mm_or_si128(_mm_and_si128(less, _mm_set1_epi32(p)), _mm_andnot_si128(less, best_idx[q]));
+						}
+					}
+
+					alignas(16) int32_t dist[8], idx[8];
+					_mm_store_si128((__m128i*)dist, best[0]);
+					_mm_store_si128((__m128i*)(dist + 4), best[1]);
+					_mm_store_si128((__m128i*)idx, best_idx[0]);
+					_mm_store_si128((__m128i*)(idx + 4), best_idx[1]);
+					for (int i = 0; i < 8; ++i)
+					{
+						indices[half * 8 + i] = uint8_t(idx[i]);
+						error += dist[i];
+					}
+				}
+				return error;
+			}
+#endif
+			int error = 0;
+			for (int i = 0; i < 16; ++i)
+			{
+				if (block.transparent[i])
+				{
+					indices[i] = 3;
+					continue;
+				}
+
+				int best = 1 << 30;
+				for (int p = 0; p < (four_colors ? 4 : 3); ++p)
+				{
+					const int dr = block.rgb[i][0] - palette[p][0], dg = block.rgb[i][1] - palette[p][1], db = block.rgb[i][2] - palette[p][2];
+					const int dist = dr * dr + dg * dg + db * db;
+					if (dist < best)
+						best = dist, indices[i] = uint8_t(p);
+				}
+				error += best;
+			}
+			return error;
+		}
+
+		struct ColorResult
+		{
+			uint16_t c0, c1;
+			uint8_t indices[16];
+			int error;
+		};
+
+		// quantizes the endpoints into the mode the decoder will pick: 3 colors for bc1 blocks with transparency
+		void evaluateEndpoints(const ColorBlock& block, const int* e0, const int* e1, bool bc1, ColorResult& result)
+		{
+			uint16_t c0 = pack565(e0), c1 = pack565(e1);
+			if (block.has_transparent ? c0 > c1 : c0 < c1)
+			{
+				const uint16_t t = c0;
+				c0 = c1, c1 = t;
+			}
+
+			const bool four_colors = !bc1 || c0 > c1;
+			int palette[4][3];
+			colorPalette(c0, c1, four_colors, palette);
+			result.c0 = c0, result.c1 = c1;
+			result.error = selectColorIndices(block, palette, four_colors, result.indices);
+		}
+
+		void singleColorEndpoints(const int* color, int* e0, int* e1)
+		{
+			const SingleColorTables& t = singleColorTables();
+			const int r0 = t.match5[color[0]][0], r1 = t.match5[color[0]][1];
+			const int g0 = t.match6[color[1]][0], g1 = t.match6[color[1]][1];
+			const int b0 = t.match5[color[2]][0], b1 = t.match5[color[2]][1];
+			e0[0] = expand5(r0), e0[1] = expand6(g0), e0[2] = expand5(b0);
+			e1[0] = expand5(r1), e1[1] = expand6(g1), e1[2] = expand5(b1);
+		}
+
+		void boundingBoxEndpoints(const ColorBlock& block, int* e0, int* e1)
+		{
+			int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 }, sum[3] = { 0, 0, 0 };
+			for (int i = 0; i < 16; ++i)
+			{
+				if (block.transparent[i])
+					continue;
+
+				for (int k = 0; k < 3; ++k)
+				{
+					const int v = block.rgb[i][k];
+					lo[k] = v < lo[k] ? v : lo[k];
+					hi[k] = v > hi[k] ? v : hi[k];
+					sum[k] += v;
+				}
+			}
+
+			// the box diagonal follows the channel with the largest range, anticorrelated channels are swapped
+			int major = 0;
+			for (int k = 1; k < 3; ++k)
+			{
+				if (hi[k] - lo[k] > hi[major] - lo[major])
+					major = k;
+			}
+
+			for (int k = 0; k < 3; ++k)
+			{
+				const int inset = (hi[k] - lo[k]) >> 4;
+				e0[k] = hi[k] - inset, e1[k] = lo[k] + inset;
+				if (k == major)
+					continue;
+
+				int cov = 0;
+				for (int i = 0; i < 16; ++i)
+				{
+					if (!block.transparent[i])
+						cov += (block.rgb[i][major] * block.opaque_count - sum[major]) * (block.rgb[i][k] * block.opaque_count - sum[k]) / 256;
+				}
+
+				if (cov < 0)
+				{
+					const int t = e0[k];
+					e0[k] = e1[k], e1[k] = t;
+				}
+			}
+		}
+
+		void principalAxisEndpoints(const ColorBlock& block, int* e0, int* e1)
+		{
+			float mean[3] = { 0.0f, 0.0f, 0.0f };
+			for (int i = 0; i < 16; ++i)
+			{
+				for (int k = 0; k < 3 && !block.transparent[i]; ++k)
+					mean[k] += block.rgb[i][k];
+			}
+			for (int k = 0; k < 3; ++k)
+				mean[k] /= block.opaque_count;
+
+			float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int i = 0; i < 16; ++i)
+			{
+				if (block.transparent[i])
+					continue;
+
+				const float r = block.rgb[i][0] - mean[0], g = block.rgb[i][1] - mean[1], b = block.rgb[i][2] - mean[2];
+				cov[0] += r * r, cov[1] += r * g, cov[2] += r * b;
+				cov[3] += g * g, cov[4] += g * b, cov[5] += b * b;
+			}
+
+			// power iteration
+			float axis[3] = { 1.0f, 1.0f, 1.0f };
+			for (int it = 0; it < 6; ++it)
+			{
+				const float x = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+				const float y = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+				const float z = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+				float m = x < 0.0f ? -x : x;
+				m = (y < 0.0f ? -y : y) > m ? (y < 0.0f ? -y : y) : m;
+				m = (z < 0.0f ? -z : z) > m ? (z < 0.0f ? -z : z) : m;
+				if (m < 1e-6f)
+					break;
+
+				axis[0] = x / m, axis[1] = y / m, axis[2] = z / m;
+			}
+
+			int lo = -1, hi = -1;
+			float lo_dot = 0.0f, hi_dot = 0.0f;
+			for (int i = 0; i < 16; ++i)
+			{
+				if (block.transparent[i])
+					continue;
+
+				const float d = block.rgb[i][0] * axis[0] + block.rgb[i][1] * axis[1] + block.rgb[i][2] * axis[2];
+				if (lo < 0 || d < lo_dot)
+					lo = i, lo_dot = d;
+				if (hi < 0 || d > hi_dot)
+					hi = i, hi_dot = d;
+			}
+
+			for (int k = 0; k < 3; ++k)
+				e0[k] = block.rgb[hi][k], e1[k] = block.rgb[lo][k];
+		}
+
+		// least squares endpoints for the current indices
+		bool refineEndpoints(const ColorBlock& block, const ColorResult& current, bool bc1, int* e0, int* e1)
+		{
+			const bool four_colors = !bc1 || current.c0 > current.c1;
+			static const float weights4[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+			static const float weights3[4] = { 1.0f, 0.0f, 0.5f, 0.0f };
+			const float* weights = four_colors ? weights4 : weights3;
+
+			float aa = 0.0f, bb = 0.0f, ab = 0.0f, at[3] = { 0.0f, 0.0f, 0.0f }, bt[3] = { 0.0f, 0.0f, 0.0f };
+			for (int i = 0; i < 16; ++i)
+			{
+				if (block.transparent[i])
+					continue;
+
+				const float a = weights[current.indices[i]], b = 1.0f - a;
+				aa += a * a, bb += b * b, ab += a * b;
+				for (int k = 0; k < 3; ++k)
+					at[k] += a * block.rgb[i][k], bt[k] += b * block.rgb[i][k];
+			}
+
+			const float det = aa * bb - ab * ab;
+			if (det < 1e-4f && det > -1e-4f)
+				return false;
+
+			for (int k = 0; k < 3; ++k)
+			{
+				e0[k] = clamp255(int((at[k] * bb - bt[k] * ab) / det + 0.5f));
+				e1[k] = clamp255(int((bt[k] * aa - at[k] * ab) / det + 0.5f));
+			}
+			return true;
+		}
+
+		void writeColorBlock(const ColorResult& r, uint8_t* out)
+		{
+			uint32_t bits = 0;
+			for (int i = 0; i < 16; ++i)
+				bits |= uint32_t(r.indices[i]) << (i * 2);
+
+			out[0] = uint8_t(r.c0), out[1] = uint8_t(r.c0 >> 8);
+			out[2] = uint8_t(r.c1), out[3] = uint8_t(r.c1 >> 8);
+			for (int i = 0; i < 4; ++i)
+				out[4 + i] = uint8_t(bits >> (i * 8));
+		}
+
+		void encodeColor(const uint8_t* rgba, bool bc1, BlockQuality quality, uint8_t* out)
+		{
+			ColorBlock block;
+			block.opaque_count = 0;
+			block.has_transparent = false;
+			bool single = true;
+			int first = -1;
+			for (int i = 0; i < 16; ++i)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					block.rgb[i][k] = rgba[i * 4 + k];
+#ifdef ROX_BLOCK_SSE2
+					block.channels[k][i] = int16_t(rgba[i * 4 + k]);
+#endif
+				}
+
+				block.transparent[i] = bc1 && rgba[i * 4 + 3] < 128;
+				if (block.transparent[i])
+				{
+					block.has_transparent = true;
+					continue;
+				}
+
+				++block.opaque_count;
+				if (first < 0)
+					first = i;
+				else if (single && memcmp(rgba + i * 4, rgba + first * 4, 3) != 0)
+					single = false;
+			}
+
+			ColorResult result;
+			if (!block.opaque_count)
+			{
+				result.c0 = result.c1 = 0;
+				memset(result.indices, 3, sizeof(result.indices));
+				writeColorBlock(result, out);
+				return;
+			}
+
+			int e0[3], e1[3];
+			if (single)
+			{
+				singleColorEndpoints(block.rgb[first], e0, e1);
+				evaluateEndpoints(block, e0, e1, bc1, result);
+				writeColorBlock(result, out);
+				return;
+			}
+
+			if (quality == BLOCK_QUALITY_FAST)
+				boundingBoxEndpoints(block, e0, e1);
+			else
+				principalAxisEndpoints(block, e0, e1);
+			evaluateEndpoints(block, e0, e1, bc1, result);
+
+			const int iterations = quality == BLOCK_QUALITY_FAST ? 0 : (quality == BLOCK_QUALITY_NORMAL ? 1 : 4);
+			for (int it = 0; it < iterations && result.error > 0; ++it)
+			{
+				if (!refineEndpoints(block, result, bc1, e0, e1))
+					break;
+
+				ColorResult refined;
+				evaluateEndpoints(block, e0, e1, bc1, refined);
+				if (refined.error >= result.error)
+					break;
+
+				result = refined;
+			}
+
+			writeColorBlock(result, out);
+		}
+
+		//================ Channel blocks =================
+		// values as RoxFormats::DirectDrawSurface decodes them, 8 interpolated if a0 > a1, otherwise 6 with 0 and 255
+		void channelCodes(int a0, int a1, int* codes)
+		{
+			codes[0] = a0, codes[1] = a1;
+			if (a0 > a1)
+			{
+				for (int i = 1; i < 7; ++i)
+					codes[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+			}
+			else
+			{
+				for (int i = 1; i < 5; ++i)
+					codes[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+				codes[6] = 0, codes[7] = 255;
+			}
+		}
+
+		int selectChannelIndices(const uint8_t* values, int a0, int a1, uint8_t* indices)
+		{
+			int codes[8];
+			channelCodes(a0, a1, codes);
+
+#ifdef ROX_BLOCK_SSE2
+			// absolute differences of 16 bytes at once, the first nearest code wins as in the scalar loop
+			const __m128i v = _mm_loadu_si128((const __m128i*)values);
+			const __m128i zero = _mm_setzero_si128();
+			__m128i best = _mm_set1_epi8(-1), best_idx = zero;
+			for (int c = 0; c < 8; ++c)
+			{
+				const __m128i code = _mm_set1_epi8(char(codes[c]));
+				const __m128i d = _mm_or_si128(_mm_subs_epu8(v, code), _mm_subs_epu8(code, v));
+				const __m128i less = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_subs_epu8(best, d), zero), _mm_set1_epi8(-1));
+				best = _mm_min_epu8(best, d);
+				best_idx = _mm_or_si128(_mm_and_si128(less, _mm_set1_epi8(char(c))), _mm_andnot_si128(less, best_idx));
+			}
+			_mm_storeu_si128((__m128i*)indices, best_idx);
+
+			const __m128i lo = _mm_unpacklo_epi8(best, zero), hi = _mm_unpackhi_epi8(best, zero);
+			__m128i sum = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+			sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+			sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+			return _mm_cvtsi128_si32(sum);
+#else
+			int error = 0;
+			for (int i = 0; i < 16; ++i)
+			{
+				int best = 1 << 30;
+				for (int c = 0; c < 8; ++c)
+				{
+					const int d = values[i] - codes[c];
+					if (d * d < best)
+						best = d * d, indices[i] = uint8_t(c);
+				}
+				error += best;
+			}
+			return error;
+#endif
+		}
+
+		void encodeChannel(const uint8_t* values, BlockQuality quality, uint8_t* out)
+		{
+			int lo = 255, hi = 0, inner_lo = 255, inner_hi = 0;
+			for (int i = 0; i < 16; ++i)
+			{
+				const int v = values[i];
+				lo = v < lo ? v : lo;
+				hi = v > hi ? v : hi;
+				if (v > 0 && v < 255)
+				{
+					inner_lo = v < inner_lo ? v : inner_lo;
+					inner_hi = v > inner_hi ? v : inner_hi;
+				}
+			}
+
+			int a0 = hi, a1 = lo;
+			uint8_t indices[16], candidate[16];
+			int error = selectChannelIndices(values, a0, a1, indices);
+
+			if (quality != BLOCK_QUALITY_FAST && error > 0)
+			{
+				// 6 values mode spends its range between the extremes when the block has exact 0 or 255
+				const int b0 = inner_lo <= inner_hi ? inner_lo : 0, b1 = inner_lo <= inner_hi ? inner_hi : 0;
+				const int e = selectChannelIndices(values, b0, b1, candidate);
+				if (e < error)
+				{
+					error = e, a0 = b0, a1 = b1;
+					memcpy(indices, candidate, sizeof(indices));
+				}
+			}
+
+			// hill climbing over the neighbour endpoints within the same mode
+			for (int step = 0; quality == BLOCK_QUALITY_HIGH && error > 0 && step < 16; ++step)
+			{
+				const int c0 = a0, c1 = a1;
+				for (int d0 = -1; d0 <= 1; ++d0)
+				{
+					for (int d1 = -1; d1 <= 1; ++d1)
+					{
+						const int t0 = clamp255(c0 + d0), t1 = clamp255(c1 + d1);
+						if ((t0 > t1) != (c0 > c1) || (t0 == c0 && t1 == c1))
+							continue;
+
+						const int e = selectChannelIndices(values, t0, t1, candidate);
+						if (e < error)
+						{
+							error = e, a0 = t0, a1 = t1;
+							memcpy(indices, candidate, sizeof(indices));
+						}
+					}
+				}
+
+				if (a0 == c0 && a1 == c1)
+					break;
+			}
+
+			out[0] = uint8_t(a0), out[1] = uint8_t(a1);
+			for (int i = 0; i < 2; ++i)
+			{
+				uint32_t bits = 0;
+				for (int j = 0; j < 8; ++j)
+					bits |= uint32_t(indices[i * 8 + j]) << (j * 3);
+
+				out[2 + i * 3] = uint8_t(bits), out[3 + i * 3] = uint8_t(bits >> 8), out[4 + i * 3] = uint8_t(bits >> 16);
+			}
+		}
+
+		//================ Blocks =================
+		int blockBytes(BlockFormat format) { return format == BLOCK_BC1 || format == BLOCK_BC4 ? 8 : 16; }
+
+		// pixels outside of the image repeat the edge
+		void fetchBlock(const uint8_t* rgba, unsigned int width, unsigned int height, unsigned int x, unsigned int y, uint8_t* out)
+		{
+			if (x + 4 <= width && y + 4 <= height)
+			{
+				for (int r = 0; r < 4; ++r)
+					memcpy(out + r * 16, rgba + ((y + r) * size_t(width) + x) * 4, 16);
+				return;
+			}
+
+			for (unsigned int r = 0; r < 4; ++r)
+			{
+				const unsigned int sy = y + r < height ? y + r : height - 1;
+				for (unsigned int c = 0; c < 4; ++c)
+				{
+					const unsigned int sx = x + c < width ? x + c : width - 1;
+					memcpy(out + (r * 4 + c) * 4, rgba + (sy * size_t(width) + sx) * 4, 4);
+				}
+			}
+		}
+
+		void encodeBlock(const uint8_t* block, BlockFormat format, BlockQuality quality, uint8_t* out)
+		{
+			uint8_t channel[16];
+			switch (format)
+			{
+			case BLOCK_BC1:
+				encodeColor(block, true, quality, out);
+				break;
+
+			case BLOCK_BC3:
+				for (int i = 0; i < 16; ++i)
+					channel[i] = block[i * 4 + 3];
+				encodeChannel(channel, quality, out);
+				encodeColor(block, false, quality, out + 8);
+				break;
+
+			case BLOCK_BC4:
+			case BLOCK_BC5:
+				for (int c = 0; c < (format == BLOCK_BC5 ? 2 : 1); ++c)
+				{
+					for (int i = 0; i < 16; ++i)
+						channel[i] = block[i * 4 + c];
+					encodeChannel(channel, quality, out + c * 8);
+				}
+				break;
+			}
+		}
+	}
+
+	size_t blockCompressedSize(unsigned int width, unsigned int height, BlockFormat format)
+	{
+		return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+	}
+
+	bool blockCompress(const uint8_t* rgba, unsigned int width, unsigned int height, BlockFormat format,
+	                   BlockQuality quality, uint8_t* out)
+	{
+		if (!rgba || !out || !width || !height)
+			return false;
+
+		const unsigned int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+		const size_t row_bytes = size_t(blocks_x) * blockBytes(format);
+		const int band = 4;
+		const int bands_count = int((blocks_y + band - 1) / band);
+
+		auto job = [&](int idx) {
+			uint8_t block[64];
+			const unsigned int to = (idx + 1) * band < int(blocks_y) ? (idx + 1) * band : blocks_y;
+			for (unsigned int by = idx * band; by < to; ++by)
+			{
+				uint8_t* o = out + by * row_bytes;
+				for (unsigned int bx = 0; bx < blocks_x; ++bx, o += blockBytes(format))
+				{
+					fetchBlock(rgba, width, height, bx * 4, by * 4, block);
+					encodeBlock(block, format, quality, o);
+				}
+			}
+		};
+
+		if (bands_count > 1 && size_t(blocks_x) * blocks_y >= 1024)
+			RoxMemory::RoxThreadPool::get().run(bands_count, job);
+		else
+		{
+			for (int i = 0; i < bands_count; ++i)
+				job(i);
+		}
+		return true;
+	}
+}
@@ -0,0 +1,46 @@
+// Updated By the ROX_ENGINE
+// Copyright (C) 2024 Torox Project
+// Portions Copyright (C) 2013 nyan.developer@gmail.com (nya-engine)
+//
+// This file was modified by the Torox Project.
+// 
+// This file incorporates code from the nya-engine project, which is licensed under the MIT License.
+// See the LICENSE-MIT file in the root directory for more information.
+//
+// This file is also part of the Rox-engine, which is licensed under a dual-license system:
+// 1. Free Use License (for non-commercial and commercial use under specific conditions)
+// 2. Commercial License (for use on proprietary platforms)
+// See the LICENSE file in the root directory for the full Rox-engine license terms.
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace RoxRender
+{
+	enum BlockFormat
+	{
+		BLOCK_BC1, //DXT1, rgb with 1-bit alpha
+		BLOCK_BC3, //DXT5, rgba
+		BLOCK_BC4, //red channel
+		BLOCK_BC5  //red and green channels, for normal maps
+	};
+
+	enum BlockQuality
+	{
+		BLOCK_QUALITY_FAST, //bounding box endpoints, for load time compression
+		BLOCK_QUALITY_NORMAL, //principal axis endpoints with a least squares refinement
+		BLOCK_QUALITY_HIGH //iterated refinement and endpoint search, for offline tools
+	};
+
+	//blocks of the partially covered edges are counted, for textures with sides multiple of 4
+	//it matches the mip size RoxTexture expects
+	size_t blockCompressedSize(unsigned int width, unsigned int height, BlockFormat format);
+
+	//rgba is width*height*4 bytes, BC1 pixels with alpha below 128 become transparent
+	//large images are compressed in rows of blocks on the thread pool
+	bool blockCompress(const uint8_t* rgba, unsigned int width, unsigned int height, BlockFormat format,
+	                   BlockQuality quality, uint8_t* out);
+}
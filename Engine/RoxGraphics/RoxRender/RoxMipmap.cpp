@@ -0,0 +1,478 @@
+// Updated By the ROX_ENGINE
+// Copyright (C) 2024 Torox Project
+// Portions Copyright (C) 2013 nyan.developer@gmail.com (nya-engine)
+//
+// This file was modified by the Torox Project.
+// 
+// This file incorporates code from the nya-engine project, which is licensed under the MIT License.
+// See the LICENSE-MIT file in the root directory for more information.
+//
+// This file is also part of the Rox-engine, which is licensed under a dual-license system:
+// 1. Free Use License (for non-commercial and commercial use under specific conditions)
+// 2. Commercial License (for use on proprietary platforms)
+// See the LICENSE file in the root directory for the full Rox-engine license terms.
+
+#include "RoxMipmap.h"
+#include "RoxBitmap.h"
+#include "RoxMemory/RoxThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace RoxRender
+{
+	namespace
+	{
+		struct PixelFormat
+		{
+			int channels;
+			int alpha; //channel index or -1
+			bool isFloat;
+			bool srgb;
+
+			size_t pixelSize() const { return isFloat ? channels * sizeof(float) : channels; }
+		};
+
+		bool getPixelFormat(RoxTexture::COLOR_FORMAT format, PixelFormat& f)
+		{
+			f.alpha = -1;
+			f.isFloat = false;
+			f.srgb = false;
+
+			switch (format)
+			{
+			case RoxTexture::COLOR_RGB: f.channels = 3; return true;
+			case RoxTexture::COLOR_RGBA:
+			case RoxTexture::COLOR_BGRA: f.channels = 4; f.alpha = 3; return true;
+			case RoxTexture::GREYSCALE: f.channels = 1; return true;
+			case RoxTexture::COLOR_R32F: f.channels = 1; f.isFloat = true; return true;
+			case RoxTexture::COLOR_RGB32F: f.channels = 3; f.isFloat = true; return true;
+			case RoxTexture::COLOR_RGBA32F: f.channels = 4; f.alpha = 3; f.isFloat = true; return true;
+			default: return false;
+			}
+		}
+
+		//================ sRGB =================
+		struct SrgbTables
+		{
+			static const int bucketsCount = 4096;
+
+			float toLinear[256];
+			float thresholds[255]; //linear value between the neighbour 8-bit values
+			uint8_t buckets[bucketsCount + 1]; //first 8-bit value of each linear range bucket
+
+			static float decode(float c) { return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f); }
+
+			SrgbTables()
+			{
+				for (int i = 0; i < 256; ++i)
+					toLinear[i] = decode(i / 255.0f);
+				for (int i = 0; i < 255; ++i)
+					thresholds[i] = decode((i + 0.5f) / 255.0f);
+
+				int idx = 0;
+				for (int i = 0; i <= bucketsCount; ++i)
+				{
+					while (idx < 255 && float(i) / bucketsCount >= thresholds[idx])
+						++idx;
+					buckets[i] = (uint8_t)idx;
+				}
+			}
+
+			// exact, buckets are narrower than the thresholds spacing so only a couple of steps are taken
+			uint8_t encode(float v) const
+			{
+				if (!(v > 0.0f))
+					return 0;
+				if (v >= 1.0f)
+					return 255;
+
+				int idx = buckets[int(v * bucketsCount)];
+				while (idx < 255 && v >= thresholds[idx])
+					++idx;
+				return (uint8_t)idx;
+			}
+		};
+
+		const SrgbTables& srgbTables()
+		{
+			static const SrgbTables tables;
+			return tables;
+		}
+
+		void decodeRow(const uint8_t* row, int width, const PixelFormat& f, float* out)
+		{
+			const int count = width * f.channels;
+			if (f.isFloat)
+			{
+				memcpy(out, row, count * sizeof(float));
+				return;
+			}
+
+			if (!f.srgb)
+			{
+				for (int i = 0; i < count; ++i)
+					out[i] = row[i] * (1.0f / 255.0f);
+				return;
+			}
+
+			const SrgbTables& t = srgbTables();
+			for (int i = 0; i < count; i += f.channels)
+			{
+				for (int c = 0; c < f.channels; ++c)
+					out[i + c] = c == f.alpha ? row[i + c] * (1.0f / 255.0f) : t.toLinear[row[i + c]];
+			}
+		}
+
+		void encodeRow(const float* row, int width, const PixelFormat& f, uint8_t* out)
+		{
+			const int count = width * f.channels;
+			if (f.isFloat)
+			{
+				memcpy(out, row, count * sizeof(float));
+				return;
+			}
+
+			const SrgbTables& t = srgbTables();
+			for (int i = 0; i < count; i += f.channels)
+			{
+				for (int c = 0; c < f.channels; ++c)
+				{
+					const float v = row[i + c];
+					if (f.srgb && c != f.alpha)
+						out[i + c] = t.encode(v);
+					else
+						out[i + c] = v <= 0.0f ? 0 : (v >= 1.0f ? 255 : (uint8_t)(v * 255.0f + 0.5f));
+				}
+			}
+		}
+
+		//================ Filters =================
+		const float pi = 3.14159265358979f;
+
+		float sinc(float x)
+		{
+			if (fabsf(x) < 1e-6f)
+				return 1.0f;
+			x *= pi;
+			return sinf(x) / x;
+		}
+
+		float bessel0(float x)
+		{
+			float sum = 1.0f, term = 1.0f;
+			const float hx = x * 0.5f;
+			for (int k = 1; k < 64 && term > sum * 1e-8f; ++k)
+			{
+				term *= (hx / k) * (hx / k);
+				sum += term;
+			}
+			return sum;
+		}
+
+		// support in destination pixels
+		float filterSupport(MipmapFilter filter) { return filter == MIPMAP_FILTER_BOX ? 0.5f : 3.0f; }
+
+		float filterValue(MipmapFilter filter, float x)
+		{
+			x = fabsf(x);
+			switch (filter)
+			{
+			case MIPMAP_FILTER_BOX: return x <= 0.5f ? 1.0f : 0.0f;
+			case MIPMAP_FILTER_LANCZOS: return x < 3.0f ? sinc(x) * sinc(x / 3.0f) : 0.0f;
+			case MIPMAP_FILTER_KAISER:
+				{
+					const float alpha = 4.0f, width = 3.0f;
+					if (x >= width)
+						return 0.0f;
+					const float t = x / width;
+					return sinc(x) * bessel0(alpha * sqrtf(1.0f - t * t)) / bessel0(alpha);
+				}
+			}
+			return 0.0f;
+		}
+
+		// weights of the source pixels for each destination pixel, edges are clamped
+		struct Filter1D
+		{
+			int taps;
+			std::vector<int> first;
+			std::vector<float> weights; //taps per destination pixel, zero padded
+
+			void build(MipmapFilter filter, int srcSize, int dstSize)
+			{
+				const float scale = float(srcSize) / dstSize;
+				const float radius = filterSupport(filter) * scale;
+				std::vector<float> w(srcSize);
+
+				taps = 1;
+				first.resize(dstSize);
+				std::vector<int> last(dstSize);
+				for (int pass = 0; pass < 2; ++pass)
+				{
+					if (pass == 1)
+						weights.assign(dstSize * taps, 0.0f);
+
+					for (int i = 0; i < dstSize; ++i)
+					{
+						const float center = (i + 0.5f) * scale;
+						int lo = (int)floorf(center - radius), hi = (int)ceilf(center + radius);
+						const int clo = lo < 0 ? 0 : lo, chi = hi >= srcSize ? srcSize - 1 : hi;
+
+						if (pass == 0)
+						{
+							first[i] = clo;
+							last[i] = chi;
+							if (chi - clo + 1 > taps)
+								taps = chi - clo + 1;
+							continue;
+						}
+
+						float sum = 0.0f;
+						for (int j = clo; j <= chi; ++j)
+							w[j] = 0.0f;
+						for (int j = lo; j <= hi; ++j)
+						{
+							const float v = filterValue(filter, (j + 0.5f - center) / scale);
+							w[j < 0 ? 0 : (j >= srcSize ? srcSize - 1 : j)] += v;
+							sum += v;
+						}
+
+						float* iw = &weights[i * taps];
+						for (int j = clo; j <= chi; ++j)
+							iw[j - clo] = sum != 0.0f ? w[j] / sum : (j == clo ? 1.0f : 0.0f);
+					}
+				}
+			}
+		};
+
+		template<int C>
+		void filterRow(const float* src, const Filter1D& fx, int dw, float* out)
+		{
+			for (int x = 0; x < dw; ++x, out += C)
+			{
+				const float* wx = &fx.weights[x * fx.taps];
+				const float* s = src + fx.first[x] * C;
+				float sum[C] = {};
+				for (int t = 0; t < fx.taps; ++t, s += C)
+				{
+					for (int k = 0; k < C; ++k)
+						sum[k] += wx[t] * s[k];
+				}
+				for (int k = 0; k < C; ++k)
+					out[k] = sum[k];
+			}
+		}
+
+		bool isHalf(int src, int dst) { return src == 1 ? dst == 1 : src == dst * 2; }
+
+		void downsampleLevel(const uint8_t* src, int sw, int sh, uint8_t* dst, int dw, int dh, const PixelFormat& f,
+		                     MipmapFilter filter)
+		{
+			if (!f.isFloat && !f.srgb && filter == MIPMAP_FILTER_BOX && isHalf(sw, dw) && isHalf(sh, dh))
+			{
+				bitmapDownsample2x(src, sw, sh, f.channels, dst);
+				return;
+			}
+
+			Filter1D fx, fy;
+			fx.build(filter, sw, dw);
+			fy.build(filter, sh, dh);
+
+			const int c = f.channels;
+			const size_t srcStride = sw * f.pixelSize(), dstStride = dw * f.pixelSize();
+			const int band = 64;
+			const int bandsCount = (dh + band - 1) / band;
+
+			auto job = [&](int idx) {
+				// horizontally filtered source rows are kept in a ring, neighbour destination rows share most of them
+				std::vector<float> ring(fy.taps * dw * c), srcRow((sw + fx.taps) * c), acc(dw * c); //zero padded taps may read past the row end
+				std::vector<int> ringRows(fy.taps, -1);
+
+				const int to = (idx + 1) * band < dh ? (idx + 1) * band : dh;
+				for (int y = idx * band; y < to; ++y)
+				{
+					std::fill(acc.begin(), acc.end(), 0.0f);
+					for (int t = 0; t < fy.taps; ++t)
+					{
+						const float wy = fy.weights[y * fy.taps + t];
+						if (wy == 0.0f)
+							continue;
+
+						const int r = fy.first[y] + t;
+						float* h = &ring[(r % fy.taps) * dw * c];
+						if (ringRows[r % fy.taps] != r)
+						{
+							ringRows[r % fy.taps] = r;
+							decodeRow(src + r * srcStride, sw, f, srcRow.data());
+							switch (c)
+							{
+							case 1: filterRow<1>(srcRow.data(), fx, dw, h); break;
+							case 3: filterRow<3>(srcRow.data(), fx, dw, h); break;
+							default: filterRow<4>(srcRow.data(), fx, dw, h); break;
+							}
+						}
+
+						for (int i = 0; i < dw * c; ++i)
+							acc[i] += wy * h[i];
+					}
+					encodeRow(acc.data(), dw, f, dst + y * dstStride);
+				}
+			};
+
+			if (bandsCount > 1 && size_t(dw) * dh * c >= 64 * 1024)
+				RoxMemory::RoxThreadPool::get().run(bandsCount, job);
+			else
+			{
+				for (int i = 0; i < bandsCount; ++i)
+					job(i);
+			}
+		}
+
+		//================ Alpha coverage =================
+		uint8_t scaleAlpha8(int a, float scale)
+		{
+			const float v = a * scale;
+			return v >= 255.0f ? 255 : (uint8_t)(v + 0.5f);
+		}
+
+		// share of pixels with the scaled alpha above cutoff, 8-bit alpha is counted with a histogram
+		struct AlphaCoverage
+		{
+			const uint8_t* data;
+			size_t count;
+			const PixelFormat& f;
+			float cutoff;
+			size_t histogram[256];
+
+			AlphaCoverage(const uint8_t* data, size_t count, const PixelFormat& f, float cutoff): data(data), count(count), f(f), cutoff(cutoff)
+			{
+				if (f.isFloat)
+					return;
+
+				memset(histogram, 0, sizeof(histogram));
+				for (size_t i = 0; i < count; ++i)
+					++histogram[data[i * f.channels + f.alpha]];
+			}
+
+			float get(float scale) const
+			{
+				size_t covered = 0;
+				if (f.isFloat)
+				{
+					const float* fdata = (const float*)data;
+					for (size_t i = 0; i < count; ++i)
+					{
+						if (fdata[i * f.channels + f.alpha] * scale > cutoff)
+							++covered;
+					}
+				}
+				else
+				{
+					for (int a = 0; a < 256; ++a)
+					{
+						if (scaleAlpha8(a, scale) > cutoff * 255.0f)
+							covered += histogram[a];
+					}
+				}
+				return float(covered) / count;
+			}
+		};
+
+		void scaleAlpha(uint8_t* data, size_t count, const PixelFormat& f, float scale)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (f.isFloat)
+				{
+					float& a = ((float*)data)[i * f.channels + f.alpha];
+					a = a * scale > 1.0f ? 1.0f : a * scale;
+				}
+				else
+				{
+					uint8_t& a = data[i * f.channels + f.alpha];
+					a = scaleAlpha8(a, scale);
+				}
+			}
+		}
+
+		void preserveCoverage(uint8_t* data, size_t count, const PixelFormat& f, float cutoff, float target)
+		{
+			const AlphaCoverage coverage(data, count, f, cutoff);
+			float lo = 0.0f, hi = 4.0f, best = 1.0f, bestError = fabsf(coverage.get(1.0f) - target);
+			for (int i = 0; i < 16 && bestError > 0.0f; ++i)
+			{
+				const float mid = (lo + hi) * 0.5f;
+				const float c = coverage.get(mid);
+				if (fabsf(c - target) < bestError)
+					bestError = fabsf(c - target), best = mid;
+
+				if (c < target)
+					lo = mid;
+				else
+					hi = mid;
+			}
+
+			if (best != 1.0f)
+				scaleAlpha(data, count, f, best);
+		}
+	}
+
+	bool mipmapIsFormatSupported(RoxTexture::COLOR_FORMAT format)
+	{
+		PixelFormat f;
+		return getPixelFormat(format, f);
+	}
+
+	int mipmapLevelsCount(unsigned int width, unsigned int height)
+	{
+		int count = 1;
+		for (; width > 1 || height > 1; ++count)
+			width = width > 1 ? width / 2 : 1, height = height > 1 ? height / 2 : 1;
+		return count;
+	}
+
+	size_t mipmapChainSize(unsigned int width, unsigned int height, RoxTexture::COLOR_FORMAT format, int levels)
+	{
+		PixelFormat f;
+		if (!getPixelFormat(format, f))
+			return 0;
+
+		size_t size = 0;
+		for (int i = 0; i < levels; ++i, width = width > 1 ? width / 2 : 1, height = height > 1 ? height / 2 : 1)
+			size += width * height * f.pixelSize();
+		return size;
+	}
+
+	bool mipmapGenerate(const void* data, unsigned int width, unsigned int height, RoxTexture::COLOR_FORMAT format,
+	                    const MipmapSettings& settings, void* out, int levels)
+	{
+		PixelFormat f;
+		if (!data || !out || !width || !height || !getPixelFormat(format, f))
+			return false;
+
+		f.srgb = settings.srgb && !f.isFloat;
+		if (levels <= 0)
+			levels = mipmapLevelsCount(width, height);
+
+		const bool coverage = settings.preserveAlphaCoverage && f.alpha >= 0;
+		const float target = coverage ? AlphaCoverage((const uint8_t*)data, size_t(width) * height, f, settings.alphaCutoff).get(1.0f) : 0.0f;
+
+		uint8_t* level = (uint8_t*)out;
+		memcpy(level, data, width * height * f.pixelSize());
+		for (int i = 1; i < levels; ++i)
+		{
+			const unsigned int w = width > 1 ? width / 2 : 1, h = height > 1 ? height / 2 : 1;
+			uint8_t* next = level + width * height * f.pixelSize();
+			downsampleLevel(level, width, height, next, w, h, f, settings.filter);
+			if (coverage)
+				preserveCoverage(next, size_t(w) * h, f, settings.alphaCutoff, target);
+
+			level = next, width = w, height = h;
+		}
+
+		return true;
+	}
+}
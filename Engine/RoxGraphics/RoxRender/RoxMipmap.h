@@ -0,0 +1,50 @@
+// Updated By the ROX_ENGINE
+// Copyright (C) 2024 Torox Project
+// Portions Copyright (C) 2013 nyan.developer@gmail.com (nya-engine)
+//
+// This file was modified by the Torox Project.
+// 
+// This file incorporates code from the nya-engine project, which is licensed under the MIT License.
+// See the LICENSE-MIT file in the root directory for more information.
+//
+// This file is also part of the Rox-engine, which is licensed under a dual-license system:
+// 1. Free Use License (for non-commercial and commercial use under specific conditions)
+// 2. Commercial License (for use on proprietary platforms)
+// See the LICENSE file in the root directory for the full Rox-engine license terms.
+
+
+#pragma once
+
+#include "RoxTexture.h"
+#include <stddef.h>
+
+namespace RoxRender
+{
+	enum MipmapFilter
+	{
+		MIPMAP_FILTER_BOX,
+		MIPMAP_FILTER_KAISER,
+		MIPMAP_FILTER_LANCZOS
+	};
+
+	struct MipmapSettings
+	{
+		MipmapFilter filter;
+		bool srgb; //color channels of 8-bit formats are filtered in linear space
+		bool preserveAlphaCoverage; //alpha is scaled to keep the share of pixels above alphaCutoff of the top level
+		float alphaCutoff;
+
+		MipmapSettings(): filter(MIPMAP_FILTER_BOX), srgb(false), preserveAlphaCoverage(false), alphaCutoff(0.5f) {}
+	};
+
+	//COLOR_RGB, COLOR_RGBA, COLOR_BGRA, GREYSCALE, COLOR_R32F, COLOR_RGB32F and COLOR_RGBA32F
+	bool mipmapIsFormatSupported(RoxTexture::COLOR_FORMAT format);
+
+	int mipmapLevelsCount(unsigned int width, unsigned int height); //full chain down to 1x1
+	size_t mipmapChainSize(unsigned int width, unsigned int height, RoxTexture::COLOR_FORMAT format, int levels);
+
+	//writes levels one after another into out, the first one is a copy of data, levels=0 for a full chain
+	//each level is filtered from the previous one while it's still in cache, out layout is the one buildTexture expects
+	bool mipmapGenerate(const void* data, unsigned int width, unsigned int height, RoxTexture::COLOR_FORMAT format,
+	                    const MipmapSettings& settings, void* out, int levels = 0);
+}
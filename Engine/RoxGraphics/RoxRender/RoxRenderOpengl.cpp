@@ -441,6 +441,9 @@ namespace RoxRender
 			case RoxVBO::FLOAT_16: return GL_HALF_FLOAT;
 			case RoxVBO::FLOAT_32: return GL_FLOAT;
 			case RoxVBO::UINT_8: return GL_UNSIGNED_BYTE;
+			case RoxVBO::INT_16: return GL_SHORT;
+			case RoxVBO::UINT_16: return GL_UNSIGNED_SHORT;
+			case RoxVBO::INT_8: return GL_BYTE;
 			}
 
 			return GL_FLOAT;
@@ -1617,6 +1620,28 @@ namespace RoxRender
 		return true;
 	}
 
+	const char* RoxRenderOpengl::getDeviceId()
+	{
+		static std::string id;
+		if (!id.empty())
+			return id.c_str();
+
+		//the strings are null without a current context, nothing is cached until one exists
+		const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+		std::string result = "opengl";
+		for (int i = 0; i < 3; ++i)
+		{
+			const char* str = (const char*)glGetString(names[i]);
+			if (!str)
+				return "";
+
+			result.append("|").append(str);
+		}
+
+		id = result;
+		return id.c_str();
+	}
+
 	namespace
 	{
 		RoxMath::Matrix4 modelview, projection;
@@ -1784,7 +1809,7 @@ namespace RoxRender
 					{
 						if (!applied_layout.normal.dimension)
 							glEnableVertexAttribArray(NORMAL_ATTRIBUTE);
-						glVertexAttribPointer(NORMAL_ATTRIBUTE, 3, getGLElementType(v.layout.normal.type), true,
+						glVertexAttribPointer(NORMAL_ATTRIBUTE, v.layout.normal.dimension, getGLElementType(v.layout.normal.type), true,
 						                      v.stride, (void*)(ptrdiff_t)(v.layout.normal.offset));
 					}
 				}
@@ -74,6 +74,7 @@ namespace RoxRender
 	public:
 		int setProgramBinaryShader(const char* vertex_code, const char* fragment_code, RoxCompiledShader& cmp_shdr) override;
 		bool getProgramBinaryShader(int idx, RoxCompiledShader& cmp_shdr) override;
+		const char* getDeviceId() override;
 	public:
 		void setCamera(const RoxMath::Matrix4& modelview, const RoxMath::Matrix4& projection) override;
 		void clear(const ViewportState& s, bool color, bool depth, bool stencil) override;
@@ -14,10 +14,14 @@
 
 #include "RoxShaderCodeParser.h"
 #include "RoxLogger/RoxLogger.h"
+#include "RoxMemory/RoxHash.h"
+#include "RoxMemory/RoxMemoryReader.h"
+#include "RoxMemory/RoxMemoryWriter.h"
 #include <cstdlib>
 #include <cstring>
 #include <cstdio>
 #include <algorithm>
+#include <mutex>
 
 namespace RoxRender
 {
@@ -49,7 +53,241 @@ namespace RoxRender
 
 	static bool isNameChar(char c) { return isalnum(c) || c == '_'; }
 
-	bool RoxShaderCodeParser::convertToHlsl()
+	namespace
+	{
+		enum CacheTarget
+		{
+			CACHE_HLSL,
+			CACHE_GLSL,
+			CACHE_GLSL3,
+			CACHE_METAL,
+			CACHE_UNIFORMS
+		};
+
+		struct CacheEntry
+		{
+			std::string code, error;
+			std::vector<RoxShaderCodeParser::Variable> uniforms, attributes, varying;
+		};
+
+		const char cacheMagic[8] = { 'r', 'o', 'x', ' ', 's', 'p', 'c', 0 };
+		const uint32_t cacheVersion = 1;
+
+		struct Cache
+		{
+			std::mutex mutex;
+			std::map<std::pair<uint64_t, uint64_t>, CacheEntry> entries;
+			std::string filename;
+			bool loaded;
+			bool enabled;
+
+			Cache() : loaded(false), enabled(true) {}
+		};
+
+		Cache& getCache()
+		{
+			static Cache cache;
+			return cache;
+		}
+
+		void writeVars(RoxMemory::RoxMemoryWriter& w, const std::vector<RoxShaderCodeParser::Variable>& vars)
+		{
+			w.writeUint((unsigned int)vars.size());
+			for (size_t i = 0; i < vars.size(); ++i)
+			{
+				w.writeInt(vars[i].type);
+				w.writeUint(vars[i].array_size);
+				w.writeString(vars[i].name);
+			}
+		}
+
+		bool readVars(RoxMemory::RoxMemoryReader& r, std::vector<RoxShaderCodeParser::Variable>& vars)
+		{
+			const unsigned int count = r.read<unsigned int>();
+			if (!r.checkRemained(size_t(count) * 10))
+				return false;
+
+			vars.resize(count);
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				vars[i].type = (RoxShaderCodeParser::VARIABLE_TYPE)r.read<int>();
+				vars[i].array_size = r.read<unsigned int>();
+				vars[i].name = r.readString<unsigned short>();
+			}
+
+			return true;
+		}
+
+		size_t writeEntry(const std::pair<uint64_t, uint64_t>& key, const CacheEntry& e, void* data, size_t size)
+		{
+			RoxMemory::RoxMemoryWriter w(data, size);
+			w.write(key.first);
+			w.write(key.second);
+			w.writeString<unsigned int>(e.code);
+			w.writeString<unsigned int>(e.error);
+			writeVars(w, e.uniforms);
+			writeVars(w, e.attributes);
+			writeVars(w, e.varying);
+			return w.getOffset();
+		}
+
+		// entries after a truncated one are dropped, they are added again when translated
+		void loadCacheFile(Cache& c)
+		{
+			if (c.loaded)
+				return;
+
+			c.loaded = true;
+			if (c.filename.empty())
+				return;
+
+			FILE* f = fopen(c.filename.c_str(), "rb");
+			if (!f)
+				return;
+
+			std::vector<char> buf;
+			if (fseek(f, 0, SEEK_END) == 0)
+			{
+				const long size = ftell(f);
+				buf.resize(size > 0 ? size : 0);
+			}
+
+			const bool read = !buf.empty() && fseek(f, 0, SEEK_SET) == 0 && fread(buf.data(), buf.size(), 1, f) == 1;
+			fclose(f);
+			if (!read)
+				return;
+
+			RoxMemory::RoxMemoryReader r(buf.data(), buf.size());
+			if (!r.test(cacheMagic, sizeof(cacheMagic)) || r.read<uint32_t>() != cacheVersion)
+				return;
+
+			while (r.checkRemained(sizeof(uint64_t) * 2 + sizeof(unsigned int)))
+			{
+				std::pair<uint64_t, uint64_t> key;
+				key.first = r.read<uint64_t>();
+				key.second = r.read<uint64_t>();
+				const unsigned int size = r.read<unsigned int>();
+				if (!r.checkRemained(size))
+					break;
+
+				RoxMemory::RoxMemoryReader er(r.getData(), size);
+				r.skip(size);
+
+				CacheEntry e;
+				e.code = er.readString<unsigned int>();
+				e.error = er.readString<unsigned int>();
+				if (!readVars(er, e.uniforms) || !readVars(er, e.attributes) || !readVars(er, e.varying))
+					break;
+
+				c.entries[key] = e;
+			}
+		}
+
+		void appendCacheFile(const Cache& c, const std::pair<uint64_t, uint64_t>& key, const CacheEntry& e)
+		{
+			if (c.filename.empty())
+				return;
+
+			FILE* f = fopen(c.filename.c_str(), "ab");
+			if (!f)
+				return;
+
+			bool written = fseek(f, 0, SEEK_END) == 0;
+			if (written && ftell(f) == 0)
+				written = fwrite(cacheMagic, sizeof(cacheMagic), 1, f) == 1 && fwrite(&cacheVersion, sizeof(cacheVersion), 1, f) == 1;
+
+			// the entry is sized for the reader to skip it, the key is part of the counted data
+			std::vector<char> buf(writeEntry(key, e, 0, 0));
+			writeEntry(key, e, buf.data(), buf.size());
+			const unsigned int size = (unsigned int)(buf.size() - sizeof(uint64_t) * 2);
+			written = written && fwrite(buf.data(), sizeof(uint64_t) * 2, 1, f) == 1 && fwrite(&size, sizeof(size), 1, f) == 1
+				&& fwrite(buf.data() + sizeof(uint64_t) * 2, size, 1, f) == 1;
+			if (fclose(f) != 0 || !written)
+				RoxLogger::log() << "shader code parser: unable to write cache file " << c.filename.c_str() << "\n";
+		}
+	}
+
+	void RoxShaderCodeParser::setCacheEnabled(bool enabled)
+	{
+		Cache& c = getCache();
+		std::lock_guard<std::mutex> lock(c.mutex);
+		c.enabled = enabled;
+	}
+
+	void RoxShaderCodeParser::setCacheFile(const char* filename)
+	{
+		Cache& c = getCache();
+		std::lock_guard<std::mutex> lock(c.mutex);
+		c.filename.assign(filename ? filename : "");
+		c.loaded = false;
+	}
+
+	void RoxShaderCodeParser::clearCache()
+	{
+		Cache& c = getCache();
+		std::lock_guard<std::mutex> lock(c.mutex);
+		c.entries.clear();
+		c.loaded = false;
+	}
+
+	RoxShaderCodeParser::CacheKey RoxShaderCodeParser::getCacheKey(int target) const
+	{
+		uint64_t seed = RoxMemory::hash64(&target, sizeof(target), cacheVersion);
+		seed = RoxMemory::hash64(m_replace_str.c_str(), seed);
+		seed = RoxMemory::hash64(m_flip_y_uniform.c_str(), seed);
+		return CacheKey(RoxMemory::hash64(m_code.data(), m_code.size(), seed), RoxMemory::hash64(m_code.data(), m_code.size(), ~seed));
+	}
+
+	// the converters clear the uniforms and attributes and start with no varying, so a fresh state is keyed by the code alone
+	bool RoxShaderCodeParser::convertCached(int target, bool (RoxShaderCodeParser::*convert)())
+	{
+		Cache& c = getCache();
+		{
+			std::lock_guard<std::mutex> lock(c.mutex);
+			if (!c.enabled || !m_varying.empty())
+				return (this->*convert)();
+		}
+
+		const CacheKey key = getCacheKey(target);
+		{
+			std::lock_guard<std::mutex> lock(c.mutex);
+			loadCacheFile(c);
+			std::map<CacheKey, CacheEntry>::const_iterator it = c.entries.find(key);
+			if (it != c.entries.end())
+			{
+				m_code = it->second.code;
+				m_error.append(it->second.error);
+				m_uniforms = it->second.uniforms;
+				m_attributes = it->second.attributes;
+				m_varying = it->second.varying;
+				return true;
+			}
+		}
+
+		const size_t error_size = m_error.size();
+		if (!(this->*convert)())
+			return false;
+
+		CacheEntry e;
+		e.code = m_code;
+		e.error = m_error.substr(error_size);
+		e.uniforms = m_uniforms;
+		e.attributes = m_attributes;
+		e.varying = m_varying;
+
+		std::lock_guard<std::mutex> lock(c.mutex);
+		if (c.entries.insert(std::make_pair(key, e)).second)
+			appendCacheFile(c, key, e);
+
+		return true;
+	}
+
+	bool RoxShaderCodeParser::convertToHlsl() { return convertCached(CACHE_HLSL, &RoxShaderCodeParser::translateToHlsl); }
+	bool RoxShaderCodeParser::convertToGlsl() { return convertCached(CACHE_GLSL, &RoxShaderCodeParser::translateToGlsl); }
+	bool RoxShaderCodeParser::convertToGlsl3() { return convertCached(CACHE_GLSL3, &RoxShaderCodeParser::translateToGlsl3); }
+	bool RoxShaderCodeParser::convertToMetal() { return convertCached(CACHE_METAL, &RoxShaderCodeParser::translateToMetal); }
+
+	bool RoxShaderCodeParser::translateToHlsl()
 	{
 		m_uniforms.clear();
 		m_attributes.clear();
@@ -117,7 +355,7 @@ namespace RoxRender
 
 			char buf[512];
 			// TODO: CONVERTED FROM _nya_ to _rox_
-			printf(buf, "%s %s: register(t%d); SamplerState %s_nya_st: register(s%d);\n",
+			sprintf(buf, "%s %s: register(t%d); SamplerState %s_nya_st: register(s%d);\n",
 				   types[v.type - TYPE_SAMPLER2D], v.name.c_str(), samplers_count, v.name.c_str(), samplers_count);
 			prefix.append(buf);
 			++samplers_count;
@@ -152,11 +390,11 @@ namespace RoxRender
 			if (v.type == TYPE_INVALID)
 				return false;
 
-			if (v.type - 1 >= sizeof(type_names) / sizeof(type_names[0]))
+			if (v.type >= sizeof(type_names) / sizeof(type_names[0]))
 				continue;
 
 			char buf[255];
-			printf(buf, "%s %s:TEXCOORD%d;", type_names[v.type], m_varying[i].name.c_str(), idx);
+			sprintf(buf, "%s %s:TEXCOORD%d;", type_names[v.type], m_varying[i].name.c_str(), idx);
 			prefix.append(buf);
 			idx += typeRegsize(v.type);
 		}
@@ -186,7 +424,7 @@ namespace RoxRender
 					return false;
 				}
 
-				if (v.type - 1 >= sizeof(type_names) / sizeof(type_names[0]))
+				if (v.type >= sizeof(type_names) / sizeof(type_names[0]))
 					continue;
 
 				prefix.append("static " + std::string(type_names[v.type]) + " " + m_varying[i].name + ";");
@@ -221,7 +459,7 @@ namespace RoxRender
 					else
 					{
 						char buf[255];
-						printf(buf, "float4 %s:TEXCOORD%d;", a.name.c_str(), idx);
+						sprintf(buf, "float4 %s:TEXCOORD%d;", a.name.c_str(), idx);
 						prefix.append(buf);
 						idx += typeRegsize(a.type);
 					}
@@ -252,7 +490,7 @@ namespace RoxRender
 				if (v.type == TYPE_INVALID)
 					return false;
 
-				if (v.type - 1 >= sizeof(type_names) / sizeof(type_names[0]))
+				if (v.type >= sizeof(type_names) / sizeof(type_names[0]))
 					continue;
 
 				prefix.append("static " + std::string(type_names[v.type]) + " " + m_varying[i].name + ";");
@@ -281,14 +519,14 @@ namespace RoxRender
 				if (v.type == TYPE_INVALID)
 					return false;
 
-				if (v.type - 1 >= sizeof(type_names) / sizeof(type_names[0]))
+				if (v.type >= sizeof(type_names) / sizeof(type_names[0]))
 					continue;
 
 				prefix.append(type_names[v.type]), prefix.append(" " + v.name);
 				if (v.array_size > 1)
 				{
 					char buf[255];
-					printf(buf, "[%d];", v.array_size);
+					sprintf(buf, "[%d];", v.array_size);
 					prefix.append(buf);
 				}
 				else
@@ -321,7 +559,7 @@ namespace RoxRender
 		return false;
 	}
 
-	bool RoxShaderCodeParser::convertToMetal()
+	bool RoxShaderCodeParser::translateToMetal()
 	{
 		m_uniforms.clear();
 		m_attributes.clear();
@@ -361,7 +599,7 @@ namespace RoxRender
 				if (v.array_size > 1)
 				{
 					char buf[255];
-					printf(buf, "[%d];", v.array_size);
+					sprintf(buf, "[%d];", v.array_size);
 					prefix.append(buf);
 				}
 				else
@@ -392,7 +630,7 @@ namespace RoxRender
 					return false;
 				}
 
-				if (v.type - 1 >= sizeof(type_names) / sizeof(type_names[0]))
+				if (v.type >= sizeof(type_names) / sizeof(type_names[0]))
 					continue;
 
 				prefix.append(std::string(type_names[v.type]) + ' ' + m_varying[i].name + ';');
@@ -431,9 +669,9 @@ namespace RoxRender
 			const char *types[] = {"texture2d<float>", "texturecube<float>"};
 
 			char buf[64];
-			printf(buf, "[[texture(%d)]]", samplers_count);
+			sprintf(buf, "[[texture(%d)]]", samplers_count);
 			args.add(types[v.type - TYPE_SAMPLER2D], v.name, buf);
-			printf(buf, "[[sampler(%d)]]", samplers_count);
+			sprintf(buf, "[[sampler(%d)]]", samplers_count);
 			args.add("sampler", v.name + m_replace_str + "st", buf);
 
 			++samplers_count;
@@ -501,7 +739,7 @@ namespace RoxRender
 				else
 				{
 					char buf[255];
-					printf(buf, "float4 %s[[attribute(%d)]];", a.name.c_str(), a.idx + 3);
+					sprintf(buf, "float4 %s[[attribute(%d)]];", a.name.c_str(), a.idx + 3);
 					prefix.append(buf);
 				}
 			}
@@ -649,7 +887,7 @@ namespace RoxRender
 		return true;
 	}
 
-	bool RoxShaderCodeParser::convertToGlsl()
+	bool RoxShaderCodeParser::translateToGlsl()
 	{
 		if (replaceVariable("gl_InstanceID", "gl_InstanceIDARB"))
 			m_code.insert(0, "#extension GL_ARB_draw_instanced:enable\n");
@@ -658,7 +896,7 @@ namespace RoxRender
 		return true;
 	}
 
-	bool RoxShaderCodeParser::convertToGlsl3()
+	bool RoxShaderCodeParser::translateToGlsl3()
 	{
 		m_uniforms.clear();
 		m_attributes.clear();
@@ -738,10 +976,39 @@ namespace RoxRender
 
 	int RoxShaderCodeParser::getUniformsCount()
 	{
-		if (m_uniforms.empty())
+		if (!m_uniforms.empty())
+			return (int)m_uniforms.size();
+
+		Cache& c = getCache();
+		bool cached;
 		{
-			parsePredefinedUniforms(m_replace_str.c_str(), false);
-			parseUniforms(false);
+			std::lock_guard<std::mutex> lock(c.mutex);
+			cached = c.enabled;
+		}
+
+		const CacheKey key = cached ? getCacheKey(CACHE_UNIFORMS) : CacheKey();
+		if (cached)
+		{
+			std::lock_guard<std::mutex> lock(c.mutex);
+			loadCacheFile(c);
+			std::map<CacheKey, CacheEntry>::const_iterator it = c.entries.find(key);
+			if (it != c.entries.end())
+			{
+				m_uniforms = it->second.uniforms;
+				return (int)m_uniforms.size();
+			}
+		}
+
+		parsePredefinedUniforms(m_replace_str.c_str(), false);
+		parseUniforms(false);
+
+		if (cached)
+		{
+			CacheEntry e;
+			e.uniforms = m_uniforms;
+			std::lock_guard<std::mutex> lock(c.mutex);
+			if (c.entries.insert(std::make_pair(key, e)).second)
+				appendCacheFile(c, key, e);
 		}
 
 		return (int)m_uniforms.size();
@@ -807,7 +1074,7 @@ namespace RoxRender
 				prefix.append(t + (" " + m_replace_str) + f + "(");
 				for (int k = 0; k < functions_args[i]; ++k)
 				{
-					printf(buf, "%s%s a%d", k == 0 ? "" : ",", t, k);
+					sprintf(buf, "%s%s a%d", k == 0 ? "" : ",", t, k);
 					prefix.append(buf);
 				}
 
@@ -818,7 +1085,7 @@ namespace RoxRender
 					prefix.append(std::string(k == 0 ? "" : ",") + f + "(");
 					for (int l = 0; l < functions_args[i]; ++l)
 					{
-						printf(buf, "%sa%d%s", l == 0 ? "" : ",", l, j == 0 ? "" : components[k]);
+						sprintf(buf, "%sa%d%s", l == 0 ? "" : ",", l, j == 0 ? "" : components[k]);
 						prefix.append(buf);
 					}
 					prefix.append(")");
@@ -831,18 +1098,41 @@ namespace RoxRender
 		return true;
 	}
 
+	// a single pass, line comments keep their line break and an unclosed block comment runs to the end
 	void RoxShaderCodeParser::removeComments()
 	{
-		while (m_code.find("//") != std::string::npos)
-		{
-			const size_t from = m_code.find("//");
-			m_code.erase(from, m_code.find_first_of("\n\r", from + 1) - from);
-		}
-		while (m_code.find("/*") != std::string::npos)
+		size_t from = m_code.find('/');
+		if (from == std::string::npos)
+			return;
+
+		std::string out(m_code, 0, from);
+		out.reserve(m_code.size());
+		while (from < m_code.size())
 		{
-			const size_t from = m_code.find("/*");
-			m_code.erase(from, (m_code.find("*/", from + 2) - from) + 2);
+			const size_t next = m_code.find('/', from);
+			if (next == std::string::npos || next + 1 >= m_code.size())
+			{
+				out.append(m_code, from, std::string::npos);
+				break;
+			}
+
+			out.append(m_code, from, next - from);
+			const char c = m_code[next + 1];
+			if (c == '/')
+				from = std::min(m_code.find_first_of("\n\r", next + 2), m_code.size());
+			else if (c == '*')
+			{
+				const size_t end = m_code.find("*/", next + 2);
+				from = end == std::string::npos ? m_code.size() : end + 2;
+			}
+			else
+			{
+				out.push_back('/');
+				from = next + 1;
+			}
 		}
+
+		m_code.swap(out);
 	}
 
 	template <typename t>
@@ -1344,7 +1634,9 @@ namespace RoxRender
 		if (!from || !from[0] || !to)
 			return false;
 
-		bool result = false;
+		// built in one pass, replacing in place would move the tail of the code on every match
+		std::string out;
+		size_t copied = 0;
 		const size_t from_len = strlen(from);
 		while ((start_pos = m_code.find(from, start_pos)) != std::string::npos)
 		{
@@ -1355,12 +1647,20 @@ namespace RoxRender
 				continue;
 			}
 
-			m_code.replace(start_pos, from_len, to);
-			start_pos += strlen(to);
-			result = true;
+			if (out.empty())
+				out.reserve(m_code.size());
+
+			out.append(m_code, copied, start_pos - copied).append(to);
+			start_pos += from_len;
+			copied = start_pos;
 		}
 
-		return result;
+		if (!copied)
+			return false;
+
+		out.append(m_code, copied, std::string::npos);
+		m_code.swap(out);
+		return true;
 	}
 
 	bool RoxShaderCodeParser::findVariable(const char *str, size_t start_pos)
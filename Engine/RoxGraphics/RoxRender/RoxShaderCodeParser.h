@@ -18,6 +18,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <stdint.h>
 
 namespace RoxRender
 {
@@ -84,11 +85,27 @@ namespace RoxRender
 	public:
 		bool fixPerComponentFunctions();
 
+	public:
+		// conversions and uniform lists are memoized by the hash of the code, the target and the prefixes
+		static void setCacheEnabled(bool enabled); // enabled by default
+		static void setCacheFile(const char* filename); // loaded on first use, new entries are appended, 0 for memory only
+		static void clearCache();
+
 	public:
 		RoxShaderCodeParser(const char* text, const char* replace_prefix_str = "_rox_", const char* flip_y_uniform = 0):
 			m_code(text ? text : ""), m_replace_str(replace_prefix_str ? replace_prefix_str : ""),
 			m_flip_y_uniform(flip_y_uniform ? flip_y_uniform : "") { removeComments(); }
 
+	private:
+		typedef std::pair<uint64_t, uint64_t> CacheKey;
+		CacheKey getCacheKey(int target) const;
+		bool convertCached(int target, bool (RoxShaderCodeParser::*convert)());
+
+		bool translateToHlsl();
+		bool translateToGlsl();
+		bool translateToGlsl3();
+		bool translateToMetal();
+
 	private:
 		void removeComments();
 
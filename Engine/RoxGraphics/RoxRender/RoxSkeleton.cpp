@@ -388,9 +388,9 @@ void RoxSkeleton::updateIk(int idx)
     }
 }
 
-void RoxSkeleton::update()
+void RoxSkeleton::update(bool ik_and_bounds)
 {
-    if(m_iks.empty() && m_bounds.empty())
+    if(!ik_and_bounds || (m_iks.empty() && m_bounds.empty()))
     {
         for(int i=0,count=(int)m_bones.size();i<count;++i)
             baseUpdateBone(i);
@@ -45,7 +45,7 @@ public:
 
     void setBoneTransform(int bone_idx,const RoxMath::Vector3 &pos,
                                                 const RoxMath::Quaternion &rot);
-    void update();
+    void update(bool ik_and_bounds=true);
 
 public:
     const float *getPosBuffer() const;
@@ -30,8 +30,13 @@ public:
     uint verts_count;
     uint opaque_poly_count;
     uint transparent_poly_count;
+    uint skeleton_updates;
+    uint skeleton_updates_skipped;
+    uint lod_triangles_saved; //against drawing the most detailed levels
+    uint cluster_triangles_culled;
 
-    Statistics(): draw_count(0),verts_count(0),opaque_poly_count(0),transparent_poly_count(0) {}
+    Statistics(): draw_count(0),verts_count(0),opaque_poly_count(0),transparent_poly_count(0),
+                  skeleton_updates(0),skeleton_updates_skipped(0),lod_triangles_saved(0),cluster_triangles_culled(0) {}
 
 public:
     static bool enabled();
@@ -14,6 +14,7 @@
 
 #include "RoxTexture.h"
 #include "RoxBitmap.h"
+#include "RoxMipmap.h"
 #include "RoxRenderOpengl.h"
 #include "RoxMemory/RoxTmpBuffers.h"
 
@@ -30,6 +31,10 @@ namespace RoxRender
         RoxTexture::FILTER default_mag_filter = RoxTexture::FILTER_LINEAR;
         RoxTexture::FILTER default_mip_filter = RoxTexture::FILTER_LINEAR;
         unsigned int default_aniso = 0;
+        bool cpu_mipmaps = false;
+        MipmapSettings cpu_mipmap_settings;
+
+        bool cpu_mipmaps_supported(RoxTexture::COLOR_FORMAT format) { return cpu_mipmaps && mipmapIsFormatSupported(format); }
     }
 
 bool RoxTexture::buildTexture(const void* data_a[6], bool is_cubemap, unsigned int width, unsigned int height,
@@ -67,7 +72,7 @@ bool RoxTexture::buildTexture(const void* data_a[6], bool is_cubemap, unsigned i
         }
     }
 
-    if (format >= COLOR_R32F && mip_count < 0)
+    if (format >= COLOR_R32F && mip_count < 0 && !cpu_mipmaps_supported(format))
         mip_count = 1;
 
     const bool is_pvrtc = format == PVR_RGB2B || format == PVR_RGBA2B || format == PVR_RGB4B || format == PVR_RGBA4B;
@@ -93,6 +98,20 @@ bool RoxTexture::buildTexture(const void* data_a[6], bool is_cubemap, unsigned i
     else if (!pot)
         mip_count = 1;
 
+    RoxMemory::RoxTmpBufferRef mips_buf;
+    if (mip_count < 0 && cpu_mipmaps_supported(format))
+    {
+        mip_count = mipmapLevelsCount(width, height);
+        const size_t size = mipmapChainSize(width, height, format, mip_count);
+        mips_buf.allocate(is_cubemap ? size * 6 : size);
+        for (int i = 0; i < (is_cubemap ? 6 : 1); ++i)
+        {
+            void* to = mips_buf.getData(i * size);
+            mipmapGenerate(is_cubemap ? data_a[i] : data, width, height, format, cpu_mipmap_settings, to, mip_count);
+            (is_cubemap ? data_a[i] : data) = to;
+        }
+    }
+
     RoxMemory::RoxTmpBufferRef tmp_buf;
 
     if (!getAPIInterface().isTextureFormatSupported(format))
@@ -113,7 +132,7 @@ bool RoxTexture::buildTexture(const void* data_a[6], bool is_cubemap, unsigned i
             {
                 size_t size = 0;
                 for (int i = 0, w = width, h = height; i < (mip_count >= 0 ? mip_count : 1); w > 1 ? w = w / 2 : w = 1, h > 1 ? h /= 2 : h = 1, ++i)
-                    size += width * height * 4;
+                    size += w * h * 4;
 
                 tmp_buf.allocate(is_cubemap ? size * 6 : size);
                 for (int i = 0; i < (is_cubemap ? 6 : 1); ++i)
@@ -156,6 +175,7 @@ bool RoxTexture::buildTexture(const void* data_a[6], bool is_cubemap, unsigned i
         m_tex = getAPIInterface().createTexture(data, width, height, format, mip_count);
 
     tmp_buf.free();
+    mips_buf.free();
 
     if(m_tex<0)
         return false;
@@ -338,6 +358,20 @@ void RoxTexture::setDefaultWrap(WRAP s, WRAP t)
     default_wrap_t = t;
 }
 
+void RoxTexture::setCpuMipmaps(bool enable, const MipmapSettings* settings)
+{
+    cpu_mipmaps = enable;
+    if (settings)
+        cpu_mipmap_settings = *settings;
+}
+
+bool RoxTexture::getCpuMipmaps(MipmapSettings* settings)
+{
+    if (settings)
+        *settings = cpu_mipmap_settings;
+    return cpu_mipmaps;
+}
+
 void RoxTexture::setDefaultFilter(FILTER minification, FILTER magnification, FILTER mipmap)
 {
     default_min_filter = minification;
@@ -14,6 +14,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 namespace RoxMemory
 {
 	class RoxTmpBufferRef;
@@ -23,6 +25,8 @@ struct ID3D11Texture2D;
 
 namespace RoxRender
 {
+	struct MipmapSettings;
+
 	class RoxTexture
 	{
 		friend class RoxFBO;
@@ -106,6 +110,11 @@ namespace RoxRender
 		void setFilter(FILTER minification, FILTER magnification, FILTER mipmap);
 		void setAniso(uint level);
 
+		//mip_count= -1 generates mipmaps on cpu with mipmapGenerate instead of the driver, float formats get mipmaps too
+		//settings=0 keeps the current ones, box filter by default
+		static void setCpuMipmaps(bool enable, const MipmapSettings* settings = 0);
+		static bool getCpuMipmaps(MipmapSettings* settings = 0);
+
 		static void setDefaultWrap(WRAP s, WRAP t);
 		static void setDefaultFilter(FILTER minification, FILTER magnification, FILTER mipmap);
 		static void setDefaultAniso(uint level);
@@ -156,4 +165,12 @@ namespace RoxRender
 		uint m_aniso;
 		FILTER m_filter_min, m_filter_mag, m_filter_mip;
 	};
+
+	//keeps processed textures between runs, entries are opaque to the provider
+	class IRoxTextureCacheProvider
+	{
+	public:
+		virtual bool get(const char* /*key*/, RoxMemory::RoxTmpBufferRef& /*data*/) { return false; }
+		virtual bool set(const char* /*key*/, const void* /*data*/, size_t /*size*/) { return false; }
+	};
 }
@@ -163,10 +163,10 @@ namespace RoxRender
 		setLayout(m_layout);
 	}
 
-	void RoxVBO::setNormals(uint offset, VERTEX_ATRIB_TYPE type)
+	void RoxVBO::setNormals(uint offset, VERTEX_ATRIB_TYPE type, uint dimension)
 	{
 		m_layout.normal.offset = offset;
-		m_layout.normal.dimension = 3;
+		m_layout.normal.dimension = dimension;
 		m_layout.normal.type = type;
 		setLayout(m_layout);
 	}
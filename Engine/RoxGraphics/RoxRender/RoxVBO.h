@@ -43,8 +43,11 @@ namespace RoxRender
 		{
 			FLOAT_16,
 			FLOAT_32,
-			UINT_8
-		};
+			UINT_8,
+			INT_16,
+			UINT_16,
+			INT_8
+		}; // integer types are normalized to [0,1] or [-1,1]
 
 		enum USAGE_HINT
 		{
@@ -80,7 +83,7 @@ namespace RoxRender
 		bool setIndexData(const void* data, INDEX_SIZE size, uint indices_count, USAGE_HINT usage = STATIC_DRAW);
 		void setElementType(ELEMENT_TYPE type);
 		void setVertices(uint offset, uint dimension, VERTEX_ATRIB_TYPE = FLOAT_32);
-		void setNormals(uint offset, VERTEX_ATRIB_TYPE = FLOAT_32);
+		void setNormals(uint offset, VERTEX_ATRIB_TYPE = FLOAT_32, uint dimension = 3); // 2 for octahedral encoded normals
 		void setTexCoord(uint tex_coord_idx, uint offset, uint dimension, VERTEX_ATRIB_TYPE = FLOAT_32);
 		void setColors(uint offset, uint dimension, VERTEX_ATRIB_TYPE = FLOAT_32);
 		void setLayout(const Layout& l);
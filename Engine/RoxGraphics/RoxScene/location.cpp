@@ -3,10 +3,51 @@
 #include "location.h"
 #include "RoxFormats/RoxTextParser.h"
 #include "RoxFormats/RoxStringConvert.h"
+#include "RoxFormats/RoxMeshBatcher.h"
+#include "RoxMemory/RoxHash.h"
+#include "RoxResources/RoxResources.h"
+#include "RoxScene.h"
+#include <cstdio>
+#include <map>
 
 namespace RoxScene
 {
 
+namespace
+{
+    bool static_batching=false;
+    std::string static_batching_cache;
+
+    struct batch_source
+    {
+        std::vector<char> data;
+        uint64_t hash;
+        std::string layout; //empty if it can't be batched
+
+        batch_source(): hash(0) {}
+    };
+
+    bool read_resource(const char *name,std::vector<char> &out)
+    {
+        RoxResources::IRoxResourceData *res=RoxResources::getResourcesProvider().access(name);
+        if(!res)
+            return false;
+
+        out.resize(res->getSize());
+        const bool result=!out.empty() && res->readAll(out.data());
+        res->release();
+        return result;
+    }
+
+    std::string tags_str(const tags &tg)
+    {
+        std::string s;
+        for(int i=0;i<tg.get_count();++i)
+            s.append(i?",":"").append(tg.get(i));
+        return s;
+    }
+}
+
 bool location::load_text(shared_location &res,resource_data &data,const char* name)
 {
     RoxFormats::RTextParser parser;
@@ -84,6 +125,12 @@ bool location::load(const char *name)
         m_material_params[j].second=material::param_proxy(m_shared->material_params[j].second);
     }
 
+    if(static_batching)
+    {
+        load_batches();
+        return true;
+    }
+
     for(size_t i=0;i<m_shared->meshes.size();++i)
     {
         const shared_location::location_mesh &m=m_shared->meshes[i];
@@ -93,6 +140,236 @@ bool location::load(const char *name)
     return true;
 }
 
+void location::set_static_batching(bool enable,const char *cache_folder)
+{
+    static_batching=enable;
+    static_batching_cache.assign(cache_folder?cache_folder:"");
+    if(!static_batching_cache.empty() && static_batching_cache[static_batching_cache.size()-1]!='/')
+        static_batching_cache.push_back('/');
+}
+
+void location::load_batches()
+{
+    const std::vector<shared_location::location_mesh> &meshes=m_shared->meshes;
+    std::map<std::string,batch_source> sources;
+    std::vector<std::string> keys;
+    std::vector<tags> keys_tags;
+    std::vector<int> batch_idx(meshes.size(),-1);
+
+    //the merge is keyed by the content of the batched files, not by their names
+    const uint64_t batcher_version=1;
+    uint64_t hash=RoxMemory::hash64(&batcher_version,sizeof(batcher_version));
+    for(size_t i=0;i<meshes.size();++i)
+    {
+        const shared_location::location_mesh &m=meshes[i];
+        if(m.name.empty())
+            continue;
+
+        std::map<std::string,batch_source>::iterator it=sources.find(m.name);
+        if(it==sources.end())
+        {
+            batch_source &s=sources[m.name];
+            if(read_resource((mesh_internal::get_resources_prefix()+m.name).c_str(),s.data)
+               && RoxFormats::nms_static_batcher::get_layout_key(s.data.data(),s.data.size(),s.layout))
+                s.hash=RoxMemory::hash64(s.data.data(),s.data.size());
+            else
+                s=batch_source();
+
+            it=sources.find(m.name);
+        }
+
+        if(it->second.layout.empty())
+            continue;
+
+        const std::string tg=tags_str(m.tg);
+        const std::string key=tg+"|"+it->second.layout;
+        size_t idx=0;
+        while(idx<keys.size() && keys[idx]!=key)
+            ++idx;
+
+        if(idx==keys.size())
+        {
+            keys.push_back(key);
+            keys_tags.push_back(m.tg);
+        }
+
+        batch_idx[i]=(int)idx;
+        hash=RoxMemory::hash64(&it->second.hash,sizeof(it->second.hash),hash);
+        hash=RoxMemory::hash64(&m.tr.get_pos(),sizeof(RoxMath::Vector3),hash);
+        hash=RoxMemory::hash64(&m.tr.get_rot(),sizeof(RoxMath::Quaternion),hash);
+        hash=RoxMemory::hash64(&m.tr.get_scale(),sizeof(RoxMath::Vector3),hash);
+        hash=RoxMemory::hash64(tg.c_str(),hash);
+    }
+
+    for(size_t i=0;i<meshes.size();++i)
+    {
+        if(batch_idx[i]<0)
+            add_mesh(meshes[i].name.c_str(),meshes[i].tg,meshes[i].tr);
+    }
+
+    if(keys.empty())
+        return;
+
+    std::string cache_name;
+    if(!static_batching_cache.empty())
+    {
+        char buf[32];
+        snprintf(buf,sizeof(buf),"%016llx.nms",(unsigned long long)hash);
+        cache_name=static_batching_cache+buf;
+
+        std::vector<char> cached;
+        FILE *f=fopen(cache_name.c_str(),"rb");
+        if(f)
+        {
+            if(fseek(f,0,SEEK_END)==0)
+            {
+                const long size=ftell(f);
+                cached.resize(size>0?size:0);
+            }
+
+            const bool read=!cached.empty() && fseek(f,0,SEEK_SET)==0 && fread(cached.data(),cached.size(),1,f)==1;
+            fclose(f);
+            if(read && add_batches(cached.data(),cached.size()))
+                return;
+
+            log()<<"location static batching: invalid cache "<<cache_name.c_str()<<", rebuilding\n";
+        }
+    }
+
+    std::vector<RoxFormats::nms_static_batcher> batchers(keys.size());
+    for(size_t i=0;i<meshes.size();++i)
+    {
+        if(batch_idx[i]<0)
+            continue;
+
+        const std::vector<char> &data=sources[meshes[i].name].data;
+        const transform &tr=meshes[i].tr;
+        batchers[batch_idx[i]].add(data.data(),data.size(),tr.get_pos(),tr.get_rot(),tr.get_scale());
+    }
+
+    //general chunk with the batch tags, then its mesh, materials and clusters
+    std::vector<std::vector<char> > chunks;
+    std::vector<unsigned int> types;
+    for(size_t i=0;i<batchers.size();++i)
+    {
+        RoxFormats::nms_mesh_chunk mesh;
+        RoxFormats::nms_material_chunk materials;
+        RoxFormats::nms_clusters_chunk clusters;
+        if(!batchers[i].build(mesh,materials,clusters))
+            continue;
+
+        RoxFormats::nms_general_chunk general;
+        general.objects.resize(1);
+        general.objects[0].name="static batch";
+        general.objects[0].type="batch";
+        general.objects[0].add_string_param("tags",tags_str(keys_tags[i]).c_str());
+
+        chunks.resize(chunks.size()+4);
+        std::vector<char> *c=&chunks[chunks.size()-4];
+        c[0].resize(general.get_chunk_size()),general.write_to_buf(c[0].data(),c[0].size());
+        c[1].resize(mesh.get_chunk_size()),mesh.write_to_buf(c[1].data(),c[1].size());
+        c[2].resize(materials.get_chunk_size()),materials.write_to_buf(c[2].data(),c[2].size());
+        c[3].resize(clusters.get_chunk_size()),clusters.write_to_buf(c[3].data(),c[3].size());
+        types.push_back(RoxFormats::nms::general);
+        types.push_back(RoxFormats::nms::mesh_data);
+        types.push_back(RoxFormats::nms::materials);
+        types.push_back(RoxFormats::nms::clusters);
+    }
+
+    RoxFormats::nms file;
+    file.version=RoxFormats::nms::latest_version;
+    for(size_t i=0;i<chunks.size();++i)
+    {
+        RoxFormats::nms::chunk_info c;
+        c.type=types[i];
+        c.size=(unsigned int)chunks[i].size();
+        c.data=chunks[i].data();
+        file.chunks.push_back(c);
+    }
+
+    std::vector<char> buf(file.get_nms_size());
+    if(file.write_to_buf(buf.data(),buf.size())!=buf.size() || !add_batches(buf.data(),buf.size()))
+    {
+        log()<<"location static batching: unable to merge the meshes of "<<(m_shared.getName()?m_shared.getName():"")<<"\n";
+        return;
+    }
+
+    if(cache_name.empty())
+        return;
+
+    //written aside and renamed, so that a crash never leaves a truncated cache
+    const std::string tmp_name=cache_name+".tmp";
+    FILE *f=fopen(tmp_name.c_str(),"wb");
+    if(!f)
+        return;
+
+    const bool written=fwrite(buf.data(),buf.size(),1,f)==1;
+    if(fclose(f)!=0 || !written || rename(tmp_name.c_str(),cache_name.c_str())!=0)
+        remove(tmp_name.c_str());
+}
+
+bool location::add_batches(const void *data,size_t size)
+{
+    RoxFormats::nms file;
+    if(!file.read_chunks_info(data,size))
+        return false;
+
+    std::vector<std::pair<tags,shared_mesh> > batches;
+    bool result=true;
+    for(size_t i=0;i<file.chunks.size() && result;++i)
+    {
+        const RoxFormats::nms::chunk_info &c=file.chunks[i];
+        if(c.type==RoxFormats::nms::general)
+        {
+            RoxFormats::nms_general_chunk general;
+            if(!general.read(c.data,c.size,file.version) || general.objects.empty())
+            {
+                result=false;
+                break;
+            }
+
+            batches.resize(batches.size()+1);
+            const RoxFormats::nms_general_chunk::object &o=general.objects[0];
+            for(size_t j=0;j<o.strings.size();++j)
+            {
+                if(o.strings[j].name=="tags")
+                    batches.back().first=tags(o.strings[j].value.c_str());
+            }
+
+            continue;
+        }
+
+        if(batches.empty())
+        {
+            result=false;
+            break;
+        }
+
+        shared_mesh &res=batches.back().second;
+        switch(c.type)
+        {
+            case RoxFormats::nms::mesh_data: result=mesh::load_nms_mesh_section(res,c.data,c.size,file.version); break;
+            case RoxFormats::nms::materials: result=mesh::load_nms_material_section(res,c.data,c.size,file.version); break;
+            case RoxFormats::nms::clusters: result=mesh::load_nms_clusters_section(res,c.data,c.size,file.version); break;
+        }
+    }
+
+    if(!result || batches.empty())
+    {
+        for(size_t i=0;i<batches.size();++i)
+            batches[i].second.release();
+        return false;
+    }
+
+    for(size_t i=0;i<batches.size();++i)
+    {
+        const int idx=add_mesh(batches[i].first,transform());
+        m_meshes.get(idx).m.create(batches[i].second);
+    }
+
+    return true;
+}
+
 void location::unload()
 {
     m_meshes.clear();
@@ -165,39 +442,51 @@ void location::update(int dt)
 
 void location::draw(const char *pass,const tags &t) const
 {
+    m_draw_list.clear();
+
     if(t.get_count()<=1)
     {
-        for(int i=0;i<m_meshes.getCount(t.get(0));++i)
+        const char *tag=t.get(0);
+        for(int i=0;i<m_meshes.getCount(tag);++i)
         {
-            const location_mesh &lm=m_meshes.get(i);
+            const location_mesh &lm=m_meshes.get(tag?m_meshes.getIdx(tag,i):i);
             if(!lm.visible)
                 continue;
 
-            lm.m.draw(pass);
+            m_draw_list.push_back(&lm.m);
         }
-
-        return;
     }
-
-    m_draw_cache.clear();
-    m_draw_cache.resize(m_meshes.getCount(),false);
-    for(int i=0;i<t.get_count();++i)
+    else
     {
-        const char *tag=t.get(i);
-        for(int j=0;j<m_meshes.getCount(tag);++j)
+        m_draw_cache.clear();
+        m_draw_cache.resize(m_meshes.getCount(),false);
+        for(int i=0;i<t.get_count();++i)
         {
-            const int mesh_idx=m_meshes.getIdx(tag,j);
-            if(m_draw_cache[mesh_idx])
-                continue;
+            const char *tag=t.get(i);
+            for(int j=0;j<m_meshes.getCount(tag);++j)
+            {
+                const int mesh_idx=m_meshes.getIdx(tag,j);
+                if(m_draw_cache[mesh_idx])
+                    continue;
 
-            const location_mesh &lm=m_meshes.get(mesh_idx);
-            if(!lm.visible)
-                continue;
+                const location_mesh &lm=m_meshes.get(mesh_idx);
+                if(!lm.visible)
+                    continue;
 
-            lm.m.draw(pass);
-            m_draw_cache[mesh_idx]=true;
+                m_draw_list.push_back(&lm.m);
+                m_draw_cache[mesh_idx]=true;
+            }
         }
     }
+
+    if(m_instancing)
+    {
+        mesh::draw_instanced(m_draw_list.empty()?0:&m_draw_list[0],(int)m_draw_list.size(),pass);
+        return;
+    }
+
+    for(size_t i=0;i<m_draw_list.size();++i)
+        m_draw_list[i]->draw(pass);
 }
 
 const char *location::get_material_param_name(int idx) const
@@ -58,14 +58,25 @@ public:
 public:
     void update(int dt);
     void draw(const char *pass=material::default_pass,const tags &t=0) const;
+    void set_instancing(bool enable) { m_instancing=enable; } //see mesh::draw_instanced, enabled by default
 
 public:
-    location(): m_need_apply(false) {}
-    location(const char *name) { load(name); }
+    //merges the location meshes with equal tags and vertex layouts at load, see RoxFormats::nms_static_batcher
+    //merged meshes aren't listed, each batch is added as a mesh with the tags and an identity transform
+    //with a cache folder the batches are stored as nms keyed by the hash of the location and its meshes, so that they are merged once
+    static void set_static_batching(bool enable,const char *cache_folder=0);
+
+public:
+    location(): m_need_apply(false),m_instancing(true) {}
+    location(const char *name): m_need_apply(false),m_instancing(true) { load(name); }
 
 public:
     static bool load_text(shared_location &res,resource_data &data,const char* name);
 
+private:
+    void load_batches();
+    bool add_batches(const void *data,size_t size);
+
 private:
     struct location_mesh
     {
@@ -78,8 +89,10 @@ private:
 
     RoxMemory::RoxTagList<location_mesh> m_meshes;
     mutable std::vector<bool> m_draw_cache;
+    mutable std::vector<const mesh *> m_draw_list;
     std::vector<std::pair<std::string,material::param_proxy> > m_material_params;
     bool m_need_apply;
+    bool m_instancing;
 };
 
 }
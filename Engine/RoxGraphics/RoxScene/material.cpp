@@ -1,6 +1,7 @@
 //nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
 
 #include "material.h"
+#include "texture_atlas.h"
 #include "RoxFormats/RoxTextParser.h"
 #include "RoxFormats/RoxStringConvert.h"
 #include "RoxMemory/RoxInvalidObject.h"
@@ -656,6 +657,72 @@ void material_internal::update_passes_maps() const
     m_should_rebuild_passes_maps = false;
 }
 
+namespace
+{
+    bool same_state(const RoxRender::State &a,const RoxRender::State &b)
+    {
+        return a.blend==b.blend && a.blend_src==b.blend_src && a.blend_dst==b.blend_dst
+            && a.cull_face==b.cull_face && a.cull_order==b.cull_order
+            && a.depth_test==b.depth_test && a.depth_comparison==b.depth_comparison
+            && a.zwrite==b.zwrite && a.color_write==b.color_write;
+    }
+}
+
+bool material_internal::is_same(const material_internal &other) const
+{
+    if(this==&other)
+        return true;
+
+    if(m_passes.size()!=other.m_passes.size() || m_params.size()!=other.m_params.size() || m_textures.size()!=other.m_textures.size())
+        return false;
+
+    for(size_t i=0;i<m_passes.size();++i)
+    {
+        const pass &a=m_passes[i],&b=other.m_passes[i];
+        if(a.m_name!=b.m_name || !same_state(a.m_render_state,b.m_render_state))
+            return false;
+
+        if(a.m_shader.internal().get_shared_data().constGet()!=b.m_shader.internal().get_shared_data().constGet())
+            return false;
+
+        if(a.m_pass_params.size()!=b.m_pass_params.size())
+            return false;
+
+        for(size_t j=0;j<a.m_pass_params.size();++j)
+        {
+            const param &pa=a.m_pass_params[j].p,&pb=b.m_pass_params[j].p;
+            if(a.m_pass_params[j].name!=b.m_pass_params[j].name || pa.x!=pb.x || pa.y!=pb.y || pa.z!=pb.z || pa.w!=pb.w)
+                return false;
+        }
+    }
+
+    for(size_t i=0;i<m_params.size();++i)
+    {
+        const param_holder &a=m_params[i],&b=other.m_params[i];
+        if(a.name!=b.name || a.a!=b.a)
+            return false;
+
+        if(a.p==b.p)
+            continue;
+
+        const param &pa=a.p.get(),&pb=b.p.get();
+        if(pa.x!=pb.x || pa.y!=pb.y || pa.z!=pb.z || pa.w!=pb.w)
+            return false;
+    }
+
+    for(size_t i=0;i<m_textures.size();++i)
+    {
+        const material_texture &a=m_textures[i],&b=other.m_textures[i];
+        if(a.semantics!=b.semantics)
+            return false;
+
+        if(a.proxy!=b.proxy && a.proxy.get().internal().get_shared_data().constGet()!=b.proxy.get().internal().get_shared_data().constGet())
+            return false;
+    }
+
+    return true;
+}
+
 bool material_internal::release()
 {
     m_passes.clear();
@@ -724,6 +791,15 @@ void material::set_texture(const char *semantics,const texture_proxy &proxy)
         m_internal.m_textures[texture_idx].proxy=proxy;
 }
 
+void material::set_texture(const char *semantics,const texture_atlas &atlas,const char *name)
+{
+    if(!semantics || !semantics[0] || !atlas.contains(name))
+        return;
+
+    set_texture(semantics,atlas.get_texture(name));
+    set_param((std::string(semantics)+"_rect").c_str(),atlas.get_rect(name));
+}
+
 int material::get_textures_count() const
 {
     m_internal.update_passes_maps();
@@ -11,6 +11,7 @@ namespace RoxScene
 {
 
 class material_internal;
+class texture_atlas;
 typedef material_internal shared_material;
 
 class material_internal: public scene_shared<shared_material>
@@ -26,6 +27,9 @@ public:
     int get_texture_idx(const char *semantics) const;
     bool release();
 
+    //same passes, params and textures, like the per mesh copies that only share location params
+    bool is_same(const material_internal &other) const;
+
     material_internal(): m_last_set_pass_idx(-1),m_should_rebuild_passes_maps(false) {}
 
 private:
@@ -85,6 +89,7 @@ private:
 
     private:
         friend class material_internal;
+class texture_atlas;
         friend class material;
         void update_maps(const material_internal &m) const;
         void update_pass_params();
@@ -157,6 +162,7 @@ public:
     void set_texture(const char *semantics,const texture_proxy &proxy);
     void set_texture(int idx,const texture &tex);
     void set_texture(int idx,const texture_proxy &proxy);
+    void set_texture(const char *semantics,const texture_atlas &atlas,const char *name); //binds the atlas page, shaders map uv with the <semantics>_rect param
 
     int get_textures_count() const;
     const char *get_texture_semantics(int idx) const;
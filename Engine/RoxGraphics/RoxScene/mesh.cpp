@@ -4,13 +4,18 @@
 #include "RoxMath/RoxConstants.h"
 #include "RoxMemory/RoxInvalidObject.h"
 #include "RoxMemory/RoxMemoryReader.h"
+#include "RoxMemory/RoxThreadPool.h"
 #include "RoxMemory/RoxTmpBuffers.h"
 #include "RoxFormats/RoxStringConvert.h"
 #include "RoxFormats/RoxMesh.h"
 #include "RoxRender/RoxRender.h"
+#include "RoxRender/RoxStatistics.h"
 #include "RoxScene.h"
 #include "shader.h"
+#include <cfloat>
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
 
 #include "material.h"
 #include "mesh.h"
@@ -31,151 +36,372 @@ namespace RoxScene
         }
 
         bool frustum_cull_enabled = true;
+        bool cluster_cull_enabled = true;
 
-    }
+        std::vector<mesh::anim_lod> anim_lods;
+        unsigned int anim_lod_phase = 0;
 
-    bool mesh::load_nms_mesh_section(shared_mesh& res, const void* data, size_t size, int version)
-    {
-        RoxFormats::nms_mesh_chunk c;
-        if (!c.read_header(data, size, version))
+        int select_anim_lod(float dist, float screen_size)
         {
-            log() << "nms load warning: invalid mesh chunk\n";
-            return false;
+            for (int i = (int)anim_lods.size() - 1; i >= 0; --i)
+            {
+                const mesh::anim_lod& l = anim_lods[i];
+                if ((l.distance > 0.0f && dist >= l.distance) || (l.screen_size > 0.0f && screen_size < l.screen_size))
+                    return i;
+            }
+
+            return -1;
         }
 
-        res.aabb = RoxMath::Aabb(c.aabb_min, c.aabb_max);
-        for (size_t i = 0; i < c.elements.size(); ++i)
+        std::vector<float> lod_screen_sizes;
+        float lod_bias_scale = 1.0f;
+        float lod_hysteresis = 0.1f;
+        unsigned int lod_crossfade_time = 0;
+
+        const float default_lod_screen_sizes[] = { 0.5f, 0.25f, 0.125f, 0.0625f, 0.03125f, 0.015625f, 0.0078125f, 0.00390625f };
+
+        //thresholds go from near to far, the level changes only when the value is past a threshold by the margin
+        int select_lod(int current, float value, const float* thresholds, int count, bool by_distance)
         {
-            const RoxFormats::nms_mesh_chunk::element& e = c.elements[i];
-			RoxLogger::log() << "nms mesh elements " << e.type << " :\noffset: " << e.offset << "\ndimension: " << e.dimension << "\ntype: " << e.type << "\ndata_type: " << e.data_type << "\nsemantics: " << e.semantics << "\n";
-                const RoxRender::RoxVBO::VERTEX_ATRIB_TYPE type = RoxRender::RoxVBO::VERTEX_ATRIB_TYPE(e.data_type);
-            switch (e.type)
+            const float lo = 1.0f - lod_hysteresis, hi = 1.0f + lod_hysteresis;
+            int coarser = 0, finer = 0;
+            for (int i = 0; i < count; ++i)
             {
-            case RoxFormats::nms_mesh_chunk::pos: res.vbo.setVertices(e.offset, e.dimension, type); break;
-            case RoxFormats::nms_mesh_chunk::normal: res.vbo.setNormals(e.offset, type); break;
-            case RoxFormats::nms_mesh_chunk::color: res.vbo.setColors(e.offset, e.dimension, type); break;
-            default: res.vbo.setTexCoord(e.type - RoxFormats::nms_mesh_chunk::tc0, e.offset, e.dimension, type); break;
-            };
+                if (by_distance ? value * lo >= thresholds[i] : value * hi < thresholds[i])
+                    coarser = i + 1;
+                if (by_distance ? value * hi >= thresholds[i] : value * lo < thresholds[i])
+                    finer = i + 1;
+            }
+
+            if (current < coarser)
+                return coarser;
+
+            return current > finer ? finer : current;
         }
 
-        res.vbo.setVertexData(c.vertices_data, c.vertex_stride, c.verts_count);
+        struct instance_item
+        {
+            const mesh_internal* m;
+            const shared_mesh* shared;
+            int lod, group;
+            const material* mat;
+            const material* batch_mat; //the first equal material of the group, copies batch through it
+        };
+
+        //drawn after the batches in the submission order
+        struct deferred_item
+        {
+            const mesh* whole; //0 for a single blended group
+            instance_item group;
+        };
+
+        std::vector<instance_item> instance_items;
+        std::vector<const material*> batch_materials;
+        std::vector<deferred_item> deferred_items;
+        std::vector<float> instance_buffer;
+        const transform instanced_transform;
 
-        switch (c.index_size)
+        unsigned int triangles_count(const shared_mesh::group& g)
         {
-        case 0: break; //to indices
-        case 2: res.vbo.setIndexData(c.indices_data, RoxRender::RoxVBO::INDEX_2D, c.indices_count); break;
-        case 4: res.vbo.setIndexData(c.indices_data, RoxRender::RoxVBO::INDEX_4D, c.indices_count); break;
-        default: log() << "nms load warning: invalid index size\n"; return false;
+            switch (g.elem_type)
+            {
+            case RoxRender::RoxVBO::TRIANGLES: return g.count / 3;
+            case RoxRender::RoxVBO::TRIANGLE_STRIP: return g.count > 2 ? g.count - 2 : 0;
+            default: return 0;
+            }
         }
 
-        for (size_t i = 0; i < c.lods.size(); ++i)
+    }
+
+    namespace
+    {
+        bool apply_nms_mesh(shared_mesh& res, const RoxFormats::nms_mesh_chunk& c)
         {
-            res.groups.resize(c.lods[i].groups.size());
-            for (size_t j = 0; j < res.groups.size(); ++j)
+            res.aabb = RoxMath::Aabb(c.aabb_min, c.aabb_max);
+            for (size_t i = 0; i < c.elements.size(); ++i)
             {
-                const RoxFormats::nms_mesh_chunk::group& from = c.lods[i].groups[j];
-                shared_mesh::group& to = res.groups[j];
+                const RoxFormats::nms_mesh_chunk::element& e = c.elements[i];
+                const RoxRender::RoxVBO::VERTEX_ATRIB_TYPE type = RoxRender::RoxVBO::VERTEX_ATRIB_TYPE(e.data_type);
+                switch (e.type)
+                {
+                case RoxFormats::nms_mesh_chunk::pos:
+                    res.vbo.setVertices(e.offset, e.dimension, type);
+                    if (e.data_type == RoxFormats::nms_mesh_chunk::uint16)
+                    {
+                        res.pos_dequant_offset = c.aabb_min;
+                        res.pos_dequant_scale = c.aabb_max - c.aabb_min;
+                    }
+                    else if (e.data_type == RoxFormats::nms_mesh_chunk::int16)
+                    {
+                        res.pos_dequant_offset = (c.aabb_min + c.aabb_max) * 0.5f;
+                        res.pos_dequant_scale = (c.aabb_max - c.aabb_min) * 0.5f;
+                    }
+                    break;
 
-                to.name = from.name;
+                case RoxFormats::nms_mesh_chunk::normal: res.vbo.setNormals(e.offset, type, e.dimension); break; //2 if octahedral encoded
+                case RoxFormats::nms_mesh_chunk::color: res.vbo.setColors(e.offset, e.dimension, type); break;
+                default: res.vbo.setTexCoord(e.type - RoxFormats::nms_mesh_chunk::tc0, e.offset, e.dimension, type); break;
+                };
+            }
 
-                to.aabb = RoxMath::Aabb(from.aabb_min, from.aabb_max);
+            res.vbo.setVertexData(c.vertices_data, c.vertex_stride, c.verts_count);
 
-                to.material_idx = from.material_idx;
-                to.offset = from.offset;
-                to.count = from.count;
+            switch (c.index_size)
+            {
+            case 0: break; //to indices
+            case 2: res.vbo.setIndexData(c.indices_data, RoxRender::RoxVBO::INDEX_2D, c.indices_count); break;
+            case 4: res.vbo.setIndexData(c.indices_data, RoxRender::RoxVBO::INDEX_4D, c.indices_count); break;
+            default: log() << "nms load warning: invalid index size\n"; return false;
+            }
+
+            res.lods.resize(c.lods.empty() ? 0 : c.lods.size() - 1);
+            for (size_t i = 0; i < c.lods.size(); ++i)
+            {
+                std::vector<shared_mesh::group>& groups = i ? res.lods[i - 1].groups : res.groups;
+                groups.resize(c.lods[i].groups.size());
+                for (size_t j = 0; j < groups.size(); ++j)
+                {
+                    const RoxFormats::nms_mesh_chunk::group& from = c.lods[i].groups[j];
+                    shared_mesh::group& to = groups[j];
+
+                    to.name = from.name;
+
+                    to.aabb = RoxMath::Aabb(from.aabb_min, from.aabb_max);
 
-                to.elem_type = RoxRender::RoxVBO::ELEMENT_TYPE(from.element_type);
+                    to.material_idx = from.material_idx;
+                    to.offset = from.offset;
+                    to.count = from.count;
+
+                    to.elem_type = RoxRender::RoxVBO::ELEMENT_TYPE(from.element_type);
+                }
             }
 
-            break; //ToDo: load all lods
+            return true;
         }
 
-        return true;
-    }
-
-    bool mesh::load_nms_skeleton_section(shared_mesh& res, const void* data, size_t size, int version)
-    {
-        RoxFormats::nms_skeleton_chunk c;
-        if (!c.read(data, size, version))
+        bool apply_nms_skeleton(shared_mesh& res, const RoxFormats::nms_skeleton_chunk& c)
         {
-            log() << "nms load warning: invalid skeleton chunk\n";
-            return false;
+            for (size_t i = 0; i < c.bones.size(); ++i)
+            {
+                const RoxFormats::nms_skeleton_chunk::bone& b = c.bones[i];
+                res.skeleton.addBone(b.name.c_str(), b.pos, b.rot, b.parent);
+            }
+
+            return true;
         }
 
-        for (size_t i = 0; i < c.bones.size(); ++i)
+        bool apply_nms_material(shared_mesh& res, const RoxFormats::nms_material_chunk& c)
         {
-            RoxFormats::nms_skeleton_chunk::bone& b = c.bones[i];
-            res.skeleton.addBone(b.name.c_str(), b.pos, b.rot, b.parent);
-        }
+            size_t mat_idx_off = res.materials.size();
+            res.materials.resize(mat_idx_off + c.materials.size());
+            for (size_t i = 0; i < c.materials.size(); ++i)
+            {
+                const RoxFormats::nms_material_chunk::material_info& from = c.materials[i];
+                material& to = res.materials[i + mat_idx_off];
 
-        return true;
-    }
+                for (size_t j = 0; j < from.strings.size(); ++j)
+                {
+                    const std::string& name = from.strings[j].name;
+                    const std::string& value = from.strings[j].value;
 
-    bool mesh::load_nms_material_section(shared_mesh& res, const void* data, size_t size, int version)
-    {
-        RoxFormats::nms_material_chunk c;
-        if (!c.read(data, size, version))
-        {
-            log() << "nms load warning: invalid materials chunk\n";
-            return false;
+                    if (name == "nya_material")
+                    {
+                        to.load(value.c_str());
+                    }
+                    else if (name == "nya_shader")
+                    {
+                        RoxShader sh;
+                        sh.load(value.c_str());
+                        material_default_pass(to).set_shader(sh);
+                    }
+                    else if (name == "nya_blend")
+                    {
+                        RoxRender::State& st = material_default_pass(to).get_state();
+                        st.blend = RoxFormats::blendModeFromString(value.c_str(), st.blend_src, st.blend_dst);
+                    }
+                    else if (name == "nya_cull")
+                    {
+                        RoxRender::State& st = material_default_pass(to).get_state();
+                        st.cull_face = RoxFormats::cullFaceFromString(value.c_str(), st.cull_order);
+                    }
+                    else if (name == "nya_zwrite")
+                        material_default_pass(to).get_state().zwrite = RoxFormats::boolFromString(value.c_str());
+                }
+
+                for (size_t j = 0; j < from.textures.size(); ++j)
+                {
+                    texture tex;
+                    tex.load(from.textures[j].filename.c_str());
+                    to.set_texture(from.textures[j].semantics.c_str(), tex);
+                }
+
+                for (size_t j = 0; j < from.vectors.size(); ++j)
+                {
+                    const int param_idx = to.get_param_idx(from.vectors[j].name.c_str());
+                    if (param_idx < 0)
+                        continue;
+
+                    to.set_param(param_idx, from.vectors[j].value);
+                }
+
+                to.set_name(from.name.c_str());
+            }
+
+            return true;
         }
 
-        size_t mat_idx_off = res.materials.size();
-        res.materials.resize(mat_idx_off + c.materials.size());
-        for (size_t i = 0; i < c.materials.size(); ++i)
+        bool apply_nms_general(shared_mesh& res, const RoxFormats::nms_general_chunk& c)
         {
-            const RoxFormats::nms_material_chunk::material_info& from = c.materials[i];
-            material& to = res.materials[i + mat_idx_off];
-
-            for (size_t j = 0; j < from.strings.size(); ++j)
+            size_t idx_off = res.misc.size();
+            res.misc.resize(idx_off + c.objects.size());
+            for (size_t i = 0; i < c.objects.size(); ++i)
             {
-                const std::string& name = from.strings[j].name;
-                const std::string& value = from.strings[j].value;
+                const RoxFormats::nms_general_chunk::object& from = c.objects[i];
+                shared_mesh::misc_info& to = res.misc[i + idx_off];
+                to.name = from.name;
+                to.type = from.type;
 
-                if (name == "nya_material")
+                to.string_params.resize(from.strings.size());
+                for (size_t j = 0; j < from.strings.size(); ++j)
                 {
-                    to.load(value.c_str());
+                    to.string_params[j].first = from.strings[j].name;
+                    to.string_params[j].second = from.strings[j].value;
                 }
-                else if (name == "nya_shader")
+
+                to.vec4_params.resize(from.vectors.size());
+                for (size_t j = 0; j < from.vectors.size(); ++j)
                 {
-                    RoxShader sh;
-                    sh.load(value.c_str());
-                    material_default_pass(to).set_shader(sh);
+                    to.vec4_params[j].first = from.vectors[j].name;
+                    to.vec4_params[j].second = from.vectors[j].value;
                 }
-                else if (name == "nya_blend")
+            }
+
+            return true;
+        }
+
+        bool apply_nms_clusters(shared_mesh& res, const RoxFormats::nms_clusters_chunk& c)
+        {
+            //follows its mesh chunk, the mesh is drawn without clusters if they don't match
+            if (c.lods.size() != res.lods.size() + 1)
+            {
+                log() << "nms load warning: clusters chunk does not match the mesh\n";
+                return true;
+            }
+
+            std::vector<shared_mesh::cluster> clusters;
+            for (size_t i = 0; i < c.lods.size(); ++i)
+            {
+                const std::vector<shared_mesh::group>& groups = i ? res.lods[i - 1].groups : res.groups;
+                if (c.lods[i].groups.size() != groups.size())
                 {
-                    RoxRender::State& st = material_default_pass(to).get_state();
-                    st.blend = RoxFormats::blendModeFromString(value.c_str(), st.blend_src, st.blend_dst);
+                    log() << "nms load warning: clusters chunk does not match the mesh\n";
+                    return true;
                 }
-                else if (name == "nya_cull")
+
+                for (size_t j = 0; j < groups.size(); ++j)
                 {
-                    RoxRender::State& st = material_default_pass(to).get_state();
-                    st.cull_face = RoxFormats::cullFaceFromString(value.c_str(), st.cull_order);
+                    const std::vector<RoxFormats::nms_clusters_chunk::cluster>& from = c.lods[i].groups[j].clusters;
+                    for (size_t k = 0; k < from.size(); ++k)
+                    {
+                        const RoxFormats::nms_clusters_chunk::cluster& fc = from[k];
+                        if (fc.offset < groups[j].offset || fc.count > groups[j].offset + groups[j].count - fc.offset)
+                        {
+                            log() << "nms load warning: invalid cluster range\n";
+                            return true;
+                        }
+
+                        shared_mesh::cluster to;
+                        to.offset = fc.offset;
+                        to.count = fc.count;
+                        to.center = fc.center;
+                        to.radius = fc.radius;
+                        to.cone_axis = fc.cone_axis;
+                        to.cone_cutoff = fc.cone_cutoff;
+                        clusters.push_back(to);
+                    }
                 }
-                else if (name == "nya_zwrite")
-                    material_default_pass(to).get_state().zwrite = RoxFormats::boolFromString(value.c_str());
             }
 
-            for (size_t j = 0; j < from.textures.size(); ++j)
+            res.clusters.swap(clusters);
+            for (size_t i = 0, first = 0; i < c.lods.size(); ++i)
             {
-                texture tex;
-                tex.load(from.textures[j].filename.c_str());
-                to.set_texture(from.textures[j].semantics.c_str(), tex);
+                std::vector<shared_mesh::group>& groups = i ? res.lods[i - 1].groups : res.groups;
+                for (size_t j = 0; j < groups.size(); ++j)
+                {
+                    groups[j].first_cluster = (unsigned int)first;
+                    groups[j].clusters_count = (unsigned int)c.lods[i].groups[j].clusters.size();
+                    first += groups[j].clusters_count;
+                }
             }
 
-            for (size_t j = 0; j < from.vectors.size(); ++j)
-            {
-                const int param_idx = to.get_param_idx(from.vectors[j].name.c_str());
-                if (param_idx < 0)
-                    continue;
+            return true;
+        }
 
-                to.set_param(param_idx, from.vectors[j].value);
+        struct nms_decoded_chunk
+        {
+            RoxFormats::nms_mesh_chunk mesh;
+            RoxFormats::nms_skeleton_chunk skeleton;
+            RoxFormats::nms_material_chunk materials;
+            RoxFormats::nms_general_chunk general;
+            RoxFormats::nms_clusters_chunk clusters;
+            bool valid;
+
+            nms_decoded_chunk() : valid(false) {}
+        };
+
+        //only parses, vertex and index data stay in the resource buffer until the vbo upload
+        void decode_nms_chunk(const RoxFormats::nms::chunk_info& c, int version, nms_decoded_chunk& out)
+        {
+            switch (c.type)
+            {
+            case RoxFormats::nms::mesh_data: out.valid = out.mesh.read_header(c.data, c.size, version) > 0; break;
+            case RoxFormats::nms::skeleton: out.valid = out.skeleton.read(c.data, c.size, version); break;
+            case RoxFormats::nms::materials: out.valid = out.materials.read(c.data, c.size, version); break;
+            case RoxFormats::nms::general: out.valid = out.general.read(c.data, c.size, version); break;
+            case RoxFormats::nms::clusters: out.valid = out.clusters.read(c.data, c.size, version); break;
+            default: out.valid = true; break;
             }
+        }
+
+        //mesh chunks only point into the data, the other chunks are worth a thread when their strings and arrays add up
+        const size_t nms_parallel_decode_size = 64 * 1024;
+        const char* const nms_chunk_names[] = { "mesh", "skeleton", "materials", "general", "clusters" };
+    }
 
-            to.set_name(from.name.c_str());
+    bool mesh::load_nms_mesh_section(shared_mesh& res, const void* data, size_t size, int version)
+    {
+        RoxFormats::nms_mesh_chunk c;
+        if (!c.read_header(data, size, version))
+        {
+            log() << "nms load warning: invalid mesh chunk\n";
+            return false;
         }
 
-        return true;
+        return apply_nms_mesh(res, c);
+    }
+
+    bool mesh::load_nms_skeleton_section(shared_mesh& res, const void* data, size_t size, int version)
+    {
+        RoxFormats::nms_skeleton_chunk c;
+        if (!c.read(data, size, version))
+        {
+            log() << "nms load warning: invalid skeleton chunk\n";
+            return false;
+        }
+
+        return apply_nms_skeleton(res, c);
+    }
+
+    bool mesh::load_nms_material_section(shared_mesh& res, const void* data, size_t size, int version)
+    {
+        RoxFormats::nms_material_chunk c;
+        if (!c.read(data, size, version))
+        {
+            log() << "nms load warning: invalid materials chunk\n";
+            return false;
+        }
+
+        return apply_nms_material(res, c);
     }
 
     bool mesh::load_nms_general_section(shared_mesh& res, const void* data, size_t size, int version)
@@ -187,31 +413,19 @@ namespace RoxScene
             return false;
         }
 
-        size_t idx_off = res.misc.size();
-        res.misc.resize(idx_off + c.objects.size());
-        for (size_t i = 0; i < c.objects.size(); ++i)
-        {
-            const RoxFormats::nms_general_chunk::object& from = c.objects[i];
-            shared_mesh::misc_info& to = res.misc[i + idx_off];
-            to.name = from.name;
-            to.type = from.type;
-
-            to.string_params.resize(from.strings.size());
-            for (size_t j = 0; j < from.strings.size(); ++j)
-            {
-                to.string_params[j].first = from.strings[j].name;
-                to.string_params[j].second = from.strings[j].value;
-            }
+        return apply_nms_general(res, c);
+    }
 
-            to.vec4_params.resize(from.vectors.size());
-            for (size_t j = 0; j < from.vectors.size(); ++j)
-            {
-                to.vec4_params[j].first = from.vectors[j].name;
-                to.vec4_params[j].second = from.vectors[j].value;
-            }
+    bool mesh::load_nms_clusters_section(shared_mesh& res, const void* data, size_t size, int version)
+    {
+        RoxFormats::nms_clusters_chunk c;
+        if (!c.read(data, size, version))
+        {
+            log() << "nms load warning: invalid clusters chunk\n";
+            return false;
         }
 
-        return true;
+        return apply_nms_clusters(res, c);
     }
 
     bool mesh::load_nms(shared_mesh& res, resource_data& data, const char* name)
@@ -232,15 +446,42 @@ namespace RoxScene
             return false;
         }
 
+        //chunks are decoded concurrently, then applied in order on this thread since it owns the render context
+        std::vector<nms_decoded_chunk> decoded(m.chunks.size());
+        size_t parallel_size = 0;
         for (size_t i = 0; i < m.chunks.size(); ++i)
         {
-            const RoxFormats::nms::chunk_info c = m.chunks[i];
-            switch (c.type)
+            if (m.chunks[i].type != RoxFormats::nms::mesh_data)
+                parallel_size += m.chunks[i].size;
+        }
+
+        const int version = m.version;
+        const auto decode = [&](int i) { decode_nms_chunk(m.chunks[i], version, decoded[i]); };
+        if (m.chunks.size() > 1 && parallel_size >= nms_parallel_decode_size)
+            RoxMemory::RoxThreadPool::get().run((int)m.chunks.size(), decode);
+        else
+        {
+            for (int i = 0; i < (int)m.chunks.size(); ++i)
+                decode(i);
+        }
+
+        for (size_t i = 0; i < m.chunks.size(); ++i)
+        {
+            const unsigned int type = m.chunks[i].type;
+            const nms_decoded_chunk& c = decoded[i];
+            if (!c.valid)
+            {
+                log() << "nms load warning: invalid " << nms_chunk_names[type] << " chunk\n";
+                return false;
+            }
+
+            switch (type)
             {
-            case RoxFormats::nms::mesh_data: if (!load_nms_mesh_section(res, c.data, c.size, m.version)) return false; break;
-            case RoxFormats::nms::skeleton: if (!load_nms_skeleton_section(res, c.data, c.size, m.version)) return false; break;
-            case RoxFormats::nms::materials: if (!load_nms_material_section(res, c.data, c.size, m.version)) return false; break;
-            case RoxFormats::nms::general: if (!load_nms_general_section(res, c.data, c.size, m.version)) return false; break;
+            case RoxFormats::nms::mesh_data: if (!apply_nms_mesh(res, c.mesh)) return false; break;
+            case RoxFormats::nms::skeleton: if (!apply_nms_skeleton(res, c.skeleton)) return false; break;
+            case RoxFormats::nms::materials: if (!apply_nms_material(res, c.materials)) return false; break;
+            case RoxFormats::nms::general: if (!apply_nms_general(res, c.general)) return false; break;
+            case RoxFormats::nms::clusters: if (!apply_nms_clusters(res, c.clusters)) return false; break;
                 //default: log()<<"nms load warning: unknown chunk type\n"; //not an error
             };
         }
@@ -260,6 +501,14 @@ namespace RoxScene
         m_skeleton = m_shared->skeleton;
         m_bone_controls.clear();
 
+        //spread throttled updates of meshes with the same lod across frames
+        m_anim_lod = -1;
+        m_anim_lod_frame = anim_lod_phase++;
+        m_anim_skip_ik = false;
+
+        m_lod = m_forced_lod >= 0 ? std::min(m_forced_lod, get_lods_count() - 1) : 0;
+        m_lod_prev = -1;
+
         for (int i = 0; i<int(m_shared->materials.size()); ++i)
             m_shared->materials[i].internal().skeleton_changed(&m_skeleton);
 
@@ -302,6 +551,8 @@ namespace RoxScene
         m_internal.m_skeleton = RoxRender::RoxSkeleton();
         m_internal.m_aabb = RoxMath::Aabb();
         m_internal.m_groups.clear();
+        m_internal.m_lod = 0;
+        m_internal.m_lod_prev = -1;
     }
 
     int mesh_internal::get_materials_count() const
@@ -342,36 +593,131 @@ namespace RoxScene
         return (int)g.material_idx;
     }
 
-    void mesh_internal::draw_group(int idx, const char* pass_name) const
+    int mesh_internal::get_mat_idx(int lod, int group_idx) const
+    {
+        if (lod <= 0)
+            return get_mat_idx(group_idx);
+
+        //levels with the same groups follow the replaced materials of the detailed one
+        const std::vector<shared_mesh::group>& groups = lod_groups(lod);
+        if (groups.size() == m_shared->groups.size())
+            return get_mat_idx(group_idx);
+
+        if (group_idx < 0 || group_idx >= (int)groups.size() || groups[group_idx].material_idx >= m_shared->materials.size())
+            return -1;
+
+        return (int)groups[group_idx].material_idx;
+    }
+
+    int mesh_internal::get_lods_count() const
+    {
+        if (!m_shared.isValid())
+            return 0;
+
+        return int(m_shared->lods.size()) + 1;
+    }
+
+    unsigned int mesh_internal::lod_triangles(int lod) const
+    {
+        unsigned int count = 0;
+        const std::vector<shared_mesh::group>& groups = lod_groups(lod);
+        for (size_t i = 0; i < groups.size(); ++i)
+            count += triangles_count(groups[i]);
+
+        return count;
+    }
+
+    void mesh_internal::draw_group(int idx, const char* pass_name, int lod) const
     {
         if (!m_shared.isValid())
             return;
 
-        if (idx < 0 || idx >= (int)m_shared->groups.size())
+        if (lod < 0 || lod >= get_lods_count() || idx < 0 || idx >= (int)lod_groups(lod).size())
             return;
 
         update_skeleton();
 
-        int mat_idx = get_mat_idx(idx);
+        int mat_idx = get_mat_idx(lod, idx);
         if (mat_idx < 0)
         {
             RoxLogger::warning() << "invalid material for group'" << idx << "in mesh" << getName() << "\n";
             return;
         }
 
-        const shared_mesh::group& g = m_shared->groups[idx];
+        const shared_mesh::group& g = lod_groups(lod)[idx];
 
         transform::set(m_transform);
         shader_internal::set_skeleton(&m_skeleton);
+        shader_internal::set_pos_dequant(m_shared->pos_dequant_offset, m_shared->pos_dequant_scale);
 
         const material& m = mat(mat_idx);
         m.internal().set(pass_name);
         m_shared->vbo.bind();
-        m_shared->vbo.draw(g.offset, g.count, g.elem_type);
+        if (g.clusters_count > 0 && cluster_cull_enabled && m_skeleton.getBonesCount() == 0)
+            draw_clusters(g, m.get_pass(pass_name).get_state());
+        else
+            m_shared->vbo.draw(g.offset, g.count, g.elem_type);
         m_shared->vbo.unbind();
         m.internal().unset();
 
         shader_internal::set_skeleton(0);
+        shader_internal::set_pos_dequant(RoxMath::Vector3(), RoxMath::Vector3(1.0f, 1.0f, 1.0f));
+    }
+
+    //visible clusters next to each other in the indices are drawn at once
+    void mesh_internal::draw_clusters(const shared_mesh::group& g, const RoxRender::State& state) const
+    {
+        const RoxMath::Vector3& s = m_transform.get_scale();
+        const RoxMath::Vector3 abs_s = RoxMath::Vector3::abs(s);
+        const float scale = std::max(abs_s.x, std::max(abs_s.y, abs_s.z));
+        const float eps = 0.001f * scale;
+
+        //the cone spread holds only under uniform scale, a mirroring transform flips the winding the cones were built for
+        const bool mirrored = s.x * s.y * s.z < 0.0f;
+        const bool cones = state.cull_face && !mirrored && fabsf(abs_s.x - abs_s.y) <= eps && fabsf(abs_s.x - abs_s.z) <= eps;
+        const float cone_sign = state.cull_order == RoxRender::CullFace::CW ? -1.0f : 1.0f;
+
+        const camera& cam = get_camera();
+        const RoxMath::RoxFrustum& frustum = cam.get_frustum();
+        unsigned int from = 0, count = 0, culled = 0;
+        for (unsigned int i = 0; i < g.clusters_count; ++i)
+        {
+            const shared_mesh::cluster& c = m_shared->clusters[g.first_cluster + i];
+            const RoxMath::Vector3 center = m_transform.transform_vec(c.center);
+            const float radius = c.radius * scale;
+
+            bool visible = !frustum_cull_enabled || frustum.testIntersect(RoxMath::Aabb(center - RoxMath::Vector3(radius, radius, radius),
+                                                                                        center + RoxMath::Vector3(radius, radius, radius)));
+            if (visible && cones && c.cone_cutoff < 1.0f)
+            {
+                const RoxMath::Vector3 to_center = center - cam.get_pos();
+                const RoxMath::Vector3 axis = m_transform.get_rot().rotate(c.cone_axis) * cone_sign;
+                visible = to_center.dot(axis) < c.cone_cutoff * to_center.length() + radius;
+            }
+
+            if (!visible)
+            {
+                culled += c.count;
+                continue;
+            }
+
+            if (count > 0 && from + count == c.offset)
+            {
+                count += c.count;
+                continue;
+            }
+
+            if (count > 0)
+                m_shared->vbo.draw(from, count, g.elem_type);
+
+            from = c.offset, count = c.count;
+        }
+
+        if (count > 0)
+            m_shared->vbo.draw(from, count, g.elem_type);
+
+        if (culled > 0 && RoxRender::Statistics::enabled())
+            RoxRender::Statistics::get().cluster_triangles_culled += culled / 3;
     }
 
     void mesh::draw(const char* pass_name) const
@@ -382,8 +728,58 @@ namespace RoxScene
         if (internal().m_has_aabb && frustum_cull_enabled && !get_camera().get_frustum().testIntersect(get_aabb()))
             return;
 
-        for (int i = 0; i < get_groups_count(); ++i)
-            draw_group(i, pass_name);
+        const mesh_internal& mi = internal();
+        if (mi.m_lod_prev >= 0)
+        {
+            shader_internal::set_lod_fade(mi.m_lod_fade, false);
+            mi.draw_lod(mi.m_lod_prev, pass_name);
+            shader_internal::set_lod_fade(mi.m_lod_fade, true);
+            mi.draw_lod(mi.m_lod, pass_name);
+            shader_internal::set_lod_fade(1.0f, true);
+            return;
+        }
+
+        mi.draw_lod(mi.m_lod, pass_name);
+
+        if (mi.m_lod > 0 && RoxRender::Statistics::enabled() && has_pass(pass_name))
+        {
+            const unsigned int full = mi.lod_triangles(0), drawn = mi.lod_triangles(mi.m_lod);
+            if (full > drawn)
+                RoxRender::Statistics::get().lod_triangles_saved += full - drawn;
+        }
+    }
+
+    void mesh_internal::draw_lod(int lod, const char* pass_name) const
+    {
+        if (!m_shared.isValid() || lod < 0 || lod >= get_lods_count())
+            return;
+
+        const int count = (int)lod_groups(lod).size();
+        const bool same_groups = count == (int)m_groups.size();
+        for (int i = 0; i < count; ++i)
+        {
+            int mat_idx = get_mat_idx(lod, i);
+            if (mat_idx < 0)
+                continue;
+
+            if (mat(mat_idx).get_pass_idx(pass_name) < 0)
+                continue;
+
+            //less detailed levels with other groups have only the mesh bounds, tested by the caller
+            if (frustum_cull_enabled && same_groups)
+            {
+                update_aabb_transform();
+                if (m_groups[i].has_aabb)
+                {
+                    if (!get_camera().get_frustum().testIntersect(m_groups[i].aabb))
+                        continue;
+                }
+                else if (m_has_aabb && !get_camera().get_frustum().testIntersect(m_aabb))
+                    continue;
+            }
+
+            draw_group(i, pass_name, lod);
+        }
     }
 
     void mesh::draw_group(int idx, const char* pass_name) const
@@ -410,7 +806,177 @@ namespace RoxScene
                 return;
         }
 
-        internal().draw_group(idx, pass_name);
+        //the group of the current level if levels have the same groups
+        const int lod = internal().m_lod;
+        internal().draw_group(idx, pass_name, internal().lod_groups(lod).size() == internal().m_shared->groups.size() ? lod : 0);
+    }
+
+    void mesh::draw_instanced(const mesh* const* meshes, int count, const char* pass_name)
+    {
+        if (!meshes || count <= 0 || !pass_name)
+            return;
+
+        instance_items.clear();
+        deferred_items.clear();
+        for (int i = 0; i < count; ++i)
+        {
+            if (!meshes[i] || !meshes[i]->internal().m_shared.isValid())
+                continue;
+
+            const mesh_internal& mi = meshes[i]->internal();
+            if (mi.m_lod_prev >= 0 || mi.m_skeleton.getBonesCount() > 0)
+            {
+                const deferred_item item = { meshes[i], instance_item() };
+                deferred_items.push_back(item);
+                continue;
+            }
+
+            if (mi.m_has_aabb && frustum_cull_enabled && !get_camera().get_frustum().testIntersect(meshes[i]->get_aabb()))
+                continue;
+
+            const int lod = mi.m_lod;
+            const std::vector<shared_mesh::group>& groups = mi.lod_groups(lod);
+            const bool same_groups = groups.size() == mi.m_groups.size();
+            bool drawn = false;
+            for (int j = 0; j < (int)groups.size(); ++j)
+            {
+                const int mat_idx = mi.get_mat_idx(lod, j);
+                if (mat_idx < 0 || mi.mat(mat_idx).get_pass_idx(pass_name) < 0)
+                    continue;
+
+                if (frustum_cull_enabled && same_groups && mi.m_groups[j].has_aabb && !get_camera().get_frustum().testIntersect(mi.m_groups[j].aabb))
+                    continue;
+
+                const instance_item item = { &mi, mi.m_shared.constGet(), lod, j, &mi.mat(mat_idx), &mi.mat(mat_idx) };
+                if (item.mat->get_pass(pass_name).get_state().blend)
+                {
+                    const deferred_item blended = { 0, item };
+                    deferred_items.push_back(blended);
+                }
+                else
+                    instance_items.push_back(item);
+                drawn = true;
+            }
+
+            if (drawn && lod > 0 && RoxRender::Statistics::enabled())
+            {
+                const unsigned int full = mi.lod_triangles(0), lod_drawn = mi.lod_triangles(lod);
+                if (full > lod_drawn)
+                    RoxRender::Statistics::get().lod_triangles_saved += full - lod_drawn;
+            }
+        }
+
+        std::sort(instance_items.begin(), instance_items.end(), [](const instance_item& a, const instance_item& b)
+        {
+            if (a.shared != b.shared)
+                return a.shared < b.shared;
+            if (a.lod != b.lod)
+                return a.lod < b.lod;
+            if (a.group != b.group)
+                return a.group < b.group;
+            return a.mat < b.mat;
+        });
+
+        //equal copies are sorted apart by their pointers, they get one representative before the batches are formed
+        for (size_t from = 0, to = 0; from < instance_items.size(); from = to)
+        {
+            const instance_item& first = instance_items[from];
+            for (to = from + 1; to < instance_items.size(); ++to)
+            {
+                const instance_item& it = instance_items[to];
+                if (it.shared != first.shared || it.lod != first.lod || it.group != first.group)
+                    break;
+            }
+
+            bool merged = false;
+            batch_materials.assign(1, first.mat);
+            for (size_t i = from + 1; i < to; ++i)
+            {
+                instance_item& it = instance_items[i];
+                if (it.mat == instance_items[i - 1].mat)
+                {
+                    it.batch_mat = instance_items[i - 1].batch_mat;
+                    continue;
+                }
+
+                size_t k = 0;
+                while (k < batch_materials.size() && !it.mat->internal().is_same(batch_materials[k]->internal()))
+                    ++k;
+
+                if (k == batch_materials.size())
+                    batch_materials.push_back(it.mat);
+                else
+                {
+                    it.batch_mat = batch_materials[k];
+                    merged = true;
+                }
+            }
+
+            if (merged)
+            {
+                std::stable_sort(instance_items.begin() + from, instance_items.begin() + to, [](const instance_item& a, const instance_item& b)
+                {
+                    return a.batch_mat < b.batch_mat;
+                });
+            }
+        }
+
+        for (size_t from = 0, to = 0; from < instance_items.size(); from = to)
+        {
+            const instance_item& first = instance_items[from];
+            for (to = from + 1; to < instance_items.size(); ++to)
+            {
+                const instance_item& it = instance_items[to];
+                if (it.shared != first.shared || it.lod != first.lod || it.group != first.group || it.batch_mat != first.batch_mat)
+                    break;
+            }
+
+            const int max_instances = to - from > 1 ? first.mat->get_pass(pass_name).get_shader().internal().get_max_instances() : 0;
+            if (max_instances < 2)
+            {
+                for (size_t i = from; i < to; ++i)
+                    instance_items[i].m->draw_group(instance_items[i].group, pass_name, instance_items[i].lod);
+                continue;
+            }
+
+            const shared_mesh::group& g = first.m->lod_groups(first.lod)[first.group];
+            for (size_t i = from; i < to; i += max_instances)
+            {
+                const int n = (int)std::min(to - i, (size_t)max_instances);
+                instance_buffer.resize(n * 10);
+                float* pos = &instance_buffer[0], * rot = pos + n * 3, * scale = rot + n * 4;
+                for (int k = 0; k < n; ++k)
+                {
+                    const transform& tr = instance_items[i + k].m->m_transform;
+                    memcpy(pos + k * 3, &tr.get_pos().x, sizeof(float) * 3);
+                    memcpy(scale + k * 3, &tr.get_scale().x, sizeof(float) * 3);
+                    const RoxMath::Quaternion& q = tr.get_rot();
+                    rot[k * 4] = q.v.x, rot[k * 4 + 1] = q.v.y, rot[k * 4 + 2] = q.v.z, rot[k * 4 + 3] = q.w;
+                }
+
+                transform::set(instanced_transform);
+                shader_internal::set_pos_dequant(first.shared->pos_dequant_offset, first.shared->pos_dequant_scale);
+                shader_internal::set_instances(pos, rot, scale, n);
+
+                first.mat->internal().set(pass_name);
+                first.shared->vbo.bind();
+                first.shared->vbo.draw(g.offset, g.count, g.elem_type, n);
+                first.shared->vbo.unbind();
+                first.mat->internal().unset();
+
+                shader_internal::set_instances(0, 0, 0, 0);
+                shader_internal::set_pos_dequant(RoxMath::Vector3(), RoxMath::Vector3(1.0f, 1.0f, 1.0f));
+            }
+        }
+
+        for (size_t i = 0; i < deferred_items.size(); ++i)
+        {
+            const deferred_item& d = deferred_items[i];
+            if (d.whole)
+                d.whole->draw(pass_name);
+            else
+                d.group.m->draw_group(d.group.group, pass_name, d.group.lod);
+        }
     }
 
     bool mesh::has_pass(const char* pass_name) const
@@ -746,6 +1312,8 @@ namespace RoxScene
         if (!m_shared.isValid())
             return;
 
+        update_lod(dt);
+
         if (m_anims.empty() && m_bone_controls.empty())
             return;
 
@@ -763,10 +1331,99 @@ namespace RoxScene
             a.full_weight = (fabsf(1.0f - a.anim->m_weight) < eps);
         }
 
+        if (!update_anim_lod())
+        {
+            if (RoxRender::Statistics::enabled())
+                ++RoxRender::Statistics::get().skeleton_updates_skipped;
+            return;
+        }
+
         need_update_skeleton = true;
         m_recalc_aabb = true;
     }
 
+    bool mesh_internal::update_anim_lod()
+    {
+        ++m_anim_lod_frame;
+
+        if (anim_lods.empty())
+        {
+            m_anim_lod = -1;
+            m_anim_skip_ik = false;
+            return true;
+        }
+
+        float dist, screen_size;
+        get_lod_metrics(dist, screen_size);
+        if (!m_has_aabb)
+            screen_size = FLT_MAX; //no bounds, so no projected size to compare
+
+        const int prev_lod = m_anim_lod;
+        m_anim_lod = select_anim_lod(dist, screen_size);
+        if (m_anim_lod < 0)
+        {
+            m_anim_skip_ik = false;
+            return true;
+        }
+
+        const mesh::anim_lod& l = anim_lods[m_anim_lod];
+        m_anim_skip_ik = l.skip_ik;
+        if (m_anim_lod != prev_lod || l.update_interval <= 1)
+            return true;
+
+        return m_anim_lod_frame % l.update_interval == 0;
+    }
+
+    void mesh_internal::get_lod_metrics(float& dist, float& screen_size) const
+    {
+        const camera& cam = get_camera();
+        const float scale = std::max(std::max(fabsf(m_transform.get_scale().x), fabsf(m_transform.get_scale().y)), fabsf(m_transform.get_scale().z));
+        const float radius = m_shared->aabb.delta.length() * scale;
+        dist = (m_transform.transform_vec(m_shared->aabb.origin) - cam.get_pos()).length();
+        const RoxMath::Matrix4& proj = cam.get_proj_matrix();
+        const float w = proj.m[3][3] > 0.5f ? 1.0f : std::max(dist, 0.0001f); //ortho or perspective
+        screen_size = radius * proj.m[1][1] / w;
+    }
+
+    void mesh_internal::update_lod(unsigned int dt)
+    {
+        if (m_lod_prev >= 0)
+        {
+            m_lod_fade += lod_crossfade_time ? float(dt) / lod_crossfade_time : 1.0f;
+            if (m_lod_fade >= 1.0f)
+                m_lod_prev = -1;
+        }
+
+        const int count = get_lods_count();
+        if (count <= 1 || m_forced_lod >= 0)
+            return;
+
+        float dist, screen_size;
+        get_lod_metrics(dist, screen_size);
+
+        int lod;
+        if (!m_lod_distances.empty())
+            lod = select_lod(m_lod, dist / lod_bias_scale, &m_lod_distances[0], std::min(count - 1, (int)m_lod_distances.size()), true);
+        else if (!lod_screen_sizes.empty())
+            lod = select_lod(m_lod, screen_size * lod_bias_scale, &lod_screen_sizes[0], std::min(count - 1, (int)lod_screen_sizes.size()), false);
+        else
+        {
+            const int default_count = int(sizeof(default_lod_screen_sizes) / sizeof(default_lod_screen_sizes[0]));
+            lod = select_lod(m_lod, screen_size * lod_bias_scale, default_lod_screen_sizes, std::min(count - 1, default_count), false);
+        }
+
+        if (lod == m_lod)
+            return;
+
+        if (lod_crossfade_time)
+        {
+            m_lod_prev = m_lod;
+            m_lod_fade = 0.0f;
+        }
+
+        m_lod = lod;
+    }
+
     void mesh_internal::update_skeleton() const
     {
         if (!need_update_skeleton)
@@ -851,7 +1508,10 @@ namespace RoxScene
             m_skeleton.setBoneTransform(i, pos, rot);
         }
 
-        m_skeleton.update();
+        m_skeleton.update(!m_anim_skip_ik);
+
+        if (RoxRender::Statistics::enabled())
+            ++RoxRender::Statistics::get().skeleton_updates;
 
         const int mat_count = get_materials_count();
         for (int i = 0; i < mat_count; ++i)
@@ -869,7 +1529,60 @@ namespace RoxScene
         m_internal.m_transform.set_rot(yaw, pitch, roll); m_internal.m_recalc_aabb = true;
     }
 
+    void mesh::set_anim_lods(const anim_lod* lods, int count)
+    {
+        if (!lods || count <= 0)
+        {
+            anim_lods.clear();
+            return;
+        }
+
+        anim_lods.assign(lods, lods + count);
+    }
+
+    int mesh::get_anim_lods_count() { return (int)anim_lods.size(); }
+
+    const mesh::anim_lod& mesh::get_anim_lod(int idx)
+    {
+        if (idx < 0 || idx >= (int)anim_lods.size())
+            return RoxMemory::invalidObject<anim_lod>();
+
+        return anim_lods[idx];
+    }
+
+    void mesh::set_lod(int lod)
+    {
+        m_internal.m_forced_lod = lod < 0 ? -1 : lod;
+        if (lod < 0)
+            return;
+
+        m_internal.m_lod = std::max(std::min(lod, internal().get_lods_count() - 1), 0);
+        m_internal.m_lod_prev = -1;
+    }
+
+    void mesh::set_lod_distances(const float* distances, int count)
+    {
+        if (!distances || count <= 0)
+            m_internal.m_lod_distances.clear();
+        else
+            m_internal.m_lod_distances.assign(distances, distances + count);
+    }
+
+    void mesh::set_lod_screen_sizes(const float* sizes, int count)
+    {
+        if (!sizes || count <= 0)
+            lod_screen_sizes.clear();
+        else
+            lod_screen_sizes.assign(sizes, sizes + count);
+    }
+
+    void mesh::set_lod_bias(float bias) { lod_bias_scale = powf(2.0f, -bias); }
+    void mesh::set_lod_hysteresis(float margin) { lod_hysteresis = margin > 0.0f ? margin : 0.0f; }
+    void mesh::set_lod_crossfade(unsigned int time) { lod_crossfade_time = time; }
+
     bool mesh::is_frustrum_cull_enabled() { return frustum_cull_enabled; }
     void mesh::set_frustum_cull(bool enable) { frustum_cull_enabled = enable; }
+    bool mesh::is_cluster_cull_enabled() { return cluster_cull_enabled; }
+    void mesh::set_cluster_cull(bool enable) { cluster_cull_enabled = enable; }
 
 }
@@ -35,14 +35,31 @@ namespace RoxScene
             unsigned int offset;
             unsigned int count;
             RoxRender::RoxVBO::ELEMENT_TYPE elem_type;
+            unsigned int first_cluster, clusters_count;
 
-            group() : material_idx(0), offset(0), count(0), elem_type(RoxRender::RoxVBO::TRIANGLES) {}
+            group() : material_idx(0), offset(0), count(0), elem_type(RoxRender::RoxVBO::TRIANGLES), first_cluster(0), clusters_count(0) {}
         };
 
         std::vector<group> groups;
+
+        struct lod { std::vector<group> groups; };
+        std::vector<lod> lods; //less detailed levels after groups, from near to far
+
+        struct cluster
+        {
+            unsigned int offset, count;
+            RoxMath::Vector3 center;
+            float radius;
+            RoxMath::Vector3 cone_axis;
+            float cone_cutoff; //see RoxFormats::nms_clusters_chunk
+        };
+        std::vector<cluster> clusters; //ranges of the groups, culled when drawn
+
         std::vector<material> materials;
         RoxRender::RoxSkeleton skeleton;
 
+        RoxMath::Vector3 pos_dequant_offset, pos_dequant_scale; //for quantized positions, 0 and 1 otherwise
+
         struct misc_info
         {
             std::string name, type;
@@ -56,8 +73,12 @@ namespace RoxScene
             aabb = RoxMath::Aabb();
             vbo.release();
             groups.clear();
+            lods.clear();
+            clusters.clear();
             materials.clear();
             skeleton = RoxRender::RoxSkeleton();
+            pos_dequant_offset = RoxMath::Vector3();
+            pos_dequant_scale = RoxMath::Vector3(1.0f, 1.0f, 1.0f);
 
             if (add_data)
             {
@@ -67,7 +88,7 @@ namespace RoxScene
             return true;
         }
 
-        shared_mesh() : add_data(0) {}
+        shared_mesh() : pos_dequant_scale(1.0f, 1.0f, 1.0f), add_data(0) {}
 
         struct additional_data
         {
@@ -92,14 +113,23 @@ namespace RoxScene
         int get_bone_idx(const char* name) const { return m_skeleton.getBoneIdx(name); }
 
     private:
-        mesh_internal() : m_recalc_aabb(true), m_has_aabb(false), need_update_skeleton(true) {}
+        mesh_internal() : m_recalc_aabb(true), m_has_aabb(false), need_update_skeleton(true),
+                          m_anim_lod(-1), m_anim_lod_frame(0), m_anim_skip_ik(false),
+                          m_lod(0), m_lod_prev(-1), m_lod_fade(0.0f), m_forced_lod(-1) {}
 
-        void draw_group(int idx, const char* pass_name) const;
+        void draw_group(int idx, const char* pass_name, int lod = 0) const;
+        void draw_lod(int lod, const char* pass_name) const;
+        void draw_clusters(const shared_mesh::group& g, const RoxRender::State& state) const;
         bool init_from_shared();
 
         int get_materials_count() const;
         const material& mat(int idx) const; //idx must be valid
         int get_mat_idx(int group_idx) const;
+        int get_mat_idx(int lod, int group_idx) const;
+
+        int get_lods_count() const;
+        const std::vector<shared_mesh::group>& lod_groups(int lod) const { return lod > 0 ? m_shared->lods[lod - 1].groups : m_shared->groups; }
+        unsigned int lod_triangles(int lod) const;
 
         struct applied_anim
         {
@@ -120,6 +150,9 @@ namespace RoxScene
 
         void update(unsigned int dt);
         void update_skeleton() const;
+        bool update_anim_lod();
+        void update_lod(unsigned int dt);
+        void get_lod_metrics(float& dist, float& screen_size) const;
 
         void update_aabb_transform() const;
 
@@ -149,6 +182,16 @@ namespace RoxScene
         typedef std::map<int, bone_control> bone_control_map;
         bone_control_map m_bone_controls;
 
+        int m_anim_lod;
+        unsigned int m_anim_lod_frame;
+        bool m_anim_skip_ik;
+
+        int m_lod;
+        int m_lod_prev; //fading out, -1 if none
+        float m_lod_fade;
+        int m_forced_lod;
+        std::vector<float> m_lod_distances;
+
         std::vector<int> m_replaced_materials_idx;
         std::vector<material> m_replaced_materials;
 
@@ -182,6 +225,12 @@ namespace RoxScene
         void draw_group(int group_idx, const char* pass_name = material::default_pass) const;
         bool has_pass(const char* pass_name) const;
 
+        //opaque groups of the same resource, level and equal materials are drawn with one instanced draw per batch
+        //if the pass shader has "nya instances pos" (and rot, scale) arrays, the arrays size limits the batch
+        //batched instances are not cluster culled, groups left alone in their batch are
+        //blended groups, skinned and crossfading meshes are drawn one by one after the batches, in the given order
+        static void draw_instanced(const mesh* const* meshes, int count, const char* pass_name = material::default_pass);
+
         const RoxMath::Aabb& get_aabb() const;
 
         // transform
@@ -227,6 +276,35 @@ namespace RoxScene
         unsigned int get_anim_time(int layer = 0) const;
         bool is_anim_finished(int layer = 0) const;
         void set_anim_time(unsigned int time, int layer = 0);
+        int get_anim_lod() const { return internal().m_anim_lod; } //-1 if full rate
+
+        // level of detail, selected in update
+        int get_lods_count() const { return internal().get_lods_count(); } //1 if the mesh has no less detailed levels
+        int get_lod() const { return internal().m_lod; }
+        void set_lod(int lod); //-1 to select by the projected size or the distances
+        void set_lod_distances(const float* distances, int count); //level i+1 from distances[i], count 0 to use the projected size
+
+    public:
+        struct anim_lod
+        {
+            float distance; //level applies from this camera distance, 0 to ignore
+            float screen_size; //or if projected size (fraction of the screen height) is below, 0 to ignore
+            unsigned int update_interval; //update skeleton once per n mesh updates
+            bool skip_ik; //skip ik and bone bounds
+
+            anim_lod() : distance(0.0f), screen_size(0.0f), update_interval(1), skip_ik(false) {}
+        };
+
+        //levels from near to far, count 0 disables animation lod
+        static void set_anim_lods(const anim_lod* lods, int count);
+        static int get_anim_lods_count();
+        static const anim_lod& get_anim_lod(int idx);
+
+        //level i+1 is used when the projected size (fraction of the screen height) is below sizes[i], 0.5, 0.25, 0.125... by default
+        static void set_lod_screen_sizes(const float* sizes, int count);
+        static void set_lod_bias(float bias); //quality setting, each +1 switches to less detailed levels at twice the size or half the distance
+        static void set_lod_hysteresis(float margin); //relative to the thresholds, 0.1 by default
+        static void set_lod_crossfade(unsigned int time); //both levels are drawn for time ms with "nya lod fade" set, 0 to switch at once
 
     public:
         mesh() {}
@@ -238,6 +316,8 @@ namespace RoxScene
     public:
         static bool is_frustrum_cull_enabled();
         static void set_frustum_cull(bool enable);
+        static bool is_cluster_cull_enabled();
+        static void set_cluster_cull(bool enable); //off screen and back facing clusters, if the mesh has them
 
     public:
         static bool load_nms(shared_mesh& res, resource_data& data, const char* name);
@@ -245,6 +325,7 @@ namespace RoxScene
         static bool load_nms_skeleton_section(shared_mesh& res, const void* data, size_t size, int version);
         static bool load_nms_material_section(shared_mesh& res, const void* data, size_t size, int version);
         static bool load_nms_general_section(shared_mesh& res, const void* data, size_t size, int version);
+        static bool load_nms_clusters_section(shared_mesh& res, const void* data, size_t size, int version);
 
         const mesh_internal& internal() const { return m_internal; }
 
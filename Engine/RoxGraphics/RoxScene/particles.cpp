@@ -5,12 +5,30 @@
 #include "RoxFormats/RoxTextParser.h"
 #include "RoxFormats/RoxStringConvert.h"
 #include "RoxMemory/RoxInvalidObject.h"
+#include "RoxMemory/RoxThreadPool.h"
+#include "RoxMemory/RoxMutex.h"
 #include "cstdlib"
 #include "cstring"
 
 namespace RoxScene
 {
 
+namespace
+{
+    const unsigned int particle_chunk_size=4096; //fixed, so results don't depend on the threads count
+    unsigned int particles_seed=0;
+
+    unsigned int random_seed(unsigned int seed,unsigned int frame,unsigned int stream)
+    {
+        unsigned int h=seed*0x9e3779b9u^frame*0x85ebca6bu^stream*0xc2b2ae35u;
+        h^=h>>16,h*=0x7feb352du;
+        h^=h>>15,h*=0x846ca68bu;
+        return h^(h>>16);
+    }
+}
+
+particles::particles(): m_time(0),m_dt(0.0f),m_frame(0),m_random_seed(++particles_seed),m_need_update_params(false) {}
+
 bool particles::load(const char *name)
 {
     default_load_function(load_text);
@@ -68,6 +86,7 @@ void particles::reset_time()
     {
         particle &p=m_particles[i];
         p.count=0;
+        p.capacity=0;
         p.update_bufs.clear();
         if(!p.init_buf.empty())
             memset(&p.init_buf[0],0,p.init_buf.size()*sizeof(p.init_buf[0]));
@@ -76,7 +95,8 @@ void particles::reset_time()
     if(!m_shared.isValid())
         return;
 
-    m_curr_particles=this;
+    m_frame=0;
+    RoxFormats::RoxMathExprParser::setRandomSeed(random_seed(m_random_seed,m_frame,0));
     for(int i=0;i<(int)m_shared->spawn.size();++i)
         spawn(m_shared->spawn[i],1);
 }
@@ -88,15 +108,17 @@ void particles::update(unsigned int dt)
 
     m_local_cam_pos = m_transform.inverse_transform(get_camera().get_pos());
 
-    m_curr_particles=this;
     m_time+=dt;
     m_dt=dt*0.001f;
+    ++m_frame;
+
+    RoxFormats::RoxMathExprParser::setRandomSeed(random_seed(m_random_seed,m_frame,0));
 
     if(m_need_update_params)
     {
-        for(m_curr_emitter_idx=0;m_curr_emitter_idx<(int)m_emitters.size();++m_curr_emitter_idx)
+        for(int i=0;i<(int)m_emitters.size();++i)
         {
-            emitter &e=m_emitters[m_curr_emitter_idx];
+            emitter &e=m_emitters[i];
             const shared_particles::emitter &se=m_shared->emitters[e.type];
             update_params(&e.update_buf[0],get_function(se.update).param_binds);
         }
@@ -108,11 +130,12 @@ void particles::update(unsigned int dt)
         spawn(m_spawn_emitters[i].type,m_spawn_emitters[i].count,m_spawn_emitters[i].parent);
     m_spawn_emitters.clear();
 
-    for(m_curr_emitter_idx=0;m_curr_emitter_idx<(int)m_emitters.size();++m_curr_emitter_idx)
+    update_context ctx;
+    for(int i=0;i<(int)m_emitters.size();++i)
     {
-        emitter &e=m_emitters[m_curr_emitter_idx];
+        emitter &e=m_emitters[i];
         const shared_particles::emitter &se=m_shared->emitters[e.type];
-        m_curr_want_die=false;
+        ctx.reset(this,i);
         float *update_buf=&e.update_buf[0];
 
         if(e.dead)
@@ -130,77 +153,30 @@ void particles::update(unsigned int dt)
             int update_count=int((m_time-e.last_update_time)/frame_time);
             if(update_count>0)
             {
-                unsigned int restore_time=m_time;
-                float restore_dt=m_dt;
-                m_time=e.last_update_time;
-                m_dt=frame_time*0.001f;
-                for(int i=0;i<update_count && !e.dead;++i)
+                ctx.time=e.last_update_time;
+                ctx.dt=frame_time*0.001f;
+                for(int j=0;j<update_count && !e.dead;++j)
                 {
-                    m_time+=frame_time;
-                    get_function(se.update).calculate(update_buf);
-                    e.dead=m_curr_want_die;
+                    ctx.time+=frame_time;
+                    get_function(se.update).calculate(update_buf,&ctx);
+                    flush_emits(ctx);
+                    e.dead=ctx.want_die;
                 }
-                e.last_update_time=m_time;
-                m_time=restore_time;
-                m_dt=restore_dt;
+                e.last_update_time=ctx.time;
             }
         }
         else
         {
-            get_function(se.update).calculate(update_buf);
-            e.dead=m_curr_want_die;
+            get_function(se.update).calculate(update_buf,&ctx);
+            flush_emits(ctx);
+            e.dead=ctx.want_die;
         }
+
+        m_spawn_emitters.insert(m_spawn_emitters.end(),ctx.spawns.begin(),ctx.spawns.end()); //reset clears them for the next emitter
     }
 
     for(int i=0;i<(int)m_particles.size();++i)
-    {
-        const shared_particles::particle &sp=m_shared->particles[i];
-        particle &p=m_particles[i];
-
-        for(unsigned int j=0;j<p.count;)
-        {
-            m_curr_want_die=false;
-
-            emitter &e=m_emitters[p.parent_emitters[j]];
-            const shared_particles::emitter &se=m_shared->emitters[e.type];
-
-            float *part_update_buf=&p.update_bufs[j*p.update_buf_size];
-            shared_particles::function::update_in(&e.update_buf[0],part_update_buf,se.particle_binds[i].update);
-            get_function(sp.update).calculate(part_update_buf);
-
-            if(m_curr_want_die)
-            {
-                --p.count;
-                --e.ref_count;
-                if(j>=p.count)
-                    break;
-
-                memcpy(part_update_buf,&p.update_bufs[p.count*p.update_buf_size],p.update_buf_size*sizeof(float));
-                p.parent_emitters[j]=p.parent_emitters[p.count];
-            }
-            else
-                ++j;
-        }
-
-        if(sp.sort_key_offset>=0 && p.count>1)
-        {
-            float *part_update_buf=&p.update_bufs[0]+p.update_buf_size;
-            for(unsigned int i=1;i<p.count;++i, part_update_buf+=p.update_buf_size)
-            {
-                float *buf=part_update_buf;
-                for(unsigned int j=i;j>0;--j, buf-=p.update_buf_size)
-                {
-                    float *buf2=buf-p.update_buf_size;
-                    if((buf[sp.sort_key_offset] <= buf2[sp.sort_key_offset]) ^ sp.sort_ascending)
-                        break;
-
-                    for(unsigned int k=0;k<p.update_buf_size;++k)
-                        std::swap(buf[k],buf2[k]);
-                    std::swap(p.parent_emitters[j],p.parent_emitters[j-1]);
-                }
-            }
-        }
-    }
+        update_particles(i);
 
     for(int i=0;i<(int)m_emitters.size();)
     {
@@ -230,6 +206,106 @@ void particles::update(unsigned int dt)
     }
 }
 
+void particles::update_particles(int idx)
+{
+    const shared_particles::particle &sp=m_shared->particles[idx];
+    particle &p=m_particles[idx];
+    if(!p.count)
+        return;
+
+    m_values.resize(p.update_buf_size);
+    for(unsigned int k=0;k<p.update_buf_size;++k)
+        m_values[k]=p.values(k);
+
+    for(unsigned int j=0;j<p.count;++j)
+    {
+        const emitter &e=m_emitters[p.parent_emitters[j]];
+        const shared_particles::var_binds &binds=m_shared->emitters[e.type].particle_binds[idx].update;
+        for(size_t k=0;k<binds.size();++k)
+            m_values[binds[k].to][j]=e.update_buf[binds[k].from];
+    }
+
+    p.want_die.assign(p.count,0);
+
+    const shared_particles::function &f=get_function(sp.update);
+    const int chunks_count=int((p.count+particle_chunk_size-1)/particle_chunk_size);
+    m_chunk_contexts.resize(chunks_count);
+
+    auto update_chunk=[&](int chunk)
+    {
+        const unsigned int from=chunk*particle_chunk_size;
+        const int count=int(RoxMath::min(p.count-from,particle_chunk_size));
+
+        update_context &ctx=m_chunk_contexts[chunk];
+        ctx.reset(this,-1);
+        ctx.want_die_n=&p.want_die[from];
+
+        std::vector<float *> values(p.update_buf_size);
+        for(unsigned int k=0;k<p.update_buf_size;++k)
+            values[k]=m_values[k]+from;
+
+        RoxFormats::RoxMathExprParser::setRandomSeed(random_seed(m_random_seed,m_frame,((idx+1)<<16)+chunk));
+        f.calculate_n(values.empty()?0:&values[0],count,&ctx);
+    };
+
+    if(chunks_count>1)
+        RoxMemory::RoxThreadPool::get().run(chunks_count,update_chunk);
+    else
+        update_chunk(0);
+
+    for(int i=0;i<chunks_count;++i)
+    {
+        const update_context &ctx=m_chunk_contexts[i];
+        m_spawn_emitters.insert(m_spawn_emitters.end(),ctx.spawns.begin(),ctx.spawns.end());
+    }
+
+    for(unsigned int j=0;j<p.count;)
+    {
+        if(!p.want_die[j])
+        {
+            ++j;
+            continue;
+        }
+
+        --p.count;
+        --m_emitters[p.parent_emitters[j]].ref_count;
+        if(j>=p.count)
+            break;
+
+        for(unsigned int k=0;k<p.update_buf_size;++k)
+            m_values[k][j]=m_values[k][p.count];
+        p.parent_emitters[j]=p.parent_emitters[p.count];
+        p.want_die[j]=p.want_die[p.count];
+    }
+
+    if(sp.sort_key_offset>=0 && p.count>1)
+        sort_particles(p,sp.sort_key_offset,sp.sort_ascending);
+}
+
+void particles::update(particles * const *instances,int count,unsigned int dt)
+{
+    if(!instances)
+        return;
+
+    RoxMemory::RoxThreadPool::get().run(count,[&](int i)
+    {
+        if(instances[i])
+            instances[i]->update(dt);
+    });
+}
+
+void particles::update_context::reset(particles *p,short emitter_idx)
+{
+    this->p=p;
+    this->emitter_idx=emitter_idx;
+    time=p->m_time;
+    dt=p->m_dt;
+    want_die=false;
+    want_die_n=0;
+    emits.clear();
+    spawns.clear();
+}
+
 void particles::draw(const char *pass_name) const
 {
     for(int i=0;i<(int)m_particles.size();++i)
@@ -242,7 +318,6 @@ void particles::draw(const char *pass_name) const
         if(!p.count)
             continue;
 
-        const float *part_update_buf=&p.update_bufs[0];
         int current=0;
 
         transform::set(m_transform);
@@ -253,7 +328,7 @@ void particles::draw(const char *pass_name) const
         for(size_t i=0;i<sp.params.size();++i)
             params[i]=sp.params[i]->get_buf();
 
-        for(unsigned int j=0;j<p.count;++j,part_update_buf+=p.update_buf_size)
+        for(unsigned int j=0;j<p.count;++j)
         {
             const int current_pidx=current*4;
             for(int k=0;k<(int)sp.update_sh_binds.size();++k)
@@ -262,7 +337,7 @@ void particles::draw(const char *pass_name) const
                 if(current>=sp.params[b.to_idx]->get_count()) //ToDo: separate update uniform param binds
                     continue;
 
-                params[b.to_idx][current_pidx+b.to_swizzle]=part_update_buf[b.from];
+                params[b.to_idx][current_pidx+b.to_swizzle]=p.values(b.from)[j];
             }
 
             if(++current>=sp.prim_count)
@@ -280,7 +355,7 @@ void particles::draw(const char *pass_name) const
                         if(current>=sp.params[b.to_idx]->get_count()) //ToDo: separate update uniform param binds
                             continue;
 
-                        params[b.to_idx][b.to_swizzle]=part_update_buf[b.from];
+                        params[b.to_idx][b.to_swizzle]=p.values(b.from)[j];
                     }
                     ++current;
                 }
@@ -298,7 +373,7 @@ void particles::draw(const char *pass_name) const
     }
 }
 
-void particles::emit_particle(short emitter_idx,short particle_idx,int count)
+void particles::emit_particle(short emitter_idx,short particle_idx,int count,update_context &ctx)
 {
     if(count<1)
         return;
@@ -312,34 +387,134 @@ void particles::emit_particle(short emitter_idx,short particle_idx,int count)
     emitter &e=m_emitters[emitter_idx];
     const shared_particles::emitter &se=m_shared->emitters[e.type];
 
-    if(m_in_emitter_init && !e.init_buf.empty())
-        shared_particles::function::update_in(&e.init_buf[0],&e.update_buf[0],se.init_update_binds);
-
     particle &p=m_particles[particle_idx];
     const shared_particles::particle &sp=m_shared->particles[particle_idx];
     if(!p.update_buf_size)
         return;
 
-    p.update_bufs.resize((p.count+count)*p.update_buf_size,0.0f);
+    p.reserve(p.count+count);
     p.parent_emitters.resize(p.count+count);
 
     float *part_init_buf=p.init_buf.empty()?0:&p.init_buf[0];
-    float *part_update_buf=&p.update_bufs[p.count*p.update_buf_size];
     const float *update_buf=&e.update_buf[0];
 
-    for(int i=0;i<count;++i,part_update_buf+=p.update_buf_size)
+    for(int i=0;i<count;++i)
     {
+        const unsigned int idx=p.count+i;
         update_params(part_init_buf,get_function(sp.init).param_binds);
         shared_particles::function::update_in(update_buf,part_init_buf,se.particle_binds[particle_idx].init);
-        get_function(sp.init).calculate(part_init_buf);
-        shared_particles::function::update_in(part_init_buf,part_update_buf,sp.init_update_binds);
-        p.parent_emitters[p.count+i]=emitter_idx;
+        get_function(sp.init).calculate(part_init_buf,&ctx);
+
+        for(unsigned int k=0;k<p.update_buf_size;++k)
+            p.values(k)[idx]=0.0f;
+        for(size_t k=0;k<sp.init_update_binds.size();++k)
+            p.values(sp.init_update_binds[k].to)[idx]=part_init_buf[sp.init_update_binds[k].from];
+
+        p.parent_emitters[idx]=emitter_idx;
     }
 
     p.count+=count;
     e.ref_count+=count;
 }
 
+void particles::flush_emits(update_context &ctx)
+{
+    for(size_t i=0;i<ctx.emits.size();++i) //emits from particle init are appended and flushed too
+    {
+        const emit_request r=ctx.emits[i];
+        emit_particle(r.emitter,r.particle,r.count,ctx);
+    }
+
+    ctx.emits.clear();
+}
+
+void particles::particle::reserve(unsigned int size)
+{
+    if(size<=capacity)
+        return;
+
+    unsigned int new_capacity=capacity<32?32:capacity*2;
+    while(new_capacity<size)
+        new_capacity*=2;
+
+    std::vector<float> buf(new_capacity*update_buf_size);
+    for(unsigned int i=0;i<update_buf_size && count>0;++i)
+        memcpy(&buf[i*new_capacity],&update_bufs[i*capacity],count*sizeof(float));
+
+    update_bufs.swap(buf);
+    capacity=new_capacity;
+}
+
+void particles::sort_particles(particle &p,short key_idx,bool ascending)
+{
+    //lsd radix sort of (key,index) pairs, then a single gather per value array
+
+    const unsigned int count=p.count;
+    m_sort_keys.resize(count*2);
+    m_sort_idx.resize(count*2);
+    unsigned int *keys=&m_sort_keys[0],*keys_tmp=keys+count;
+    unsigned int *idx=&m_sort_idx[0],*idx_tmp=idx+count;
+
+    const float *key_values=p.values(key_idx);
+    for(unsigned int i=0;i<count;++i)
+    {
+        unsigned int k;
+        memcpy(&k,&key_values[i],sizeof(k));
+        k^=(k&0x80000000)?0xffffffff:0x80000000;
+        keys[i]=ascending?k:~k;
+        idx[i]=i;
+    }
+
+    for(int shift=0;shift<32;shift+=8)
+    {
+        unsigned int offsets[256]={0};
+        for(unsigned int i=0;i<count;++i)
+            ++offsets[(keys[i]>>shift)&0xff];
+
+        if(offsets[(keys[0]>>shift)&0xff]==count)
+            continue;
+
+        for(unsigned int i=0,sum=0;i<256;++i)
+        {
+            const unsigned int c=offsets[i];
+            offsets[i]=sum;
+            sum+=c;
+        }
+
+        for(unsigned int i=0;i<count;++i)
+        {
+            const unsigned int to=offsets[(keys[i]>>shift)&0xff]++;
+            keys_tmp[to]=keys[i];
+            idx_tmp[to]=idx[i];
+        }
+
+        std::swap(keys,keys_tmp);
+        std::swap(idx,idx_tmp);
+    }
+
+    unsigned int first_moved=0;
+    while(first_moved<count && idx[first_moved]==first_moved)
+        ++first_moved;
+
+    if(first_moved==count)
+        return;
+
+    m_sort_tmp.resize(count);
+    for(unsigned int k=0;k<p.update_buf_size;++k)
+    {
+        float *values=p.values(k);
+        for(unsigned int i=0;i<count;++i)
+            m_sort_tmp[i]=values[idx[i]];
+        memcpy(values,&m_sort_tmp[0],count*sizeof(float));
+    }
+
+    std::vector<short> &parents=p.parent_emitters;
+    for(unsigned int i=0;i<count;++i)
+        keys_tmp[i]=(unsigned int)parents[idx[i]];
+    for(unsigned int i=0;i<count;++i)
+        parents[i]=(short)keys_tmp[i];
+}
+
 void particles::spawn(short emitter_type,int count,short parent)
 {
     if(count<1)
@@ -351,10 +526,11 @@ void particles::spawn(short emitter_type,int count,short parent)
     const int curr_count=(short)m_emitters.size();
     m_emitters.resize(curr_count+count);
 
-    const int curr=m_curr_emitter_idx;
-    for(m_curr_emitter_idx=curr_count;m_curr_emitter_idx<(short)m_emitters.size();++m_curr_emitter_idx)
+    update_context ctx;
+    for(int i=curr_count;i<(int)m_emitters.size();++i)
     {
-        emitter &e=m_emitters[m_curr_emitter_idx];
+        ctx.reset(this,i);
+        emitter &e=m_emitters[i];
         e.type=emitter_type;
         e.last_update_time=m_time;
         const shared_particles::emitter &se=m_shared->emitters[e.type];
@@ -389,13 +565,11 @@ void particles::spawn(short emitter_type,int count,short parent)
             shared_particles::function::update_in(&pe.update_buf[0],init_buf,m_emitter_emitter_binds[e.parent_bind].init_binds);
         }
 
-        m_in_emitter_init=true;
-        get_function(se.init).calculate(init_buf);
-        m_in_emitter_init=false;
+        get_function(se.init).calculate(init_buf,&ctx);
         shared_particles::function::update_in(init_buf,&e.update_buf[0],se.init_update_binds);
+        flush_emits(ctx);
+        m_spawn_emitters.insert(m_spawn_emitters.end(),ctx.spawns.begin(),ctx.spawns.end());
     }
-
-    m_curr_emitter_idx=curr;
 }
 
 void particles::spawn(const char *emitter_id)
@@ -800,16 +974,33 @@ void shared_particles::function::update_binds(const std::vector<param> &params)
     }
 }
 
-void shared_particles::function::calculate(float *inout_buf) const
+void shared_particles::function::calculate(float *inout_buf,void *ctx) const
 {
     for(size_t i=0;i<expressions.size();++i)
     {
         const expression &e=expressions[i];
-        float *vars=e.expr.getVars();
+        float local_vars[32];
+        std::vector<float> heap_vars;
+        float *vars=e.bind_count<=32?local_vars:(heap_vars.resize(e.bind_count),&heap_vars[0]);
         for(int j=e.bind_offset;j<e.bind_offset+e.bind_count;++j)
             vars[binds[j].to]=inout_buf[binds[j].from];
 
-        inout_buf[e.inout_idx]=e.expr.calculate();
+        inout_buf[e.inout_idx]=e.expr.calculateVars(vars,ctx);
+    }
+}
+
+void shared_particles::function::calculate_n(float * const *inout,int count,void *ctx) const
+{
+    static thread_local std::vector<const float *> vars;
+
+    for(size_t i=0;i<expressions.size();++i)
+    {
+        const expression &e=expressions[i];
+        vars.resize(e.bind_count+1);
+        for(int j=e.bind_offset;j<e.bind_offset+e.bind_count;++j)
+            vars[binds[j].to]=inout[binds[j].from];
+
+        e.expr.calculateN(&vars[0],inout[e.inout_idx],count,ctx);
     }
 }
 
@@ -893,45 +1084,160 @@ static bool compare_curve_points(shared_particles::curve_points::const_reference
     return a.first<b.first;
 }
 
-void shared_particles::curve::sample(const curve_points &p)
+namespace
 {
-    points=p;
+    int default_curve_samples=128;
 
-    if(points.empty())
+    struct curve_cache_entry
     {
-        for(int i=0;i<samples_count;++i)
-            samples[i] = RoxMath::Vector4();
-        return;
+        shared_particles::curve_points points;
+        int samples_count;
+        RoxMemory::RoxSharedPtr<shared_particles::curve_samples> samples;
+    };
+
+    std::vector<curve_cache_entry> curve_cache;
+    RoxMemory::RoxMutex curve_cache_mutex;
+
+    bool equal_points(const shared_particles::curve_points &a,const shared_particles::curve_points &b)
+    {
+        if(a.size()!=b.size())
+            return false;
+
+        for(size_t i=0;i<a.size();++i)
+        {
+            const RoxMath::Vector4 &va=a[i].second,&vb=b[i].second;
+            if(a[i].first!=b[i].first || va.x!=vb.x || va.y!=vb.y || va.z!=vb.z || va.w!=vb.w)
+                return false;
+        }
+
+        return true;
     }
 
-    if(points.size()==1)
+    RoxMath::Vector4 eval_points(const shared_particles::curve_points &points,float t)
     {
-        for(int i=0;i<samples_count;++i)
-            samples[i] = points.front().second;
-        return;
+        if(t<=points.front().first)
+            return points.front().second;
+
+        for(size_t i=1;i<points.size();++i)
+        {
+            if(t>points[i].first)
+                continue;
+
+            const float d=points[i].first-points[i-1].first;
+            return d>0.0f?RoxMath::Vector4::lerp(points[i-1].second,points[i].second,(t-points[i-1].first)/d):points[i].second;
+        }
+
+        return points.back().second;
     }
+}
 
+void shared_particles::curve::sample(const curve_points &p,int samples_count)
+{
+    points=p;
     std::sort(points.begin(),points.end(),compare_curve_points);
 
-    for(int i=1;i<(int)points.size();++i)
+    if(samples_count<=0)
+        samples_count=default_curve_samples;
+    if(samples_count<2)
+        samples_count=2;
+
+    RoxMemory::RoxLockGuard lock(curve_cache_mutex);
+
+    for(size_t i=0;i<curve_cache.size();)
     {
-        const int idx0=int(points[i-1].first*(samples_count-1));
-        const int idx1=int(points[i].first*(samples_count-1));
+        if(curve_cache[i].samples.getRefCount()>1)
+        {
+            ++i;
+            continue;
+        }
 
-        for(int j=idx0<0?0:idx0;j<idx1 && j<samples_count;++j)
+        curve_cache[i]=curve_cache.back();
+        curve_cache.pop_back();
+    }
+
+    for(size_t i=0;i<curve_cache.size();++i)
+    {
+        if(curve_cache[i].samples_count==samples_count && equal_points(curve_cache[i].points,points))
         {
-            const float k=(j/float(samples_count-1) - points[i-1].first) / (points[i].first - points[i-1].first);
-            samples[j]=RoxMath::Vector4::lerp(points[i-1].second,points[i].second, k);
+            samples=curve_cache[i].samples;
+            return;
         }
     }
 
-    const int idxf=int(points.front().first*(samples_count-1));
-    for(int i=0;i<idxf;++i)
-        samples[i]=points.front().second;
+    std::vector<RoxMath::Vector4> values(samples_count);
+    if(!points.empty())
+    {
+        for(int i=0;i<samples_count;++i)
+            values[i]=eval_points(points,i/float(samples_count-1));
+    }
+
+    curve_samples cs;
+    cs.samples_count=samples_count;
+    for(int i=0;i<samples_count;++i)
+    {
+        const float *v=&values[i].x;
+        for(int c=cs.channels;c<4;++c)
+        {
+            if(v[c]!=0.0f)
+                cs.channels=c+1;
+        }
+    }
+
+    cs.values.resize(cs.channels*samples_count);
+    for(int c=0;c<cs.channels;++c)
+    {
+        for(int i=0;i<samples_count;++i)
+            cs.values[c*samples_count+i]=(&values[i].x)[c];
+    }
+
+    samples.create(cs);
 
-    const int idxl=int(points.back().first*(samples_count-1));
-    for(int i=idxl;i<samples_count;++i)
-        samples[i]=points.back().second;
+    curve_cache_entry e;
+    e.points=points;
+    e.samples_count=samples_count;
+    e.samples=samples;
+    curve_cache.push_back(e);
+}
+
+RoxMath::Vector4 shared_particles::curve::get(float t) const
+{
+    if(!samples.isValid())
+        return RoxMath::Vector4();
+
+    return RoxMath::Vector4(samples->get(0,t),samples->get(1,t),samples->get(2,t),samples->get(3,t));
+}
+
+void shared_particles::curve::set_default_samples_count(int count) { default_curve_samples=count<2?2:count; }
+int shared_particles::curve::get_default_samples_count() { return default_curve_samples; }
+
+float shared_particles::curve_samples::get(int channel,float t) const
+{
+    float r;
+    gather(channel,&t,&r,1);
+    return r;
+}
+
+void shared_particles::curve_samples::gather(int channel,const float *t,float *result,int count) const
+{
+    if(channel<0 || channel>=channels)
+    {
+        memset(result,0,count*sizeof(float));
+        return;
+    }
+
+    const float *v=&values[channel*samples_count];
+    const float scale=float(samples_count-1);
+    const int last=samples_count-2;
+    for(int i=0;i<count;++i)
+    {
+        float f=t[i]*scale;
+        f=!(f>0.0f)?0.0f:(f>scale?scale:f); //nan goes to the first sample, int(nan) is undefined
+        int i0=int(f);
+        if(i0>last)
+            i0=last;
+        const float v0=v[i0];
+        result[i]=v0+(v[i0+1]-v0)*(f-float(i0));
+    }
 }
 
 namespace { typedef std::list<RoxFormats::RTextParser> parsers_list; }
@@ -1043,14 +1349,22 @@ bool particles::load_text(shared_particles &res,resource_data &data,const char*
                     continue;
 
                 shared_particles::curve_points points;
+                int samples_count=0;
                 for(int j=0;j<parser.getSubsectionsCount(i);++j)
                 {
-                    const float a=(float)atof(parser.getSubsectionType(i,j));
-                    points.push_back(std::make_pair(a,parser.getSubsectionValueVec4(i,j)));
+                    const char *type=parser.getSubsectionType(i,j);
+                    if(type && strcmp(type,"samples")==0)
+                    {
+                        const char *value=parser.getSubsectionValue(i,j);
+                        samples_count=value?atoi(value):0;
+                        continue;
+                    }
+
+                    points.push_back(std::make_pair((float)atof(type),parser.getSubsectionValueVec4(i,j)));
                 }
 
                 const int idx=add_idx(res.curves,sname);
-                res.curves[idx].sample(points);
+                res.curves[idx].sample(points,samples_count);
 
                 const char *pname=parser.getSectionName(i,1);
                 if(pname && pname[0])
@@ -1143,7 +1457,7 @@ bool particles::load_text(shared_particles &res,resource_data &data,const char*
 
                     if(strstr(fvalue,"curve"))
                     {
-                        e.setFunction("curve",2,1,curve_func);
+                        e.setFunction("curve",2,1,curve_func,curve_func_n);
                         for(int k=0;k<(int)res.curves.size();++k)
                         {
                             e.setConstant(res.curves[k].id.c_str(),float(k*4));
@@ -1419,16 +1733,10 @@ bool particles::load_text(shared_particles &res,resource_data &data,const char*
     return true;
 }
 
-particles *particles::m_curr_particles=0;
-bool particles::m_curr_want_die=false;
-bool particles::m_in_emitter_init=false;
-short particles::m_curr_emitter_idx= -1;
-float particles::m_dt=0.0f;
-
-void particles::time_func(float *a,float *r) { r[0] = (m_curr_particles->m_time % int(1000/a[0]))*(0.001f*a[0]); }
-void particles::get_dt_func(float *a,float *r) { r[0] = m_dt; }
+void particles::time_func(float *a,float *r,int,void *ctx) { r[0] = (((update_context *)ctx)->time % int(1000/a[0]))*(0.001f*a[0]); }
+void particles::get_dt_func(float *,float *r,int,void *ctx) { r[0] = ((update_context *)ctx)->dt; }
 
-void particles::emit_func(float *a,float *r)
+void particles::emit_func(float *a,float *r,int,void *ctx)
 {
     const int count=(int)lroundf(a[1]);
     if(count<1)
@@ -1437,11 +1745,13 @@ void particles::emit_func(float *a,float *r)
         return;
     }
 
-    m_curr_particles->emit_particle(m_curr_emitter_idx,short(a[0]),count);
+    update_context &c=*(update_context *)ctx;
+    const emit_request e={c.emitter_idx,short(a[0]),count};
+    c.emits.push_back(e);
     r[0]=float(count);
 }
 
-void particles::spawn_func(float *a,float *r)
+void particles::spawn_func(float *a,float *r,int,void *ctx)
 {
     const int count=(int)lroundf(a[1]);
     if(count<1)
@@ -1450,31 +1760,61 @@ void particles::spawn_func(float *a,float *r)
         return;
     }
 
+    update_context &c=*(update_context *)ctx;
     spawn_emitter e;
     e.type=int(a[0]);
     e.count=count;
-    e.parent=m_curr_emitter_idx;
-    m_curr_particles->m_spawn_emitters.push_back(e);
+    e.parent=c.emitter_idx;
+    c.spawns.push_back(e);
     r[0]=float(count);
 }
 
-void particles::curve_func(float *a,float *r)
+void particles::curve_func(float *a,float *r,int,void *ctx)
 {
-    int sidx=int(a[1]*shared_particles::curve::samples_count);
-    if(sidx>=shared_particles::curve::samples_count)
-        sidx=shared_particles::curve::samples_count-1;
-    else if(sidx<0)
-        sidx=0;
-
     const unsigned int a0=(unsigned int)(a[0]);
-    const unsigned int idx=a0/4;
-    const std::vector<shared_particles::curve> &curves=m_curr_particles->get_shared_data()->curves;
-    r[0]=idx>=curves.size()?0.0f:(&curves[idx].samples[sidx].x)[a0%4];
+    const unsigned int curve_idx=a0/4;
+    const std::vector<shared_particles::curve> &curves=((update_context *)ctx)->p->get_shared_data()->curves;
+    if(curve_idx>=curves.size() || !curves[curve_idx].samples.isValid())
+        r[0]=0.0f;
+    else
+        r[0]=curves[curve_idx].samples->get(a0%4,a[1]);
 }
 
-void particles::print_func(float *a,float *r) { log()<<"particle print: "<<a[0]<<"\n"; r[0]=a[0]; }
-void particles::die_if_func(float *a,float *r) { r[0]=float(m_curr_want_die || (m_curr_want_die=a[0]>0.0f)); }
-void particles::dist_to_cam(float *a,float *r) { r[0]=(m_curr_particles->m_local_cam_pos - RoxMath::Vector3(a[0],a[1],a[2])).length(); }
-void particles::fade(float *a,float *r) { r[0]=RoxMath::fade(a[0],a[1],a[2],a[3]); }
+void particles::curve_func_n(const float * const *a,float * const *r,int count,int,void *ctx)
+{
+    const std::vector<shared_particles::curve> &curves=((update_context *)ctx)->p->get_shared_data()->curves;
+    for(int i=0;i<count;) //gather runs with the same curve and channel, usually the whole block
+    {
+        const float c=a[0][i];
+        int to=i+1;
+        while(to<count && a[0][to]==c)
+            ++to;
+
+        const unsigned int a0=(unsigned int)c;
+        const unsigned int curve_idx=a0/4;
+        if(curve_idx>=curves.size() || !curves[curve_idx].samples.isValid())
+            memset(r[0]+i,0,(to-i)*sizeof(float));
+        else
+            curves[curve_idx].samples->gather(a0%4,a[1]+i,r[0]+i,to-i);
+
+        i=to;
+    }
+}
+
+void particles::print_func(float *a,float *r,int,void *) { log()<<"particle print: "<<a[0]<<"\n"; r[0]=a[0]; }
+void particles::die_if_func(float *a,float *r,int idx,void *ctx)
+{
+    update_context &c=*(update_context *)ctx;
+    if(!c.want_die_n)
+    {
+        r[0]=float(c.want_die || (c.want_die=a[0]>0.0f));
+        return;
+    }
+
+    char &want_die=c.want_die_n[idx];
+    r[0]=float(want_die || (want_die=a[0]>0.0f));
+}
+void particles::dist_to_cam(float *a,float *r,int,void *ctx) { r[0]=(((update_context *)ctx)->p->m_local_cam_pos - RoxMath::Vector3(a[0],a[1],a[2])).length(); }
+void particles::fade(float *a,float *r,int,void *) { r[0]=RoxMath::fade(a[0],a[1],a[2],a[3]); }
 
 }
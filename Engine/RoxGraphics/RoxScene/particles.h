@@ -8,6 +8,7 @@
 #include "material.h"
 #include "transform.h"
 #include "RoxRender/RoxVBO.h"
+#include "RoxMemory/RoxSharedPtr.h"
 
 namespace RoxScene
 {
@@ -42,14 +43,29 @@ struct shared_particles
 
     typedef std::vector<std::pair<float,RoxMath::Vector4> > curve_points;
 
+    struct curve_samples
+    {
+        int samples_count;
+        int channels; //trailing channels that are zero everywhere are not stored
+        std::vector<float> values; //per channel arrays of samples_count values
+
+        float get(int channel,float t) const;
+        void gather(int channel,const float *t,float *result,int count) const; //lerps between samples
+
+        curve_samples(): samples_count(0),channels(0) {}
+    };
+
     struct curve
     {
         std::string id, name;
         curve_points points;
-        static const int samples_count = 128;
-        RoxMath::Vector4 samples[samples_count];
+        RoxMemory::RoxSharedPtr<curve_samples> samples; //shared between curves with equal points and resolution
+
+        void sample(const curve_points &points,int samples_count=0); //0 for default
+        RoxMath::Vector4 get(float t) const;
 
-        void sample(const curve_points &points);
+        static void set_default_samples_count(int count);
+        static int get_default_samples_count();
     };
 
     std::vector<curve> curves;
@@ -71,7 +87,8 @@ struct shared_particles
 
         short get_inout_idx(const char *name) const;
         void update_binds(const std::vector<param> &params);
-        void calculate(float *inout_buf) const; //inout_buf size must be equal in_out.size()
+        void calculate(float *inout_buf,void *ctx=0) const; //inout_buf size must be equal in_out.size()
+        void calculate_n(float * const *inout,int count,void *ctx=0) const; //in_out.size() arrays of count values
         static void link(const function &from,const function &to,var_binds &binds,const char *prefix="");
         static void link(const function &from,const material &to,sh_binds &binds);
         static void update_in(const float *buf_from,float *buf_to,const var_binds &binds);
@@ -180,6 +197,13 @@ public:
 public:
     void spawn(const char *emitter_id);
 
+public:
+    //updates instances in parallel, results don't depend on the threads count
+    static void update(particles * const *instances,int count,unsigned int dt);
+
+    //seed of the expressions rand, instances get different seeds by default
+    void set_random_seed(unsigned int seed) { m_random_seed=seed; }
+
 public:
     int get_params_count() const;
     const char *get_param_name(int idx) const;
@@ -207,7 +231,7 @@ public:
     unsigned int get_count() const;
 
 public:
-    particles(): m_time(0), m_need_update_params(false) {}
+    particles();
     particles(const char *name) { *this=particles(); load(name); }
 
 public:
@@ -219,11 +243,34 @@ private:
     int find_emitter_emitter_bind(int from,int to);
     void update_params(float *buf_to,const shared_particles::prm_binds &binds) const;
 
-    void emit_particle(short emitter_idx,short particle_idx,int count);
+    struct spawn_emitter { short type,count,parent; };
+    struct emit_request { short emitter,particle; int count; };
+
+    struct update_context
+    {
+        particles *p;
+        short emitter_idx;
+        unsigned int time;
+        float dt;
+        bool want_die;
+        char *want_die_n;
+        std::vector<emit_request> emits;
+        std::vector<spawn_emitter> spawns;
+
+        void reset(particles *p,short emitter_idx);
+        update_context(): p(0),emitter_idx(-1),time(0),dt(0.0f),want_die(false),want_die_n(0) {}
+    };
+
+    void emit_particle(short emitter_idx,short particle_idx,int count,update_context &ctx);
+    void flush_emits(update_context &ctx);
     void spawn(short emitter_type,int count,short parent= -1);
+    void update_particles(int idx);
 
 private:
     unsigned int m_time;
+    float m_dt;
+    unsigned int m_frame;
+    unsigned int m_random_seed;
     transform m_transform;
 
     struct emitter
@@ -247,13 +294,28 @@ private:
         std::vector<float> init_buf;
         unsigned int update_buf_size;
         unsigned int count;
-        std::vector<float> update_bufs;
+        unsigned int capacity;
+        std::vector<float> update_bufs; //soa, value idx of the particle j is at idx*capacity+j
         std::vector<short> parent_emitters;
+        std::vector<char> want_die;
+
+        float *values(int idx) { return &update_bufs[idx*capacity]; }
+        const float *values(int idx) const { return &update_bufs[idx*capacity]; }
+        void reserve(unsigned int size);
+
+        particle(): update_buf_size(0),count(0),capacity(0) {}
     };
 
     std::vector<particle> m_particles;
 
-    struct spawn_emitter { short type,count,parent; };
+    void sort_particles(particle &p,short key_idx,bool ascending);
+
+    std::vector<float *> m_values;
+    std::vector<unsigned int> m_sort_keys;
+    std::vector<unsigned int> m_sort_idx;
+    std::vector<float> m_sort_tmp;
+    std::vector<update_context> m_chunk_contexts;
+
     std::vector<spawn_emitter> m_spawn_emitters;
 
     std::vector<shared_particles::emitter_bind> m_emitter_emitter_binds;
@@ -265,22 +327,16 @@ private:
     RoxMath::Vector3 m_local_cam_pos;
 
 private:
-    static void time_func(float *a,float *r);
-    static void get_dt_func(float *a,float *r);
-    static void emit_func(float *a,float *r);
-    static void spawn_func(float *a,float *r);
-    static void curve_func(float *a,float *r);
-    static void print_func(float *a,float *r);
-    static void die_if_func(float *a,float *r);
-    static void dist_to_cam(float *a,float *r);
-    static void fade(float *a,float *r);
-
-private:
-    static particles *m_curr_particles;
-    static bool m_curr_want_die;
-    static bool m_in_emitter_init;
-    static short m_curr_emitter_idx;
-    static float m_dt;
+    static void time_func(float *a,float *r,int idx,void *ctx);
+    static void get_dt_func(float *a,float *r,int idx,void *ctx);
+    static void emit_func(float *a,float *r,int idx,void *ctx);
+    static void spawn_func(float *a,float *r,int idx,void *ctx);
+    static void curve_func(float *a,float *r,int idx,void *ctx);
+    static void curve_func_n(const float * const *a,float * const *r,int count,int offset,void *ctx);
+    static void print_func(float *a,float *r,int idx,void *ctx);
+    static void die_if_func(float *a,float *r,int idx,void *ctx);
+    static void dist_to_cam(float *a,float *r,int idx,void *ctx);
+    static void fade(float *a,float *r,int idx,void *ctx);
 };
 
 }
@@ -14,6 +14,7 @@
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#include <algorithm>
 
 #include "RoxMath/RoxQuaternion.h"
 
@@ -260,7 +261,9 @@ bool load_nya_shader_internal(shared_shader& res, shader_description& desc, reso
             const char* predefined_semantics[] = { "nya camera pos","nya camera rot","nya camera dir",
                                                 "nya bones pos","nya bones pos transform","nya bones rot","nya bones rot transform",
                                                 "nya bones pos texture","nya bones pos transform texture","nya bones rot texture",
-                                                "nya viewport","nya model pos","nya model rot","nya model scale" };
+                                                "nya viewport","nya model pos","nya model rot","nya model scale","nya lod fade",
+                                                "nya pos dequant offset","nya pos dequant scale",
+                                                "nya instances pos","nya instances rot","nya instances scale" };
 
             char predefined_count_static_assert[sizeof(predefined_semantics) / sizeof(predefined_semantics[0])
                 == shared_shader::predefines_count ? 1 : -1];
@@ -662,6 +665,31 @@ void shader_internal::set() const
         }
         break;
 
+        case shared_shader::lod_fade: m_shared->shdr.setUniform(p.location, m_lod_fade[0], m_lod_fade[1], 0.0f, 0.0f); break;
+        case shared_shader::pos_dequant_offset: m_shared->shdr.setUniform(p.location, m_pos_dequant[0].x, m_pos_dequant[0].y, m_pos_dequant[0].z, 0.0f); break;
+        case shared_shader::pos_dequant_scale: m_shared->shdr.setUniform(p.location, m_pos_dequant[1].x, m_pos_dequant[1].y, m_pos_dequant[1].z, 0.0f); break;
+
+        case shared_shader::instances_pos:
+        {
+            const float identity[3] = { 0.0f, 0.0f, 0.0f };
+            m_shared->shdr.setUniform3Array(p.location, m_instances_count > 0 ? m_instances_pos : identity, m_instances_count > 0 ? m_instances_count : 1);
+        }
+        break;
+
+        case shared_shader::instances_rot:
+        {
+            const float identity[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+            m_shared->shdr.setUniform4Array(p.location, m_instances_count > 0 ? m_instances_rot : identity, m_instances_count > 0 ? m_instances_count : 1);
+        }
+        break;
+
+        case shared_shader::instances_scale:
+        {
+            const float identity[3] = { 1.0f, 1.0f, 1.0f };
+            m_shared->shdr.setUniform3Array(p.location, m_instances_count > 0 ? m_instances_scale : identity, m_instances_count > 0 ? m_instances_count : 1);
+        }
+        break;
+
         case shared_shader::predefines_count: break;
         }
     }
@@ -737,6 +765,28 @@ unsigned int shader_internal::get_uniform_array_size(int idx) const
     return m_shared->shdr.getUniformArraySize(get_uniform(idx).location);
 }
 
+int shader_internal::get_max_instances() const
+{
+    if(!m_shared.isValid())
+        return 0;
+
+    int count=-1;
+    bool has_pos=false;
+    for(size_t i=0;i<m_shared->predefines.size();++i)
+    {
+        const shared_shader::predefined &p=m_shared->predefines[i];
+        if(p.type!=shared_shader::instances_pos && p.type!=shared_shader::instances_rot && p.type!=shared_shader::instances_scale)
+            continue;
+
+        const int size=p.location<0?0:(int)m_shared->shdr.getUniformArraySize(p.location);
+        count=count<0?size:std::min(count,size);
+        if(p.type==shared_shader::instances_pos)
+            has_pos=true;
+    }
+
+    return has_pos?count:0;
+}
+
 void shader_internal::set_uniform_value(int idx,float f0,float f1,float f2,float f3) const
 {
     if(!m_shared.isValid() || idx<0 || idx >=(int)m_shared->uniforms.size())
@@ -781,6 +831,12 @@ int shader_internal::get_uniforms_count() const
 }
 
 const RoxRender::RoxSkeleton *shader_internal::m_skeleton=0;
+float shader_internal::m_lod_fade[2]={1.0f,1.0f};
+RoxMath::Vector3 shader_internal::m_pos_dequant[2]={RoxMath::Vector3(0.0f,0.0f,0.0f),RoxMath::Vector3(1.0f,1.0f,1.0f)};
+const float *shader_internal::m_instances_pos=0;
+const float *shader_internal::m_instances_rot=0;
+const float *shader_internal::m_instances_scale=0;
+int shader_internal::m_instances_count=0;
 
 void shader_internal::skeleton_changed(const RoxRender::RoxSkeleton *RoxSkeleton) const
 {
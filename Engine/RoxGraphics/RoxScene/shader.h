@@ -37,6 +37,12 @@ struct shared_shader
         model_pos,
         model_rot,
         model_scale,
+        lod_fade,
+        pos_dequant_offset,
+        pos_dequant_scale,
+        instances_pos,
+        instances_rot,
+        instances_scale,
 
         predefines_count
     };
@@ -117,6 +123,16 @@ public:
     static void unset() { RoxRender::RoxShader::unbind(); }
 
     static void set_skeleton(const RoxRender::RoxSkeleton *RoxSkeleton) { m_skeleton=RoxSkeleton; }
+
+    //"nya lod fade": x is the crossfade progress, y is 1 for the incoming level and -1 for the outgoing one
+    //a dithered fade keeps pixels with dither<x on the incoming level and the rest on the outgoing one
+    static void set_lod_fade(float progress,bool incoming) { m_lod_fade[0]=progress; m_lod_fade[1]=incoming?1.0f:-1.0f; }
+    //"nya pos dequant offset" and "nya pos dequant scale": pos=offset+attribute*scale, 0 and 1 for float positions
+    static void set_pos_dequant(const RoxMath::Vector3 &offset,const RoxMath::Vector3 &scale) { m_pos_dequant[0]=offset; m_pos_dequant[1]=scale; }
+    //"nya instances pos", "nya instances rot" and "nya instances scale" arrays, indexed by gl_InstanceID
+    //the model transform is identity for instanced draws, single draws get one identity instance
+    static void set_instances(const float *pos,const float *rot,const float *scale,int count) { m_instances_pos=pos; m_instances_rot=rot; m_instances_scale=scale; m_instances_count=count; }
+    int get_max_instances() const; //by the arrays size, 0 if the shader has no "nya instances pos"
     void reset_skeleton() { if(!m_shared.isValid()) return; m_shared->last_skeleton_pos=0; m_shared->last_skeleton_rot=0; }
     void skeleton_changed (const RoxRender::RoxSkeleton *RoxSkeleton) const;
 
@@ -136,6 +152,12 @@ public:
 
 private:
     static const RoxRender::RoxSkeleton *m_skeleton;
+    static float m_lod_fade[2];
+    static RoxMath::Vector3 m_pos_dequant[2];
+    static const float *m_instances_pos;
+    static const float *m_instances_rot;
+    static const float *m_instances_scale;
+    static int m_instances_count;
 };
 
 class RoxShader
@@ -110,6 +110,11 @@ namespace RoxScene
             get_load_functions().add(function, true);
         }
 
+        //tried before the resource is read as a whole, may read only the chunks it needs
+        typedef bool (*partial_load_function)(t& sh, RoxResources::IRoxResourceData* data, const char* name);
+
+        static void set_partial_load_function(partial_load_function function) { get_partial_load_function() = function; }
+
     public:
         virtual ~scene_shared<t>() {}
 
@@ -134,6 +139,12 @@ namespace RoxScene
                     return false;
                 }
 
+                if (scene_shared::get_partial_load_function() && scene_shared::get_partial_load_function()(res, file_data, name))
+                {
+                    file_data->release();
+                    return true;
+                }
+
                 const size_t data_size = file_data->getSize();
                 RoxMemory::RoxTmpBufferRef res_data(data_size);
                 file_data->readAll(res_data.getData());
@@ -156,7 +167,7 @@ namespace RoxScene
                 return false;
             }
 
-            bool release_resource(t& res)
+            bool releaseResource(t& res)
             {
                 return res.release();
             }
@@ -201,6 +212,12 @@ namespace RoxScene
             return functions;
         }
 
+        static partial_load_function& get_partial_load_function()
+        {
+            static partial_load_function function = 0;
+            return function;
+        }
+
     private:
         static std::string& get_resources_prefix_str()
         {
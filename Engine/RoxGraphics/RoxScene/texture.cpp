@@ -12,11 +12,283 @@
 #include "RoxRender/RoxShader.h"
 #include "RoxRender/RoxScreenQuad.h"
 #include "RoxRender/RoxBitmap.h"
+#include "RoxRender/RoxMipmap.h"
+#include "RoxMemory/RoxHash.h"
 #include <cstdlib>
+#include <cstdio>
 
 namespace RoxScene
 {
 
+namespace
+{
+    RoxRender::IRoxTextureCacheProvider *cache_provider=0;
+
+    size_t level_size(unsigned int width,unsigned int height,RoxRender::RoxTexture::COLOR_FORMAT format)
+    {
+        const unsigned int bpp=RoxRender::RoxTexture::getFormatBpp(format);
+        if(format<RoxRender::RoxTexture::DXT1)
+            return size_t(width)*height*bpp/8;
+
+        return size_t((width+3)/4)*((height+3)/4)*bpp*2;
+    }
+
+    RoxRender::RoxTexture::WRAP get_wrap(const std::string &s)
+    {
+        if(s=="repeat")
+            return RoxRender::RoxTexture::WRAP_REPEAT;
+        if(s=="mirror")
+            return RoxRender::RoxTexture::WRAP_REPEAT_MIRROR;
+
+        return RoxRender::RoxTexture::WRAP_CLAMP;
+    }
+
+    //values are -1 if not set
+    struct texture_meta
+    {
+        int32_t wrap_s,wrap_t;
+        int32_t aniso;
+
+        texture_meta(): wrap_s(-1),wrap_t(-1),aniso(-1) {}
+    };
+
+    bool read_meta_values(const void *data,size_t size,texture_meta &meta)
+    {
+        RoxFormats::Meta m;
+        if(!m.read(data,size))
+            return false;
+
+        for(int i=0;i<(int)m.values.size();++i)
+        {
+            if(m.values[i].first=="nya_wrap_s")
+                meta.wrap_s=get_wrap(m.values[i].second);
+            else if(m.values[i].first=="nya_wrap_t")
+                meta.wrap_t=get_wrap(m.values[i].second);
+            else if(m.values[i].first=="nya_aniso")
+            {
+                const int aniso=atoi(m.values[i].second.c_str());
+                meta.aniso=aniso>0?aniso:0;
+            }
+        }
+
+        return true;
+    }
+
+    void apply_meta(RoxRender::RoxTexture &tex,const texture_meta &meta)
+    {
+        if(meta.aniso>=0)
+            tex.setAniso(meta.aniso);
+
+        if(meta.wrap_s<0 && meta.wrap_t<0)
+            return;
+
+        tex.setWrap(meta.wrap_s<0?RoxRender::RoxTexture::WRAP_REPEAT:RoxRender::RoxTexture::WRAP(meta.wrap_s),
+                    meta.wrap_t<0?RoxRender::RoxTexture::WRAP_REPEAT:RoxRender::RoxTexture::WRAP(meta.wrap_t));
+    }
+
+    //entries are keyed by the name and the load settings, so each target format gets its own entry
+    //the header identifies the source by its size and modification time, so a hit is found before the file is read,
+    //providers without the time fall back to the content hash; the meta values are kept since a hit has no file data
+    class texture_cache
+    {
+    public:
+        bool load(shared_texture &res) const
+        {
+            if(m_key.empty())
+                return false;
+
+            RoxMemory::RoxTmpBufferRef buf;
+            if(!cache_provider->get(m_key.c_str(),buf))
+                return false;
+
+            header h;
+            bool result=buf.copyTo(&h,sizeof(h)) && memcmp(h.sign,"RTXC",4)==0 && h.version==version
+                        && h.source_hash==m_source_hash && h.source_time==m_source_time && h.source_size==m_source_size
+                        && buf.getSize()==sizeof(h)+h.face_size*(h.cubemap?6:1);
+            if(result)
+            {
+                const RoxRender::RoxTexture::COLOR_FORMAT format=RoxRender::RoxTexture::COLOR_FORMAT(h.format);
+                if(h.cubemap)
+                {
+                    const void *data[6];
+                    for(int i=0;i<6;++i)
+                        data[i]=buf.getData(size_t(sizeof(h)+i*h.face_size));
+                    result=res.tex.buildCubemap(data,h.width,h.height,format,h.mip_count);
+                }
+                else
+                    result=res.tex.buildTexture(buf.getData(sizeof(h)),h.width,h.height,format,h.mip_count);
+
+                if(result)
+                    apply_meta(res.tex,h.meta);
+            }
+
+            buf.free();
+            return result;
+        }
+
+        bool build(RoxRender::RoxTexture &tex,const void *data,unsigned int width,unsigned int height,RoxRender::RoxTexture::COLOR_FORMAT format,int mip_count)
+        {
+            const void *data_a[6]={data};
+            return build(tex,data_a,false,width,height,format,mip_count);
+        }
+
+        bool build(RoxRender::RoxTexture &tex,const void *data[6],bool cubemap,unsigned int width,unsigned int height,RoxRender::RoxTexture::COLOR_FORMAT format,int mip_count)
+        {
+            if(m_key.empty() || format>RoxRender::RoxTexture::ETC2_A1 || !data[0])
+                return cubemap?tex.buildCubemap(data,width,height,format,mip_count):tex.buildTexture(data[0],width,height,format,mip_count);
+
+            const int faces=cubemap?6:1;
+            const bool pot=(width&(width-1))==0 && (height&(height-1))==0;
+
+            //cpu mipmaps are generated here instead of buildTexture so the whole chain gets cached
+            RoxRender::MipmapSettings settings;
+            RoxMemory::RoxTmpBufferRef mips;
+            if(mip_count<0 && pot && RoxRender::RoxTexture::getCpuMipmaps(&settings) && RoxRender::mipmapIsFormatSupported(format))
+            {
+                mip_count=RoxRender::mipmapLevelsCount(width,height);
+                const size_t size=RoxRender::mipmapChainSize(width,height,format,mip_count);
+                mips.allocate(size*faces);
+                for(int i=0;i<faces;++i)
+                {
+                    RoxRender::mipmapGenerate(data[i],width,height,format,settings,mips.getData(i*size),mip_count);
+                    data[i]=mips.getData(i*size);
+                }
+            }
+
+            header h;
+            memcpy(h.sign,"RTXC",4);
+            h.version=version;
+            h.source_hash=m_source_hash;
+            h.source_time=m_source_time;
+            h.source_size=m_source_size;
+            h.width=width;
+            h.height=height;
+            h.format=format;
+            h.mip_count=mip_count;
+            h.cubemap=cubemap;
+            h.meta=m_meta;
+            h.reserved[0]=h.reserved[1]=0;
+            h.face_size=0;
+            for(int i=0,w=width,hh=height;i<(mip_count>0?mip_count:1);++i,w=w>1?w/2:1,hh=hh>1?hh/2:1)
+                h.face_size+=level_size(w,hh,format);
+
+            RoxMemory::RoxTmpBufferScoped entry(sizeof(h)+h.face_size*faces);
+            entry.copyFrom(&h,sizeof(h));
+            for(int i=0;i<faces;++i)
+                entry.copyFrom(data[i],h.face_size,sizeof(h)+i*h.face_size);
+
+            const bool result=cubemap?tex.buildCubemap(data,width,height,format,mip_count):tex.buildTexture(data[0],width,height,format,mip_count);
+            mips.free();
+            if(result)
+                cache_provider->set(m_key.c_str(),entry.getData(),entry.getSize());
+            return result;
+        }
+
+    public:
+        //source_time is 0 if the provider doesn't know it
+        texture_cache(const char *name,const resource_data &data,uint64_t source_time,const unsigned int *settings,int settings_count):
+            m_source_hash(0),m_source_time(source_time),m_source_size(data.getSize())
+        {
+            if(!init_key(name,settings,settings_count))
+                return;
+
+            if(!source_time)
+                m_source_hash=RoxMemory::hash64(data.getData(),data.getSize());
+            read_meta_values(data.getData(),data.getSize(),m_meta);
+        }
+
+        //looks up without the file data, only sources with a modification time can be found this way
+        texture_cache(const char *name,uint64_t source_size,uint64_t source_time,const unsigned int *settings,int settings_count):
+            m_source_hash(0),m_source_time(source_time),m_source_size(source_size)
+        {
+            if(source_time)
+                init_key(name,settings,settings_count);
+        }
+
+    private:
+        //settings are the load options which change the result
+        bool init_key(const char *name,const unsigned int *settings,int settings_count)
+        {
+            if(!cache_provider || !name)
+                return false;
+
+            RoxRender::MipmapSettings mip_settings;
+            const bool cpu_mipmaps=RoxRender::RoxTexture::getCpuMipmaps(&mip_settings);
+            const unsigned int common[]={RoxRender::RoxTexture::isDxtSupported(),cpu_mipmaps,unsigned(mip_settings.filter),mip_settings.srgb,
+                                         mip_settings.preserveAlphaCoverage,unsigned(mip_settings.alphaCutoff*255.0f)};
+
+            uint64_t key=RoxMemory::hash64(name);
+            key=RoxMemory::hash64(common,sizeof(common),key);
+            key=RoxMemory::hash64(settings,settings_count*sizeof(unsigned int),key);
+
+            char buf[32];
+            snprintf(buf,sizeof(buf),"%016llx",(unsigned long long)key);
+            m_key=buf;
+            return true;
+        }
+
+    private:
+        static const uint32_t version=2;
+
+        struct header
+        {
+            char sign[4];
+            uint32_t version;
+            uint64_t source_hash;
+            uint64_t source_time;
+            uint64_t source_size;
+            uint64_t face_size;
+            uint32_t width,height;
+            uint32_t format;
+            int32_t mip_count;
+            uint32_t cubemap;
+            texture_meta meta;
+            uint32_t reserved[2];
+        };
+
+        std::string m_key;
+        uint64_t m_source_hash;
+        uint64_t m_source_time;
+        uint64_t m_source_size;
+        texture_meta m_meta;
+    };
+
+    bool build_compressed(texture_cache &cache,RoxRender::RoxTexture &tex,const void *data,unsigned int width,unsigned int height,int channels,RoxRender::BlockQuality quality)
+    {
+        typedef unsigned char uchar;
+
+        RoxMemory::RoxTmpBufferScoped rgba(width*height*4);
+        if(channels==3)
+            RoxRender::bitmapRgbToRgba((const uchar *)data,width,height,255,(uchar *)rgba.getData());
+        else
+            rgba.copyFrom(data,width*height*4);
+
+        const bool opaque=channels==3 || RoxRender::bitmapIsFullAlpha((const uchar *)rgba.getData(),width,height);
+        const RoxRender::BlockFormat format=opaque?RoxRender::BLOCK_BC1:RoxRender::BLOCK_BC3;
+
+        const bool pot=(width&(width-1))==0 && (height&(height-1))==0;
+        const int levels=pot?RoxRender::mipmapLevelsCount(width,height):1;
+        RoxMemory::RoxTmpBufferScoped mips(RoxRender::mipmapChainSize(width,height,RoxRender::RoxTexture::COLOR_RGBA,levels));
+        RoxRender::mipmapGenerate(rgba.getData(),width,height,RoxRender::RoxTexture::COLOR_RGBA,RoxRender::MipmapSettings(),mips.getData(),levels);
+
+        size_t size=0;
+        for(int i=0,w=width,h=height;i<levels;++i,w=w>1?w/2:1,h=h>1?h/2:1)
+            size+=RoxRender::blockCompressedSize(w,h,format);
+
+        RoxMemory::RoxTmpBufferScoped compressed(size);
+        const uchar *from=(const uchar *)mips.getData();
+        uchar *to=(uchar *)compressed.getData();
+        for(int i=0,w=width,h=height;i<levels;++i,w=w>1?w/2:1,h=h>1?h/2:1)
+        {
+            RoxRender::blockCompress(from,w,h,format,quality,to);
+            from+=w*h*4;
+            to+=RoxRender::blockCompressedSize(w,h,format);
+        }
+
+        return cache.build(tex,compressed.getData(),width,height,opaque?RoxRender::RoxTexture::DXT1:RoxRender::RoxTexture::DXT5,levels);
+    }
+}
+
 int texture::m_load_ktx_mip_offset=0;
 
 bool texture::load_ktx(shared_texture &res,resource_data &data,const char* name)
@@ -85,6 +357,9 @@ bool texture::load_ktx(shared_texture &res,resource_data &data,const char* name)
     return res.tex.buildTexture(ktx.data,width>0?width:1,height>0?height:1,cf,ktx.mipmap_count-mip_off);
 }
 
+bool texture::m_load_tga_compress=false;
+RoxRender::BlockQuality texture::m_load_tga_compress_quality=RoxRender::BLOCK_QUALITY_FAST;
+
 bool texture::m_load_dds_flip=false;
 int texture::m_load_dds_mip_offset=0;
 
@@ -107,6 +382,12 @@ bool texture::load_dds(shared_texture &res,resource_data &data,const char* name)
         return false;
     }
 
+    unsigned int settings[cache_settings_count];
+    get_cache_settings(settings);
+    texture_cache cache(name,data,res.source_time,settings,cache_settings_count);
+    if(!res.source_time && cache.load(res)) //sources with a time were looked up before the read
+        return true;
+
     if(dds.pixel_format != RoxFormats::DirectDrawSurface::PALETTE8_RGBA && dds.pixel_format != RoxFormats::DirectDrawSurface::PALETTE4_RGBA) //ToDo
     {
         for(int i=0;i<m_load_dds_mip_offset && dds.mipmap_count > 1;++i)
@@ -131,6 +412,8 @@ bool texture::load_dds(shared_texture &res,resource_data &data,const char* name)
         case RoxFormats::DirectDrawSurface::DXT3: cf=RoxRender::RoxTexture::DXT3; break;
         case RoxFormats::DirectDrawSurface::DXT4:
         case RoxFormats::DirectDrawSurface::DXT5: cf=RoxRender::RoxTexture::DXT5; break;
+        case RoxFormats::DirectDrawSurface::BC4:
+        case RoxFormats::DirectDrawSurface::BC5: cf=RoxRender::RoxTexture::COLOR_RGBA; break; //always decoded
 
         case RoxFormats::DirectDrawSurface::BGRA: cf=RoxRender::RoxTexture::COLOR_RGBA; break;
         case RoxFormats::DirectDrawSurface::RGBA: cf=RoxRender::RoxTexture::COLOR_RGBA; break;
@@ -139,7 +422,10 @@ bool texture::load_dds(shared_texture &res,resource_data &data,const char* name)
 
         case RoxFormats::DirectDrawSurface::BGR:
         {
-            RoxRender::bitmapRgbToBgr((unsigned char*)dds.data,dds.width,dds.height,3);
+            size_t size=0;
+            for(int i=0;i<int(dds.mipmap_count);++i)
+                size+=dds.getMipSize(i);
+            RoxRender::bitmapRgbToBgr((unsigned char*)dds.data,int(size/3),1,3); //all mips and faces
             cf=RoxRender::RoxTexture::COLOR_RGB;
         }
         break;
@@ -166,7 +452,9 @@ bool texture::load_dds(shared_texture &res,resource_data &data,const char* name)
 
     bool result=false;
 
-    const bool decode_dxt=cf>=RoxRender::RoxTexture::DXT1 && (!RoxRender::RoxTexture::isDxtSupported() || dds.height%2>0);
+    const bool decode_dxt=dds.isBlockCompressed() && (cf==RoxRender::RoxTexture::COLOR_RGBA || !RoxRender::RoxTexture::isDxtSupported() || dds.height%2>0);
+    if(decode_dxt && mipmap_count>1)
+        mipmap_count= -1; //decoded mipmaps are regenerated, only the top level of every face is decoded
 
     switch(dds.type)
     {
@@ -174,24 +462,17 @@ bool texture::load_dds(shared_texture &res,resource_data &data,const char* name)
         {
             if(decode_dxt)
             {
-                tmp_buf.allocate(dds.getDecodedSize());
-                dds.decodeDxt(tmp_buf.getData());
-                dds.data_size=tmp_buf.getSize();
-                dds.data=tmp_buf.getData();
+                tmp_buf.allocate(dds.getDecodedSize(1));
+                dds.decodeDxt(tmp_buf.getData(),m_load_dds_flip,1);
                 cf=RoxRender::RoxTexture::COLOR_RGBA;
-                dds.pixel_format = RoxFormats::DirectDrawSurface::BGRA;
-                if(mipmap_count>1)
-                    mipmap_count= -1;
+                result=cache.build(res.tex,tmp_buf.getData(),dds.width,dds.height,cf,mipmap_count);
             }
-
-            if(m_load_dds_flip)
+            else
             {
-                RoxMemory::RoxTmpBufferScoped tmp_data(dds.data_size);
-                dds.flipVertical(dds.data,tmp_data.getData());
-                result=res.tex.buildTexture(tmp_data.getData(),dds.width,dds.height,cf,mipmap_count);
+                if(m_load_dds_flip)
+                    dds.flipVertical(dds.data,(void *)dds.data);
+                result=cache.build(res.tex,dds.data,dds.width,dds.height,cf,mipmap_count);
             }
-            else
-                result=res.tex.buildTexture(dds.data,dds.width,dds.height,cf,mipmap_count);
         }
         break;
 
@@ -199,20 +480,18 @@ bool texture::load_dds(shared_texture &res,resource_data &data,const char* name)
         {
             if(decode_dxt)
             {
-                tmp_buf.allocate(dds.getDecodedSize());
-                dds.decodeDxt(tmp_buf.getData());
+                tmp_buf.allocate(dds.getDecodedSize(1));
+                dds.decodeDxt(tmp_buf.getData(),false,1);
                 dds.data_size=tmp_buf.getSize();
                 dds.data=tmp_buf.getData();
                 cf=RoxRender::RoxTexture::COLOR_RGBA;
                 dds.pixel_format = RoxFormats::DirectDrawSurface::BGRA;
-                if(mipmap_count>1)
-                    mipmap_count= -1;
             }
 
             const void *data[6];
             for(int i=0;i<6;++i)
                 data[i]=(const char *)dds.data+i*dds.data_size/6;
-            result=res.tex.buildCubemap(data,dds.width,dds.height,cf,mipmap_count);
+            result=cache.build(res.tex,data,true,dds.width,dds.height,cf,mipmap_count);
         }
         break;
 
@@ -248,20 +527,18 @@ bool texture::load_tga(shared_texture &res,resource_data &data,const char* name)
         default: log()<<"unable to load tga: unsupported color format in file "<<name<<"\n"; return false;
     }
 
-    typedef unsigned char uchar;
+    unsigned int settings[cache_settings_count];
+    get_cache_settings(settings);
+    texture_cache cache(name,data,res.source_time,settings,cache_settings_count);
+    if(!res.source_time && cache.load(res)) //sources with a time were looked up before the read
+        return true;
 
+    //uncompressed images are flipped and swizzled in place in the file data
     RoxMemory::RoxTmpBufferRef tmp_data;
-    const void *color_data=tga.data;
+    void *color_data=(void *)tga.data;
     if(tga.rle)
     {
         tmp_data.allocate(tga.uncompressed_size);
-        if(!tga.decodeRLE(tmp_data.getData()))
-        {
-            tmp_data.free();
-            log()<<"unable to load tga: unable to decode rle in file "<<name<<"\n";
-            return false;
-        }
-
         color_data=tmp_data.getData();
     }
     else if(header_size+tga.uncompressed_size>data.getSize())
@@ -270,81 +547,56 @@ bool texture::load_tga(shared_texture &res,resource_data &data,const char* name)
         return false;
     }
 
-    if(tga.channels==3 || tga.horisontal_flip || tga.vertical_flip)
+    if(!tga.decode(color_data,tga.channels==3))
     {
-        if(!tmp_data.getData())
-        {
-            tmp_data.allocate(tga.uncompressed_size);
-
-            if(tga.horisontal_flip || tga.vertical_flip)
-            {
-                if(tga.horisontal_flip)
-                    tga.flipHorisontal(color_data,tmp_data.getData());
-
-                if(tga.vertical_flip)
-                    tga.flipVertical(color_data,tmp_data.getData());
-            }
-            else
-                tmp_data.copyFrom(color_data,tga.uncompressed_size);
-
-            color_data=tmp_data.getData();
-        }
-        else
-        {
-            if(tga.horisontal_flip)
-                tga.flipHorisontal(tmp_data.getData(),tmp_data.getData());
-
-            if(tga.vertical_flip)
-                tga.flipVertical(tmp_data.getData(),tmp_data.getData());
-        }
-
-        if(tga.channels==3)
-            RoxRender::bitmapRgbToBgr((unsigned char*)color_data,tga.width,tga.height,3);
+        tmp_data.free();
+        log()<<"unable to load tga: unable to decode rle in file "<<name<<"\n";
+        return false;
     }
 
-    const bool result=res.tex.buildTexture(color_data,tga.width,tga.height,color_format);
+    bool result;
+    if(m_load_tga_compress && tga.channels>1 && tga.width%4==0 && tga.height%4==0 && RoxRender::RoxTexture::isDxtSupported())
+        result=build_compressed(cache,res.tex,color_data,tga.width,tga.height,tga.channels,m_load_tga_compress_quality);
+    else
+        result=cache.build(res.tex,color_data,tga.width,tga.height,color_format,-1);
     tmp_data.free();
     read_meta(res,data);
     return result;
 }
 
-inline RoxRender::RoxTexture::WRAP get_wrap(const std::string &s)
+bool texture::read_meta(shared_texture &res,resource_data &data)
 {
-    if(s=="repeat")
-        return RoxRender::RoxTexture::WRAP_REPEAT;
-    if(s=="mirror")
-        return RoxRender::RoxTexture::WRAP_REPEAT_MIRROR;
+    texture_meta meta;
+    if(!read_meta_values(data.getData(),data.getSize(),meta))
+        return false;
+
+    apply_meta(res.tex,meta);
+    return true;
+}
 
-    return RoxRender::RoxTexture::WRAP_CLAMP;
+void texture::get_cache_settings(unsigned int *settings)
+{
+    settings[0]=m_load_dds_flip;
+    settings[1]=unsigned(m_load_dds_mip_offset);
+    settings[2]=m_load_tga_compress;
+    settings[3]=unsigned(m_load_tga_compress_quality);
 }
 
-bool texture::read_meta(shared_texture &res,resource_data &data)
+bool texture::load_cached(shared_texture &res,RoxResources::IRoxResourceData *data,const char *name)
 {
-    RoxFormats::Meta m;
-    if(!m.read(data.getData(),data.getSize()))
+    res.source_time=0;
+    if(!cache_provider || !data)
         return false;
 
-    bool set_wrap=false;
-    RoxRender::RoxTexture::WRAP s,t;
-    s=t=RoxRender::RoxTexture::WRAP_REPEAT;
-
-    for(int i=0;i<(int)m.values.size();++i)
-    {
-        if(m.values[i].first=="nya_wrap_s")
-            s=get_wrap(m.values[i].second),set_wrap=true;
-        else if(m.values[i].first=="nya_wrap_t")
-            t=get_wrap(m.values[i].second),set_wrap=true;
-        else if(m.values[i].first=="nya_aniso")
-        {
-            const int aniso=atoi(m.values[i].second.c_str());
-            res.tex.setAniso(aniso>0?aniso:0);
-        }
-    }
-
-    if(set_wrap)
-        res.tex.setWrap(s,t);
+    res.source_time=data->getModificationTime();
+    unsigned int settings[cache_settings_count];
+    get_cache_settings(settings);
+    return texture_cache(name,data->getSize(),res.source_time,settings,cache_settings_count).load(res);
+}
 
-    return true;
+bool texture::load_partial(shared_texture &res,RoxResources::IRoxResourceData *data,const char *name)
+{
+    return load_streamed(res,data,name) || load_cached(res,data,name);
 }
 
 bool texture_internal::set(int slot) const
@@ -357,6 +609,8 @@ bool texture_internal::set(int slot) const
 
     m_last_slot=slot;
     m_shared->tex.bind(slot);
+    if(m_shared->stream_id)
+        texture::touch_stream(m_shared->stream_id);
 
     return true;
 }
@@ -655,6 +909,12 @@ bool texture::update_region(const texture &source,uint src_x,uint src_y,uint wid
     return update_region(texture_proxy(source),src_x,src_y,width,height,dst_x,dst_y);
 }
 
+void texture::set_cache_provider(RoxRender::IRoxTextureCacheProvider *provider)
+{
+    cache_provider=provider;
+    texture_internal::set_partial_load_function(load_partial);
+}
+
 void texture::set_resources_prefix(const char *prefix)
 {
     texture_internal::set_resources_prefix(prefix);
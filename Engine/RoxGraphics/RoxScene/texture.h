@@ -4,6 +4,7 @@
 
 #include "shared_resources.h"
 #include "RoxRender/RoxTexture.h"
+#include "RoxRender/RoxBlockCompression.h"
 #include "proxy.h"
 
 namespace RoxScene
@@ -12,17 +13,18 @@ namespace RoxScene
 struct shared_texture
 {
     RoxRender::RoxTexture tex;
+    unsigned int stream_id; //non-zero while the mipmaps are streamed
+    uint64_t source_time; //modification time of the file being loaded, 0 if unknown
 
-    bool release()
-    {
-        tex.release();
-        return true;
-    }
+    shared_texture(): stream_id(0),source_time(0) {}
+
+    bool release();
 };
 
 class texture_internal: public scene_shared<shared_texture>
 {
     friend class texture;
+    friend class texture_atlas;
 
 public:
     bool set(int slot=0) const;
@@ -53,7 +55,7 @@ public:
     void unload() { return m_internal.unload(); }
 
 public:
-    void create(const shared_texture &res) { m_internal.create(res); }
+    void create(const shared_texture &res);
 
 public:
     typedef RoxRender::RoxTexture::COLOR_FORMAT color_format;
@@ -90,8 +92,35 @@ public:
     static void set_dds_mip_offset(int off) { m_load_dds_mip_offset=off; }
     static void set_ktx_mip_offset(int off) { m_load_ktx_mip_offset=off; }
 
+    //rgb and rgba tga with sides multiple of 4 are stored as DXT1/DXT5 when supported, mipmaps are generated on cpu
+    static void set_load_tga_compression(bool enable,RoxRender::BlockQuality quality=RoxRender::BLOCK_QUALITY_FAST)
+    {
+        m_load_tga_compress=enable;
+        m_load_tga_compress_quality=quality;
+    }
+
     static bool read_meta(shared_texture &res,resource_data &data);
 
+    //tga and dds are stored as they are uploaded, mipmaps included when generated on cpu, 0 to disable
+    static void set_cache_provider(RoxRender::IRoxTextureCacheProvider *provider);
+
+public:
+    //2d dds and ktx with pot sides and complete mipmaps load only the mips up to min_size, higher ones are read in the background
+    //mip offsets still cap the quality of streamed textures
+    static void set_streaming(bool enable,unsigned int min_size=64);
+    static void set_streaming_budget(size_t bytes); //0 for unlimited, least recently used textures lose their high mips first
+    static void set_streaming_distance(float full_quality_distance,int mip_bias=0); //each doubling of the distance drops a mip
+    static size_t get_streaming_memory();
+
+    //call once per frame from the render thread, uploads finished mips and evicts over the budget
+    static void update_streaming();
+
+    //bound textures want all their mips, requests made in the same frame lower that
+    void request_stream_size(unsigned int size) const; //larger side in texels
+    void request_stream_distance(float distance) const;
+
+    static bool load_streamed(shared_texture &res,RoxResources::IRoxResourceData *data,const char *name);
+
 public:
     static void set_resources_prefix(const char *prefix);
     static void register_load_function(texture_internal::load_function function,bool clear_default=true);
@@ -99,11 +128,24 @@ public:
 public:
     const texture_internal &internal() const { return m_internal; }
 
+private:
+    friend class texture_internal;
+    friend class texture_atlas;
+    static void touch_stream(unsigned int id);
+
+    //the cache is looked up before the file is read, streamed textures are tried first
+    static bool load_partial(shared_texture &res,RoxResources::IRoxResourceData *data,const char *name);
+    static bool load_cached(shared_texture &res,RoxResources::IRoxResourceData *data,const char *name);
+    enum { cache_settings_count=4 };
+    static void get_cache_settings(unsigned int *settings); //loader options which change the cached result
+
 private:
     texture_internal m_internal;
     static bool m_load_dds_flip;
     static int m_load_dds_mip_offset;
     static int m_load_ktx_mip_offset;
+    static bool m_load_tga_compress;
+    static RoxRender::BlockQuality m_load_tga_compress_quality;
 };
 
 }
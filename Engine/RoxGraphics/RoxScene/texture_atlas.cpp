@@ -0,0 +1,399 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#include "texture_atlas.h"
+#include "RoxScene.h"
+#include "RoxRender/RoxBitmap.h"
+#include "RoxMemory/RoxInvalidObject.h"
+#include "RoxMemory/RoxTmpBuffers.h"
+#include <algorithm>
+#include <cstring>
+
+namespace RoxScene
+{
+
+namespace
+{
+    struct placement
+    {
+        int page;
+        unsigned int x,y;
+    };
+
+    template<typename e> struct larger_first
+    {
+        bool operator()(const e *a,const e *b) const
+        {
+            if(a->height!=b->height)
+                return a->height>b->height;
+            return a->width>b->width;
+        }
+    };
+}
+
+void texture_atlas::init(unsigned int page_width,unsigned int page_height,unsigned int padding,int max_pages)
+{
+    release();
+
+    m_page_width=page_width;
+    m_page_height=page_height;
+    m_padding=padding;
+    m_max_pages=max_pages>0?max_pages:1;
+}
+
+void texture_atlas::release()
+{
+    m_entries.clear();
+    for(size_t i=0;i<m_pages.size();++i)
+        m_pages[i].tex.unload();
+    m_pages.clear();
+    m_stamp=0;
+}
+
+bool texture_atlas::add(const char *name)
+{
+    texture tex;
+    if(!tex.load(name))
+        return false;
+
+    const bool result=add(name,tex);
+    tex.unload();
+    return result;
+}
+
+bool texture_atlas::add(const char *name,const texture &tex)
+{
+    const unsigned int width=tex.get_width(),height=tex.get_height();
+    RoxMemory::RoxTmpBufferScoped data(tex.get_data());
+    if(!data.getSize())
+    {
+        log()<<"unable to add texture to atlas: unable to get data of "<<(name?name:"")<<"\n";
+        return false;
+    }
+
+    switch(tex.get_format())
+    {
+        case RoxRender::RoxTexture::COLOR_RGBA: return add(name,data.getData(),width,height);
+
+        case RoxRender::RoxTexture::COLOR_BGRA:
+            RoxRender::bitmapRgbToBgr((uint8_t *)data.getData(),width,height,4);
+            return add(name,data.getData(),width,height);
+
+        case RoxRender::RoxTexture::COLOR_RGB:
+        {
+            RoxMemory::RoxTmpBufferScoped rgba(width*height*4);
+            RoxRender::bitmapRgbToRgba((const uint8_t *)data.getData(),width,height,255,(uint8_t *)rgba.getData());
+            return add(name,rgba.getData(),width,height);
+        }
+
+        default: break;
+    }
+
+    log()<<"unable to add texture to atlas: unsupported format of "<<(name?name:"")<<"\n";
+    return false;
+}
+
+bool texture_atlas::add(const char *name,const void *rgba,unsigned int width,unsigned int height)
+{
+    if(!name || !rgba || !width || !height)
+        return false;
+
+    if(!m_page_width || !m_page_height)
+    {
+        log()<<"unable to add texture to atlas: atlas is not initialised\n";
+        return false;
+    }
+
+    unsigned int align=1;
+    while(align<m_padding)
+        align*=2;
+
+    const unsigned int pad=m_padding;
+    const unsigned int padded_width=(width+pad*2+align-1)/align*align;
+    const unsigned int padded_height=(height+pad*2+align-1)/align*align;
+    if(padded_width>m_page_width || padded_height>m_page_height)
+    {
+        log()<<"unable to add texture to atlas: "<<name<<" is larger than the atlas page\n";
+        return false;
+    }
+
+    entries_map::iterator it=m_entries.find(name);
+    const bool existed=it!=m_entries.end();
+    if(!existed)
+    {
+        it=m_entries.insert(std::make_pair(std::string(name),entry())).first;
+    }
+
+    entry &e=it->second;
+    const bool same_place=existed && e.page>=0 && e.width==padded_width && e.height==padded_height;
+
+    e.width=padded_width;
+    e.height=padded_height;
+    e.inner_width=width;
+    e.inner_height=height;
+    e.stamp=++m_stamp;
+
+    //edge texels are repeated into the padding so filtering and mips don't pick up the neighbours
+    e.rgba.resize(size_t(padded_width)*padded_height*4);
+    const unsigned char *src=(const unsigned char *)rgba;
+    for(unsigned int y=0;y<padded_height;++y)
+    {
+        const unsigned int sy=y<pad?0:std::min(y-pad,height-1);
+        unsigned char *row=&e.rgba[size_t(y)*padded_width*4];
+        const unsigned char *src_row=src+size_t(sy)*width*4;
+        for(unsigned int x=0;x<pad;++x)
+            memcpy(row+x*4,src_row,4);
+        memcpy(row+pad*4,src_row,width*4);
+        for(unsigned int x=pad+width;x<padded_width;++x)
+            memcpy(row+x*4,src_row+(width-1)*4,4);
+    }
+
+    if(same_place)
+    {
+        update_entry(e);
+        return true;
+    }
+
+    e.page= -1;
+    if(place(e))
+        return true;
+
+    m_entries.erase(it);
+    log()<<"unable to add texture to atlas: no space left for "<<name<<"\n";
+    return false;
+}
+
+bool texture_atlas::place(entry &e)
+{
+    for(int i=0;i<(int)m_pages.size();++i)
+    {
+        if(!m_pages[i].packer.add(e.width,e.height,e.x,e.y))
+            continue;
+
+        e.page=i;
+        update_entry(e);
+        return true;
+    }
+
+    if((int)m_pages.size()<m_max_pages)
+    {
+        m_pages.resize(m_pages.size()+1);
+        page &p=m_pages.back();
+        p.packer.init(m_page_width,m_page_height);
+
+        RoxMemory::RoxTmpBufferScoped empty(size_t(m_page_width)*m_page_height*4);
+        memset(empty.getData(),0,empty.getSize());
+        if(!p.tex.build(empty.getData(),m_page_width,m_page_height,RoxRender::RoxTexture::COLOR_RGBA))
+        {
+            m_pages.pop_back();
+            return false;
+        }
+
+        return place(e);
+    }
+
+    //an evicted slot is reused as is when the entry fits, other holes only after repacking the whole pages
+    entries_map::iterator slot=find_unused(e.width,e.height);
+    if(slot!=m_entries.end())
+    {
+        e.page=slot->second.page;
+        e.x=slot->second.x;
+        e.y=slot->second.y;
+        m_entries.erase(slot);
+        update_entry(e);
+        return true;
+    }
+
+    while(!repack())
+    {
+        slot=find_unused(0,0);
+        if(slot==m_entries.end())
+            return false;
+
+        m_entries.erase(slot);
+    }
+
+    return true;
+}
+
+bool texture_atlas::repack()
+{
+    std::vector<entry *> order;
+    order.reserve(m_entries.size());
+    for(entries_map::iterator it=m_entries.begin();it!=m_entries.end();++it)
+        order.push_back(&it->second);
+    std::stable_sort(order.begin(),order.end(),larger_first<entry>());
+
+    for(size_t pages_count=1;pages_count<=m_pages.size();++pages_count)
+    {
+        std::vector<RoxRender::RoxAtlasPacker> packers(pages_count,RoxRender::RoxAtlasPacker(m_page_width,m_page_height));
+        std::vector<placement> places(order.size());
+
+        bool fits=true;
+        for(size_t i=0;i<order.size() && fits;++i)
+        {
+            fits=false;
+            for(size_t j=0;j<packers.size() && !fits;++j)
+            {
+                if(packers[j].add(order[i]->width,order[i]->height,places[i].x,places[i].y))
+                {
+                    places[i].page=int(j);
+                    fits=true;
+                }
+            }
+        }
+
+        if(!fits)
+            continue;
+
+        for(size_t i=pages_count;i<m_pages.size();++i)
+            m_pages[i].tex.unload();
+        m_pages.resize(pages_count);
+
+        for(size_t i=0;i<pages_count;++i)
+            m_pages[i].packer=packers[i];
+
+        for(size_t i=0;i<order.size();++i)
+        {
+            order[i]->page=places[i].page;
+            order[i]->x=places[i].x;
+            order[i]->y=places[i].y;
+        }
+
+        for(int i=0;i<(int)m_pages.size();++i)
+            upload_page(i);
+
+        return true;
+    }
+
+    return false;
+}
+
+texture_atlas::entries_map::iterator texture_atlas::find_unused(unsigned int width,unsigned int height)
+{
+    entries_map::iterator oldest=m_entries.end();
+    for(entries_map::iterator it=m_entries.begin();it!=m_entries.end();++it)
+    {
+        const entry &e=it->second;
+        if(e.page<0 || e.width<width || e.height<height || e.tex.getRefCount()>1 || e.rect.getRefCount()>1)
+            continue;
+
+        if(oldest==m_entries.end() || e.stamp<oldest->second.stamp)
+            oldest=it;
+    }
+
+    return oldest;
+}
+
+void texture_atlas::remove(const char *name)
+{
+    if(name)
+        m_entries.erase(name);
+}
+
+int texture_atlas::release_unused()
+{
+    int count=0;
+    for(entries_map::iterator it=m_entries.begin();it!=m_entries.end();)
+    {
+        if(it->second.tex.getRefCount()>1 || it->second.rect.getRefCount()>1)
+        {
+            ++it;
+            continue;
+        }
+
+        m_entries.erase(it++);
+        ++count;
+    }
+
+    return count;
+}
+
+void texture_atlas::defragment()
+{
+    if(m_entries.empty())
+    {
+        for(size_t i=0;i<m_pages.size();++i)
+            m_pages[i].tex.unload();
+        m_pages.clear();
+        return;
+    }
+
+    repack();
+}
+
+float texture_atlas::get_occupancy() const
+{
+    if(m_pages.empty())
+        return 0.0f;
+
+    size_t area=0;
+    for(entries_map::const_iterator it=m_entries.begin();it!=m_entries.end();++it)
+        area+=size_t(it->second.width)*it->second.height;
+
+    return float(area)/(float(m_page_width)*m_page_height*m_pages.size());
+}
+
+const texture_proxy &texture_atlas::get_texture(const char *name) const
+{
+    if(!name)
+        return RoxMemory::invalidObject<texture_proxy>();
+
+    entries_map::const_iterator it=m_entries.find(name);
+    if(it==m_entries.end())
+        return RoxMemory::invalidObject<texture_proxy>();
+
+    return it->second.tex;
+}
+
+const texture_atlas::rect_proxy &texture_atlas::get_rect(const char *name) const
+{
+    if(!name)
+        return RoxMemory::invalidObject<rect_proxy>();
+
+    entries_map::const_iterator it=m_entries.find(name);
+    if(it==m_entries.end())
+        return RoxMemory::invalidObject<rect_proxy>();
+
+    return it->second.rect;
+}
+
+RoxRender::RoxTexture &texture_atlas::page_texture(int idx)
+{
+    texture_internal::shared_resources::RoxSharedResourceMutableRef ref=texture_internal::shared_resources::modify(m_pages[idx].tex.m_internal.m_shared);
+    return ref->tex;
+}
+
+void texture_atlas::update_entry(entry &e)
+{
+    page_texture(e.page).updateRegion(&e.rgba[0],e.x,e.y,e.width,e.height);
+    update_proxies(e);
+}
+
+void texture_atlas::update_proxies(entry &e)
+{
+    e.rect.set(RoxMath::Vector4(float(e.x+m_padding)/m_page_width,float(e.y+m_padding)/m_page_height,
+                                float(e.inner_width)/m_page_width,float(e.inner_height)/m_page_height));
+    e.tex.set(m_pages[e.page].tex);
+}
+
+void texture_atlas::upload_page(int idx)
+{
+    RoxMemory::RoxTmpBufferScoped buf(size_t(m_page_width)*m_page_height*4);
+    memset(buf.getData(),0,buf.getSize());
+
+    for(entries_map::iterator it=m_entries.begin();it!=m_entries.end();++it)
+    {
+        entry &e=it->second;
+        if(e.page!=idx)
+            continue;
+
+        for(unsigned int y=0;y<e.height;++y)
+            memcpy(buf.getData((size_t(e.y+y)*m_page_width+e.x)*4),&e.rgba[size_t(y)*e.width*4],e.width*4);
+
+        update_proxies(e);
+    }
+
+    page_texture(idx).buildTexture(buf.getData(),m_page_width,m_page_height,RoxRender::RoxTexture::COLOR_RGBA);
+}
+
+}
@@ -0,0 +1,89 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#pragma once
+
+#include "texture.h"
+#include "RoxMath/RoxVector.h"
+#include "RoxRender/RoxAtlasPacker.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace RoxScene
+{
+
+//packs small rgba textures into shared pages to save texture binds
+//each entry has its own texture and uv rect proxies, they follow the entry when pages are repacked
+class texture_atlas
+{
+public:
+    typedef proxy<RoxMath::Vector4> rect_proxy; //uv*zw+xy maps the texture uv into the page
+
+public:
+    //pot pages keep mipmaps, padding is filled with the edge texels and keeps mips up to log2(padding) from bleeding
+    void init(unsigned int page_width=1024,unsigned int page_height=1024,unsigned int padding=4,int max_pages=4);
+    void release();
+
+public:
+    bool add(const char *name); //loads the texture
+    bool add(const char *name,const texture &tex);
+    bool add(const char *name,const void *rgba,unsigned int width,unsigned int height);
+    void remove(const char *name);
+    bool contains(const char *name) const { return name && m_entries.find(name)!=m_entries.end(); }
+
+    const texture_proxy &get_texture(const char *name) const;
+    const rect_proxy &get_rect(const char *name) const;
+
+public:
+    //entries which proxies are held only by the atlas are kept until the space is needed, least recently added go first
+    int release_unused();
+    void defragment();
+
+    int get_pages_count() const { return (int)m_pages.size(); }
+    float get_occupancy() const;
+
+public:
+    texture_atlas(): m_page_width(0),m_page_height(0),m_padding(0),m_max_pages(0),m_stamp(0) {}
+
+private:
+    struct entry
+    {
+        texture_proxy tex;
+        rect_proxy rect;
+        std::vector<unsigned char> rgba; //with the padding, kept for repacking
+        unsigned int width,height; //with the padding rounded up
+        unsigned int inner_width,inner_height;
+        unsigned int x,y;
+        int page;
+        unsigned int stamp;
+
+        //the proxies have no copy assignment, they are created valid here
+        entry(): tex(texture()),rect(RoxMath::Vector4()),width(0),height(0),inner_width(0),inner_height(0),x(0),y(0),page(-1),stamp(0) {}
+    };
+
+    struct page
+    {
+        texture tex;
+        RoxRender::RoxAtlasPacker packer;
+    };
+
+    typedef std::map<std::string,entry> entries_map;
+
+    bool place(entry &e);
+    bool repack();
+    entries_map::iterator find_unused(unsigned int width,unsigned int height); //least recently added
+    void update_entry(entry &e);
+    void update_proxies(entry &e);
+    void upload_page(int idx);
+    RoxRender::RoxTexture &page_texture(int idx); //shared by the entries, modified in place
+
+private:
+    std::vector<page> m_pages;
+    entries_map m_entries;
+    unsigned int m_page_width,m_page_height;
+    unsigned int m_padding;
+    int m_max_pages;
+    unsigned int m_stamp;
+};
+
+}
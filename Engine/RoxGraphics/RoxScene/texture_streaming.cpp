@@ -0,0 +1,578 @@
+//nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+#include "texture.h"
+#include "RoxScene.h"
+#include "RoxMemory/RoxTmpBuffers.h"
+#include "RoxFormats/RoxDirectDrawSurface.h"
+#include "RoxFormats/RoxKhronosTexture.h"
+#include "RoxRender/RoxBitmap.h"
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RoxScene
+{
+
+namespace
+{
+    struct stream_layout
+    {
+        std::string name;
+        bool ktx;
+        bool flip;
+        bool swap_rb;
+        RoxFormats::DirectDrawSurface::PIXEL_FORMAT dds_format;
+        RoxRender::RoxTexture::COLOR_FORMAT format;
+        unsigned int width,height;
+        std::vector<size_t> offsets; //file offset of each mip and the data end, ktx offsets point to the size prefix
+        std::vector<size_t> sizes;
+
+        int count() const { return (int)sizes.size(); }
+        unsigned int mip_width(int mip) const { return width>>mip?width>>mip:1; }
+        unsigned int mip_height(int mip) const { return height>>mip?height>>mip:1; }
+
+        size_t bytes(int mip) const
+        {
+            size_t size=0;
+            for(int i=mip;i<count();++i)
+                size+=sizes[i];
+            return size;
+        }
+
+        stream_layout(): ktx(false),flip(false),swap_rb(false),dds_format(RoxFormats::DirectDrawSurface::RGBA),
+                         format(RoxRender::RoxTexture::COLOR_RGBA),width(0),height(0) {}
+    };
+
+    struct stream_state
+    {
+        shared_texture *res;
+        stream_layout layout;
+        std::vector<char> meta;
+        int top,base;
+        int resident,target,loading,requested;
+        bool used;
+        unsigned int last_used;
+    };
+
+    bool read_mips(RoxResources::IRoxResourceData *data,const stream_layout &l,int mip,RoxMemory::RoxTmpBufferRef &buf)
+    {
+        const size_t offset=l.offsets[mip];
+        const size_t size=l.offsets.back()-offset;
+        buf.allocate(size);
+        if(!data->readChunk(buf.getData(),size,offset))
+        {
+            buf.free();
+            return false;
+        }
+
+        char *d=(char *)buf.getData();
+        if(l.ktx)
+        {
+            size_t from=0,to=0;
+            for(int i=mip;i<l.count();++i)
+            {
+                unsigned int mip_size;
+                memcpy(&mip_size,d+from,sizeof(mip_size));
+                if(mip_size!=l.sizes[i])
+                {
+                    buf.free();
+                    return false;
+                }
+
+                memmove(d+to,d+from+sizeof(mip_size),mip_size);
+                from+=sizeof(mip_size)+mip_size;
+                to+=mip_size;
+            }
+            return true;
+        }
+
+        const size_t mips_size=l.bytes(mip);
+        if(l.swap_rb)
+            RoxRender::bitmapRgbToBgr((uint8_t *)d,int(mips_size/3),1,3);
+
+        if(l.flip)
+        {
+            RoxFormats::DirectDrawSurface dds;
+            dds.width=l.mip_width(mip);
+            dds.height=l.mip_height(mip);
+            dds.mipmap_count=l.count()-mip;
+            dds.pixel_format=l.dds_format;
+            dds.type=RoxFormats::DirectDrawSurface::TEXTURE_2D;
+
+            RoxMemory::RoxTmpBufferRef flipped(mips_size);
+            dds.flipVertical(d,flipped.getData());
+            buf.free();
+            buf=flipped;
+        }
+
+        return true;
+    }
+
+    bool dds_layout(const void *header,size_t size,stream_layout &l)
+    {
+        RoxFormats::DirectDrawSurface dds;
+        const size_t offset=dds.decodeHeaderInfo(header,size);
+        if(!offset || dds.type!=RoxFormats::DirectDrawSurface::TEXTURE_2D || dds.need_generate_mipmaps)
+            return false;
+
+        switch(dds.pixel_format)
+        {
+            case RoxFormats::DirectDrawSurface::DXT1: l.format=RoxRender::RoxTexture::DXT1; break;
+            case RoxFormats::DirectDrawSurface::DXT2:
+            case RoxFormats::DirectDrawSurface::DXT3: l.format=RoxRender::RoxTexture::DXT3; break;
+            case RoxFormats::DirectDrawSurface::DXT4:
+            case RoxFormats::DirectDrawSurface::DXT5: l.format=RoxRender::RoxTexture::DXT5; break;
+
+            case RoxFormats::DirectDrawSurface::BGRA:
+            case RoxFormats::DirectDrawSurface::RGBA: l.format=RoxRender::RoxTexture::COLOR_RGBA; break;
+            case RoxFormats::DirectDrawSurface::BGR: l.swap_rb=true; //fallthrough
+            case RoxFormats::DirectDrawSurface::RGB: l.format=RoxRender::RoxTexture::COLOR_RGB; break;
+            case RoxFormats::DirectDrawSurface::GREYSCALE: l.format=RoxRender::RoxTexture::GREYSCALE; break;
+
+            default: return false; //decoded on load
+        }
+
+        if(dds.isBlockCompressed() && !RoxRender::RoxTexture::isDxtSupported())
+            return false;
+
+        l.dds_format=dds.pixel_format;
+        l.width=dds.width;
+        l.height=dds.height;
+        l.offsets.push_back(offset);
+        for(int i=0;i<int(dds.mipmap_count);++i)
+        {
+            l.sizes.push_back(dds.getMipSize(i));
+            l.offsets.push_back(l.offsets.back()+l.sizes.back());
+        }
+
+        return true;
+    }
+
+    bool ktx_layout(const void *header,size_t size,stream_layout &l)
+    {
+        RoxFormats::KhronosTexture ktx;
+        const size_t offset=ktx.decodeHeaderInfo(header,size);
+        if(!offset)
+            return false;
+
+        switch(ktx.pf)
+        {
+            case RoxFormats::KhronosTexture::RGB: l.format=RoxRender::RoxTexture::COLOR_RGB; break;
+            case RoxFormats::KhronosTexture::RGBA:
+            case RoxFormats::KhronosTexture::BGRA: l.format=RoxRender::RoxTexture::COLOR_RGBA; break;
+
+            case RoxFormats::KhronosTexture::ETC1: l.format=RoxRender::RoxTexture::ETC1; break;
+            case RoxFormats::KhronosTexture::ETC2: l.format=RoxRender::RoxTexture::ETC2; break;
+            case RoxFormats::KhronosTexture::ETC2_EAC: l.format=RoxRender::RoxTexture::ETC2_EAC; break;
+            case RoxFormats::KhronosTexture::ETC2_A1: l.format=RoxRender::RoxTexture::ETC2_A1; break;
+
+            //pvr needs square textures, dropped mips keep the aspect
+            case RoxFormats::KhronosTexture::PVR_RGB2B: l.format=RoxRender::RoxTexture::PVR_RGB2B; break;
+            case RoxFormats::KhronosTexture::PVR_RGB4B: l.format=RoxRender::RoxTexture::PVR_RGB4B; break;
+            case RoxFormats::KhronosTexture::PVR_RGBA2B: l.format=RoxRender::RoxTexture::PVR_RGBA2B; break;
+            case RoxFormats::KhronosTexture::PVR_RGBA4B: l.format=RoxRender::RoxTexture::PVR_RGBA4B; break;
+
+            default: return false;
+        }
+
+        l.ktx=true;
+        l.width=ktx.width;
+        l.height=ktx.height;
+        l.offsets.push_back(offset);
+        for(int i=0;i<int(ktx.mipmap_count);++i)
+        {
+            l.sizes.push_back(ktx.getMipSize(i));
+            l.offsets.push_back(l.offsets.back()+sizeof(unsigned int)+l.sizes.back());
+        }
+
+        return true;
+    }
+
+    struct stream_job
+    {
+        unsigned int id;
+        int mip;
+        stream_layout layout;
+    };
+
+    struct stream_result
+    {
+        unsigned int id;
+        int mip;
+        bool ok;
+        RoxMemory::RoxTmpBufferRef data;
+    };
+
+    class stream_loader
+    {
+    public:
+        void push(const stream_job &job)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(!m_thread.joinable())
+                m_thread=std::thread(&stream_loader::work,this);
+
+            m_jobs.push_back(job);
+            m_wake.notify_one();
+        }
+
+        bool pop(stream_result &result)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(m_results.empty())
+                return false;
+
+            result=m_results.front();
+            m_results.pop_front();
+            return true;
+        }
+
+    public:
+        stream_loader(): m_quit(false) {}
+
+        ~stream_loader()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_quit=true;
+                m_wake.notify_one();
+            }
+
+            if(m_thread.joinable())
+                m_thread.join();
+
+            for(size_t i=0;i<m_results.size();++i)
+                m_results[i].data.free();
+        }
+
+    private:
+        void work()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while(true)
+            {
+                m_wake.wait(lock,[this]{ return m_quit || !m_jobs.empty(); });
+                if(m_quit)
+                    return;
+
+                const stream_job job=m_jobs.front();
+                m_jobs.pop_front();
+                lock.unlock();
+
+                stream_result result;
+                result.id=job.id;
+                result.mip=job.mip;
+                result.ok=false;
+
+                RoxResources::IRoxResourceData *data=RoxResources::getResourcesProvider().access(job.layout.name.c_str());
+                if(data)
+                {
+                    result.ok=data->getSize()>=job.layout.offsets.back() && read_mips(data,job.layout,job.mip,result.data);
+                    data->release();
+                }
+
+                lock.lock();
+                m_results.push_back(result);
+            }
+        }
+
+    private:
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::deque<stream_job> m_jobs;
+        std::deque<stream_result> m_results;
+        bool m_quit;
+    };
+
+    struct streaming
+    {
+        bool enabled;
+        unsigned int min_size;
+        size_t budget;
+        float distance;
+        int mip_bias;
+        unsigned int frame;
+        unsigned int last_id;
+        std::map<unsigned int,stream_state> textures;
+        stream_loader loader;
+
+        streaming(): enabled(false),min_size(64),budget(0),distance(0.0f),mip_bias(0),frame(0),last_id(0) {}
+    };
+
+    streaming &get_streaming()
+    {
+        static streaming s;
+        return s;
+    }
+
+    stream_state *find_stream(unsigned int id)
+    {
+        if(!id)
+            return 0;
+
+        std::map<unsigned int,stream_state>::iterator it=get_streaming().textures.find(id);
+        return it==get_streaming().textures.end()?0:&it->second;
+    }
+
+    bool build_stream(stream_state &s,int mip,const void *data)
+    {
+        const stream_layout &l=s.layout;
+        if(!s.res->tex.buildTexture(data,l.mip_width(mip),l.mip_height(mip),l.format,l.count()-mip))
+            return false;
+
+        if(!s.meta.empty())
+        {
+            resource_data meta(s.meta.size());
+            meta.copyFrom(&s.meta[0],s.meta.size());
+            texture::read_meta(*s.res,meta);
+            meta.free();
+        }
+
+        s.resident=mip;
+        return true;
+    }
+
+    void request_mip(unsigned int id,int mip)
+    {
+        stream_state *s=find_stream(id);
+        if(!s)
+            return;
+
+        s->requested=s->requested<0?mip:std::min(s->requested,mip);
+        s->last_used=get_streaming().frame;
+    }
+}
+
+bool shared_texture::release()
+{
+    if(stream_id)
+        get_streaming().textures.erase(stream_id);
+    stream_id=0;
+
+    tex.release();
+    return true;
+}
+
+void texture::create(const shared_texture &res)
+{
+    shared_texture copy=res;
+    copy.stream_id=0; //streamed mips stay with the loaded resource
+    m_internal.create(copy);
+}
+
+bool texture::load_streamed(shared_texture &res,RoxResources::IRoxResourceData *data,const char *name)
+{
+    streaming &st=get_streaming();
+    if(!st.enabled || !data || !name)
+        return false;
+
+    char header[128];
+    const size_t file_size=data->getSize();
+    if(file_size<sizeof(header) || !data->readChunk(header,sizeof(header)))
+        return false;
+
+    stream_layout l;
+    int top=0;
+    if(memcmp(header,"DDS ",4)==0)
+    {
+        if(!dds_layout(header,sizeof(header),l))
+            return false;
+
+        l.flip=m_load_dds_flip;
+        top=m_load_dds_mip_offset;
+    }
+    else if(memcmp(header+1,"KTX ",4)==0)
+    {
+        if(!ktx_layout(header,sizeof(header),l))
+            return false;
+
+        top=m_load_ktx_mip_offset;
+    }
+    else
+        return false;
+
+    const bool pot=(l.width&(l.width-1))==0 && (l.height&(l.height-1))==0;
+    if(!pot || l.count()<2 || l.offsets.back()>file_size)
+        return false;
+
+    const bool block=l.format>=RoxRender::RoxTexture::DXT1;
+    int base=0;
+    while(base+1<l.count() && std::max(l.mip_width(base),l.mip_height(base))>st.min_size)
+        ++base;
+    while(block && base>0 && std::min(l.mip_width(base),l.mip_height(base))<4)
+        --base;
+
+    l.name=name;
+
+    stream_state s;
+    s.res=&res;
+    s.layout=l;
+    s.top=std::max(0,std::min(top,base));
+    s.base=base;
+    s.resident=s.target=base;
+    s.loading=s.requested=-1;
+    s.used=false;
+    s.last_used=st.frame;
+
+    const size_t meta_from=std::min(l.offsets.back(),file_size-sizeof(header)); //meta reader wants at least 128 bytes
+    if(file_size>l.offsets.back())
+    {
+        s.meta.resize(file_size-meta_from);
+        if(!data->readChunk(&s.meta[0],s.meta.size(),meta_from))
+            s.meta.clear();
+    }
+
+    RoxMemory::RoxTmpBufferRef buf;
+    if(!read_mips(data,l,base,buf))
+    {
+        log()<<"unable to stream texture: unable to read mipmaps from file "<<name<<"\n";
+        return false;
+    }
+
+    const bool result=build_stream(s,base,buf.getData());
+    buf.free();
+    if(!result)
+        return false;
+
+    res.stream_id=++st.last_id;
+    st.textures[res.stream_id]=s;
+    return true;
+}
+
+void texture::set_streaming(bool enable,unsigned int min_size)
+{
+    get_streaming().enabled=enable;
+    get_streaming().min_size=min_size>0?min_size:1;
+    texture_internal::set_partial_load_function(load_partial);
+}
+
+void texture::set_streaming_budget(size_t bytes) { get_streaming().budget=bytes; }
+
+void texture::set_streaming_distance(float full_quality_distance,int mip_bias)
+{
+    get_streaming().distance=full_quality_distance;
+    get_streaming().mip_bias=mip_bias;
+}
+
+size_t texture::get_streaming_memory()
+{
+    size_t size=0;
+    for(std::map<unsigned int,stream_state>::const_iterator it=get_streaming().textures.begin();it!=get_streaming().textures.end();++it)
+        size+=it->second.layout.bytes(it->second.resident);
+    return size;
+}
+
+void texture::update_streaming()
+{
+    streaming &st=get_streaming();
+    typedef std::map<unsigned int,stream_state>::iterator iterator;
+
+    stream_result r;
+    while(st.loader.pop(r))
+    {
+        stream_state *s=find_stream(r.id);
+        if(s && s->loading==r.mip)
+        {
+            s->loading=-1;
+            if(!r.ok || !build_stream(*s,r.mip,r.data.getData()))
+            {
+                log()<<"unable to stream texture: unable to read mipmaps from file "<<s->layout.name<<"\n";
+                s->top=s->base=s->target=s->resident; //don't retry every frame
+            }
+        }
+        r.data.free();
+    }
+
+    std::vector<stream_state *> lru;
+    size_t planned=0;
+    for(iterator it=st.textures.begin();it!=st.textures.end();++it)
+    {
+        stream_state &s=it->second;
+        if(s.requested>=0)
+            s.target=s.requested+st.mip_bias;
+        else if(s.used)
+            s.target=st.mip_bias;
+
+        s.target=std::max(s.top,std::min(s.target,s.base));
+        s.requested=-1;
+        s.used=false;
+
+        planned+=s.layout.bytes(s.target);
+        lru.push_back(&s);
+    }
+
+    if(st.budget && planned>st.budget)
+    {
+        struct older { bool operator()(const stream_state *a,const stream_state *b) const { return a->last_used<b->last_used; } };
+        std::stable_sort(lru.begin(),lru.end(),older());
+
+        for(size_t i=0;i<lru.size() && planned>st.budget;++i)
+        {
+            stream_state &s=*lru[i];
+            while(s.target<s.base && planned>st.budget)
+            {
+                planned-=s.layout.sizes[s.target];
+                ++s.target;
+            }
+        }
+    }
+
+    for(size_t i=0;i<lru.size();++i)
+    {
+        stream_state &s=*lru[i];
+        if(s.loading>=0 || s.target==s.resident)
+            continue;
+
+        stream_job job;
+        job.id=s.res->stream_id;
+        job.mip=s.loading=s.target;
+        job.layout=s.layout;
+        st.loader.push(job);
+    }
+
+    ++st.frame;
+}
+
+void texture::touch_stream(unsigned int id)
+{
+    stream_state *s=find_stream(id);
+    if(!s)
+        return;
+
+    s->used=true;
+    s->last_used=get_streaming().frame;
+}
+
+void texture::request_stream_size(unsigned int size) const
+{
+    if(!internal().get_shared_data().isValid())
+        return;
+
+    const unsigned int id=internal().get_shared_data()->stream_id;
+    const stream_state *s=find_stream(id);
+    if(!s)
+        return;
+
+    int mip=0;
+    while(mip+1<s->layout.count() && std::max(s->layout.mip_width(mip+1),s->layout.mip_height(mip+1))>=size)
+        ++mip;
+    request_mip(id,mip);
+}
+
+void texture::request_stream_distance(float distance) const
+{
+    if(!internal().get_shared_data().isValid())
+        return;
+
+    int mip=0;
+    for(float d=get_streaming().distance;d>0.0f && distance>=d*2.0f && mip<16;d*=2.0f)
+        ++mip;
+    request_mip(internal().get_shared_data()->stream_id,mip);
+}
+
+}
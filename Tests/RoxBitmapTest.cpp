@@ -0,0 +1,206 @@
+// nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+// compares every simd level of the bitmap kernels with the scalar code and measures their throughput
+// sizes cover the vector tails of every kernel, buffers are offset to test unaligned rows
+
+#include "RoxRender/RoxBitmap.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+using namespace RoxRender;
+
+namespace
+{
+    typedef std::vector<uint8_t> buffer;
+    typedef std::function<void(uint8_t *in, uint8_t *out)> kernel;
+
+    unsigned int random_state = 12345;
+    uint8_t random_byte()
+    {
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 17;
+        random_state ^= random_state << 5;
+        return uint8_t(random_state);
+    }
+
+    int checks = 0, mismatches = 0;
+
+    //out_size is 0 for the in place kernels, the input buffer is compared then
+    void check(BitmapSimd simd, const char *name, int w, int h, size_t in_size, size_t out_size, const kernel &k, bool full_alpha = false)
+    {
+        for (int offset = 0; offset < 4; ++offset)
+        {
+            buffer in(in_size + offset + 64), out(out_size + offset + 64, 0xcd);
+            for (size_t i = 0; i < in.size(); ++i)
+                in[i] = random_byte();
+            if (full_alpha)
+            {
+                for (size_t i = offset + 3; i < in.size(); i += 4)
+                    in[i] = 0xff;
+            }
+
+            buffer simd_in = in, simd_out = out;
+            bitmapSetSimd(BITMAP_SIMD_NONE);
+            k(&in[offset], &out[offset]);
+            bitmapSetSimd(simd);
+            k(&simd_in[offset], &simd_out[offset]);
+
+            ++checks;
+            if (in == simd_in && out == simd_out)
+                continue;
+
+            if (mismatches < 20)
+                printf("FAIL %s simd %d size %dx%d offset %d\n", name, int(simd), w, h, offset);
+            ++mismatches;
+        }
+    }
+
+    void check_size(BitmapSimd simd, int w, int h)
+    {
+        for (int c = 1; c <= 4; ++c)
+        {
+            const size_t n = size_t(w) * h * c;
+            check(simd, "downsample2x", w, h, n, n, [&](uint8_t *i, uint8_t *o) { bitmapDownsample2x(i, w, h, c, o); });
+            check(simd, "downsample2x in place", w, h, n, 0, [&](uint8_t *i, uint8_t *)
+            {
+                bitmapDownsample2x(i, w, h, c);
+                const size_t used = size_t(w > 1 ? w / 2 : w) * (h > 1 ? h / 2 : h) * c;
+                memset(i + used, 0, n - used);
+            });
+            check(simd, "flip horisontal", w, h, n, n, [&](uint8_t *i, uint8_t *o) { bitmapFlipHorisontal(i, w, h, c, o); });
+            check(simd, "flip horisontal in place", w, h, n, 0, [&](uint8_t *i, uint8_t *) { bitmapFlipHorisontal(i, w, h, c); });
+            check(simd, "rotate 90 left", w, h, n, n, [&](uint8_t *i, uint8_t *o) { bitmapRotate_90_left(i, w, h, c, o); });
+            check(simd, "rotate 90 left in place", w, h, n, 0, [&](uint8_t *i, uint8_t *) { bitmapRotate_90_left(i, w, h, c); });
+            check(simd, "rotate 90 right", w, h, n, n, [&](uint8_t *i, uint8_t *o) { bitmapRotate_90_right(i, w, h, c, o); });
+            check(simd, "rotate 90 right in place", w, h, n, 0, [&](uint8_t *i, uint8_t *) { bitmapRotate_90_right(i, w, h, c); });
+            check(simd, "rotate 180", w, h, n, n, [&](uint8_t *i, uint8_t *o) { bitmapRotate_180(i, w, h, c, o); });
+            check(simd, "rotate 180 in place", w, h, n, 0, [&](uint8_t *i, uint8_t *) { bitmapRotate_180(i, w, h, c); });
+            if (w > 1 && h > 1)
+            {
+                const int nw = (w * 7) % 23 + 1, nh = (h * 5) % 17 + 1;
+                check(simd, "resize", w, h, n + c * (w + 2), size_t(nw) * nh * c, [&](uint8_t *i, uint8_t *o) { bitmapResize(i, w, h, nw, nh, c, o); });
+            }
+            check(simd, "rgb to bgr", w, h, n, n, [&](uint8_t *i, uint8_t *o) { bitmapRgbToBgr(i, w, h, c, o); });
+            check(simd, "rgb to bgr in place", w, h, n, 0, [&](uint8_t *i, uint8_t *) { bitmapRgbToBgr(i, w, h, c); });
+
+            const size_t yuv_size = size_t(w) * h + 2 * (size_t(w) * h / 4) + w + h;
+            check(simd, "rgb to yuv420", w, h, n, yuv_size, [&](uint8_t *i, uint8_t *o) { bitmapRgbToYuv420(i, w, h, c, o); });
+            check(simd, "bgr to yuv420", w, h, n, yuv_size, [&](uint8_t *i, uint8_t *o) { bitmapBgrToYuv420(i, w, h, c, o); });
+        }
+
+        const size_t n = size_t(w) * h;
+        check(simd, "rgba to rgb", w, h, n * 4, n * 3, [&](uint8_t *i, uint8_t *o) { bitmapRgbaToRgb(i, w, h, o); });
+        check(simd, "rgba to rgb in place", w, h, n * 4, 0, [&](uint8_t *i, uint8_t *) { bitmapRgbaToRgb(i, w, h); });
+        check(simd, "rgra to rgb", w, h, n * 4, n * 3, [&](uint8_t *i, uint8_t *o) { bitmapRgraToRgb(i, w, h, o); });
+        check(simd, "rgra to rgb in place", w, h, n * 4, 0, [&](uint8_t *i, uint8_t *) { bitmapRgraToRgb(i, w, h); });
+        check(simd, "rgb to rgba", w, h, n * 3, n * 4, [&](uint8_t *i, uint8_t *o) { bitmapRgbToRgba(i, w, h, 77, o); });
+        check(simd, "rgb to rgba in place", w, h, n * 4, 0, [&](uint8_t *i, uint8_t *) { bitmapRgbToRgba(i, w, h, 77, i); });
+        check(simd, "rgb to bgra", w, h, n * 3, n * 4, [&](uint8_t *i, uint8_t *o) { bitmapRgbToBgra(i, w, h, 77, o); });
+        check(simd, "rgb to bgra in place", w, h, n * 4, 0, [&](uint8_t *i, uint8_t *) { bitmapRgbToBgra(i, w, h, 77, i); });
+        check(simd, "argb to rgba", w, h, n * 4, n * 4, [&](uint8_t *i, uint8_t *o) { bitmapArgbToRgba(i, w, h, o); });
+        check(simd, "argb to rgba in place", w, h, n * 4, 0, [&](uint8_t *i, uint8_t *) { bitmapArgbToRgba(i, w, h); });
+        check(simd, "argb to bgra", w, h, n * 4, n * 4, [&](uint8_t *i, uint8_t *o) { bitmapArgbToBgra(i, w, h, o); });
+        check(simd, "argb to bgra in place", w, h, n * 4, 0, [&](uint8_t *i, uint8_t *) { bitmapArgbToBgra(i, w, h); });
+        check(simd, "yuv420 to rgb", w, h, n + 2 * (n / 4) + 8, n * 3, [&](uint8_t *i, uint8_t *o) { bitmapYuv420ToRgb(i, w, h, o); });
+        check(simd, "is full alpha", w, h, n * 4, 1, [&](uint8_t *i, uint8_t *o) { *o = bitmapIsFullAlpha(i, w, h); });
+        check(simd, "is full alpha opaque", w, h, n * 4, 1, [&](uint8_t *i, uint8_t *o) { *o = bitmapIsFullAlpha(i, w, h); }, true);
+        check(simd, "is full alpha last", w, h, n * 4, 1, [&](uint8_t *i, uint8_t *o)
+        {
+            i[(n - 1) * 4 + 3] = 0xfe;
+            *o = bitmapIsFullAlpha(i, w, h);
+        }, true);
+    }
+
+    //MB of input per second
+    double throughput(const std::function<void()> &f, size_t bytes, double seconds)
+    {
+        f();
+        int iterations = 0;
+        double elapsed = 0.0;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        do
+        {
+            f();
+            ++iterations;
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (elapsed < seconds);
+
+        return double(bytes) * iterations / elapsed / 1e6;
+    }
+
+    void report_throughput(int w, int h, double seconds)
+    {
+        const size_t n = size_t(w) * h;
+        buffer in(n * 4 + w * 8), out(n * 4 + w * 8);
+        for (size_t k = 0; k < in.size(); ++k)
+            in[k] = uint8_t(k * 7 + k / 13);
+        for (size_t k = 3; k < in.size(); k += 4)
+            in[k] = 0xff;
+
+        uint8_t *i = in.data(), *o = out.data();
+        struct bench_kernel { const char *name; size_t bytes; std::function<void()> f; };
+        const bench_kernel kernels[] =
+        {
+            { "downsample2x rgba", n * 4, [&] { bitmapDownsample2x(i, w, h, 4, o); } },
+            { "flip horisontal rgba", n * 4, [&] { bitmapFlipHorisontal(i, w, h, 4, o); } },
+            { "rotate 90 left rgba", n * 4, [&] { bitmapRotate_90_left(i, w, h, 4, o); } },
+            { "rotate 180 rgba", n * 4, [&] { bitmapRotate_180(i, w, h, 4, o); } },
+            { "resize rgba 0.75x", n * 4, [&] { bitmapResize(i, w, h, w * 3 / 4, h * 3 / 4, 4, o); } },
+            { "rgb to bgr (4ch)", n * 4, [&] { bitmapRgbToBgr(i, w, h, 4, o); } },
+            { "rgb to bgr (3ch)", n * 3, [&] { bitmapRgbToBgr(i, w, h, 3, o); } },
+            { "rgba to rgb", n * 4, [&] { bitmapRgbaToRgb(i, w, h, o); } },
+            { "rgb to rgba", n * 3, [&] { bitmapRgbToRgba(i, w, h, 255, o); } },
+            { "argb to rgba", n * 4, [&] { bitmapArgbToRgba(i, w, h, o); } },
+            { "argb to bgra", n * 4, [&] { bitmapArgbToBgra(i, w, h, o); } },
+            { "rgba to yuv420", n * 4, [&] { bitmapRgbToYuv420(i, w, h, 4, o); } },
+            { "yuv420 to rgb", n * 3 / 2, [&] { bitmapYuv420ToRgb(i, w, h, o); } },
+            { "is full alpha", n * 4, [&] { bitmapIsFullAlpha(i, w, h); } },
+        };
+
+        //levels above the supported one are clamped, they are reported as the supported one
+        printf("%dx%d, MB/s of input\n%-22s %8s %8s %8s %8s\n", w, h, "kernel", "scalar", "sse2", "ssse3", "avx2");
+        for (const bench_kernel &k : kernels)
+        {
+            printf("%-22s", k.name);
+            for (int simd = BITMAP_SIMD_NONE; simd <= BITMAP_SIMD_AVX2; ++simd)
+            {
+                bitmapSetSimd(BitmapSimd(simd));
+                printf(" %8.0f", throughput(k.f, k.bytes, seconds));
+            }
+            printf("\n");
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+    const BitmapSimd supported = bitmapGetSimd();
+    printf("supported simd level %d\n", int(supported));
+
+    //the kernels are checked and measured on a single thread
+    bitmapSetParallel(false);
+
+    const int max_width = bench ? 37 : 19, max_height = bench ? 19 : 7;
+    for (int simd = BITMAP_SIMD_SSE2; simd <= supported; ++simd)
+    {
+        for (int w = 1; w <= max_width; ++w)
+        {
+            for (int h = 1; h <= max_height; ++h)
+                check_size(BitmapSimd(simd), w, h);
+        }
+    }
+
+    printf("%d checks, %d mismatches\n", checks, mismatches);
+
+    if (bench)
+        report_throughput(1920, 1080, 0.3);
+    else
+        report_throughput(256, 256, 0.01);
+
+    bitmapSetSimd(supported);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+// nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+// compresses generated fixture images with every block format and quality, decodes them back with
+// DirectDrawSurface and checks the PSNR against thresholds, encode throughput is reported
+// the fixture sides are not multiples of 4, so the partially covered edge blocks are tested too
+
+#include "RoxRender/RoxBlockCompression.h"
+#include "RoxFormats/RoxDirectDrawSurface.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace RoxRender;
+
+namespace
+{
+    struct image
+    {
+        const char *name;
+        unsigned int width, height;
+        std::vector<uint8_t> rgba;
+    };
+
+    uint8_t to_byte(float f) { return uint8_t(std::min(255.0f, std::max(0.0f, f))); }
+
+    //smooth gradients with noise and an alpha pattern, like a photo with a cutout mask
+    image make_photo(unsigned int width, unsigned int height)
+    {
+        image img = { "photo", width, height, std::vector<uint8_t>(size_t(width) * height * 4) };
+        std::mt19937 random(3);
+        for (unsigned int y = 0; y < height; ++y)
+        {
+            for (unsigned int x = 0; x < width; ++x)
+            {
+                uint8_t *p = &img.rgba[(size_t(y) * width + x) * 4];
+                const float fx = x / 1024.0f, fy = y / 1024.0f;
+                p[0] = to_byte(128.0f + 100.0f * sinf(fx * 9.0f + fy * 3.0f) + float(random() % 16));
+                p[1] = to_byte(128.0f + 90.0f * cosf(fy * 7.0f - fx * 2.0f) + float(random() % 16));
+                p[2] = to_byte(100.0f + 80.0f * sinf((fx + fy) * 5.0f) + float(random() % 16));
+                p[3] = to_byte(255.0f * ((x / 37 + y / 53) % 3 == 0 ? 0.2f : 1.0f) * (0.5f + 0.5f * fx));
+            }
+        }
+
+        return img;
+    }
+
+    image make_normal_map(unsigned int width, unsigned int height)
+    {
+        image img = { "normal map", width, height, std::vector<uint8_t>(size_t(width) * height * 4) };
+        for (unsigned int y = 0; y < height; ++y)
+        {
+            for (unsigned int x = 0; x < width; ++x)
+            {
+                uint8_t *p = &img.rgba[(size_t(y) * width + x) * 4];
+                const float nx = 0.6f * sinf(x * 0.05f) * cosf(y * 0.031f), ny = 0.6f * cosf(x * 0.021f + y * 0.04f);
+                p[0] = to_byte((nx * 0.5f + 0.5f) * 255.0f);
+                p[1] = to_byte((ny * 0.5f + 0.5f) * 255.0f);
+                p[2] = to_byte((sqrtf(std::max(0.0f, 1.0f - nx * nx - ny * ny)) * 0.5f + 0.5f) * 255.0f);
+                p[3] = 255;
+            }
+        }
+
+        return img;
+    }
+
+    //channels [from, from+count), only pixels the format keeps opaque if opaque_only
+    double psnr(const image &src, const std::vector<uint8_t> &decoded, int from, int count, bool opaque_only)
+    {
+        double error = 0.0;
+        size_t samples = 0;
+        for (size_t i = 0; i < size_t(src.width) * src.height; ++i)
+        {
+            if (opaque_only && src.rgba[i * 4 + 3] < 128)
+                continue;
+
+            for (int c = from; c < from + count; ++c)
+            {
+                const double d = double(src.rgba[i * 4 + c]) - decoded[i * 4 + c];
+                error += d * d;
+                ++samples;
+            }
+        }
+
+        if (!samples || error == 0.0)
+            return 99.0;
+
+        return 10.0 * log10(255.0 * 255.0 / (error / samples));
+    }
+
+    struct format_case
+    {
+        BlockFormat format;
+        RoxFormats::DirectDrawSurface::PIXEL_FORMAT dds_format;
+        const char *name;
+        int from, count; //checked channels
+        bool normal_map;
+        float min_psnr[3]; //per quality
+    };
+
+    //thresholds are about 1 dB under the measured values, bc3 is checked on its alpha since its color blocks come from the bc1 encoder
+    const format_case formats[] =
+    {
+        { BLOCK_BC1, RoxFormats::DirectDrawSurface::DXT1, "bc1", 0, 3, false, { 35.0f, 35.5f, 35.5f } },
+        { BLOCK_BC3, RoxFormats::DirectDrawSurface::DXT5, "bc3 alpha", 3, 1, false, { 68.0f, 68.0f, 68.0f } },
+        { BLOCK_BC4, RoxFormats::DirectDrawSurface::BC4, "bc4", 0, 1, false, { 50.5f, 50.5f, 51.5f } },
+        { BLOCK_BC5, RoxFormats::DirectDrawSurface::BC5, "bc5", 0, 2, true, { 55.0f, 55.0f, 56.0f } },
+    };
+
+    const char *quality_names[] = { "fast", "normal", "high" };
+}
+
+int main(int argc, char **argv)
+{
+    const bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+    const unsigned int width = bench ? 1022 : 254, height = bench ? 1023 : 131;
+    const image photo = make_photo(width, height), normal_map = make_normal_map(width, height);
+
+    int failed = 0;
+    for (const format_case &f : formats)
+    {
+        const image &img = f.normal_map ? normal_map : photo;
+        std::vector<uint8_t> blocks(blockCompressedSize(img.width, img.height, f.format));
+
+        //the decoder works on whole blocks, the padding is cropped before comparing
+        RoxFormats::DirectDrawSurface dds;
+        dds.width = (img.width + 3) / 4 * 4;
+        dds.height = (img.height + 3) / 4 * 4;
+        dds.mipmap_count = 1;
+        dds.type = RoxFormats::DirectDrawSurface::TEXTURE_2D;
+        dds.pixel_format = f.dds_format;
+        dds.data = blocks.data();
+        dds.data_size = blocks.size();
+        std::vector<uint8_t> decoded(dds.getDecodedSize()), cropped(img.rgba.size());
+
+        for (int q = BLOCK_QUALITY_FAST; q <= BLOCK_QUALITY_HIGH; ++q)
+        {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (!blockCompress(img.rgba.data(), img.width, img.height, f.format, BlockQuality(q), blocks.data()))
+            {
+                printf("FAIL %s %s: unable to compress\n", f.name, quality_names[q]);
+                ++failed;
+                continue;
+            }
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            dds.decodeDxt(decoded.data());
+            for (unsigned int y = 0; y < img.height; ++y)
+                memcpy(&cropped[size_t(y) * img.width * 4], &decoded[size_t(y) * dds.width * 4], img.width * 4);
+
+            const double value = psnr(img, cropped, f.from, f.count, f.format == BLOCK_BC1);
+            const bool passed = value >= f.min_psnr[q];
+            printf("%s %-10s %-10s %-6s %8.1f Mpix/s  PSNR %6.2f dB (min %.1f)\n", passed ? "    " : "FAIL",
+                   img.name, f.name, quality_names[q], img.width * img.height / seconds / 1e6, value, f.min_psnr[q]);
+            if (!passed)
+                ++failed;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,134 @@
+// nya-engine (C) nyan.developer@gmail.com released under the MIT license (see LICENSE)
+
+// checks the expression evaluator against native code and measures it on particle style expressions
+// only parse, getVarIdx, getVars, calculate and calculateN are used, so the file also builds against the stack
+// interpreter the bytecode compiler replaced, which gives the numbers to compare with
+
+#include "RoxFormats/RoxMathExprParser.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    struct bench_case
+    {
+        const char *expr;
+        const char *vars[8];
+        float (*reference)(const float *v); //v follows the vars order, vector results are compared by their last component
+    };
+
+    const bench_case cases[] =
+    {
+        { "pos+vel*dt", { "pos", "vel", "dt" },
+            [](const float *v) { return v[0] + v[1] * v[2]; } },
+        { "vec3(px,py,pz)+vec3(vx,vy,vz)*dt+vec3(0,-9.8,0)*dt*dt*0.5", { "px", "py", "pz", "vx", "vy", "vz", "dt" },
+            [](const float *v) { return v[2] + v[5] * v[6]; } },
+        { "clamp(1-age/life,0,1)*lerp(size0,size1,age/life)", { "age", "life", "size0", "size1" },
+            [](const float *v) { const float k = v[0] / v[1], c = 1.0f - k; return (c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c)) * (v[2] + (v[3] - v[2]) * k); } },
+        { "normalize(vec3(vx,vy,vz))*length(vec3(vx,vy,vz))*0.98*(1+0*dt)", { "vx", "vy", "vz", "dt" },
+            [](const float *v) { return v[2] * 0.98f; } },
+        { "sin(age*3.0+pi*0.5)*amp+(age/life)*(age/life)*2", { "age", "amp", "life" },
+            [](const float *v) { const float k = v[0] / v[2]; return sinf(v[0] * 3.0f + 3.14159265f * 0.5f) * v[1] + k * k * 2.0f; } },
+    };
+
+    bool nearly_equal(float a, float b) { return fabsf(a - b) <= 1e-4f * (1.0f + fabsf(b)); }
+
+    double elapsed_ns(std::chrono::steady_clock::time_point from)
+    {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - from).count();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+    const int count = 4096, reps = bench ? 400 : 4;
+
+    int failed = 0;
+    for (const bench_case &c : cases)
+    {
+        RoxFormats::RoxMathExprParser p;
+        if (!p.parse(c.expr))
+        {
+            printf("FAIL %s: unable to parse\n", c.expr);
+            ++failed;
+            continue;
+        }
+
+        //inputs are indexed by the parser vars, the reference gets them in the case order
+        const int vars_count = p.getVarsCount();
+        std::vector<std::vector<float> > values(vars_count, std::vector<float>(count));
+        std::vector<const float *> columns(vars_count);
+        unsigned int seed = 1;
+        for (int v = 0; v < vars_count; ++v)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                values[v][i] = 0.25f + float(seed >> 8) * (4.0f / 16777216.0f);
+            }
+            columns[v] = values[v].data();
+        }
+
+        std::vector<float> batch(count);
+        p.calculateN(vars_count ? columns.data() : nullptr, batch.data(), count);
+
+        int mismatches = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            float ref_vars[8] = {};
+            for (int k = 0; k < 8 && c.vars[k]; ++k)
+            {
+                const int idx = p.getVarIdx(c.vars[k]);
+                ref_vars[k] = idx < 0 ? 0.0f : values[idx][i];
+            }
+
+            float *vars = p.getVars();
+            for (int v = 0; v < vars_count; ++v)
+                vars[v] = values[v][i];
+
+            const float scalar = p.calculate(), expected = c.reference(ref_vars);
+            if (!nearly_equal(scalar, expected) || !nearly_equal(batch[i], expected))
+            {
+                if (!mismatches)
+                    printf("FAIL %s: element %d scalar %g batch %g expected %g\n", c.expr, i, scalar, batch[i], expected);
+                ++mismatches;
+            }
+        }
+
+        if (mismatches)
+        {
+            ++failed;
+            continue;
+        }
+
+        volatile float sink = 0.0f;
+        std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+        for (int r = 0; r < reps; ++r)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                float *vars = p.getVars();
+                for (int v = 0; v < vars_count; ++v)
+                    vars[v] = values[v][i];
+                sink = sink + p.calculate();
+            }
+        }
+        const double scalar_ns = elapsed_ns(t) / (double(count) * reps);
+
+        t = std::chrono::steady_clock::now();
+        for (int r = 0; r < reps; ++r)
+        {
+            p.calculateN(vars_count ? columns.data() : nullptr, batch.data(), count);
+            sink = sink + batch[r % count];
+        }
+        const double batch_ns = elapsed_ns(t) / (double(count) * reps);
+
+        printf("%-64s scalar %7.2f ns/elem  batch %6.2f ns/elem\n", c.expr, scalar_ns, batch_ns);
+    }
+
+    return failed ? 1 : 0;
+}